@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/time.h>
+#include "bb/Intersection.hpp"
+
+namespace {
+
+const bb::Intersection::Kernel KERNELS[] = {
+  bb::Intersection::SCALAR, bb::Intersection::GALLOP, bb::Intersection::SSE42, bb::Intersection::AVX2
+};
+const char* KERNEL_NAMES[] = { "scalar", "gallop", "sse4.2", "avx2" };
+
+double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+std::vector<uint32_t> makeDocIds(uint32_t length, uint32_t universe)
+{
+  std::vector<uint32_t> docIds;
+  uint32_t docId = 0;
+  uint32_t maxGap = std::max(1U, universe / length * 2);
+  for (uint32_t i = 0; i < length; ++i) {
+    docId += 1 + rand() % maxGap;
+    docIds.push_back(docId);
+  }
+  return docIds;
+}
+
+std::vector<uint32_t> makePostings(uint32_t count, uint32_t docCount)
+{
+  std::vector<uint32_t> postings;
+  uint32_t perDoc = std::max(1U, count / docCount);
+  for (uint32_t docId = 0; postings.size() < count * 2; ++docId) {
+    uint32_t offset = 0;
+    for (uint32_t p = 0; p < perDoc && postings.size() < count * 2; ++p) {
+      offset += 1 + rand() % 4;
+      postings.push_back(docId);
+      postings.push_back(offset);
+    }
+  }
+  return postings;
+}
+
+void benchIntersect(uint32_t aLength, uint32_t bLength, uint32_t rounds)
+{
+  std::vector<uint32_t> a = makeDocIds(aLength, 1 << 24);
+  std::vector<uint32_t> b = makeDocIds(bLength, 1 << 24);
+  std::vector<uint32_t> out(aLength);
+
+  printf("docIds %8u x %8u:", aLength, bLength);
+  for (uint32_t k = 0; k < 4; ++k) {
+    if (!bb::Intersection::isSupported(KERNELS[k])) {
+      printf("  %s      n/a", KERNEL_NAMES[k]);
+      continue;
+    }
+    double start = now();
+    uint32_t count = 0;
+    for (uint32_t r = 0; r < rounds; ++r) {
+      count += bb::Intersection::intersect(KERNELS[k], &a[0], aLength, &b[0], bLength, &out[0]);
+    }
+    printf("  %s %8.3fms", KERNEL_NAMES[k], (now() - start) * 1000 / rounds);
+  }
+  printf("\n");
+}
+
+void benchIntersectPositions(uint32_t aCount, uint32_t bCount, uint32_t rounds)
+{
+  std::vector<uint32_t> a = makePostings(aCount, 1000);
+  std::vector<uint32_t> b = makePostings(bCount, 1000);
+  std::vector<uint32_t> out(aCount * 2);
+
+  printf("postings %6u x %8u:", aCount, bCount);
+  for (uint32_t k = 0; k < 4; ++k) {
+    if (!bb::Intersection::isSupported(KERNELS[k])) {
+      printf("  %s      n/a", KERNEL_NAMES[k]);
+      continue;
+    }
+    double start = now();
+    uint32_t count = 0;
+    for (uint32_t r = 0; r < rounds; ++r) {
+      count += bb::Intersection::intersectPositions(KERNELS[k], &a[0], aCount, &b[0], bCount, 2, &out[0]);
+    }
+    printf("  %s %8.3fms", KERNEL_NAMES[k], (now() - start) * 1000 / rounds);
+  }
+  printf("\n");
+}
+
+}
+
+int main()
+{
+  srand(1);
+  benchIntersect(1 << 20, 1 << 20, 20);
+  benchIntersect(1 << 20, 1 << 16, 20);
+  benchIntersect(1 << 20, 1 << 12, 20);
+  benchIntersect(1 << 20, 1 << 8, 20);
+  benchIntersectPositions(1 << 20, 1 << 20, 20);
+  benchIntersectPositions(1 << 20, 1 << 14, 20);
+  benchIntersectPositions(1 << 20, 1 << 8, 20);
+  return 0;
+}
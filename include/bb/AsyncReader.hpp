@@ -0,0 +1,94 @@
+/**
+ * AsyncReader.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_ASYNC_READER_HPP_
+#define BB_ASYNC_READER_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <cstddef>
+#include <vector>
+
+namespace bb {
+
+/**
+ * Reads a batch of file ranges at once. On Linux the batch goes through an
+ * io_uring, so all of its reads are in flight together and the batch costs
+ * about one round trip to the disk; where no ring can be set up, the reads
+ * are done one after another with pread.
+ *
+ * A reader may be shared between threads, whose batches then take turns.
+ */
+class AsyncReader
+{
+public:
+  struct Request
+  {
+    int fd;
+    uint64_t offset;
+    void* buffer;
+    uint32_t length;
+    int64_t result;
+  };
+
+protected:
+  static const uint32_t DEFAULT_DEPTH;
+
+  int ringFd;
+  uint32_t depth;
+  void* sqRing;
+  size_t sqRingSize;
+  void* cqRing;
+  size_t cqRingSize;
+  void* sqes;
+  size_t sqesSize;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  void* cqes;
+  pthread_mutex_t mutex;
+
+  void setup(uint32_t depth);
+  void teardown();
+  bool readRing(std::vector<Request>& requests, size_t begin, uint32_t count);
+  static void readSync(Request& request);
+
+public:
+  AsyncReader();
+  explicit AsyncReader(uint32_t depth);
+  virtual ~AsyncReader();
+
+  bool isAsync() const;
+  void readAll(std::vector<Request>& requests);
+};
+
+}
+
+#endif // BB_ASYNC_READER_HPP_
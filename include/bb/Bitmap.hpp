@@ -0,0 +1,95 @@
+/**
+ * Bitmap.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_BITMAP_HPP_
+#define BB_BITMAP_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include "bb/DBM.hpp"
+
+namespace bb {
+
+/**
+ * A compressed set of docIds split into containers by the upper 16 bits,
+ * after Roaring bitmaps. A container keeps its lower 16 bits as a sorted
+ * array while it holds at most ARRAY_LIMIT of them, and as a 65536-bit
+ * bitmap beyond that, so dense ranges are intersected a word at a time.
+ *
+ * Stored in the index as (cardinality, container count, start of the last
+ * container) followed by each container as (key, cardinality, payload),
+ * the payload being the array packed two values per word, or the bitmap.
+ * Since docIds mostly arrive in ascending order, append() adds a docId to
+ * the last container in place whenever it can.
+ */
+class Bitmap
+{
+protected:
+  struct Container
+  {
+    uint32_t key;
+    uint32_t cardinality;
+    std::vector<uint16_t> values;
+    std::vector<uint64_t> bits;
+
+    bool isBitmap() const { return !this->bits.empty(); }
+  };
+
+  std::vector<Container> containers;
+  uint32_t cardinality;
+
+  std::vector<Container>::iterator findContainer(uint32_t key);
+  std::vector<Container>::const_iterator findContainer(uint32_t key) const;
+  static void toBitmap(Container& container);
+  static void toArray(Container& container);
+  static void intersectContainer(Container& container, const Container& other);
+
+public:
+  static const uint32_t ARRAY_LIMIT;
+  static const uint32_t BITMAP_LENGTH;
+  static const uint32_t HEADER_LENGTH;
+
+  Bitmap();
+  Bitmap(const uint32_t* value, uint32_t valueLength);
+
+  void add(uint32_t docId);
+  void remove(uint32_t docId);
+  bool contains(uint32_t docId) const;
+  bool findNext(uint32_t docId, uint32_t* next) const;
+  uint32_t size() const;
+  void intersect(const Bitmap& other);
+  void toVector(std::vector<uint32_t>& docIds) const;
+  void encode(std::vector<uint32_t>& value) const;
+
+  static bool get(DBM<uint32_t>* index, const char* key, Bitmap& bitmap);
+  static void set(DBM<uint32_t>* index, const char* key, const Bitmap& bitmap);
+  static bool append(DBM<uint32_t>* index, const char* key, uint32_t docId);
+};
+
+}
+
+#endif // BB_BITMAP_HPP_
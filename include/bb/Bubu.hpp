@@ -29,22 +29,121 @@
 #define BB_BUBU_HPP_
 
 #include <stdint.h>
+#include <pthread.h>
+#include <istream>
+#include <map>
 #include <string>
 #include <vector>
+#include "bb/AsyncReader.hpp"
 #include "bb/DBM.hpp"
+#include "bb/DocStore.hpp"
+#include "bb/EpochManager.hpp"
+#include "bb/Generation.hpp"
+#include "bb/GramDictionary.hpp"
+#include "bb/Query.hpp"
+#include "bb/SearchCursor.hpp"
+#include "bb/ThreadPool.hpp"
 
 namespace bb {
 
+/**
+ * What the BM25 scores of a query are computed from: the number and total
+ * length of the documents, and how many documents hold each gram of the
+ * query. Workspaces holding parts of one collection add theirs up so that
+ * every part scores its documents as the whole collection would.
+ */
+struct RankStatistics
+{
+  uint32_t docCount;
+  uint64_t totalLength;
+  std::vector<uint32_t> docFrequencies;
+};
+
 class Bubu
 {
+  friend class QueryParser;
+  friend class IndexBuilder;
+  friend class ShardedBubu;
+
 protected:
+  static const char* STATISTICS_KEY;
+  static const uint32_t STATISTICS_LENGTH;
+  static const char* SETTINGS_KEY;
+  static const uint32_t DEFAULT_GRAM_SIZE;
+  static const uint32_t MAX_GRAM_SIZE;
+  static const char* END_MARKER;
+  static const double BM25_K1;
+  static const double BM25_B;
+  static const uint32_t PARTITION_THRESHOLD;
+  static const uint32_t PARTITIONS_PER_THREAD;
+  static const char* BITMAP_KEY_PREFIX;
+  static const uint32_t BITMAP_MIN_POSTINGS;
+  static const uint32_t BITMAP_DENSITY;
+  static const uint32_t CHECKPOINT_INTERVAL;
+  static const uint32_t MAX_CHAR_LENGTH;
+  static const uint32_t STREAM_CHUNK_SIZE;
+
   DBM<uint32_t>* index;
+  DBM<uint32_t>* positions;
   DBM<char>* library;
+  DocStore* docStore;
+  DBM<uint32_t>* catalog;
+  GramDictionary* dictionary;
+  Generation* generation;
+  ThreadPool* threadPool;
+  AsyncReader* reader;
+  EpochManager* epochs;
+  pthread_mutex_t mutex;
+  uint32_t gramSize;
+  bool indexUnigrams;
+  bool readOnly;
 
   static std::string uintToString(uint32_t uintValue);
   static void tokenizeUTF8(const char* text, bool overlap,
 		    std::vector<std::string>& unigrams, 
 		    std::vector<std::string>& bigrams);
+  static void tokenizeGrams(const std::vector<std::string>& unigrams, uint32_t gramSize,
+			    std::vector<std::string>& grams);
+  static void tokenizeQuery(const char* query, uint32_t gramSize,
+			    std::vector<std::string>& grams, std::vector<uint32_t>& offsets);
+  static double calcScore(uint32_t termFrequency, double idf, uint32_t docLength, double avgDocLength);
+  static uint32_t calcMaxFrequency(double score, double idf, double avgDocLength);
+  static std::string getBitmapKey(const std::string& gram);
+  static bool combineFilter(const std::vector<Bitmap>& bitmaps, const std::vector<bool>& dense,
+			    Bitmap& filter, std::vector<bool>& filtered);
+  static void calcCheckpoints(const char* text, std::vector<uint32_t>& checkpoints);
+
+  bool upgrade(const std::string& workspace);
+  bool convertFlat(const std::string& workspace, const std::string& suffix);
+  ThreadPool* getThreadPool();
+  AsyncReader* getReader();
+  bool loadFilter(const std::vector<std::string>& grams, uint64_t epoch,
+		  Bitmap& filter, std::vector<bool>& filtered);
+  std::vector<std::pair<uint32_t, uint32_t> > searchPartitioned(const std::vector<PostingLocation>& locations,
+								const std::vector<uint32_t>& offsets,
+								const Bitmap& filter, const std::vector<bool>& filtered,
+								uint32_t partitionCount);
+  void loadStatistics(uint32_t* statistics);
+  void loadStatistics(uint32_t* statistics, uint64_t epoch);
+  void publishEpoch();
+  void updateStatistics(int32_t docCountDelta, int64_t docLengthDelta, uint32_t nextDocId);
+  uint32_t insertPostings(const char* gram, const std::vector<uint32_t>& postings);
+  void addPostings(uint32_t docId, const std::map<std::string, std::vector<uint32_t> >& postings,
+		   bool appendable, uint32_t docCount);
+  bool replacePostings(const char* gram, uint32_t docId, const std::vector<uint32_t>& postings,
+		       uint32_t* postingCount);
+  void addToBitmap(const std::string& gram, uint32_t docId, uint32_t oldPostingCount, uint32_t postingCount,
+		   uint32_t docCount);
+  void removeFromBitmap(const std::string& gram, uint32_t docId, uint32_t postingCount);
+  void insertDoc(uint32_t docId, const char* docContent);
+  bool removeDocPostings(uint32_t docId);
+  void findCheckpoint(uint32_t docId, uint32_t offset, uint64_t epoch, uint32_t* byteOffset, uint32_t* charOffset);
+  uint32_t tokenizeDoc(const char* docContent, std::vector<std::string>& grams, std::vector<uint32_t>& offsets);
+  void tokenizePart(const std::vector<std::string>& unigrams, uint32_t tokenized, uint32_t charOffset, bool last,
+		    std::vector<std::string>& grams, std::vector<uint32_t>& offsets);
+  bool expandPrefix(const char* query, std::vector<uint32_t>& postings);
+  bool expandPrefix(const char* query, std::vector<uint32_t>& postings, uint64_t epoch);
+  uint32_t loadDocLength(uint32_t docId, uint32_t defaultLength, uint64_t epoch);
 
 
 public:
@@ -52,12 +151,48 @@ public:
   virtual ~Bubu();
 
   bool open(const char* workspaceDir);
+  bool open(const char* workspaceDir, bool readOnly);
   bool create(const char* workspaceDir);
+  bool create(const char* workspaceDir, uint32_t gramSize);
+  bool create(const char* workspaceDir, uint32_t gramSize, bool indexUnigrams);
   void close();
+  bool flush();
+  uint32_t getGramSize() const;
+  bool isReadOnly() const;
+  bool isStale();
+  uint64_t pinEpoch();
+  void unpinEpoch(uint64_t epoch);
   std::vector<std::pair<uint32_t, uint32_t> > search(const char* query);
+  std::vector<std::pair<uint32_t, uint32_t> > search(const char* query, uint64_t epoch);
+  bool search(const char* query, uint64_t epoch, std::vector<std::pair<uint32_t, uint32_t> >& hits);
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > searchBatch(const std::vector<std::string>& queries);
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > searchBatch(const std::vector<std::string>& queries,
+									uint64_t epoch);
+  bool searchBatch(const std::vector<std::string>& queries, uint64_t epoch,
+		   std::vector<std::vector<std::pair<uint32_t, uint32_t> > >& hits);
+  std::vector<std::pair<uint32_t, double> > searchTopK(const char* query, uint32_t k);
+  std::vector<std::pair<uint32_t, double> > searchTopK(const char* query, uint32_t k, uint64_t epoch);
+  std::vector<std::pair<uint32_t, double> > searchTopK(const char* query, uint32_t k, uint64_t epoch,
+						       const RankStatistics& statistics);
+  bool searchTopK(const char* query, uint32_t k, uint64_t epoch, const RankStatistics& statistics,
+		  std::vector<std::pair<uint32_t, double> >& results);
+  bool getRankStatistics(const char* query, uint64_t epoch, RankStatistics& statistics);
+  SearchCursor* openCursor(const char* query);
+  Query* openQuery(const char* expression);
+  std::vector<uint32_t> searchQuery(const char* expression);
+  bool searchQuery(const char* expression, std::vector<uint32_t>& docIds);
+  std::vector<std::string> searchPrefix(const char* prefix, uint32_t limit);
+  bool searchPrefix(const char* prefix, uint32_t limit, std::vector<std::string>& grams);
   void registerDoc(uint32_t docId, const char* docContent);
+  void registerDoc(uint32_t docId, std::istream& input);
+  void updateDoc(uint32_t docId, const char* docContent);
   void unregisterDoc(uint32_t docId);
   std::string getDocContent(uint32_t docId);
+  bool getDocContent(uint32_t docId, std::string& docContent);
+  std::string getSnippet(uint32_t docId, uint32_t offset, uint32_t window);
+  bool getSnippet(uint32_t docId, uint32_t offset, uint32_t window, std::string& snippet);
+  bool getByteOffset(uint32_t docId, uint32_t offset, uint32_t* byteOffset);
+  void trainDictionary(const std::vector<std::string>& samples);
   
 };
 
@@ -29,70 +29,287 @@
 #define BB_DBM_HPP_
 
 #include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
 #include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bb/AsyncReader.hpp"
+#include "bb/EpochManager.hpp"
 
 namespace bb {
 
+/**
+ * A hash file of keys to arrays of V.
+ *
+ * The file starts with MAGIC and VERSION, the bucket and free pool lengths,
+ * the bucket and the free pool. Records are chained per bucket and laid
+ * out as (next offset, key length, key, value capacity, value length,
+ * value). Offsets, capacities and lengths are 64-bit on disk, so a file
+ * may grow past 4GB; files of the older 32-bit layout, which has no
+ * header, have to be rewritten by upgrade() before they can be opened,
+ * either in place or into a new file that is left for the caller to move.
+ *
+ * An opened file has its header and bucket mapped in place rather than
+ * read in, so opening takes the same time whatever the bucket length and
+ * only the pages of the bucket actually used are brought in. The free
+ * pool is read the first time an area is taken or given back.
+ *
+ * Bucket changes dirty only the mapped pages they fall in, and the free
+ * pool is written back only when it has changed, so close() and sync()
+ * cost as much as was changed rather than the whole bucket. sync() makes
+ * everything written so far durable without closing the file.
+ *
+ * A file opened read-only is mapped without write access, ignores every
+ * change and writes nothing back on close, so any number of processes can
+ * share one copy in the page cache next to a single writer. Its reads are
+ * unbuffered, so they see what the writer has flushed, and a new record is
+ * flushed before the bucket points at it.
+ *
+ * Given an EpochManager, the file keeps the versions which readers pinned
+ * to an earlier epoch still see. Before a key is first changed in the
+ * write epoch, its value's place and length are noted; values are never
+ * overwritten but copied to a new record, appends go past the length an
+ * old reader knows, and areas given up are only reused once reclaim()
+ * finds no reader left that might read them. The lookups taking an epoch
+ * answer from those notes wherever the key has changed since. write()
+ * still changes a value in place, so its callers keep old readers right.
+ *
+ * Only the writer's thread may use the stream. Every change is flushed
+ * before it returns, and the lookups taking an epoch, read(), locateAll()
+ * and getAll() read with pread alone, so other threads may call those
+ * next to the writer without moving its file position.
+ */
 template<typename V>
 class DBM 
 {
 protected:
-  static const uint32_t NULL_OFFSET;
-  static const uint32_t INITIAL_CAPACITY;
+  static const uint32_t MAGIC;
+  static const uint32_t VERSION;
+  static const uint64_t NULL_OFFSET;
+  static const uint64_t INITIAL_CAPACITY;
+
+  struct Version
+  {
+    uint64_t epoch;
+    uint64_t valueOffset;
+    uint32_t valueLength;
+  };
 
-  static uint32_t calcValueCapacity(uint32_t valueLength);
-  static uint32_t calcRecordSize(const char* key, uint32_t valueCapacity);
+  static uint64_t calcValueCapacity(uint64_t valueLength);
+  static uint64_t calcRecordSize(const char* key, uint64_t valueCapacity);
 
   FILE* fp;
-  uint32_t* bucket;
+  char* mapping;
+  size_t mappingSize;
+  uint64_t* bucket;
   uint32_t bucketLength;
-  std::vector<std::pair<uint32_t, uint32_t> >* freePool;
+  std::vector<std::pair<uint64_t, uint64_t> >* freePool;
   uint32_t freePoolLength;
-
-  void loadMetaData();
+  bool freePoolLoaded;
+  bool freePoolDirty;
+  bool readOnly;
+  EpochManager* epochs;
+  std::map<std::string, std::vector<Version> >* versions;
+  std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t> > >* retired;
+  pthread_mutex_t versionMutex;
+
+  bool loadMetaData();
   void saveMetaData();
+  void loadFreePool();
+  void releaseBucket();
   uint32_t calcBucketIndex(const char* key);
-  void findRecordOffset(const char* key, uint32_t* prevOffset, uint32_t* offset, uint32_t* nextOffset);
-  void allocNewRecord(uint32_t prevOffset, uint32_t nextOffset, const char* key, const V* value, uint32_t valueLength);
-  uint32_t getFreeArea(uint32_t requisiteSize);
-  void putFreeArea(uint32_t offset, uint32_t size);
+  void findRecordOffset(const char* key, uint64_t* prevOffset, uint64_t* offset, uint64_t* nextOffset);
+  bool findValue(const char* key, uint64_t epoch, uint64_t* valueOffset, uint32_t* valueLength);
+  void allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength);
+  void allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength,
+		      uint64_t valueCapacity);
+  void allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength,
+		      uint64_t valueCapacity, uint64_t copyOffset, uint64_t copyLength);
+  uint64_t getFreeArea(uint64_t requisiteSize);
+  void putFreeArea(uint64_t offset, uint64_t size);
+  void saveVersion(const char* key, uint64_t offset, uint64_t valueLength);
+  void releaseArea(uint64_t offset, uint64_t size);
+  void reclaimBefore(uint64_t epoch);
+  void resolveVersions(const std::vector<std::string>& keys, uint64_t epoch,
+		       std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths);
 
 public:
   DBM();
   virtual ~DBM();
+  static bool isLegacy(const char* path);
+  static bool upgrade(const char* path);
+  static bool upgrade(const char* path, const char* upgradedPath);
   bool open(const char* path);
+  bool open(const char* path, bool readOnly);
   bool create(const char* path, uint32_t bucketLength, uint32_t freePoolLength);
   void close();
+  bool sync();
+  bool isReadOnly() const;
+  void setEpochs(EpochManager* epochs);
+  void reclaim();
   V* get(const char* key, uint32_t* valueLength);
+  V* get(const char* key, uint32_t* valueLength, uint64_t epoch);
   void set(const char* key, const V* value, uint32_t valueLength);
+  void insert(const char* key, const V* value, uint32_t valueLength);
   void remove(const char* key);
   void append(const char* key, const V* value, uint32_t valueLength);
   bool contains(const char* key);
+  bool contains(const char* key, uint64_t epoch);
+  void getKeys(std::vector<std::string>& keys);
+  bool locate(const char* key, uint64_t* valueOffset, uint32_t* valueLength);
+  bool locate(const char* key, uint64_t* valueOffset, uint32_t* valueLength, uint64_t epoch);
+  uint32_t read(uint64_t valueOffset, uint32_t index, V* buffer, uint32_t count);
+  void write(uint64_t valueOffset, uint32_t index, const V* buffer, uint32_t count);
+  void locateAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		 std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths);
+  void locateAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		 std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths, uint64_t epoch);
+  void getAll(AsyncReader* reader, const std::vector<std::string>& keys,
+	      std::vector<V*>& values, std::vector<uint32_t>& valueLengths);
+  void getAll(AsyncReader* reader, const std::vector<std::string>& keys,
+	      std::vector<V*>& values, std::vector<uint32_t>& valueLengths, uint64_t epoch);
 };
 
-template <typename V> const uint32_t DBM<V>::NULL_OFFSET = 0;
-template <typename V> const uint32_t DBM<V>::INITIAL_CAPACITY = 1024;
+template <typename V> const uint32_t DBM<V>::MAGIC = 0x4d444242;
+template <typename V> const uint32_t DBM<V>::VERSION = 2;
+template <typename V> const uint64_t DBM<V>::NULL_OFFSET = 0;
+template <typename V> const uint64_t DBM<V>::INITIAL_CAPACITY = 1024;
 
 template <typename V>
-DBM<V>::DBM() : fp(NULL), bucket(NULL), bucketLength(0), freePoolLength(0)
+DBM<V>::DBM() : fp(NULL), mapping(NULL), mappingSize(0), bucket(NULL), bucketLength(0), freePoolLength(0),
+		freePoolLoaded(true), freePoolDirty(false), readOnly(false), epochs(NULL)
 {
-  this->freePool = new std::vector<std::pair<uint32_t, uint32_t> >;
+  this->versions = new std::map<std::string, std::vector<Version> >();
+  this->retired = new std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t> > >();
+  pthread_mutex_init(&(this->versionMutex), NULL);
+  this->freePool = new std::vector<std::pair<uint64_t, uint64_t> >;
 }
 
 template <typename V>
 DBM<V>::~DBM()
 {
   this->close();
-  if (this->bucket) delete[] this->bucket;
+  this->releaseBucket();
   delete this->freePool;
+  delete this->versions;
+  delete this->retired;
+  pthread_mutex_destroy(&(this->versionMutex));
+}
+
+template <typename V>
+bool DBM<V>::isLegacy(const char* path)
+{
+  if (path == NULL) return false;
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+
+  uint32_t magic;
+  bool legacy = fread(&magic, sizeof(uint32_t), 1, fp) != 1 || magic != DBM::MAGIC;
+  fclose(fp);
+  return legacy;
+}
+
+template <typename V>
+bool DBM<V>::upgrade(const char* path)
+{
+  if (path == NULL) return false;
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+
+  uint32_t header[2];
+  bool current = fread(header, sizeof(uint32_t), 2, fp) == 2 && header[0] == DBM::MAGIC;
+  fclose(fp);
+  if (current) return header[1] == DBM::VERSION;
+
+  std::string upgradedPath = std::string(path) + ".upgrade";
+  if (!DBM<V>::upgrade(path, upgradedPath.c_str())) return false;
+  if (rename(upgradedPath.c_str(), path) != 0) {
+    ::remove(upgradedPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+template <typename V>
+bool DBM<V>::upgrade(const char* path, const char* upgradedPath)
+{
+  if (path == NULL || upgradedPath == NULL || !DBM<V>::isLegacy(path)) return false;
+  FILE* legacy = fopen(path, "rb");
+  if (legacy == NULL) return false;
+
+  // the 32-bit layout is (bucket length, bucket, free pool length, free
+  // pool) followed by records of 32-bit fields. Its free areas are not
+  // carried over, as the records are packed one after another anyway
+  rewind(legacy);
+  uint32_t bucketLength;
+  uint32_t freePoolLength;
+  bool valid = fread(&bucketLength, sizeof(uint32_t), 1, legacy) == 1 && bucketLength > 0;
+  std::vector<uint32_t> legacyBucket(valid ? bucketLength : 0);
+  valid = valid && fread(&legacyBucket[0], sizeof(uint32_t), bucketLength, legacy) == bucketLength &&
+    fread(&freePoolLength, sizeof(uint32_t), 1, legacy) == 1;
+
+  DBM<V> upgraded;
+  valid = valid && upgraded.create(upgradedPath, bucketLength, freePoolLength);
+
+  // records are appended at the ends of their new chains, which keeps
+  // every chain in its old order, and keep their capacities
+  for (uint32_t b = 0; b < bucketLength && valid; ++b) {
+    uint32_t offset = legacyBucket[b];
+    while (offset != DBM::NULL_OFFSET && valid) {
+      uint32_t fields[2];
+      valid = fseeko(legacy, offset, SEEK_SET) == 0 && fread(fields, sizeof(uint32_t), 2, legacy) == 2;
+      if (!valid) break;
+
+      std::string key(fields[1], '\0');
+      uint32_t valueFields[2];
+      valid = (fields[1] == 0 || fread(&key[0], sizeof(char), fields[1], legacy) == fields[1]) &&
+	fread(valueFields, sizeof(uint32_t), 2, legacy) == 2 && valueFields[1] <= valueFields[0];
+      if (!valid) break;
+
+      std::vector<V> value(valueFields[1]);
+      valid = value.empty() || fread(&value[0], sizeof(V), value.size(), legacy) == value.size();
+      if (!valid) break;
+
+      uint64_t prevOffset;
+      uint64_t recordOffset;
+      uint64_t nextOffset;
+      upgraded.findRecordOffset(key.c_str(), &prevOffset, &recordOffset, &nextOffset);
+      upgraded.allocNewRecord(prevOffset, DBM::NULL_OFFSET, key.c_str(), value.empty() ? NULL : &value[0],
+			      value.size(), valueFields[0]);
+      offset = fields[0];
+    }
+  }
+
+  fclose(legacy);
+  upgraded.close();
+  if (!valid) ::remove(upgradedPath);
+  return valid;
 }
 
 template <typename V>
 bool DBM<V>::open(const char* path)
 {
-  if (path == NULL || (this->fp = fopen(path, "rb+")) == NULL) return false;
+  return this->open(path, false);
+}
 
-  this->loadMetaData();
+template <typename V>
+bool DBM<V>::open(const char* path, bool readOnly)
+{
+  if (path == NULL || (this->fp = fopen(path, readOnly ? "rb" : "rb+")) == NULL) return false;
+  this->readOnly = readOnly;
+  if (readOnly) setvbuf(this->fp, NULL, _IONBF, 0);
+
+  if (!this->loadMetaData()) {
+    fclose(this->fp);
+    this->fp = NULL;
+    return false;
+  }
 
   return true;
 }
@@ -101,15 +318,21 @@ template <typename V>
 bool DBM<V>::create(const char* path, uint32_t bucketLength, uint32_t freePoolLength)
 {
   if (path == NULL || (this->fp = fopen(path, "wb+")) == NULL) return false;
+  this->readOnly = false;
+
+  // the bucket and the free pool start out zeroed, as a hole in the file
+  uint32_t header[4] = { DBM::MAGIC, DBM::VERSION, bucketLength, freePoolLength };
+  fwrite(header, sizeof(uint32_t), 4, this->fp);
+  fflush(this->fp);
+  off_t metaDataSize = sizeof(header) + sizeof(uint64_t) * ((uint64_t) bucketLength + freePoolLength * 2ULL);
+  if (ftruncate(fileno(this->fp), metaDataSize) != 0 || !this->loadMetaData()) {
+    fclose(this->fp);
+    this->fp = NULL;
+    return false;
+  }
 
-  this->bucket = new uint32_t[bucketLength];
-  std::fill(this->bucket, this->bucket + bucketLength, DBM::NULL_OFFSET);
-  this->bucketLength = bucketLength;
-
-  this->freePool->clear();
-  this->freePoolLength = freePoolLength;
-
-  this->saveMetaData();
+  this->freePoolLoaded = true;
+  this->freePoolDirty = false;
 
   return true;
 }
@@ -118,18 +341,130 @@ template <typename V>
 void DBM<V>::close()
 {
   if (this->fp) {
-    this->saveMetaData();
+    // with the file gone no reader can need an old version any more
+    this->reclaimBefore(EpochManager::LATEST_EPOCH);
+    if (!this->readOnly) this->saveMetaData();
     fclose(this->fp);
     this->fp = NULL;
+    this->releaseBucket();
   }
 }
 
+template <typename V>
+bool DBM<V>::sync()
+{
+  if (this->fp == NULL || this->readOnly) return false;
+
+  // the kernel writes back only the dirty pages of the mapped bucket
+  this->saveMetaData();
+  return fflush(this->fp) == 0 && fdatasync(fileno(this->fp)) == 0;
+}
+
+template <typename V>
+bool DBM<V>::isReadOnly() const
+{
+  return this->readOnly;
+}
+
+template <typename V>
+void DBM<V>::setEpochs(EpochManager* epochs)
+{
+  this->reclaimBefore(EpochManager::LATEST_EPOCH);
+  this->epochs = epochs;
+}
+
+template <typename V>
+void DBM<V>::reclaim()
+{
+  if (this->epochs != NULL) this->reclaimBefore(this->epochs->getOldestEpoch());
+}
+
+template <typename V>
+void DBM<V>::reclaimBefore(uint64_t epoch)
+{
+  // what epoch e replaced is only read by readers pinned before e
+  std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t> > >::iterator areaIter = this->retired->begin();
+  while (areaIter != this->retired->end()) {
+    if (areaIter->first <= epoch) {
+      this->putFreeArea(areaIter->second.first, areaIter->second.second);
+      areaIter = this->retired->erase(areaIter);
+    }
+    else {
+      ++areaIter;
+    }
+  }
+
+  pthread_mutex_lock(&(this->versionMutex));
+  typename std::map<std::string, std::vector<Version> >::iterator keyIter = this->versions->begin();
+  while (keyIter != this->versions->end()) {
+    std::vector<Version>& keyVersions = keyIter->second;
+    typename std::vector<Version>::iterator versionIter = keyVersions.begin();
+    while (versionIter != keyVersions.end() && versionIter->epoch <= epoch) ++versionIter;
+    keyVersions.erase(keyVersions.begin(), versionIter);
+    if (keyVersions.empty()) this->versions->erase(keyIter++);
+    else ++keyIter;
+  }
+  pthread_mutex_unlock(&(this->versionMutex));
+}
+
+template <typename V>
+void DBM<V>::saveVersion(const char* key, uint64_t offset, uint64_t valueLength)
+{
+  if (this->epochs == NULL) return;
+
+  // readers pinned before the write epoch see the value as it was when
+  // the epoch first changed it
+  uint64_t writeEpoch = this->epochs->getWriteEpoch();
+  pthread_mutex_lock(&(this->versionMutex));
+  std::vector<Version>& keyVersions = (*(this->versions))[key];
+  if (keyVersions.empty() || keyVersions.back().epoch != writeEpoch) {
+    Version version = { writeEpoch, DBM::NULL_OFFSET, 0 };
+    if (offset != DBM::NULL_OFFSET) {
+      version.valueOffset = offset + sizeof(uint64_t) * 3 + sizeof(uint32_t) + strlen(key);
+      version.valueLength = (uint32_t) valueLength;
+    }
+    keyVersions.push_back(version);
+  }
+  pthread_mutex_unlock(&(this->versionMutex));
+}
+
+template <typename V>
+void DBM<V>::releaseArea(uint64_t offset, uint64_t size)
+{
+  if (this->epochs == NULL) {
+    this->putFreeArea(offset, size);
+    return;
+  }
+  this->retired->push_back(std::make_pair(this->epochs->getWriteEpoch(), std::make_pair(offset, size)));
+}
+
+template <typename V>
+void DBM<V>::resolveVersions(const std::vector<std::string>& keys, uint64_t epoch,
+			     std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths)
+{
+  if (this->epochs == NULL || epoch == EpochManager::LATEST_EPOCH) return;
+
+  pthread_mutex_lock(&(this->versionMutex));
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    typename std::map<std::string, std::vector<Version> >::const_iterator keyIter = this->versions->find(keys[i]);
+    if (keyIter == this->versions->end()) continue;
+
+    typename std::vector<Version>::const_iterator versionIter = keyIter->second.begin();
+    while (versionIter != keyIter->second.end() && versionIter->epoch <= epoch) ++versionIter;
+    if (versionIter != keyIter->second.end()) {
+      valueOffsets[i] = versionIter->valueOffset;
+      valueLengths[i] = versionIter->valueLength;
+    }
+  }
+  pthread_mutex_unlock(&(this->versionMutex));
+}
+
 template <typename V>
 V* DBM<V>::get(const char* key, uint32_t* valueLength)
 {
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
   
   if (offset == DBM::NULL_OFFSET) {
@@ -137,8 +472,10 @@ V* DBM<V>::get(const char* key, uint32_t* valueLength)
     return NULL;
   }
 
-  fseek(this->fp, sizeof(uint32_t), SEEK_CUR);
-  fread(valueLength, sizeof(uint32_t), 1, this->fp);
+  uint64_t storedLength;
+  fseeko(this->fp, sizeof(uint64_t), SEEK_CUR);
+  fread(&storedLength, sizeof(uint64_t), 1, this->fp);
+  *valueLength = (uint32_t) storedLength;
 
   V* value = new V[*valueLength];
   fread(value, sizeof(V), *valueLength, this->fp);
@@ -146,164 +483,478 @@ V* DBM<V>::get(const char* key, uint32_t* valueLength)
   return value;
 }
 
+template <typename V>
+V* DBM<V>::get(const char* key, uint32_t* valueLength, uint64_t epoch)
+{
+  uint64_t valueOffset;
+  if (!this->findValue(key, epoch, &valueOffset, valueLength)) return NULL;
+
+  V* value = new V[*valueLength];
+  if (this->read(valueOffset, 0, value, *valueLength) != *valueLength) {
+    delete[] value;
+    *valueLength = 0;
+    return NULL;
+  }
+  return value;
+}
+
 template <typename V>
 void DBM<V>::set(const char* key, const V* value, uint32_t valueLength)
 {
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  if (this->readOnly) return;
+
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
   
   if (offset == DBM::NULL_OFFSET) {
+    this->saveVersion(key, DBM::NULL_OFFSET, 0);
     this->allocNewRecord(prevOffset, DBM::NULL_OFFSET, key, value, valueLength);
+    fflush(this->fp);
     return;
   }
 
-  uint32_t oldValueCapacity;
-  fread(&oldValueCapacity, sizeof(uint32_t), 1, this->fp);
-
-  if (valueLength <= oldValueCapacity) {
-    fseek(this->fp, 0, SEEK_CUR);
-    fwrite(&valueLength, sizeof(uint32_t), 1, this->fp);
+  uint64_t oldValueCapacity;
+  uint64_t oldValueLength;
+  fread(&oldValueCapacity, sizeof(uint64_t), 1, this->fp);
+  fread(&oldValueLength, sizeof(uint64_t), 1, this->fp);
+  this->saveVersion(key, offset, oldValueLength);
+
+  // a value old readers may still see is copied rather than overwritten
+  if (valueLength <= oldValueCapacity && this->epochs == NULL) {
+    uint64_t newValueLength = valueLength;
+    fseeko(this->fp, -1 * (off_t) sizeof(uint64_t), SEEK_CUR);
+    fwrite(&newValueLength, sizeof(uint64_t), 1, this->fp);
     fwrite(value, sizeof(V), valueLength, this->fp);
   }
   else {
-    this->putFreeArea(offset, DBM<V>::calcRecordSize(key, oldValueCapacity));
+    this->releaseArea(offset, DBM<V>::calcRecordSize(key, oldValueCapacity));
     this->allocNewRecord(prevOffset, nextOffset, key, value, valueLength);
   }
+  fflush(this->fp);
+}
+
+template <typename V>
+void DBM<V>::insert(const char* key, const V* value, uint32_t valueLength)
+{
+  if (this->readOnly) return;
+
+  // the key is known to be missing, so the record goes to the head of its
+  // chain without walking it, and it is given no spare capacity
+  this->saveVersion(key, DBM::NULL_OFFSET, 0);
+  uint64_t headOffset = *(this->bucket + this->calcBucketIndex(key));
+  this->allocNewRecord(DBM::NULL_OFFSET, headOffset, key, value, valueLength, valueLength);
+  fflush(this->fp);
 }
 
 template <typename V>
 void DBM<V>::append(const char* key, const V* value, uint32_t valueLength)
 {
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  if (this->readOnly) return;
+
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
 
   if (offset == DBM::NULL_OFFSET) {
+    this->saveVersion(key, DBM::NULL_OFFSET, 0);
     this->allocNewRecord(prevOffset, DBM::NULL_OFFSET, key, value, valueLength);
+    fflush(this->fp);
     return;
   }
 
-  uint32_t oldValueCapacity;
-  uint32_t oldValueLength;
-  fread(&oldValueCapacity, sizeof(uint32_t), 1, this->fp);
-  fread(&oldValueLength, sizeof(uint32_t), 1, this->fp);
+  uint64_t oldValueCapacity;
+  uint64_t oldValueLength;
+  fread(&oldValueCapacity, sizeof(uint64_t), 1, this->fp);
+  fread(&oldValueLength, sizeof(uint64_t), 1, this->fp);
+  this->saveVersion(key, offset, oldValueLength);
 
-  uint32_t newValueLength = oldValueLength + valueLength;
+  uint64_t newValueLength = oldValueLength + valueLength;
   if (newValueLength <= oldValueCapacity) {
-    fseek(this->fp, -1 * sizeof(uint32_t), SEEK_CUR);
-    fwrite(&newValueLength, sizeof(uint32_t), 1, this->fp);
-    fseek(this->fp, sizeof(V) * oldValueLength, SEEK_CUR);
+    fseeko(this->fp, -1 * (off_t) sizeof(uint64_t), SEEK_CUR);
+    fwrite(&newValueLength, sizeof(uint64_t), 1, this->fp);
+    fseeko(this->fp, sizeof(V) * oldValueLength, SEEK_CUR);
     fwrite(value, sizeof(V), valueLength, this->fp);
   }
   else {
-    V* newValue = new V[newValueLength];
-    fread(newValue, sizeof(V), oldValueLength, this->fp);
-    memcpy(newValue + oldValueLength, value, sizeof(V) * valueLength);
-
-    this->putFreeArea(offset, DBM<V>::calcRecordSize(key, oldValueCapacity));
-    this->allocNewRecord(prevOffset, nextOffset, key, newValue, newValueLength);
+    // the old value moves over from the file a bounded chunk at a time,
+    // so its area is given up only once the copy is done
+    uint64_t oldValueOffset = (uint64_t) ftello(this->fp);
+    this->allocNewRecord(prevOffset, nextOffset, key, value, valueLength,
+			 DBM<V>::calcValueCapacity(newValueLength), oldValueOffset, oldValueLength);
+    this->releaseArea(offset, DBM<V>::calcRecordSize(key, oldValueCapacity));
   }
+  fflush(this->fp);
 }
 
 template <typename V>
-void DBM<V>::allocNewRecord(uint32_t prevOffset, uint32_t nextOffset, const char* key, const V* value, uint32_t valueLength)
+void DBM<V>::allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength)
+{
+  this->allocNewRecord(prevOffset, nextOffset, key, value, valueLength, DBM<V>::calcValueCapacity(valueLength));
+}
+
+template <typename V>
+void DBM<V>::allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength,
+			    uint64_t valueCapacity)
+{
+  this->allocNewRecord(prevOffset, nextOffset, key, value, valueLength, valueCapacity, DBM::NULL_OFFSET, 0);
+}
+
+template <typename V>
+void DBM<V>::allocNewRecord(uint64_t prevOffset, uint64_t nextOffset, const char* key, const V* value, uint64_t valueLength,
+			    uint64_t valueCapacity, uint64_t copyOffset, uint64_t copyLength)
 {
-  uint32_t valueCapacity = DBM<V>::calcValueCapacity(valueLength);
   uint32_t keyLength = strlen(key);
-  uint32_t requisiteSize = DBM<V>::calcRecordSize(key, valueCapacity);
+  uint64_t requisiteSize = DBM<V>::calcRecordSize(key, valueCapacity);
 
-  uint32_t newOffset = this->getFreeArea(requisiteSize);
+  uint64_t newOffset = this->getFreeArea(requisiteSize);
   if (newOffset == DBM::NULL_OFFSET) {
-    fseek(this->fp, 0, SEEK_END);
-    newOffset = (uint32_t) ftell(this->fp);
+    fseeko(this->fp, 0, SEEK_END);
+    newOffset = (uint64_t) ftello(this->fp);
   }
   else {
-    fseek(this->fp, newOffset, SEEK_SET);
+    fseeko(this->fp, newOffset, SEEK_SET);
   }
 
-  fwrite(&nextOffset, sizeof(uint32_t), 1, this->fp);
+  fwrite(&nextOffset, sizeof(uint64_t), 1, this->fp);
   fwrite(&keyLength, sizeof(uint32_t), 1, this->fp);
   fwrite(key, sizeof(char), keyLength, this->fp);
-  fwrite(&valueCapacity, sizeof(uint32_t), 1, this->fp);
-  fwrite(&valueLength, sizeof(uint32_t), 1, this->fp);
+  uint64_t totalLength = copyLength + valueLength;
+  fwrite(&valueCapacity, sizeof(uint64_t), 1, this->fp);
+  fwrite(&totalLength, sizeof(uint64_t), 1, this->fp);
+
+  // a value kept elsewhere in the file leads the new one
+  if (copyLength > 0) {
+    uint64_t valueOffset = (uint64_t) ftello(this->fp);
+    std::vector<V> copy(std::min(copyLength, DBM::INITIAL_CAPACITY * 64));
+    for (uint64_t copied = 0; copied < copyLength; copied += copy.size()) {
+      uint64_t count = std::min(copyLength - copied, (uint64_t) copy.size());
+      fseeko(this->fp, copyOffset + sizeof(V) * copied, SEEK_SET);
+      fread(&copy[0], sizeof(V), count, this->fp);
+      fseeko(this->fp, valueOffset + sizeof(V) * copied, SEEK_SET);
+      fwrite(&copy[0], sizeof(V), count, this->fp);
+    }
+  }
   fwrite(value, sizeof(V), valueLength, this->fp);
-  if (valueLength < valueCapacity) {
-    uint32_t nullValueLength = valueCapacity - valueLength;
-    V nullValue[nullValueLength];
-    std::fill(nullValue, nullValue + nullValueLength, 0);
-    fwrite(nullValue, sizeof(V), nullValueLength, this->fp);
+
+  // the unused capacity is zeroed a bounded chunk at a time
+  uint64_t nullValueLength = valueCapacity - totalLength;
+  if (nullValueLength > 0) {
+    std::vector<V> nullValue(std::min(nullValueLength, DBM::INITIAL_CAPACITY), 0);
+    while (nullValueLength > 0) {
+      uint64_t count = std::min(nullValueLength, (uint64_t) nullValue.size());
+      fwrite(&nullValue[0], sizeof(V), count, this->fp);
+      nullValueLength -= count;
+    }
   }
 
   if (prevOffset == DBM::NULL_OFFSET) {
+    fflush(this->fp);
     *(this->bucket + this->calcBucketIndex(key)) = newOffset;
   }
   else {
-    fseek(this->fp, prevOffset, SEEK_SET);
-    fwrite(&newOffset, sizeof(uint32_t), 1, this->fp);
+    fseeko(this->fp, prevOffset, SEEK_SET);
+    fwrite(&newOffset, sizeof(uint64_t), 1, this->fp);
   }
 }
 
 template <typename V>
 void DBM<V>::remove(const char* key)
 {
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  if (this->readOnly) return;
+
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
 
   if (offset == DBM::NULL_OFFSET) return;
 
-  uint32_t valueCapacity;
-  fread(&valueCapacity, sizeof(uint32_t), 1, this->fp);
+  uint64_t valueCapacity;
+  uint64_t valueLength;
+  fread(&valueCapacity, sizeof(uint64_t), 1, this->fp);
+  fread(&valueLength, sizeof(uint64_t), 1, this->fp);
+  this->saveVersion(key, offset, valueLength);
 
-  this->putFreeArea(offset, DBM<V>::calcRecordSize(key, valueCapacity));
+  this->releaseArea(offset, DBM<V>::calcRecordSize(key, valueCapacity));
 
   if (prevOffset == DBM::NULL_OFFSET) {
     *(this->bucket + this->calcBucketIndex(key)) = nextOffset;
   }
   else {
-    fseek(this->fp, prevOffset, SEEK_SET);
-    fwrite(&nextOffset, sizeof(uint32_t), 1, this->fp);
+    fseeko(this->fp, prevOffset, SEEK_SET);
+    fwrite(&nextOffset, sizeof(uint64_t), 1, this->fp);
+    fflush(this->fp);
   }
 }
 
 template <typename V>
 bool DBM<V>::contains(const char* key)
 {
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
 
   return (offset != DBM::NULL_OFFSET);
 }
 
 template <typename V>
-void DBM<V>::loadMetaData()
+bool DBM<V>::contains(const char* key, uint64_t epoch)
+{
+  uint64_t valueOffset;
+  uint32_t valueLength;
+  return this->findValue(key, epoch, &valueOffset, &valueLength);
+}
+
+template <typename V>
+void DBM<V>::getKeys(std::vector<std::string>& keys)
+{
+  if (this->fp == NULL) return;
+  for (uint32_t b = 0; b < this->bucketLength; ++b) {
+    uint64_t offset = *(this->bucket + b);
+    while (offset != DBM::NULL_OFFSET) {
+      uint64_t nextOffset;
+      uint32_t keyLength;
+      fseeko(this->fp, offset, SEEK_SET);
+      if (fread(&nextOffset, sizeof(uint64_t), 1, this->fp) != 1 ||
+	  fread(&keyLength, sizeof(uint32_t), 1, this->fp) != 1) {
+	break;
+      }
+
+      std::string key(keyLength, '\0');
+      if (keyLength > 0 && fread(&key[0], sizeof(char), keyLength, this->fp) != keyLength) break;
+      keys.push_back(key);
+      offset = nextOffset;
+    }
+  }
+}
+
+template <typename V>
+bool DBM<V>::locate(const char* key, uint64_t* valueOffset, uint32_t* valueLength)
+{
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
+  this->findRecordOffset(key, &prevOffset, &offset, &nextOffset);
+
+  if (offset == DBM::NULL_OFFSET) {
+    *valueLength = 0;
+    return false;
+  }
+
+  uint64_t storedLength;
+  fseeko(this->fp, sizeof(uint64_t), SEEK_CUR);
+  fread(&storedLength, sizeof(uint64_t), 1, this->fp);
+  *valueLength = (uint32_t) storedLength;
+  *valueOffset = (uint64_t) ftello(this->fp);
+
+  return true;
+}
+
+template <typename V>
+bool DBM<V>::locate(const char* key, uint64_t* valueOffset, uint32_t* valueLength, uint64_t epoch)
+{
+  return this->findValue(key, epoch, valueOffset, valueLength);
+}
+
+template <typename V>
+uint32_t DBM<V>::read(uint64_t valueOffset, uint32_t index, V* buffer, uint32_t count)
+{
+  // pread leaves the stream position alone, and every change has been
+  // flushed already, so any thread may read next to the writer
+  ssize_t readSize = pread(fileno(this->fp), buffer, sizeof(V) * count, valueOffset + sizeof(V) * (uint64_t) index);
+
+  return (readSize > 0) ? readSize / sizeof(V) : 0;
+}
+
+template <typename V>
+void DBM<V>::write(uint64_t valueOffset, uint32_t index, const V* buffer, uint32_t count)
+{
+  if (this->readOnly) return;
+
+  fseeko(this->fp, valueOffset + sizeof(V) * (uint64_t) index, SEEK_SET);
+  fwrite(buffer, sizeof(V), count, this->fp);
+  fflush(this->fp);
+}
+
+template <typename V>
+void DBM<V>::locateAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		       std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths)
+{
+  this->locateAll(reader, keys, valueOffsets, valueLengths, EpochManager::LATEST_EPOCH);
+}
+
+template <typename V>
+void DBM<V>::locateAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		       std::vector<uint64_t>& valueOffsets, std::vector<uint32_t>& valueLengths, uint64_t epoch)
+{
+  valueOffsets.assign(keys.size(), DBM::NULL_OFFSET);
+  valueLengths.assign(keys.size(), 0);
+
+  // the keys walk their chains side by side, reading one record of every
+  // unfinished chain per batch, so the batches needed are as many as the
+  // longest chain has hops rather than all hops of all chains. A record is
+  // read up to its value, sized as if its key were the wanted one
+  int fd = fileno(this->fp);
+  std::vector<uint64_t> offsets(keys.size());
+  std::vector<std::vector<char> > records(keys.size());
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    offsets[i] = *(this->bucket + this->calcBucketIndex(keys[i].c_str()));
+    records[i].resize(sizeof(uint64_t) * 3 + sizeof(uint32_t) + keys[i].size());
+  }
+
+  std::vector<AsyncReader::Request> requests;
+  std::vector<uint32_t> owners;
+  while (true) {
+    requests.clear();
+    owners.clear();
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+      if (offsets[i] == DBM::NULL_OFFSET) continue;
+      AsyncReader::Request request = { fd, offsets[i], &(records[i][0]), (uint32_t) records[i].size(), 0 };
+      requests.push_back(request);
+      owners.push_back(i);
+    }
+    if (requests.empty()) break;
+    reader->readAll(requests);
+
+    for (uint32_t r = 0; r < requests.size(); ++r) {
+      uint32_t i = owners[r];
+      const char* record = &(records[i][0]);
+      if (requests[r].result < (int64_t) (sizeof(uint64_t) + sizeof(uint32_t))) {
+	offsets[i] = DBM::NULL_OFFSET;
+	continue;
+      }
+
+      uint64_t nextOffset;
+      uint32_t keyLength;
+      memcpy(&nextOffset, record, sizeof(uint64_t));
+      memcpy(&keyLength, record + sizeof(uint64_t), sizeof(uint32_t));
+      const char* key = record + sizeof(uint64_t) + sizeof(uint32_t);
+      if (keyLength == keys[i].size() && requests[r].result == (int64_t) records[i].size() &&
+	  memcmp(key, keys[i].data(), keyLength) == 0) {
+	uint64_t storedLength;
+	memcpy(&storedLength, key + keyLength + sizeof(uint64_t), sizeof(uint64_t));
+	valueOffsets[i] = offsets[i] + records[i].size();
+	valueLengths[i] = (uint32_t) storedLength;
+	nextOffset = DBM::NULL_OFFSET;
+      }
+      offsets[i] = nextOffset;
+    }
+  }
+
+  // the notes are looked at only after the chains, since a key is always
+  // noted before it changes
+  this->resolveVersions(keys, epoch, valueOffsets, valueLengths);
+}
+
+template <typename V>
+void DBM<V>::getAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		    std::vector<V*>& values, std::vector<uint32_t>& valueLengths)
+{
+  this->getAll(reader, keys, values, valueLengths, EpochManager::LATEST_EPOCH);
+}
+
+template <typename V>
+void DBM<V>::getAll(AsyncReader* reader, const std::vector<std::string>& keys,
+		    std::vector<V*>& values, std::vector<uint32_t>& valueLengths, uint64_t epoch)
+{
+  std::vector<uint64_t> valueOffsets;
+  this->locateAll(reader, keys, valueOffsets, valueLengths, epoch);
+
+  // the values then come in together as well; missing keys get NULL
+  values.assign(keys.size(), (V*) NULL);
+  std::vector<AsyncReader::Request> requests;
+  std::vector<uint32_t> owners;
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    if (valueOffsets[i] == DBM::NULL_OFFSET) continue;
+    values[i] = new V[valueLengths[i]];
+    AsyncReader::Request request = { fileno(this->fp), valueOffsets[i], values[i],
+				     (uint32_t) (sizeof(V) * valueLengths[i]), 0 };
+    requests.push_back(request);
+    owners.push_back(i);
+  }
+  reader->readAll(requests);
+
+  for (uint32_t r = 0; r < requests.size(); ++r) {
+    uint32_t i = owners[r];
+    if (requests[r].result != (int64_t) requests[r].length) {
+      delete[] values[i];
+      values[i] = NULL;
+      valueLengths[i] = 0;
+    }
+  }
+}
+
+template <typename V>
+bool DBM<V>::loadMetaData()
 {
   rewind(this->fp);
 
-  fread(&(this->bucketLength), sizeof(uint32_t), 1, this->fp);
-  this->bucket = new uint32_t[this->bucketLength];
-  fread(this->bucket, sizeof(uint32_t), this->bucketLength, this->fp);
+  uint32_t header[4];
+  if (fread(header, sizeof(uint32_t), 4, this->fp) != 4 ||
+      header[0] != DBM::MAGIC || header[1] != DBM::VERSION) {
+    return false;
+  }
 
-  fread(&(this->freePoolLength), sizeof(uint32_t), 1, this->fp);
+  // a file too short for its bucket would fault once the mapping is touched
+  struct stat fileStat;
+  size_t mappingSize = sizeof(header) + sizeof(uint64_t) * (size_t) header[2];
+  if (fstat(fileno(this->fp), &fileStat) != 0 ||
+      (uint64_t) fileStat.st_size < mappingSize + sizeof(uint64_t) * 2ULL * header[3]) {
+    return false;
+  }
 
-  uint32_t tempFreePool[this->freePoolLength * 2];
-  fread(tempFreePool, sizeof(uint32_t), this->freePoolLength * 2, this->fp);
+  int protection = this->readOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+  void* mapping = mmap(NULL, mappingSize, protection, MAP_SHARED, fileno(this->fp), 0);
+  if (mapping == MAP_FAILED) return false;
 
-  uint32_t index = 0;
+  this->releaseBucket();
+  this->mapping = (char*) mapping;
+  this->mappingSize = mappingSize;
+  this->bucket = (uint64_t*) (this->mapping + sizeof(header));
+  this->bucketLength = header[2];
+  this->freePoolLength = header[3];
   this->freePool->clear();
-  while (index < this->freePoolLength * 2 &&
-	 tempFreePool[index] != DBM::NULL_OFFSET) {
-    this->freePool->push_back(std::pair<uint32_t, uint32_t>(tempFreePool[index], tempFreePool[index + 1]));
+  this->freePoolLoaded = false;
+  this->freePoolDirty = false;
+
+  return true;
+}
+
+template <typename V>
+void DBM<V>::loadFreePool()
+{
+  if (this->freePoolLoaded) return;
+  this->freePoolLoaded = true;
+
+  std::vector<uint64_t> tempFreePool(this->freePoolLength * 2, DBM::NULL_OFFSET);
+  if (tempFreePool.empty()) return;
+  fseeko(this->fp, sizeof(uint32_t) * 4 + sizeof(uint64_t) * (uint64_t) this->bucketLength, SEEK_SET);
+  fread(&tempFreePool[0], sizeof(uint64_t), tempFreePool.size(), this->fp);
+
+  uint32_t index = 0;
+  while (index < tempFreePool.size() && tempFreePool[index] != DBM::NULL_OFFSET) {
+    this->freePool->push_back(std::pair<uint64_t, uint64_t>(tempFreePool[index], tempFreePool[index + 1]));
     index += 2;
   }
 }
 
+template <typename V>
+void DBM<V>::releaseBucket()
+{
+  if (this->mapping != NULL) {
+    munmap(this->mapping, this->mappingSize);
+    this->mapping = NULL;
+  }
+  else if (this->bucket != NULL) {
+    delete[] this->bucket;
+  }
+  this->bucket = NULL;
+}
+
 template <typename V>
 uint32_t DBM<V>::calcBucketIndex(const char* key)
 {
@@ -320,23 +971,23 @@ uint32_t DBM<V>::calcBucketIndex(const char* key)
 }
 
 template <typename V>
-void DBM<V>::findRecordOffset(const char* key, uint32_t* prevOffset, uint32_t* offset, uint32_t* nextOffset)
+void DBM<V>::findRecordOffset(const char* key, uint64_t* prevOffset, uint64_t* offset, uint64_t* nextOffset)
 {
   *offset = *(this->bucket + this->calcBucketIndex(key));
   *prevOffset = DBM::NULL_OFFSET;
   *nextOffset = DBM::NULL_OFFSET;
 
   while (*offset) {
-    fseek(this->fp, *offset, SEEK_SET);
+    fseeko(this->fp, *offset, SEEK_SET);
 
     uint32_t keyLength;
-    fread(nextOffset, sizeof(uint32_t), 1, this->fp);
+    fread(nextOffset, sizeof(uint64_t), 1, this->fp);
     fread(&keyLength, sizeof(uint32_t), 1, this->fp);
 
     char keyContent[keyLength];
     fread(keyContent, sizeof(char), keyLength, this->fp);
 
-    if (strncmp(key, keyContent, keyLength) == 0) break;
+    if (keyLength == strlen(key) && strncmp(key, keyContent, keyLength) == 0) break;
     
     *prevOffset = *offset;
     *offset = *nextOffset;
@@ -344,35 +995,82 @@ void DBM<V>::findRecordOffset(const char* key, uint32_t* prevOffset, uint32_t* o
 }
 
 template <typename V>
-void DBM<V>::saveMetaData()
+bool DBM<V>::findValue(const char* key, uint64_t epoch, uint64_t* valueOffset, uint32_t* valueLength)
 {
-  rewind(this->fp);
+  *valueOffset = DBM::NULL_OFFSET;
+  *valueLength = 0;
 
-  fwrite(&(this->bucketLength), sizeof(uint32_t), 1, this->fp);
-  fwrite(this->bucket, sizeof(uint32_t), this->bucketLength, this->fp);
+  // the chain is walked with pread, a record read up to its value at once
+  int fd = fileno(this->fp);
+  uint32_t keyLength = strlen(key);
+  std::vector<char> record(sizeof(uint64_t) * 3 + sizeof(uint32_t) + keyLength);
+  uint64_t offset = *(this->bucket + this->calcBucketIndex(key));
+  while (offset != DBM::NULL_OFFSET) {
+    ssize_t readSize = pread(fd, &record[0], record.size(), offset);
+    if (readSize < (ssize_t) (sizeof(uint64_t) + sizeof(uint32_t))) break;
+
+    uint64_t nextOffset;
+    uint32_t recordKeyLength;
+    memcpy(&nextOffset, &record[0], sizeof(uint64_t));
+    memcpy(&recordKeyLength, &record[sizeof(uint64_t)], sizeof(uint32_t));
+    const char* recordKey = &record[sizeof(uint64_t) + sizeof(uint32_t)];
+    if (recordKeyLength == keyLength && readSize == (ssize_t) record.size() &&
+	memcmp(recordKey, key, keyLength) == 0) {
+      uint64_t storedLength;
+      memcpy(&storedLength, recordKey + keyLength + sizeof(uint64_t), sizeof(uint64_t));
+      *valueOffset = offset + record.size();
+      *valueLength = (uint32_t) storedLength;
+      break;
+    }
+    offset = nextOffset;
+  }
 
-  fwrite(&(this->freePoolLength), sizeof(uint32_t), 1, this->fp);
+  std::vector<std::string> keys(1, key);
+  std::vector<uint64_t> valueOffsets(1, *valueOffset);
+  std::vector<uint32_t> valueLengths(1, *valueLength);
+  this->resolveVersions(keys, epoch, valueOffsets, valueLengths);
+  *valueOffset = valueOffsets[0];
+  *valueLength = valueLengths[0];
+  return *valueOffset != DBM::NULL_OFFSET;
+}
+
+template <typename V>
+void DBM<V>::saveMetaData()
+{
+  // a mapped header and bucket are already in the file, and the lengths
+  // in the header never change once it is created
+  uint32_t header[4] = { DBM::MAGIC, DBM::VERSION, this->bucketLength, this->freePoolLength };
+  if (this->mapping == NULL) {
+    rewind(this->fp);
+    fwrite(header, sizeof(uint32_t), 4, this->fp);
+    fwrite(this->bucket, sizeof(uint64_t), this->bucketLength, this->fp);
+  }
+  else if (!this->freePoolDirty) {
+    return;
+  }
+  this->freePoolDirty = false;
   
-  uint32_t tempFreePool[this->freePoolLength * 2];
-  std::fill(tempFreePool, tempFreePool + this->freePoolLength * 2, DBM::NULL_OFFSET);
+  std::vector<uint64_t> tempFreePool(this->freePoolLength * 2, DBM::NULL_OFFSET);
 
   uint32_t index = 0;
-  std::vector<std::pair<uint32_t, uint32_t> >::iterator iter = this->freePool->begin();
-  while (iter != this->freePool->end()) {
+  std::vector<std::pair<uint64_t, uint64_t> >::iterator iter = this->freePool->begin();
+  while (iter != this->freePool->end() && index < tempFreePool.size()) {
     tempFreePool[index] = iter->first;
     tempFreePool[index + 1] = iter->second;
     index += 2;
     ++iter;
   }
 
-  fwrite(tempFreePool, sizeof(uint32_t), this->freePoolLength * 2, this->fp);
+  if (tempFreePool.empty()) return;
+  fseeko(this->fp, sizeof(header) + sizeof(uint64_t) * (uint64_t) this->bucketLength, SEEK_SET);
+  fwrite(&tempFreePool[0], sizeof(uint64_t), tempFreePool.size(), this->fp);
 }
 
 
 template <typename V>
-uint32_t DBM<V>::calcValueCapacity(uint32_t valueLength)
+uint64_t DBM<V>::calcValueCapacity(uint64_t valueLength)
 {
-  uint32_t valueCapacity = DBM::INITIAL_CAPACITY;
+  uint64_t valueCapacity = DBM::INITIAL_CAPACITY;
 
   while (valueCapacity < valueLength) valueCapacity *= 2;
 
@@ -380,13 +1078,16 @@ uint32_t DBM<V>::calcValueCapacity(uint32_t valueLength)
 }
 
 template <typename V>
-uint32_t DBM<V>::getFreeArea(uint32_t requisiteSize)
+uint64_t DBM<V>::getFreeArea(uint64_t requisiteSize)
 {
-  std::vector<std::pair<uint32_t, uint32_t> >::iterator iter = this->freePool->begin();
+  this->loadFreePool();
+
+  std::vector<std::pair<uint64_t, uint64_t> >::iterator iter = this->freePool->begin();
   while (iter != this->freePool->end()) {
     if (iter->second >= requisiteSize) {
-      uint32_t offset = iter->first;
+      uint64_t offset = iter->first;
       this->freePool->erase(iter);
+      this->freePoolDirty = true;
       return offset;
     }
     ++iter;
@@ -396,26 +1097,28 @@ uint32_t DBM<V>::getFreeArea(uint32_t requisiteSize)
 }
 
 template <typename V>
-void DBM<V>::putFreeArea(uint32_t offset, uint32_t size)
+void DBM<V>::putFreeArea(uint64_t offset, uint64_t size)
 {
+  this->loadFreePool();
   if (this->freePool->size() >= this->freePoolLength) return;
+  this->freePoolDirty = true;
 
-  std::vector<std::pair<uint32_t, uint32_t> >::iterator iter = this->freePool->begin();
+  std::vector<std::pair<uint64_t, uint64_t> >::iterator iter = this->freePool->begin();
   while (iter != this->freePool->end()) {
     if (iter->second > size) {
-      this->freePool->insert(iter, std::pair<uint32_t, uint32_t>(offset, size));
+      this->freePool->insert(iter, std::pair<uint64_t, uint64_t>(offset, size));
       return;
     }
     ++iter;
   }
 
-  this->freePool->push_back(std::pair<uint32_t, uint32_t>(offset, size));
+  this->freePool->push_back(std::pair<uint64_t, uint64_t>(offset, size));
 }
 
 template <typename V>
-uint32_t DBM<V>::calcRecordSize(const char* key, uint32_t valueCapacity)
+uint64_t DBM<V>::calcRecordSize(const char* key, uint64_t valueCapacity)
 {
-  return sizeof(uint32_t) * 4 + sizeof(char) * strlen(key) + sizeof(V) * valueCapacity;
+  return sizeof(uint64_t) * 3 + sizeof(uint32_t) + sizeof(char) * strlen(key) + sizeof(V) * valueCapacity;
 }
 
 }
@@ -0,0 +1,143 @@
+/**
+ * DocStore.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_DOC_STORE_HPP_
+#define BB_DOC_STORE_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "bb/DBM.hpp"
+
+namespace bb {
+
+/**
+ * Keeps document contents in the library packed into blocks of about
+ * BLOCK_SIZE bytes. The block being filled is kept under a key of its own
+ * as a run of (docId, length, content) records, each document appending
+ * its own; once full it is sealed, compressed with LZCodec against the
+ * latest trained dictionary, and moved under its block number. A sealed
+ * block is stored as (format, dictionary, entry count, content length)
+ * followed by a (docId, offset, length) entry per document and the
+ * content.
+ *
+ * Which block holds a document is found in directory pages of
+ * DIRECTORY_PAGE_LENGTH slots, one page per docId range. The last
+ * CACHE_SIZE blocks read are kept decompressed, so documents read together
+ * with their neighbours are served from memory. Documents stored one per
+ * key by older workspaces can still be read and removed.
+ *
+ * A document of BLOCK_SIZE or more gains nothing from sharing a block, so
+ * put() splits it into parts of BLOCK_SIZE bytes compressed one by one
+ * under keys of their own, and reading a range of it never decompresses
+ * the whole. append() stores a document streamed in part by part this way,
+ * since it may not fit any block.
+ *
+ * Readers share the cache and the library with the writer, so every call
+ * holds the store's mutex; a block is only used, and never evicted, while
+ * it is held.
+ */
+class DocStore
+{
+protected:
+  struct Block
+  {
+    uint32_t blockId;
+    bool sealed;
+    std::vector<uint32_t> entries;
+    std::string content;
+  };
+
+  static const char* STATE_KEY;
+  static const char* BLOCK_KEY_PREFIX;
+  static const char* OPEN_BLOCK_KEY;
+  static const char* DIRECTORY_KEY_PREFIX;
+  static const char* DICTIONARY_KEY_PREFIX;
+  static const char* LARGE_KEY_PREFIX;
+  static const uint32_t LARGE_BLOCK_ID;
+  static const uint32_t DIRECTORY_PAGE_LENGTH;
+  static const uint32_t HEADER_LENGTH;
+  static const uint32_t FORMAT_RAW;
+  static const uint32_t FORMAT_LZ;
+
+  DBM<char>* library;
+  mutable pthread_mutex_t mutex;
+  uint32_t nextBlockId;
+  uint32_t openBlockId;
+  uint32_t dictionaryId;
+  std::vector<Block*> cache;
+  std::map<uint32_t, std::string> dictionaries;
+
+  static std::string getKey(const char* prefix, uint32_t id);
+  static std::string getPartKey(uint32_t docId, uint32_t part);
+  std::string getBlockKey(uint32_t blockId);
+  void clear();
+  bool getDoc(uint32_t docId, std::string& content);
+  bool readDoc(uint32_t docId, uint32_t begin, uint32_t length, std::string& content);
+  void putDoc(uint32_t docId, const char* content, uint32_t length);
+  bool removeDoc(uint32_t docId);
+  void saveState();
+  uint32_t findBlock(uint32_t docId);
+  void setBlock(uint32_t docId, uint32_t blockId);
+  Block* loadBlock(uint32_t blockId);
+  void cacheBlock(Block* block);
+  void saveBlock(const Block* block);
+  void dropBlock(uint32_t blockId);
+  uint32_t compress(const char* content, uint32_t length, uint32_t* dictionaryId, std::string& payload);
+  bool decompress(uint32_t format, uint32_t dictionaryId, const char* payload, uint32_t payloadLength,
+		  uint32_t contentLength, std::string& content);
+  void appendLarge(uint32_t docId, const char* content, uint32_t length);
+  bool loadLarge(uint32_t docId, uint32_t* partCount, uint32_t* docLength);
+  bool loadPart(uint32_t docId, uint32_t part, std::string& content);
+  const std::string& getDictionary(uint32_t dictionaryId);
+
+public:
+  static const uint32_t BLOCK_SIZE;
+  static const uint32_t CACHE_SIZE;
+  static const uint32_t DICTIONARY_SIZE;
+
+  DocStore(DBM<char>* library);
+  virtual ~DocStore();
+
+  void load();
+  void reset();
+  bool get(uint32_t docId, std::string& content);
+  bool read(uint32_t docId, uint32_t begin, uint32_t length, std::string& content);
+  void put(uint32_t docId, const char* content, uint32_t length);
+  void append(uint32_t docId, const char* content, uint32_t length);
+  bool remove(uint32_t docId);
+  void trainDictionary(const std::vector<std::string>& samples);
+  bool sync();
+
+  static std::string buildDictionary(const std::vector<std::string>& samples, uint32_t dictionarySize);
+};
+
+}
+
+#endif // BB_DOC_STORE_HPP_
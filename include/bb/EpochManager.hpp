@@ -0,0 +1,74 @@
+/**
+ * EpochManager.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_EPOCH_MANAGER_HPP_
+#define BB_EPOCH_MANAGER_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <set>
+
+namespace bb {
+
+/**
+ * Numbers the versions of an index which a single writer publishes one
+ * after another. A reader pins the latest published epoch for as long as
+ * it needs a stable view; whatever the writer replaces after that epoch is
+ * kept until getOldestEpoch() has moved past the epoch that replaced it,
+ * that is until no reader pinned before the replacement is left.
+ *
+ * The writer's changes belong to getWriteEpoch(), one past the published
+ * epoch, until publish() makes them visible to the readers pinning next.
+ * LATEST_EPOCH stands for whatever is there, unpublished changes included.
+ * An epoch pinned already can be pinned once more for a reader sharing it,
+ * and each pin is unpinned on its own.
+ */
+class EpochManager
+{
+protected:
+  mutable pthread_mutex_t mutex;
+  uint64_t epoch;
+  std::multiset<uint64_t> pinned;
+
+public:
+  static const uint64_t LATEST_EPOCH;
+
+  EpochManager();
+  virtual ~EpochManager();
+
+  uint64_t pin();
+  uint64_t pin(uint64_t epoch);
+  void unpin(uint64_t epoch);
+  uint64_t publish();
+  uint64_t getEpoch() const;
+  uint64_t getWriteEpoch() const;
+  uint64_t getOldestEpoch() const;
+};
+
+}
+
+#endif // BB_EPOCH_MANAGER_HPP_
@@ -0,0 +1,79 @@
+/**
+ * Generation.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_GENERATION_HPP_
+#define BB_GENERATION_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+
+namespace bb {
+
+/**
+ * Tells processes which open a workspace read-only whether the single
+ * writer has changed it since. The writer counts a generation kept in a
+ * file of the workspace up to an odd number before it changes anything,
+ * and back to an even one once flush() or close() has put the changes in
+ * the files; in between it holds an exclusive lock on that file.
+ *
+ * A reader opens only at an even generation and holds a shared lock for
+ * the length of every call, which the writer waits for before its first
+ * change. Freed areas reused and records overwritten in place are thus
+ * never read halfway: once the generation has moved on, the reader is
+ * stale, its calls are refused, and it has to be reopened after the
+ * writer's next flush to see the new generation.
+ */
+class Generation
+{
+protected:
+  int fd;
+  bool readOnly;
+  bool writing;
+  uint64_t generation;
+  uint32_t readers;
+  mutable pthread_mutex_t mutex;
+
+  uint64_t load();
+  bool store(uint64_t generation);
+
+public:
+  Generation();
+  virtual ~Generation();
+
+  bool open(const char* path, bool readOnly);
+  void close();
+  uint64_t getGeneration() const;
+  bool isStale();
+  bool beginRead();
+  void endRead();
+  bool beginWrite();
+  bool endWrite();
+};
+
+}
+
+#endif // BB_GENERATION_HPP_
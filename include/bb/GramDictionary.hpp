@@ -0,0 +1,115 @@
+/**
+ * GramDictionary.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_GRAM_DICTIONARY_HPP_
+#define BB_GRAM_DICTIONARY_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bb {
+
+/**
+ * Every gram ever indexed, in byte order, each with a dense term ID given
+ * in the order grams first appear. Grams are kept in sorted tables which
+ * are memory-mapped and binary searched, each laid out as
+ *
+ *   (term count, string length) (offset, length, term ID)... strings
+ *
+ * Grams added since the last write wait in memory, and are written out as
+ * a table of their own by flush(), which runs on close() and whenever
+ * PENDING_LIMIT of them have piled up. The main file holds the oldest
+ * table, newer ones go next to it as path.1, path.2 and so on. A table is
+ * merged into the one before it as soon as it holds as many grams, so the
+ * tables at least double in size towards the main file, there are only
+ * about log2(count / PENDING_LIMIT) of them, and a gram is rewritten that
+ * many times at most rather than once per PENDING_LIMIT new grams. Grams
+ * whose postings are all removed stay.
+ *
+ * Lookups may run on other threads while grams are added. build() writes
+ * a whole table at once from grams already sorted, without holding them.
+ */
+class GramDictionary
+{
+protected:
+  struct Table
+  {
+    void* map;
+    uint32_t mapLength;
+    uint32_t termCount;
+    const uint32_t* entries;
+    const char* strings;
+  };
+
+  static const uint32_t HEADER_LENGTH;
+  static const uint32_t ENTRY_LENGTH;
+
+  std::string path;
+  std::vector<Table> tables;
+  std::map<std::string, uint32_t> pending;
+  uint32_t nextTermId;
+  mutable pthread_mutex_t mutex;
+
+  static std::string getTablePath(const std::string& path, uint32_t level);
+  static void removeTables(const std::string& path, uint32_t firstLevel);
+  static bool mapTable(const std::string& path, Table* table);
+  static void unmapTable(Table* table);
+  static std::string getTerm(const Table& table, uint32_t position);
+  static uint32_t getTermId(const Table& table, uint32_t position);
+  static uint32_t lowerBound(const Table& table, const std::string& gram);
+  static bool nextMerged(const Table& first, uint32_t* firstPosition, const Table& second, uint32_t* secondPosition,
+			 std::string* term, uint32_t* termId);
+
+  bool spill();
+  bool mergeTables();
+  bool lookup(const std::string& gram, uint32_t* termId) const;
+
+public:
+  static const uint32_t PENDING_LIMIT;
+
+  GramDictionary();
+  virtual ~GramDictionary();
+
+  bool open(const char* path);
+  bool create(const char* path);
+  void close();
+  bool flush();
+  uint32_t add(const std::string& gram);
+  bool find(const std::string& gram, uint32_t* termId) const;
+  void findPrefix(const std::string& prefix, uint32_t limit, std::vector<std::string>& grams) const;
+
+  static bool build(const char* path, FILE* grams);
+  uint32_t size() const;
+};
+
+}
+
+#endif // BB_GRAM_DICTIONARY_HPP_
@@ -0,0 +1,106 @@
+/**
+ * IndexBuilder.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_INDEX_BUILDER_HPP_
+#define BB_INDEX_BUILDER_HPP_
+
+#include <stdint.h>
+#include <cstdio>
+#include <istream>
+#include <string>
+#include <vector>
+#include "bb/Bitmap.hpp"
+#include "bb/Bubu.hpp"
+#include "bb/ThreadPool.hpp"
+
+namespace bb {
+
+/**
+ * Builds a new workspace from documents given in ascending docId order,
+ * without going through registerDoc. Contents and catalog entries are
+ * written as the documents come; their grams are tokenized on every core,
+ * a run of about RUN_SIZE bytes of content per thread, and each run is
+ * written sorted by gram to a file of its own. finish() then merges the
+ * runs, MERGE_FAN_IN at a time until one pass is left, and that last pass
+ * writes every posting list whole and without spare capacity, one record
+ * after another, along with the bitmaps and the gram dictionary. Memory
+ * stays bounded by the runs being tokenized and the MERGE_LIMIT postings
+ * held per gram; longer lists are appended in parts.
+ *
+ * A dump read by addDump() holds each document as a "docId length" line
+ * followed by that many bytes of content and a newline. The workspace is
+ * then opened with Bubu::open like any other.
+ */
+class IndexBuilder
+{
+protected:
+  class RunTask;
+
+  static const uint32_t RUN_SIZE;
+  static const uint32_t MERGE_FAN_IN;
+  static const uint32_t MERGE_LIMIT;
+  static const uint32_t MAX_BUCKET_LENGTH;
+
+  Bubu* bubu;
+  ThreadPool* threadPool;
+  std::string workspace;
+  uint32_t runSize;
+  uint32_t mergeFanIn;
+  uint32_t mergeLimit;
+  std::vector<std::pair<uint32_t, std::string> > pending;
+  uint64_t pendingSize;
+  std::vector<std::string> runs;
+  uint32_t nextRunId;
+  uint64_t gramEstimate;
+  uint32_t docCount;
+  uint64_t totalLength;
+  uint32_t nextDocId;
+
+  static uint32_t tokenizeDoc(Bubu* bubu, const char* docContent, std::vector<std::string>& grams,
+			      std::vector<uint32_t>& offsets, std::vector<uint32_t>& catalogValue);
+
+  void init(uint32_t threadCount);
+  std::string getRunPath();
+  bool tokenizeRuns();
+  bool mergeRuns(const std::vector<std::string>& runs, FILE* out, FILE* grams);
+  void writePostings(const std::string& gram, const std::vector<uint32_t>& postings, bool whole, Bitmap& docs);
+  void removeRuns();
+
+public:
+  IndexBuilder();
+  IndexBuilder(uint32_t threadCount);
+  virtual ~IndexBuilder();
+
+  bool create(const char* workspaceDir, uint32_t gramSize, bool indexUnigrams);
+  bool addDoc(uint32_t docId, const char* docContent);
+  bool addDump(std::istream& input);
+  bool finish();
+};
+
+}
+
+#endif // BB_INDEX_BUILDER_HPP_
@@ -0,0 +1,67 @@
+/**
+ * Intersection.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_INTERSECTION_HPP_
+#define BB_INTERSECTION_HPP_
+
+#include <stdint.h>
+
+namespace bb {
+
+/**
+ * Intersection kernels for sorted arrays. intersect() works on strictly
+ * increasing docIds; intersectPositions() works on (docId, offset)
+ * postings sorted by docId and then offset, and keeps the postings of a
+ * for which b holds (docId, offset + delta); offset + delta must not wrap.
+ *
+ * Both write the kept elements of a to out, which may be a itself, and
+ * return how many were kept. The SIMD kernels are compiled for their
+ * target and only run when the CPU reports support for it.
+ */
+class Intersection
+{
+public:
+  enum Kernel { SCALAR, GALLOP, SSE42, AVX2 };
+
+  static const uint32_t GALLOP_RATIO;
+
+  static bool isSupported(Kernel kernel);
+  static Kernel getBestKernel();
+
+  static uint32_t intersect(const uint32_t* a, uint32_t aLength,
+			    const uint32_t* b, uint32_t bLength, uint32_t* out);
+  static uint32_t intersect(Kernel kernel, const uint32_t* a, uint32_t aLength,
+			    const uint32_t* b, uint32_t bLength, uint32_t* out);
+  static uint32_t intersectPositions(const uint32_t* a, uint32_t aCount,
+				     const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out);
+  static uint32_t intersectPositions(Kernel kernel, const uint32_t* a, uint32_t aCount,
+				     const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out);
+};
+
+}
+
+#endif // BB_INTERSECTION_HPP_
@@ -0,0 +1,68 @@
+/**
+ * LZCodec.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_LZ_CODEC_HPP_
+#define BB_LZ_CODEC_HPP_
+
+#include <stdint.h>
+#include <string>
+
+namespace bb {
+
+/**
+ * A byte-oriented LZ77 codec in the manner of LZ4, fast enough to sit on
+ * the document read path. The output is a run of sequences, each a token
+ * holding the literal and match lengths in its two nibbles, the literals,
+ * a 16-bit match distance and any length overflow as 255-byte runs; the
+ * last sequence carries literals only.
+ *
+ * Both sides may be given the same dictionary, which then acts as text
+ * preceding the input; short inputs sharing phrases with it compress far
+ * better than on their own. Only its last MAX_DISTANCE bytes can be used.
+ */
+class LZCodec
+{
+protected:
+  static const uint32_t HASH_BITS;
+
+  static uint32_t hash(const char* bytes);
+  static void writeLength(uint32_t length, std::string& out);
+  static bool readLength(const unsigned char** in, const unsigned char* end, uint32_t* length);
+
+public:
+  static const uint32_t MIN_MATCH;
+  static const uint32_t MAX_DISTANCE;
+
+  static void compress(const char* src, uint32_t srcLength, const char* dictionary, uint32_t dictionaryLength,
+		       std::string& out);
+  static bool decompress(const char* src, uint32_t srcLength, const char* dictionary, uint32_t dictionaryLength,
+			 uint32_t rawLength, std::string& out);
+};
+
+}
+
+#endif // BB_LZ_CODEC_HPP_
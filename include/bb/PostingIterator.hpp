@@ -0,0 +1,104 @@
+/**
+ * PostingIterator.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_POSTING_ITERATOR_HPP_
+#define BB_POSTING_ITERATOR_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include "bb/DBM.hpp"
+#include "bb/PostingList.hpp"
+
+namespace bb {
+
+/**
+ * Walks the (docId, offset) postings of one gram in ascending order, reading
+ * the doc stream a block at a time instead of loading it whole. skipTo()
+ * and skipToDoc() binary search the block headers, so blocks ending before
+ * the target are never read, and the offsets of a document are only read
+ * once offset() asks for them; moving from document to document touches
+ * the doc stream alone. Given a minimum frequency, nextDoc() and
+ * skipToDoc() also pass over the blocks no document of which occurs more
+ * often than that, reading only their headers. Lists which are already in memory can be walked
+ * the same way; they are not copied and must outlive the iterator, unless
+ * they are handed over as plain (docId, offset) pairs to be encoded into
+ * storage the iterator owns.
+ */
+class PostingIterator
+{
+protected:
+  DBM<uint32_t>* index;
+  DBM<uint32_t>* positions;
+  PostingLocation location;
+  const uint32_t* positionValue;
+  uint32_t blockCount;
+  uint32_t* buffer;
+  const uint32_t* block;
+  uint32_t blockIndex;
+  uint32_t blockDocCount;
+  uint32_t docPosition;
+  uint32_t positionBegin;
+  std::vector<uint32_t> offsetBuffer;
+  const uint32_t* offsets;
+  uint32_t offsetPosition;
+  bool started;
+  uint32_t loadedBlocks;
+  std::vector<uint32_t> docStorage;
+  std::vector<uint32_t> positionStorage;
+
+  void init();
+  bool loadBlock(uint32_t blockIndex);
+  bool loadBlockAbove(uint32_t blockIndex, uint32_t minFrequency);
+  void moveToDoc(uint32_t docPosition);
+  bool loadOffsets();
+  uint32_t readLastDocId(uint32_t blockIndex);
+  uint32_t readMaxFrequency(uint32_t blockIndex);
+
+public:
+  PostingIterator(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram);
+  PostingIterator(DBM<uint32_t>* index, DBM<uint32_t>* positions, const PostingLocation& location);
+  PostingIterator(const uint32_t* docValue, uint32_t docLength, const uint32_t* positionValue, uint32_t positionLength);
+  explicit PostingIterator(const std::vector<uint32_t>& postings);
+  virtual ~PostingIterator();
+
+  bool next();
+  bool nextDoc();
+  bool nextDoc(uint32_t minFrequency);
+  bool skipTo(uint32_t docId, uint32_t offset);
+  bool skipToDoc(uint32_t docId);
+  bool skipToDoc(uint32_t docId, uint32_t minFrequency);
+  bool atEnd() const;
+  uint32_t size() const;
+  uint32_t docId() const;
+  uint32_t termFrequency() const;
+  uint32_t countLoadedBlocks() const;
+  uint32_t offset();
+};
+
+}
+
+#endif // BB_POSTING_ITERATOR_HPP_
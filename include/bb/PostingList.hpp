@@ -0,0 +1,107 @@
+/**
+ * PostingList.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_POSTING_LIST_HPP_
+#define BB_POSTING_LIST_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "bb/DBM.hpp"
+
+namespace bb {
+
+/**
+ * Where the two streams of one gram's postings are stored.
+ */
+struct PostingLocation
+{
+  uint64_t docOffset;
+  uint32_t docLength;
+  uint64_t positionOffset;
+  uint32_t positionLength;
+};
+
+/**
+ * Layout of a gram's postings, split into two values under the gram's key.
+ *
+ * The doc stream in the index holds one (docId, term frequency) entry per
+ * document, in blocks of BLOCK_LENGTH entries led by a header of (first
+ * docId, last docId, entry count, first position, max term frequency).
+ * Every block but the last is full, so block b always starts at word
+ * b * BLOCK_STRIDE and a reader can binary search the headers without
+ * decoding any entries. The max term frequency bounds the score of every
+ * document in the block, so ranking can pass over whole blocks.
+ *
+ * The position stream in the positions file holds the offsets of every
+ * document one after another in docId order; a block header tells where
+ * the offsets of its first document begin, so doc-level work never has to
+ * read them.
+ *
+ * append() tops up the last block in place, so a reader holding a shorter
+ * length than the stream now has counts only the entries within it. Postings
+ * of the document last in the list continue its entry.
+ *
+ * This layout is not compatible with index files written before it, which
+ * hold one value of (docId, offset) pairs per gram and no positions file.
+ * Those can no longer be read as they are; Bubu::open converts a workspace
+ * of the original flat layout and refuses the block layouts in between.
+ */
+class PostingList
+{
+public:
+  static const uint32_t BLOCK_LENGTH;
+  static const uint32_t HEADER_LENGTH;
+  static const uint32_t BLOCK_STRIDE;
+
+  static uint32_t countBlocks(uint32_t docLength);
+  static uint32_t countBlockDocs(const uint32_t* block, uint32_t length);
+  static uint32_t countDocs(uint32_t docLength);
+  static void encode(const uint32_t* postings, uint32_t postingCount, uint32_t positionBegin,
+		     std::vector<uint32_t>& docValue, std::vector<uint32_t>& positionValue);
+  static void decode(const uint32_t* docValue, uint32_t docLength, const uint32_t* positionValue,
+		     std::vector<uint32_t>& postings);
+  static void decodeDocs(const uint32_t* docValue, uint32_t docLength, std::vector<uint32_t>& docs);
+  static bool locate(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram, PostingLocation* location);
+  static bool locate(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram, PostingLocation* location,
+		     uint64_t epoch);
+  static bool locateAll(DBM<uint32_t>* index, DBM<uint32_t>* positions, AsyncReader* reader,
+			const std::vector<std::string>& grams, std::vector<PostingLocation>& locations);
+  static bool locateAll(DBM<uint32_t>* index, DBM<uint32_t>* positions, AsyncReader* reader,
+			const std::vector<std::string>& grams, std::vector<PostingLocation>& locations,
+			uint64_t epoch);
+  static uint32_t append(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram,
+			 const std::vector<uint32_t>& postings);
+  static bool get(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram, std::vector<uint32_t>& postings);
+  static bool getDocs(DBM<uint32_t>* index, const char* gram, std::vector<uint32_t>& docs);
+  static void set(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram,
+		  const std::vector<uint32_t>& postings);
+};
+
+}
+
+#endif // BB_POSTING_LIST_HPP_
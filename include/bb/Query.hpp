@@ -0,0 +1,123 @@
+/**
+ * Query.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_QUERY_HPP_
+#define BB_QUERY_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include "bb/SearchCursor.hpp"
+
+namespace bb {
+
+/**
+ * A node of a boolean query tree. Every node enumerates the ids of the
+ * documents it matches in ascending order, so that nodes combine by
+ * leapfrogging over each other instead of materializing their results.
+ */
+class Query
+{
+public:
+  virtual ~Query() {}
+
+  virtual bool next() = 0;
+  virtual bool skipTo(uint32_t docId) = 0;
+  virtual uint32_t docId() const = 0;
+};
+
+class PhraseQuery : public Query
+{
+protected:
+  SearchCursor* cursor;
+  bool started;
+
+public:
+  PhraseQuery(SearchCursor* cursor);
+  virtual ~PhraseQuery();
+
+  virtual bool next();
+  virtual bool skipTo(uint32_t docId);
+  virtual uint32_t docId() const;
+};
+
+class AndQuery : public Query
+{
+protected:
+  std::vector<Query*> children;
+
+  bool align();
+
+public:
+  AndQuery(const std::vector<Query*>& children);
+  virtual ~AndQuery();
+
+  virtual bool next();
+  virtual bool skipTo(uint32_t docId);
+  virtual uint32_t docId() const;
+};
+
+class OrQuery : public Query
+{
+protected:
+  std::vector<Query*> children;
+  std::vector<bool> alive;
+  uint32_t currentDocId;
+  bool started;
+
+  bool update();
+
+public:
+  OrQuery(const std::vector<Query*>& children);
+  virtual ~OrQuery();
+
+  virtual bool next();
+  virtual bool skipTo(uint32_t docId);
+  virtual uint32_t docId() const;
+};
+
+class NotQuery : public Query
+{
+protected:
+  Query* include;
+  Query* exclude;
+  bool excludeAlive;
+  bool excludeStarted;
+
+  bool align();
+
+public:
+  NotQuery(Query* include, Query* exclude);
+  virtual ~NotQuery();
+
+  virtual bool next();
+  virtual bool skipTo(uint32_t docId);
+  virtual uint32_t docId() const;
+};
+
+}
+
+#endif // BB_QUERY_HPP_
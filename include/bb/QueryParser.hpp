@@ -0,0 +1,81 @@
+/**
+ * QueryParser.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_QUERY_PARSER_HPP_
+#define BB_QUERY_PARSER_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "bb/DBM.hpp"
+#include "bb/Query.hpp"
+
+namespace bb {
+
+class Bubu;
+
+/**
+ * Builds a query tree from an expression such as
+ *
+ *   "foo" AND ("bar" OR baz) NOT "qux"
+ *
+ * Adjacent terms are joined by AND, and OR binds loosest. Every distinct
+ * gram is located in the index only once, however many phrases share it.
+ * Given an epoch the caller has pinned, every phrase reads that epoch and
+ * pins it once more for as long as its cursor lives.
+ */
+class QueryParser
+{
+protected:
+  Bubu* bubu;
+  DBM<uint32_t>* index;
+  DBM<uint32_t>* positions;
+  uint32_t gramSize;
+  uint64_t epoch;
+  std::map<std::string, PostingLocation> locations;
+  const char* cursor;
+
+  Query* parseOr();
+  Query* parseAnd();
+  Query* parsePrimary();
+  Query* createPhrase(const std::string& phrase);
+  std::string readWord();
+  bool acceptKeyword(const char* keyword);
+  bool matchKeyword(const char* keyword) const;
+  void skipSpaces();
+
+public:
+  explicit QueryParser(Bubu* bubu);
+  QueryParser(Bubu* bubu, uint64_t epoch);
+  virtual ~QueryParser();
+
+  Query* parse(const char* expression);
+};
+
+}
+
+#endif // BB_QUERY_PARSER_HPP_
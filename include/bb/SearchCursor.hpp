@@ -0,0 +1,89 @@
+/**
+ * SearchCursor.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_SEARCH_CURSOR_HPP_
+#define BB_SEARCH_CURSOR_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "bb/Bitmap.hpp"
+#include "bb/DBM.hpp"
+#include "bb/PostingIterator.hpp"
+
+namespace bb {
+
+/**
+ * Lazily enumerates the hits of a phrase query in (docId, offset) order.
+ * Each call pulls only as many postings as are needed to reach the next
+ * hit, so memory use does not depend on the number of results. Grams are
+ * first brought to a common document through their doc streams, and
+ * offsets are only read for documents which hold every gram. Each gram
+ * comes with its offset within the phrase, the first one's being zero.
+ *
+ * Grams dense enough to have a bitmap can be handed over ANDed into one
+ * filter. Documents missing from it are leapt over without reading any
+ * doc stream, and the doc streams of the filtered grams are only read
+ * for the offsets of documents which hold every gram.
+ *
+ * A cursor reading its postings as it goes can be handed the epoch they
+ * were located at, pinned for it, and unpins it once deleted.
+ */
+class SearchCursor
+{
+protected:
+  std::vector<PostingIterator*> iterators;
+  std::vector<uint32_t> offsets;
+  Bitmap filter;
+  std::vector<bool> filtered;
+  EpochManager* epochs;
+  uint64_t epoch;
+  bool exhausted;
+
+  bool align();
+  bool alignDocs();
+  bool alignOffsets();
+  bool finish();
+
+public:
+  SearchCursor(DBM<uint32_t>* index, DBM<uint32_t>* positions, const std::vector<std::string>& grams,
+	       const std::vector<uint32_t>& offsets);
+  SearchCursor(const std::vector<PostingIterator*>& iterators, const std::vector<uint32_t>& offsets);
+  SearchCursor(const std::vector<PostingIterator*>& iterators, const std::vector<uint32_t>& offsets,
+	       const Bitmap& filter, const std::vector<bool>& filtered);
+  virtual ~SearchCursor();
+
+  void holdEpoch(EpochManager* epochs, uint64_t epoch);
+  bool next();
+  bool skipTo(uint32_t docId);
+  uint32_t docId() const;
+  uint32_t offset() const;
+};
+
+}
+
+#endif // BB_SEARCH_CURSOR_HPP_
@@ -0,0 +1,103 @@
+/**
+ * ShardedBubu.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_SHARDED_BUBU_HPP_
+#define BB_SHARDED_BUBU_HPP_
+
+#include <stdint.h>
+#include <istream>
+#include <string>
+#include <vector>
+#include "bb/Bubu.hpp"
+#include "bb/ThreadPool.hpp"
+
+namespace bb {
+
+/**
+ * Spreads documents over several Bubu workspaces, docId modulo the shard
+ * count, kept in subdirectories of one workspace directory. Each shard has
+ * files of its own, so batches of documents are registered on all shards
+ * at once, and searches run on every shard in parallel before their
+ * results are merged back into docId order.
+ *
+ * Ranking adds up the statistics of all shards before any shard scores,
+ * so that scores are those of a single workspace holding every document.
+ * Opened read-only, the workspace is stale as soon as any shard is, and
+ * a read is refused, as Bubu refuses it, unless every shard serves it.
+ */
+class ShardedBubu
+{
+protected:
+  static const char* SETTINGS_FILE;
+  static const char* SHARDS_KEY;
+
+  std::vector<Bubu*> shards;
+  ThreadPool* threadPool;
+
+  static std::string getShardPath(const std::string& workspace, uint32_t shard);
+
+  ThreadPool* getThreadPool();
+  Bubu* getShard(uint32_t docId);
+  bool openShards(const std::string& workspace, uint32_t shardCount, bool creating, bool readOnly,
+		  uint32_t gramSize, bool indexUnigrams);
+
+public:
+  ShardedBubu();
+  virtual ~ShardedBubu();
+
+  bool open(const char* workspaceDir);
+  bool open(const char* workspaceDir, bool readOnly);
+  bool create(const char* workspaceDir, uint32_t shardCount);
+  bool create(const char* workspaceDir, uint32_t shardCount, uint32_t gramSize);
+  bool create(const char* workspaceDir, uint32_t shardCount, uint32_t gramSize, bool indexUnigrams);
+  void close();
+  bool flush();
+  uint32_t getShardCount() const;
+  bool isStale();
+  std::vector<std::pair<uint32_t, uint32_t> > search(const char* query);
+  bool search(const char* query, std::vector<std::pair<uint32_t, uint32_t> >& hits);
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > searchBatch(const std::vector<std::string>& queries);
+  bool searchBatch(const std::vector<std::string>& queries,
+		   std::vector<std::vector<std::pair<uint32_t, uint32_t> > >& hits);
+  std::vector<std::pair<uint32_t, double> > searchTopK(const char* query, uint32_t k);
+  bool searchTopK(const char* query, uint32_t k, std::vector<std::pair<uint32_t, double> >& results);
+  std::vector<uint32_t> searchQuery(const char* expression);
+  bool searchQuery(const char* expression, std::vector<uint32_t>& docIds);
+  void registerDoc(uint32_t docId, const char* docContent);
+  void registerDoc(uint32_t docId, std::istream& input);
+  void registerDocs(const std::vector<std::pair<uint32_t, std::string> >& docs);
+  void updateDoc(uint32_t docId, const char* docContent);
+  void unregisterDoc(uint32_t docId);
+  std::string getDocContent(uint32_t docId);
+  bool getDocContent(uint32_t docId, std::string& docContent);
+  std::string getSnippet(uint32_t docId, uint32_t offset, uint32_t window);
+  bool getSnippet(uint32_t docId, uint32_t offset, uint32_t window, std::string& snippet);
+};
+
+}
+
+#endif // BB_SHARDED_BUBU_HPP_
@@ -0,0 +1,91 @@
+/**
+ * ThreadPool.hpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BB_THREAD_POOL_HPP_
+#define BB_THREAD_POOL_HPP_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+namespace bb {
+
+class Task
+{
+public:
+  virtual ~Task() {}
+  virtual void run() = 0;
+};
+
+/**
+ * A fixed set of worker threads running submitted tasks. Tasks are not
+ * owned by the pool; the caller keeps them alive until wait() returns.
+ *
+ * Each worker has its own deque. Submitted tasks are dealt out to the
+ * deques in turn; a worker takes from the back of its own deque and, once
+ * that is empty, steals from the front of the others, so uneven tasks do
+ * not leave threads idle.
+ */
+class ThreadPool
+{
+protected:
+  struct Worker
+  {
+    ThreadPool* pool;
+    uint32_t index;
+    pthread_t thread;
+    bool running;
+    std::deque<Task*> tasks;
+    pthread_mutex_t mutex;
+  };
+
+  std::vector<Worker*> workers;
+  pthread_mutex_t mutex;
+  pthread_cond_t taskAvailable;
+  pthread_cond_t tasksDone;
+  uint32_t queuedCount;
+  uint32_t pendingCount;
+  uint32_t runningCount;
+  uint32_t nextWorker;
+  bool stopping;
+
+  static void* work(void* worker);
+  Task* takeTask(uint32_t index);
+
+public:
+  ThreadPool(uint32_t threadCount);
+  virtual ~ThreadPool();
+
+  void submit(Task* task);
+  void wait();
+  uint32_t size() const;
+};
+
+}
+
+#endif // BB_THREAD_POOL_HPP_
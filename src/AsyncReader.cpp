@@ -0,0 +1,233 @@
+/**
+ * AsyncReader.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "bb/AsyncReader.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BB_ASYNC_READER_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using bb::AsyncReader;
+
+const uint32_t AsyncReader::DEFAULT_DEPTH = 64;
+
+AsyncReader::AsyncReader()
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+  this->setup(AsyncReader::DEFAULT_DEPTH);
+}
+
+AsyncReader::AsyncReader(uint32_t depth)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+  this->setup(std::max(depth, 1U));
+}
+
+AsyncReader::~AsyncReader()
+{
+  this->teardown();
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+bool AsyncReader::isAsync() const
+{
+  return this->ringFd >= 0;
+}
+
+void AsyncReader::readAll(std::vector<Request>& requests)
+{
+  // a ring that fails midway is given up on, and whatever it did not
+  // complete is read synchronously below
+  for (size_t i = 0; i < requests.size(); ++i) requests[i].result = -EAGAIN;
+  pthread_mutex_lock(&(this->mutex));
+  for (size_t begin = 0; begin < requests.size() && this->ringFd >= 0; begin += this->depth) {
+    uint32_t count = std::min((size_t) this->depth, requests.size() - begin);
+    if (!this->readRing(requests, begin, count)) this->teardown();
+  }
+  pthread_mutex_unlock(&(this->mutex));
+
+  // requests the ring rejected (such as on kernels without plain reads)
+  // or cut short are finished off with pread
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (requests[i].result < 0 || (uint64_t) requests[i].result < requests[i].length) {
+      AsyncReader::readSync(requests[i]);
+    }
+  }
+}
+
+void AsyncReader::readSync(Request& request)
+{
+  uint64_t done = 0;
+  while (done < request.length) {
+    ssize_t readSize = pread(request.fd, (char*) request.buffer + done, request.length - done, request.offset + done);
+    if (readSize < 0 && errno == EINTR) continue;
+    if (readSize < 0 && done == 0) {
+      request.result = -errno;
+      return;
+    }
+    if (readSize <= 0) break;
+    done += readSize;
+  }
+  request.result = done;
+}
+
+#ifdef BB_ASYNC_READER_URING
+
+void AsyncReader::setup(uint32_t depth)
+{
+  this->ringFd = -1;
+  this->depth = 0;
+  this->sqRing = MAP_FAILED;
+  this->cqRing = MAP_FAILED;
+  this->sqes = MAP_FAILED;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, depth, &params);
+  if (fd < 0) return;
+  this->ringFd = fd;
+  this->depth = params.sq_entries;
+
+  // both rings share one mapping where the kernel allows it
+  this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMap) this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+
+  this->sqRing = mmap(NULL, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		      fd, IORING_OFF_SQ_RING);
+  if (this->sqRing != MAP_FAILED) {
+    this->cqRing = singleMap ? this->sqRing : mmap(NULL, this->cqRingSize, PROT_READ | PROT_WRITE,
+						   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  this->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  if (this->cqRing != MAP_FAILED) {
+    this->sqes = mmap(NULL, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		      fd, IORING_OFF_SQES);
+  }
+  if (this->sqes == MAP_FAILED) {
+    this->teardown();
+    return;
+  }
+
+  char* sq = (char*) this->sqRing;
+  char* cq = (char*) this->cqRing;
+  this->sqTail = (unsigned*) (sq + params.sq_off.tail);
+  this->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+  this->sqArray = (unsigned*) (sq + params.sq_off.array);
+  this->cqHead = (unsigned*) (cq + params.cq_off.head);
+  this->cqTail = (unsigned*) (cq + params.cq_off.tail);
+  this->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+  this->cqes = cq + params.cq_off.cqes;
+}
+
+void AsyncReader::teardown()
+{
+  if (this->sqes != MAP_FAILED) munmap(this->sqes, this->sqesSize);
+  if (this->cqRing != MAP_FAILED && this->cqRing != this->sqRing) munmap(this->cqRing, this->cqRingSize);
+  if (this->sqRing != MAP_FAILED) munmap(this->sqRing, this->sqRingSize);
+  if (this->ringFd >= 0) ::close(this->ringFd);
+  this->sqes = MAP_FAILED;
+  this->cqRing = MAP_FAILED;
+  this->sqRing = MAP_FAILED;
+  this->ringFd = -1;
+}
+
+bool AsyncReader::readRing(std::vector<Request>& requests, size_t begin, uint32_t count)
+{
+  // this thread is the only producer, so the tail needs no ordering until
+  // it is published to the kernel
+  unsigned tail = *(this->sqTail);
+  struct io_uring_sqe* sqes = (struct io_uring_sqe*) this->sqes;
+  for (uint32_t i = 0; i < count; ++i) {
+    Request& request = requests[begin + i];
+    unsigned index = tail & *(this->sqMask);
+    struct io_uring_sqe* sqe = sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = request.fd;
+    sqe->off = request.offset;
+    sqe->addr = (uint64_t) (uintptr_t) request.buffer;
+    sqe->len = request.length;
+    sqe->user_data = begin + i;
+    *(this->sqArray + index) = index;
+    ++tail;
+  }
+  __atomic_store_n(this->sqTail, tail, __ATOMIC_RELEASE);
+
+  uint32_t submitted = 0;
+  uint32_t completed = 0;
+  struct io_uring_cqe* cqes = (struct io_uring_cqe*) this->cqes;
+  while (completed < count) {
+    int result = syscall(__NR_io_uring_enter, this->ringFd, count - submitted, count - completed,
+			 IORING_ENTER_GETEVENTS, NULL, 0);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    submitted += result;
+
+    unsigned head = *(this->cqHead);
+    while (head != __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe* cqe = cqes + (head & *(this->cqMask));
+      requests[cqe->user_data].result = cqe->res;
+      ++head;
+      ++completed;
+    }
+    __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  return true;
+}
+
+#else
+
+void AsyncReader::setup(uint32_t depth)
+{
+  this->ringFd = -1;
+  this->depth = depth;
+}
+
+void AsyncReader::teardown()
+{
+}
+
+bool AsyncReader::readRing(std::vector<Request>& requests, size_t begin, uint32_t count)
+{
+  return false;
+}
+
+#endif // BB_ASYNC_READER_URING
@@ -0,0 +1,463 @@
+/**
+ * Bitmap.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "bb/Bitmap.hpp"
+
+using bb::DBM;
+using bb::Bitmap;
+
+namespace {
+
+uint32_t countBits(uint64_t word)
+{
+  return __builtin_popcountll(word);
+}
+
+}
+
+const uint32_t Bitmap::ARRAY_LIMIT = 4096;
+const uint32_t Bitmap::BITMAP_LENGTH = 2048;
+const uint32_t Bitmap::HEADER_LENGTH = 3;
+
+Bitmap::Bitmap() : cardinality(0)
+{
+}
+
+Bitmap::Bitmap(const uint32_t* value, uint32_t valueLength) : cardinality(0)
+{
+  if (valueLength < Bitmap::HEADER_LENGTH) return;
+
+  uint32_t containerCount = *(value + 1);
+  uint32_t begin = Bitmap::HEADER_LENGTH;
+  for (uint32_t c = 0; c < containerCount && begin + 2 <= valueLength; ++c) {
+    Container container;
+    container.key = *(value + begin);
+    container.cardinality = *(value + begin + 1);
+    const uint32_t* payload = value + begin + 2;
+
+    // the last container may have grown in place past the length read
+    if (container.cardinality > Bitmap::ARRAY_LIMIT) {
+      if (begin + 2 + Bitmap::BITMAP_LENGTH > valueLength) break;
+      container.bits.resize(Bitmap::BITMAP_LENGTH / 2);
+      for (uint32_t w = 0; w < Bitmap::BITMAP_LENGTH / 2; ++w) {
+	container.bits[w] = ((uint64_t) *(payload + w * 2 + 1) << 32) | *(payload + w * 2);
+      }
+      begin += 2 + Bitmap::BITMAP_LENGTH;
+    }
+    else {
+      container.cardinality = std::min(container.cardinality, (valueLength - begin - 2) * 2);
+      for (uint32_t i = 0; i < container.cardinality; ++i) {
+	uint32_t word = *(payload + i / 2);
+	container.values.push_back((i % 2) ? word >> 16 : word & 0xffff);
+      }
+      begin += 2 + (container.cardinality + 1) / 2;
+    }
+
+    this->cardinality += container.cardinality;
+    this->containers.push_back(container);
+  }
+}
+
+std::vector<Bitmap::Container>::iterator Bitmap::findContainer(uint32_t key)
+{
+  std::vector<Container>::iterator iter = this->containers.begin();
+  uint32_t low = 0;
+  uint32_t high = this->containers.size();
+  while (low < high) {
+    uint32_t middle = (low + high) / 2;
+    if (this->containers[middle].key < key) low = middle + 1;
+    else high = middle;
+  }
+  return iter + low;
+}
+
+std::vector<Bitmap::Container>::const_iterator Bitmap::findContainer(uint32_t key) const
+{
+  return const_cast<Bitmap*>(this)->findContainer(key);
+}
+
+void Bitmap::toBitmap(Container& container)
+{
+  container.bits.assign(Bitmap::BITMAP_LENGTH / 2, 0);
+  std::vector<uint16_t>::iterator iter = container.values.begin();
+  while (iter != container.values.end()) {
+    container.bits[*iter >> 6] |= (uint64_t) 1 << (*iter & 63);
+    ++iter;
+  }
+  container.values.clear();
+}
+
+void Bitmap::toArray(Container& container)
+{
+  container.values.clear();
+  for (uint32_t w = 0; w < container.bits.size(); ++w) {
+    uint64_t word = container.bits[w];
+    while (word != 0) {
+      container.values.push_back(w * 64 + __builtin_ctzll(word));
+      word &= word - 1;
+    }
+  }
+  container.bits.clear();
+}
+
+void Bitmap::intersectContainer(Container& container, const Container& other)
+{
+  if (container.isBitmap() && other.isBitmap()) {
+    uint32_t cardinality = 0;
+    for (uint32_t w = 0; w < container.bits.size(); ++w) {
+      container.bits[w] &= other.bits[w];
+      cardinality += countBits(container.bits[w]);
+    }
+    container.cardinality = cardinality;
+    if (cardinality <= Bitmap::ARRAY_LIMIT) Bitmap::toArray(container);
+    return;
+  }
+
+  if (container.isBitmap()) Bitmap::toArray(container);
+
+  std::vector<uint16_t>::iterator out = container.values.begin();
+  std::vector<uint16_t>::iterator iter = container.values.begin();
+  if (other.isBitmap()) {
+    for (; iter != container.values.end(); ++iter) {
+      if (other.bits[*iter >> 6] & ((uint64_t) 1 << (*iter & 63))) *(out++) = *iter;
+    }
+  }
+  else {
+    std::vector<uint16_t>::const_iterator otherIter = other.values.begin();
+    while (iter != container.values.end() && otherIter != other.values.end()) {
+      if (*iter < *otherIter) {
+	++iter;
+      }
+      else if (*otherIter < *iter) {
+	++otherIter;
+      }
+      else {
+	*(out++) = *iter;
+	++iter;
+	++otherIter;
+      }
+    }
+  }
+  container.values.erase(out, container.values.end());
+  container.cardinality = container.values.size();
+}
+
+void Bitmap::add(uint32_t docId)
+{
+  uint32_t key = docId >> 16;
+  uint16_t low = docId & 0xffff;
+
+  std::vector<Container>::iterator iter = this->findContainer(key);
+  if (iter == this->containers.end() || iter->key != key) {
+    Container container;
+    container.key = key;
+    container.cardinality = 0;
+    iter = this->containers.insert(iter, container);
+  }
+
+  if (iter->isBitmap()) {
+    uint64_t bit = (uint64_t) 1 << (low & 63);
+    if (iter->bits[low >> 6] & bit) return;
+    iter->bits[low >> 6] |= bit;
+  }
+  else {
+    std::vector<uint16_t>::iterator position = std::lower_bound(iter->values.begin(), iter->values.end(), low);
+    if (position != iter->values.end() && *position == low) return;
+    iter->values.insert(position, low);
+    if (iter->values.size() > Bitmap::ARRAY_LIMIT) Bitmap::toBitmap(*iter);
+  }
+
+  ++(iter->cardinality);
+  ++(this->cardinality);
+}
+
+void Bitmap::remove(uint32_t docId)
+{
+  uint32_t key = docId >> 16;
+  uint16_t low = docId & 0xffff;
+
+  std::vector<Container>::iterator iter = this->findContainer(key);
+  if (iter == this->containers.end() || iter->key != key) return;
+
+  if (iter->isBitmap()) {
+    uint64_t bit = (uint64_t) 1 << (low & 63);
+    if (!(iter->bits[low >> 6] & bit)) return;
+    iter->bits[low >> 6] &= ~bit;
+    if (iter->cardinality - 1 <= Bitmap::ARRAY_LIMIT) Bitmap::toArray(*iter);
+  }
+  else {
+    std::vector<uint16_t>::iterator position = std::lower_bound(iter->values.begin(), iter->values.end(), low);
+    if (position == iter->values.end() || *position != low) return;
+    iter->values.erase(position);
+  }
+
+  --(iter->cardinality);
+  --(this->cardinality);
+  if (iter->cardinality == 0) this->containers.erase(iter);
+}
+
+bool Bitmap::contains(uint32_t docId) const
+{
+  uint32_t key = docId >> 16;
+  uint16_t low = docId & 0xffff;
+
+  std::vector<Container>::const_iterator iter = this->findContainer(key);
+  if (iter == this->containers.end() || iter->key != key) return false;
+
+  if (iter->isBitmap()) {
+    return (iter->bits[low >> 6] >> (low & 63)) & 1;
+  }
+  else {
+    return std::binary_search(iter->values.begin(), iter->values.end(), low);
+  }
+}
+
+// Finds the smallest docId of the set not below the one given.
+bool Bitmap::findNext(uint32_t docId, uint32_t* next) const
+{
+  uint32_t key = docId >> 16;
+  std::vector<Container>::const_iterator iter = this->findContainer(key);
+  for (; iter != this->containers.end(); ++iter) {
+    uint32_t from = (iter->key == key) ? (docId & 0xffff) : 0;
+    if (iter->isBitmap()) {
+      for (uint32_t w = from >> 6; w < iter->bits.size(); ++w) {
+	uint64_t word = iter->bits[w];
+	if (w == from >> 6) word &= ~0ULL << (from & 63);
+	if (word != 0) {
+	  *next = (iter->key << 16) | (w * 64 + __builtin_ctzll(word));
+	  return true;
+	}
+      }
+    }
+    else {
+      std::vector<uint16_t>::const_iterator valueIter =
+	std::lower_bound(iter->values.begin(), iter->values.end(), from);
+      if (valueIter != iter->values.end()) {
+	*next = (iter->key << 16) | *valueIter;
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint32_t Bitmap::size() const
+{
+  return this->cardinality;
+}
+
+void Bitmap::intersect(const Bitmap& other)
+{
+  std::vector<Container>::iterator out = this->containers.begin();
+  std::vector<Container>::iterator iter = this->containers.begin();
+  std::vector<Container>::const_iterator otherIter = other.containers.begin();
+  this->cardinality = 0;
+
+  while (iter != this->containers.end() && otherIter != other.containers.end()) {
+    if (iter->key < otherIter->key) {
+      ++iter;
+    }
+    else if (otherIter->key < iter->key) {
+      ++otherIter;
+    }
+    else {
+      Bitmap::intersectContainer(*iter, *otherIter);
+      if (iter->cardinality > 0) {
+	this->cardinality += iter->cardinality;
+	if (out != iter) {
+	  out->key = iter->key;
+	  out->cardinality = iter->cardinality;
+	  out->values.swap(iter->values);
+	  out->bits.swap(iter->bits);
+	}
+	++out;
+      }
+      ++iter;
+      ++otherIter;
+    }
+  }
+  this->containers.erase(out, this->containers.end());
+}
+
+void Bitmap::toVector(std::vector<uint32_t>& docIds) const
+{
+  docIds.clear();
+  docIds.reserve(this->cardinality);
+
+  std::vector<Container>::const_iterator iter = this->containers.begin();
+  while (iter != this->containers.end()) {
+    uint32_t high = iter->key << 16;
+    if (iter->isBitmap()) {
+      for (uint32_t w = 0; w < iter->bits.size(); ++w) {
+	uint64_t word = iter->bits[w];
+	while (word != 0) {
+	  docIds.push_back(high | (w * 64 + __builtin_ctzll(word)));
+	  word &= word - 1;
+	}
+      }
+    }
+    else {
+      std::vector<uint16_t>::const_iterator valueIter = iter->values.begin();
+      while (valueIter != iter->values.end()) {
+	docIds.push_back(high | *valueIter);
+	++valueIter;
+      }
+    }
+    ++iter;
+  }
+}
+
+void Bitmap::encode(std::vector<uint32_t>& value) const
+{
+  value.clear();
+  value.push_back(this->cardinality);
+  value.push_back(this->containers.size());
+  value.push_back(0);
+
+  std::vector<Container>::const_iterator iter = this->containers.begin();
+  while (iter != this->containers.end()) {
+    value[2] = value.size();
+    value.push_back(iter->key);
+    value.push_back(iter->cardinality);
+    if (iter->isBitmap()) {
+      for (uint32_t w = 0; w < iter->bits.size(); ++w) {
+	value.push_back((uint32_t) iter->bits[w]);
+	value.push_back((uint32_t) (iter->bits[w] >> 32));
+      }
+    }
+    else {
+      for (uint32_t i = 0; i < iter->values.size(); i += 2) {
+	uint32_t word = iter->values[i];
+	if (i + 1 < iter->values.size()) word |= (uint32_t) iter->values[i + 1] << 16;
+	value.push_back(word);
+      }
+    }
+    ++iter;
+  }
+}
+
+bool Bitmap::get(DBM<uint32_t>* index, const char* key, Bitmap& bitmap)
+{
+  uint32_t valueLength;
+  uint32_t* value = index->get(key, &valueLength);
+  if (value == NULL) {
+    bitmap = Bitmap();
+    return false;
+  }
+
+  bitmap = Bitmap(value, valueLength);
+  delete[] value;
+
+  return true;
+}
+
+void Bitmap::set(DBM<uint32_t>* index, const char* key, const Bitmap& bitmap)
+{
+  if (bitmap.size() == 0) {
+    index->remove(key);
+    return;
+  }
+
+  std::vector<uint32_t> value;
+  bitmap.encode(value);
+  index->set(key, &value[0], value.size());
+}
+
+bool Bitmap::append(DBM<uint32_t>* index, const char* key, uint32_t docId)
+{
+  uint64_t valueOffset;
+  uint32_t valueLength;
+  if (!index->locate(key, &valueOffset, &valueLength)) return false;
+
+  uint32_t containerKey = docId >> 16;
+  uint32_t low = docId & 0xffff;
+  uint32_t header[3] = { 0, 0, 0 };
+  uint32_t containerHeader[2] = { 0, 0 };
+  index->read(valueOffset, 0, header, Bitmap::HEADER_LENGTH);
+  if (header[1] > 0) index->read(valueOffset, header[2], containerHeader, 2);
+  uint32_t payloadBegin = header[2] + 2;
+
+  // a docId past the last container opens a new one at the end
+  if (header[1] == 0 || containerHeader[0] < containerKey) {
+    uint32_t container[3] = { containerKey, 1, low };
+    ++header[0];
+    ++header[1];
+    header[2] = valueLength;
+    index->write(valueOffset, 0, header, Bitmap::HEADER_LENGTH);
+    index->append(key, container, 3);
+    return true;
+  }
+
+  if (containerHeader[0] == containerKey && containerHeader[1] > Bitmap::ARRAY_LIMIT) {
+    uint32_t word;
+    uint32_t bit = (uint32_t) 1 << (low & 31);
+    index->read(valueOffset, payloadBegin + low / 32, &word, 1);
+    if (word & bit) return true;
+
+    word |= bit;
+    ++header[0];
+    ++containerHeader[1];
+    index->write(valueOffset, payloadBegin + low / 32, &word, 1);
+    index->write(valueOffset, header[2], containerHeader, 2);
+    index->write(valueOffset, 0, header, Bitmap::HEADER_LENGTH);
+    return true;
+  }
+
+  // the last array ends the value, so a value above its last one is added
+  // either to the free upper half of the last word or as a new word; the
+  // last value itself is already there
+  if (containerHeader[0] == containerKey && containerHeader[1] <= Bitmap::ARRAY_LIMIT) {
+    uint32_t count = containerHeader[1];
+    uint32_t lastWord;
+    index->read(valueOffset, payloadBegin + (count - 1) / 2, &lastWord, 1);
+    uint32_t lastValue = (count % 2) ? lastWord & 0xffff : lastWord >> 16;
+
+    if (low == lastValue) return true;
+    if (low > lastValue && count < Bitmap::ARRAY_LIMIT) {
+      ++header[0];
+      ++containerHeader[1];
+      index->write(valueOffset, header[2], containerHeader, 2);
+      index->write(valueOffset, 0, header, Bitmap::HEADER_LENGTH);
+      if (count % 2) {
+	lastWord |= low << 16;
+	index->write(valueOffset, payloadBegin + (count - 1) / 2, &lastWord, 1);
+      }
+      else {
+	index->append(key, &low, 1);
+      }
+      return true;
+    }
+  }
+
+  Bitmap bitmap;
+  Bitmap::get(index, key, bitmap);
+  bitmap.add(docId);
+  Bitmap::set(index, key, bitmap);
+
+  return true;
+}
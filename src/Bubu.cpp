@@ -25,51 +25,479 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
 #include <sstream>
+#include <unistd.h>
 #include "bb/Bubu.hpp"
+#include "bb/Bitmap.hpp"
+#include "bb/Intersection.hpp"
+#include "bb/PostingList.hpp"
+#include "bb/QueryParser.hpp"
 
+using bb::AsyncReader;
 using bb::DBM;
+using bb::Bitmap;
 using bb::Bubu;
+using bb::DocStore;
+using bb::EpochManager;
+using bb::Generation;
+using bb::GramDictionary;
+using bb::SearchCursor;
+using bb::Query;
+using bb::Intersection;
+using bb::QueryParser;
+using bb::PostingIterator;
+using bb::PostingList;
+using bb::PostingLocation;
+using bb::Task;
+using bb::ThreadPool;
+
+namespace {
+
+// The two streams of a gram read into memory.
+struct PostingValue
+{
+  uint32_t* docValue;
+  uint32_t docLength;
+  uint32_t* positionValue;
+  uint32_t positionLength;
+};
+
+// Holds the generation a read-only workspace was opened at for one call,
+// which finds nothing once the writer has moved past it.
+class ReadGuard
+{
+protected:
+  Generation* generation;
+  bool current;
+
+public:
+  ReadGuard(Generation* generation) : generation(generation), current(generation->beginRead()) {}
+  ~ReadGuard() { if (this->current) this->generation->endRead(); }
+
+  bool isCurrent() const { return this->current; }
+};
+
+// Keeps the k best (score, docId) pairs seen so far in a min-heap.
+void keepBest(std::vector<std::pair<double, uint32_t> >& best, uint32_t k, double score, uint32_t docId)
+{
+  if (best.size() < k) {
+    best.push_back(std::pair<double, uint32_t>(score, docId));
+    std::push_heap(best.begin(), best.end(), std::greater<std::pair<double, uint32_t> >());
+  }
+  else if (score > best.front().first) {
+    std::pop_heap(best.begin(), best.end(), std::greater<std::pair<double, uint32_t> >());
+    best.back() = std::pair<double, uint32_t>(score, docId);
+    std::push_heap(best.begin(), best.end(), std::greater<std::pair<double, uint32_t> >());
+  }
+}
+
+void sortBest(std::vector<std::pair<double, uint32_t> >& best, std::vector<std::pair<uint32_t, double> >& results)
+{
+  std::sort_heap(best.begin(), best.end(), std::greater<std::pair<double, uint32_t> >());
+  std::vector<std::pair<double, uint32_t> >::iterator bestIter = best.begin();
+  while (bestIter != best.end()) {
+    results.push_back(std::pair<uint32_t, double>(bestIter->second, bestIter->first));
+    ++bestIter;
+  }
+}
+
+// Matches one query of a batch against posting lists fetched beforehand.
+class BatchSearchTask : public Task
+{
+protected:
+  std::vector<PostingValue> lists;
+  std::vector<uint32_t> offsets;
+  Bitmap filter;
+  std::vector<bool> filtered;
+  std::vector<std::pair<uint32_t, uint32_t> >* hits;
+
+public:
+  BatchSearchTask(const std::vector<PostingValue>& lists, const std::vector<uint32_t>& offsets,
+		  const Bitmap& filter, const std::vector<bool>& filtered,
+		  std::vector<std::pair<uint32_t, uint32_t> >* hits)
+    : lists(lists), offsets(offsets), filter(filter), filtered(filtered), hits(hits) {}
+
+  virtual void run() {
+    std::vector<PostingIterator*> iterators;
+    for (uint32_t i = 0; i < this->lists.size(); ++i) {
+      iterators.push_back(new PostingIterator(this->lists[i].docValue, this->lists[i].docLength,
+					      this->lists[i].positionValue, this->lists[i].positionLength));
+    }
+
+    SearchCursor cursor(iterators, this->offsets, this->filter, this->filtered);
+    while (cursor.next()) {
+      this->hits->push_back(std::pair<uint32_t, uint32_t>(cursor.docId(), cursor.offset()));
+    }
+  }
+};
+
+// Matches a query against the docIds in [beginDocId, endDocId) of its
+// posting lists; the last partition has no upper end.
+class PartitionSearchTask : public Task
+{
+protected:
+  DBM<uint32_t>* index;
+  DBM<uint32_t>* positions;
+  std::vector<PostingLocation> locations;
+  std::vector<uint32_t> offsets;
+  const Bitmap* filter;
+  const std::vector<bool>* filtered;
+  uint32_t beginDocId;
+  uint32_t endDocId;
+  bool bounded;
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+
+public:
+  PartitionSearchTask(DBM<uint32_t>* index, DBM<uint32_t>* positions, const std::vector<PostingLocation>& locations,
+		      const std::vector<uint32_t>& offsets, const Bitmap* filter, const std::vector<bool>* filtered,
+		      uint32_t beginDocId, uint32_t endDocId, bool bounded)
+    : index(index), positions(positions), locations(locations), offsets(offsets), filter(filter), filtered(filtered),
+      beginDocId(beginDocId), endDocId(endDocId), bounded(bounded) {}
+
+  const std::vector<std::pair<uint32_t, uint32_t> >& getHits() const { return this->hits; }
+
+  virtual void run() {
+    std::vector<PostingIterator*> iterators;
+    for (uint32_t i = 0; i < this->locations.size(); ++i) {
+      iterators.push_back(new PostingIterator(this->index, this->positions, this->locations[i]));
+    }
+
+    SearchCursor cursor(iterators, this->offsets, *(this->filter), *(this->filtered));
+    bool found = cursor.skipTo(this->beginDocId);
+    while (found && (!this->bounded || cursor.docId() < this->endDocId)) {
+      this->hits.push_back(std::pair<uint32_t, uint32_t>(cursor.docId(), cursor.offset()));
+      found = cursor.next();
+    }
+  }
+};
+
+}
+
+const char* Bubu::STATISTICS_KEY = "$statistics";
+const uint32_t Bubu::STATISTICS_LENGTH = 4;
+const char* Bubu::SETTINGS_KEY = "$settings";
+const uint32_t Bubu::DEFAULT_GRAM_SIZE = 2;
+const uint32_t Bubu::MAX_GRAM_SIZE = 8;
+const char* Bubu::END_MARKER = "\x01";
+const double Bubu::BM25_K1 = 1.2;
+const double Bubu::BM25_B = 0.75;
+const uint32_t Bubu::PARTITION_THRESHOLD = 1 << 16;
+const uint32_t Bubu::PARTITIONS_PER_THREAD = 4;
+const char* Bubu::BITMAP_KEY_PREFIX = "$bitmap:";
+const uint32_t Bubu::BITMAP_MIN_POSTINGS = 1024;
+const uint32_t Bubu::BITMAP_DENSITY = 16;
+const uint32_t Bubu::CHECKPOINT_INTERVAL = 64;
+const uint32_t Bubu::MAX_CHAR_LENGTH = 4;
+const uint32_t Bubu::STREAM_CHUNK_SIZE = 256 * 1024;
 
 Bubu::Bubu()
 {
   this->index = new DBM<uint32_t>();
+  this->positions = new DBM<uint32_t>();
   this->library = new DBM<char>();
+  this->docStore = new DocStore(this->library);
+  this->catalog = new DBM<uint32_t>();
+  this->dictionary = new GramDictionary();
+  this->generation = new Generation();
+  this->threadPool = NULL;
+  this->reader = NULL;
+  this->gramSize = Bubu::DEFAULT_GRAM_SIZE;
+  this->indexUnigrams = true;
+  this->readOnly = false;
+  pthread_mutex_init(&(this->mutex), NULL);
+
+  // the files searches read from keep what they still need of old epochs
+  this->epochs = new EpochManager();
+  this->index->setEpochs(this->epochs);
+  this->positions->setEpochs(this->epochs);
+  this->catalog->setEpochs(this->epochs);
 }
 
 Bubu::~Bubu()
 {
   this->close();
   delete this->index;
+  delete this->positions;
+  delete this->docStore;
   delete this->library;
+  delete this->catalog;
+  delete this->dictionary;
+  delete this->generation;
+  if (this->threadPool) delete this->threadPool;
+  if (this->reader) delete this->reader;
+  delete this->epochs;
+  pthread_mutex_destroy(&(this->mutex));
 }
 
 bool Bubu::open(const char* workspaceDir)
 {
+  return this->open(workspaceDir, false);
+}
+
+// Opened read-only, the workspace serves the generation it was opened at,
+// which a writer in another process leaves behind with its first change;
+// reads can not go on from a snapshot the files no longer hold. From then
+// on the reader is stale: every read is refused, the calls returning a
+// bool return false, openCursor() and openQuery() return NULL, and the
+// others return nothing. Staleness never passes, so isStale() tells a
+// refused read from an empty result after the fact. A stale reader has
+// to be opened again, which succeeds once the writer has flushed. Cursors
+// already open keep reading the files as they stand.
+bool Bubu::open(const char* workspaceDir, bool readOnly)
+{
+  this->readOnly = readOnly;
   std::string workspace(workspaceDir);
   std::string indexPath = workspace + "/bubu.idx";
+  std::string positionsPath = workspace + "/bubu.pos";
   std::string libraryPath = workspace + "/bubu.lib";
-  
-  if (!this->index->open(indexPath.c_str()) ||
-      !this->library->open(libraryPath.c_str())) {
+  std::string catalogPath = workspace + "/bubu.cat";
+  std::string dictionaryPath = workspace + "/bubu.dic";
+  std::string generationPath = workspace + "/bubu.gen";
+
+  // a reader loads everything at the generation it opens at, which the
+  // writer leaves alone until the reader is done
+  if (!this->generation->open(generationPath.c_str(), readOnly)) return false;
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  // workspaces of older layouts are converted before opening; a read-only
+  // open leaves that to the writer and fails on them instead
+  if (!readOnly && !this->upgrade(workspace)) return false;
+
+  if (!this->index->open(indexPath.c_str(), readOnly) ||
+      !this->positions->open(positionsPath.c_str(), readOnly) ||
+      !this->library->open(libraryPath.c_str(), readOnly)) {
+    return false;
+  }
+  this->docStore->load();
+
+  // workspaces made before the catalog or the dictionary existed get
+  // empty ones; the dictionary then only learns grams indexed from now on
+  if (!this->catalog->open(catalogPath.c_str(), readOnly) &&
+      (readOnly || !this->generation->beginWrite() || !this->catalog->create(catalogPath.c_str(), 100000, 10000))) {
     return false;
   }
+  if (!this->dictionary->open(dictionaryPath.c_str()) &&
+      (readOnly || !this->generation->beginWrite() || !this->dictionary->create(dictionaryPath.c_str()))) {
+    return false;
+  }
+
+  // workspaces made before the gram size was configurable index bigrams,
+  // and those made before unigrams could be left out index them
+  this->gramSize = Bubu::DEFAULT_GRAM_SIZE;
+  this->indexUnigrams = true;
+  uint32_t settingsLength;
+  uint32_t* settings = this->catalog->get(Bubu::SETTINGS_KEY, &settingsLength);
+  if (settings != NULL) {
+    if (settingsLength >= 1 && *settings >= 2 && *settings <= Bubu::MAX_GRAM_SIZE) this->gramSize = *settings;
+    if (settingsLength >= 2) this->indexUnigrams = *(settings + 1) != 0;
+    delete[] settings;
+  }
+
+  return true;
+}
+
+bool Bubu::upgrade(const std::string& workspace)
+{
+  std::string indexPath = workspace + "/bubu.idx";
+  std::string positionsPath = workspace + "/bubu.pos";
+  std::string libraryPath = workspace + "/bubu.lib";
+  std::string catalogPath = workspace + "/bubu.cat";
+  std::string dictionaryPath = workspace + "/bubu.dic";
+  std::string suffix = ".upgrade";
+
+  // every file is converted next to itself and moved into place only once
+  // all of them are, so a workspace which cannot be converted is left as
+  // it was. The posting files go last: until they are moved, the workspace
+  // still reads as one to be converted, or as none at all
+  std::vector<std::string> paths;
+  bool upgraded = true;
+  if (access(positionsPath.c_str(), F_OK) != 0) {
+    // only the original layout lacks positions, and it had no catalog
+    if (!DBM<uint32_t>::isLegacy(indexPath.c_str()) || !DBM<char>::isLegacy(libraryPath.c_str()) ||
+	access(catalogPath.c_str(), F_OK) == 0) {
+      return false;
+    }
+    upgraded = this->convertFlat(workspace, suffix);
+    paths.push_back(libraryPath);
+    paths.push_back(catalogPath);
+    paths.push_back(dictionaryPath);
+    paths.push_back(indexPath);
+    paths.push_back(positionsPath);
+  }
   else {
-    return true;
+    if (access(indexPath.c_str(), F_OK) != 0 || access(libraryPath.c_str(), F_OK) != 0) return false;
+
+    // files of the 32-bit layout since positions were split off differ
+    // from the current ones only in the DBM layout around their values
+    if (DBM<char>::isLegacy(libraryPath.c_str())) {
+      paths.push_back(libraryPath);
+      upgraded = DBM<char>::upgrade(libraryPath.c_str(), (libraryPath + suffix).c_str());
+    }
+    const std::string* indexPaths[] = { &catalogPath, &indexPath, &positionsPath };
+    for (uint32_t i = 0; i < sizeof(indexPaths) / sizeof(indexPaths[0]) && upgraded; ++i) {
+      if (!DBM<uint32_t>::isLegacy(indexPaths[i]->c_str())) continue;
+      paths.push_back(*indexPaths[i]);
+      upgraded = DBM<uint32_t>::upgrade(indexPaths[i]->c_str(), (*indexPaths[i] + suffix).c_str());
+    }
+  }
+
+  if (upgraded && !paths.empty()) upgraded = this->generation->beginWrite();
+  for (uint32_t i = 0; i < paths.size(); ++i) {
+    std::string upgradedPath = paths[i] + suffix;
+    if (upgraded) upgraded = rename(upgradedPath.c_str(), paths[i].c_str()) == 0;
+    else ::remove(upgradedPath.c_str());
+  }
+  return upgraded;
+}
+
+bool Bubu::convertFlat(const std::string& workspace, const std::string& suffix)
+{
+  // the original layout keeps each posting list as (docId, offset) pairs
+  // in the order documents were registered and each content under its
+  // docId, and always indexes unigrams and bigrams
+  std::string flatPath = workspace + "/bubu.idx.flat";
+  std::string indexPath = workspace + "/bubu.idx" + suffix;
+  std::string positionsPath = workspace + "/bubu.pos" + suffix;
+  std::string libraryPath = workspace + "/bubu.lib" + suffix;
+  std::string catalogPath = workspace + "/bubu.cat" + suffix;
+  std::string dictionaryPath = workspace + "/bubu.dic" + suffix;
+  this->gramSize = Bubu::DEFAULT_GRAM_SIZE;
+  this->indexUnigrams = true;
+
+  DBM<uint32_t> flat;
+  DBM<char> library;
+  DBM<uint32_t> index;
+  DBM<uint32_t> positions;
+  DBM<uint32_t> catalog;
+  bool converted =
+    DBM<uint32_t>::upgrade((workspace + "/bubu.idx").c_str(), flatPath.c_str()) && flat.open(flatPath.c_str()) &&
+    DBM<char>::upgrade((workspace + "/bubu.lib").c_str(), libraryPath.c_str()) && library.open(libraryPath.c_str()) &&
+    index.create(indexPath.c_str(), 100000, 10000) &&
+    positions.create(positionsPath.c_str(), 100000, 10000) &&
+    catalog.create(catalogPath.c_str(), 100000, 10000);
+
+  // the catalog entries and statistics are made from the contents
+  uint32_t statistics[Bubu::STATISTICS_LENGTH] = { 0, 0, 0, 0 };
+  uint64_t totalLength = 0;
+  std::vector<std::string> keys;
+  if (converted) library.getKeys(keys);
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    char* end;
+    uint32_t docId = strtoul(keys[i].c_str(), &end, 10);
+    if (keys[i].empty() || *end != '\0') continue;
+
+    uint32_t contentLength;
+    char* content = library.get(keys[i].c_str(), &contentLength);
+    std::string docContent(content, contentLength);
+    delete[] content;
+
+    std::vector<std::string> grams;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> catalogValue(1, this->tokenizeDoc(docContent.c_str(), grams, offsets));
+    Bubu::calcCheckpoints(docContent.c_str(), catalogValue);
+    catalog.set(keys[i].c_str(), &catalogValue[0], catalogValue.size());
+    ++statistics[0];
+    totalLength += catalogValue[0];
+    statistics[3] = std::max(statistics[3], docId + 1);
+  }
+  statistics[1] = (uint32_t) totalLength;
+  statistics[2] = (uint32_t) (totalLength >> 32);
+  catalog.set(Bubu::STATISTICS_KEY, statistics, Bubu::STATISTICS_LENGTH);
+  uint32_t settings[2] = { this->gramSize, 1 };
+  catalog.set(Bubu::SETTINGS_KEY, settings, 2);
+
+  // the lists are put in docId order, which documents registered out of
+  // order broke, and split into doc and position streams. A list of odd
+  // length is of none of the layouts this converts
+  keys.clear();
+  if (converted) flat.getKeys(keys);
+  std::sort(keys.begin(), keys.end());
+  FILE* grams = converted ? tmpfile() : NULL;
+  converted = converted && grams != NULL;
+  for (uint32_t i = 0; i < keys.size() && converted; ++i) {
+    uint32_t valueLength;
+    uint32_t* value = flat.get(keys[i].c_str(), &valueLength);
+    converted = value != NULL && valueLength % 2 == 0;
+    std::vector<std::pair<uint32_t, uint32_t> > pairs;
+    for (uint32_t j = 0; j + 1 < valueLength && converted; j += 2) {
+      pairs.push_back(std::pair<uint32_t, uint32_t>(*(value + j), *(value + j + 1)));
+    }
+    delete[] value;
+    if (pairs.empty()) continue;
+
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    std::vector<uint32_t> postings;
+    Bitmap docs;
+    for (uint32_t j = 0; j < pairs.size(); ++j) {
+      postings.push_back(pairs[j].first);
+      postings.push_back(pairs[j].second);
+      docs.add(pairs[j].first);
+    }
+    PostingList::set(&index, &positions, keys[i].c_str(), postings);
+    if (pairs.size() >= Bubu::BITMAP_MIN_POSTINGS && docs.size() * Bubu::BITMAP_DENSITY >= statistics[0]) {
+      Bitmap::set(&index, Bubu::getBitmapKey(keys[i]).c_str(), docs);
+    }
+
+    uint32_t gramLength = keys[i].size();
+    converted = fwrite(&gramLength, sizeof(uint32_t), 1, grams) == 1 &&
+      fwrite(keys[i].data(), sizeof(char), gramLength, grams) == gramLength;
   }
+  converted = converted && fflush(grams) == 0 && GramDictionary::build(dictionaryPath.c_str(), grams);
+  if (grams != NULL) fclose(grams);
+
+  flat.close();
+  ::remove(flatPath.c_str());
+  library.close();
+  index.close();
+  positions.close();
+  catalog.close();
+  return converted;
 }
 
 bool Bubu::create(const char* workspaceDir)
 {
+  return this->create(workspaceDir, Bubu::DEFAULT_GRAM_SIZE);
+}
+
+bool Bubu::create(const char* workspaceDir, uint32_t gramSize)
+{
+  return this->create(workspaceDir, gramSize, true);
+}
+
+bool Bubu::create(const char* workspaceDir, uint32_t gramSize, bool indexUnigrams)
+{
+  if (gramSize < 2 || gramSize > Bubu::MAX_GRAM_SIZE) return false;
+  this->readOnly = false;
+
   std::string workspace(workspaceDir);
   std::string indexPath = workspace + "/bubu.idx";
+  std::string positionsPath = workspace + "/bubu.pos";
   std::string libraryPath = workspace + "/bubu.lib";
+  std::string catalogPath = workspace + "/bubu.cat";
+  std::string dictionaryPath = workspace + "/bubu.dic";
+  std::string generationPath = workspace + "/bubu.gen";
   
-  if (!this->index->create(indexPath.c_str(), 100000, 10000) ||
-      !this->library->create(libraryPath.c_str(), 100000, 10000)) {
+  if (!this->generation->open(generationPath.c_str(), false) || !this->generation->beginWrite() ||
+      !this->index->create(indexPath.c_str(), 100000, 10000) ||
+      !this->positions->create(positionsPath.c_str(), 100000, 10000) ||
+      !this->library->create(libraryPath.c_str(), 100000, 10000) ||
+      !this->catalog->create(catalogPath.c_str(), 100000, 10000) ||
+      !this->dictionary->create(dictionaryPath.c_str())) {
     return false;
   }
   else {
+    this->gramSize = gramSize;
+    this->indexUnigrams = indexUnigrams;
+    uint32_t settings[2] = { gramSize, indexUnigrams ? 1u : 0u };
+    this->catalog->set(Bubu::SETTINGS_KEY, settings, 2);
+    this->docStore->load();
     return true;
   }
 }
@@ -77,182 +505,1474 @@ bool Bubu::create(const char* workspaceDir)
 void Bubu::close()
 {
   this->index->close();
+  this->positions->close();
+  this->docStore->reset();
   this->library->close();
+  this->catalog->close();
+  this->dictionary->close();
+  this->generation->close();
 }
 
-std::vector<std::pair<uint32_t, uint32_t> > Bubu::search(const char* query)
+bool Bubu::flush()
 {
-  std::vector<std::pair<uint32_t, uint32_t> > hits;
-  if (query == NULL || strcmp(query, "") == 0) return hits;
+  if (this->readOnly) return false;
 
-  std::vector<std::string> unigrams;
-  std::vector<std::string> bigrams;
-  Bubu::tokenizeUTF8(query, false, unigrams, bigrams);
-  uint32_t querySize = unigrams.size();
-  if (querySize == 0) return hits;
-  if (querySize % 2) bigrams.push_back(unigrams[querySize - 1]);
+  // the dictionary goes first, since the grams it lacks could not be found
+  // again by prefix, while a posting list without a gram is only unused
+  bool flushed = this->dictionary->flush();
+  flushed = this->catalog->sync() && flushed;
+  flushed = this->docStore->sync() && flushed;
+  flushed = this->positions->sync() && flushed;
+  flushed = this->index->sync() && flushed;
 
-  std::vector<std::string>::iterator iter = bigrams.begin();
+  // readers may open the workspace again once all of it is in the files
+  return flushed && this->generation->endWrite();
+}
 
-  uint32_t valueSize;
-  uint32_t* value = this->index->get(iter->c_str(), &valueSize);
-  for (uint32_t i = 0; i < valueSize; i += 2) {
-    hits.push_back(std::pair<uint32_t, uint32_t>(*(value + i), *(value + i + 1)));
-  }
-  delete[] value;
-  ++iter;
+uint32_t Bubu::getGramSize() const
+{
+  return this->gramSize;
+}
+
+bool Bubu::isReadOnly() const
+{
+  return this->readOnly;
+}
 
-  uint32_t totalOffset = 2;
-  while (iter != bigrams.end()) {
-    if (hits.empty()) break;
+bool Bubu::isStale()
+{
+  return this->generation->isStale();
+}
+
+uint64_t Bubu::pinEpoch()
+{
+  return this->epochs->pin();
+}
 
-    value = this->index->get(iter->c_str(), &valueSize);
-    
-    std::vector<std::pair<uint32_t, uint32_t> >::iterator hiter = hits.begin();
-    while (hiter != hits.end()) {
-      uint32_t docId = hiter->first;
-      uint32_t offset = hiter->second + totalOffset;
+void Bubu::unpinEpoch(uint64_t epoch)
+{
+  this->epochs->unpin(epoch);
+}
 
-      uint32_t i;
-      for (i = 0; i < valueSize; i += 2) {
-	if (*(value + i) == docId && *(value + i + 1) == offset) break;
-      }
+std::vector<std::pair<uint32_t, uint32_t> > Bubu::search(const char* query)
+{
+  uint64_t epoch = this->pinEpoch();
+  std::vector<std::pair<uint32_t, uint32_t> > hits = this->search(query, epoch);
+  this->unpinEpoch(epoch);
+  return hits;
+}
+
+std::vector<std::pair<uint32_t, uint32_t> > Bubu::search(const char* query, uint64_t epoch)
+{
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  this->search(query, epoch, hits);
+  return hits;
+}
+
+bool Bubu::search(const char* query, uint64_t epoch, std::vector<std::pair<uint32_t, uint32_t> >& hits)
+{
+  hits.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
 
-      hiter = (i < valueSize) ? hiter + 1 : hits.erase(hiter);
+  std::vector<uint32_t> postings;
+  if (this->expandPrefix(query, postings, epoch)) {
+    for (uint32_t i = 0; i < postings.size(); i += 2) {
+      hits.push_back(std::pair<uint32_t, uint32_t>(postings[i], postings[i + 1]));
     }
+    return true;
+  }
 
-    delete[] value;
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  Bubu::tokenizeQuery(query, this->gramSize, grams, offsets);
 
-    totalOffset += 2;
-    ++iter;
+  std::vector<PostingLocation> locations;
+  if (!PostingList::locateAll(this->index, this->positions, this->getReader(), grams, locations, epoch)) return true;
+  uint32_t maxPostingCount = 0;
+  for (uint32_t g = 0; g < locations.size(); ++g) {
+    maxPostingCount = std::max(maxPostingCount, locations[g].positionLength);
   }
 
+  // only lists long enough to outweigh the partitioning are split up
+  uint32_t partitionCount = 1;
+  if (maxPostingCount >= Bubu::PARTITION_THRESHOLD) {
+    partitionCount = this->getThreadPool()->size() * Bubu::PARTITIONS_PER_THREAD;
+  }
+
+  Bitmap filter;
+  std::vector<bool> filtered;
+  this->loadFilter(grams, epoch, filter, filtered);
+  hits = this->searchPartitioned(locations, offsets, filter, filtered, partitionCount);
+  return true;
+}
+
+std::vector<std::vector<std::pair<uint32_t, uint32_t> > > Bubu::searchBatch(const std::vector<std::string>& queries)
+{
+  uint64_t epoch = this->pinEpoch();
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > hits = this->searchBatch(queries, epoch);
+  this->unpinEpoch(epoch);
   return hits;
 }
 
-void Bubu::registerDoc(uint32_t docId, const char* docContent)
+std::vector<std::vector<std::pair<uint32_t, uint32_t> > > Bubu::searchBatch(const std::vector<std::string>& queries,
+									      uint64_t epoch)
+{
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > hits;
+  this->searchBatch(queries, epoch, hits);
+  return hits;
+}
+
+bool Bubu::searchBatch(const std::vector<std::string>& queries, uint64_t epoch,
+		       std::vector<std::vector<std::pair<uint32_t, uint32_t> > >& hits)
 {
-  if (docContent == NULL || strcmp(docContent, "") == 0) return;
+  hits.assign(queries.size(), std::vector<std::pair<uint32_t, uint32_t> >());
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  // every distinct gram of the batch is read from the index exactly once,
+  // here on the calling thread, since the index file is not shareable
+  std::vector<std::vector<std::string> > queryGrams(queries.size());
+  std::vector<std::vector<uint32_t> > queryOffsets(queries.size());
+  std::map<std::string, PostingValue> values;
+  std::vector<std::string> distinctGrams;
+  std::vector<bool> expanded(queries.size(), false);
+  for (uint32_t q = 0; q < queries.size(); ++q) {
+    std::vector<uint32_t> postings;
+    if (this->expandPrefix(queries[q].c_str(), postings, epoch)) {
+      for (uint32_t i = 0; i < postings.size(); i += 2) {
+	hits[q].push_back(std::pair<uint32_t, uint32_t>(postings[i], postings[i + 1]));
+      }
+      expanded[q] = true;
+      continue;
+    }
 
-  uint32_t idOffsetPair[2];
+    Bubu::tokenizeQuery(queries[q].c_str(), this->gramSize, queryGrams[q], queryOffsets[q]);
 
-  std::vector<std::string> unigrams;
-  std::vector<std::string> bigrams;
-  Bubu::tokenizeUTF8(docContent, true, unigrams, bigrams);
+    std::vector<std::string>::iterator gramIter = queryGrams[q].begin();
+    while (gramIter != queryGrams[q].end()) {
+      if (values.find(*gramIter) == values.end()) {
+	values.insert(std::make_pair(*gramIter, PostingValue()));
+	distinctGrams.push_back(*gramIter);
+      }
+      ++gramIter;
+    }
+  }
+
+  // all of the lists are fetched in one batch per file
+  std::vector<uint32_t*> docValues;
+  std::vector<uint32_t> docLengths;
+  std::vector<uint32_t*> positionValues;
+  std::vector<uint32_t> positionLengths;
+  this->index->getAll(this->getReader(), distinctGrams, docValues, docLengths, epoch);
+  this->positions->getAll(this->getReader(), distinctGrams, positionValues, positionLengths, epoch);
+  std::vector<std::string> bitmapKeys;
+  for (uint32_t g = 0; g < distinctGrams.size(); ++g) bitmapKeys.push_back(Bubu::getBitmapKey(distinctGrams[g]));
+  std::vector<uint32_t*> bitmapValues;
+  std::vector<uint32_t> bitmapLengths;
+  this->index->getAll(this->getReader(), bitmapKeys, bitmapValues, bitmapLengths, epoch);
+  std::map<std::string, Bitmap> bitmaps;
+  for (uint32_t g = 0; g < distinctGrams.size(); ++g) {
+    PostingValue& value = values[distinctGrams[g]];
+    value.docValue = docValues[g];
+    value.docLength = docLengths[g];
+    value.positionValue = positionValues[g];
+    value.positionLength = positionLengths[g];
+    if (bitmapValues[g] != NULL) {
+      bitmaps.insert(std::make_pair(distinctGrams[g], Bitmap(bitmapValues[g], bitmapLengths[g])));
+      delete[] bitmapValues[g];
+    }
+  }
+
+  std::vector<BatchSearchTask*> tasks;
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t q = 0; q < queries.size(); ++q) {
+    if (expanded[q]) continue;
+
+    std::vector<PostingValue> lists;
+    std::vector<Bitmap> queryBitmaps;
+    std::vector<bool> dense;
+    std::vector<std::string>::iterator gramIter = queryGrams[q].begin();
+    while (gramIter != queryGrams[q].end()) {
+      lists.push_back(values[*gramIter]);
+      std::map<std::string, Bitmap>::iterator bitmapIter = bitmaps.find(*gramIter);
+      dense.push_back(bitmapIter != bitmaps.end());
+      queryBitmaps.push_back(dense.back() ? bitmapIter->second : Bitmap());
+      ++gramIter;
+    }
+
+    Bitmap filter;
+    std::vector<bool> filtered;
+    Bubu::combineFilter(queryBitmaps, dense, filter, filtered);
+    BatchSearchTask* task = new BatchSearchTask(lists, queryOffsets[q], filter, filtered, &(hits[q]));
+    tasks.push_back(task);
+    pool->submit(task);
+  }
+  pool->wait();
 
-  idOffsetPair[0] = docId;
-  idOffsetPair[1] = 0;
-  std::vector<std::string>::iterator unigramIter = unigrams.begin();
-  while (unigramIter != unigrams.end()) {
-    this->index->append(unigramIter->c_str(), idOffsetPair, 2);
-    ++idOffsetPair[1];
-    ++unigramIter;
+  std::vector<BatchSearchTask*>::iterator taskIter = tasks.begin();
+  while (taskIter != tasks.end()) {
+    delete *taskIter;
+    ++taskIter;
   }
 
-  idOffsetPair[0] = docId;
-  idOffsetPair[1] = 0;
-  std::vector<std::string>::iterator bigramIter = bigrams.begin();
-  while (bigramIter != bigrams.end()) {
-    this->index->append(bigramIter->c_str(), idOffsetPair, 2);
-    ++idOffsetPair[1];
-    ++bigramIter;
+  std::map<std::string, PostingValue>::iterator valueIter = values.begin();
+  while (valueIter != values.end()) {
+    if (valueIter->second.docValue != NULL) delete[] valueIter->second.docValue;
+    if (valueIter->second.positionValue != NULL) delete[] valueIter->second.positionValue;
+    ++valueIter;
   }
 
-  this->library->set(Bubu::uintToString(docId).c_str(), docContent, strlen(docContent));
+  return true;
 }
 
-void Bubu::unregisterDoc(uint32_t docId)
+std::vector<std::pair<uint32_t, double> > Bubu::searchTopK(const char* query, uint32_t k)
 {
-  std::string docIdString = Bubu::uintToString(docId);
+  uint64_t epoch = this->pinEpoch();
+  std::vector<std::pair<uint32_t, double> > results = this->searchTopK(query, k, epoch);
+  this->unpinEpoch(epoch);
+  return results;
+}
+
+std::vector<std::pair<uint32_t, double> > Bubu::searchTopK(const char* query, uint32_t k, uint64_t epoch)
+{
+  std::vector<std::pair<uint32_t, double> > results;
+  RankStatistics statistics;
+  if (this->getRankStatistics(NULL, epoch, statistics)) this->searchTopK(query, k, epoch, statistics, results);
+  return results;
+}
+
+std::vector<std::pair<uint32_t, double> > Bubu::searchTopK(const char* query, uint32_t k, uint64_t epoch,
+							   const RankStatistics& statistics)
+{
+  std::vector<std::pair<uint32_t, double> > results;
+  this->searchTopK(query, k, epoch, statistics, results);
+  return results;
+}
 
-  uint32_t docContentLength;
-  char* docContent = this->library->get(docIdString.c_str(), &docContentLength);
-  if (docContent == NULL) return;
-  this->library->remove(docIdString.c_str());
+// Scores with the statistics given rather than those of this workspace, so
+// that workspaces holding parts of one collection rank alike. Grams whose
+// document frequencies are not given are counted here.
+bool Bubu::searchTopK(const char* query, uint32_t k, uint64_t epoch, const RankStatistics& statistics,
+		      std::vector<std::pair<uint32_t, double> >& results)
+{
+  results.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
 
   std::vector<std::string> grams;
-  std::vector<std::string> bigrams;
-  Bubu::tokenizeUTF8(docContent, true, grams, bigrams);
-  delete[] docContent;
-  grams.insert(grams.end(), bigrams.begin(), bigrams.end());
+  std::vector<uint32_t> offsets;
+  Bubu::tokenizeQuery(query, this->gramSize, grams, offsets);
+  if (grams.empty() || k == 0) return true;
 
-  std::vector<std::string>::iterator iter = grams.begin();
-  while (iter != grams.end()) {
-    uint32_t valueLength;
-    uint32_t* value = this->index->get(iter->c_str(), &valueLength);
-    uint32_t matchOffset = 0;
-    uint32_t matchLength = 0;
-
-    for (uint32_t i = 0; i < valueLength; i += 2) {
-      if (*(value + i) == docId) {
-	if (matchLength == 0) matchOffset = i;
-	matchLength += 2;
-      }
-      else if (matchLength > 0) {
-	break;
+  uint32_t docCount = statistics.docCount;
+  double avgDocLength = (docCount > 0) ? (double) statistics.totalLength / docCount : 0.0;
+
+  // a query expanded over the grams it prefixes has its frequencies right
+  // in the merged postings, where the hits of a document are adjacent
+  std::vector<uint32_t> postings;
+  if (this->expandPrefix(query, postings, epoch)) {
+    std::vector<std::pair<uint32_t, uint32_t> > frequencies;
+    for (uint32_t i = 0; i < postings.size(); i += 2) {
+      if (frequencies.empty() || frequencies.back().first != postings[i]) {
+	frequencies.push_back(std::pair<uint32_t, uint32_t>(postings[i], 0));
       }
+      ++(frequencies.back().second);
+    }
+
+    double docFrequency = statistics.docFrequencies.empty() ? frequencies.size() : statistics.docFrequencies[0];
+    double totalDocs = std::max((double) docCount, docFrequency);
+    double idf = log(1.0 + (totalDocs - docFrequency + 0.5) / (docFrequency + 0.5));
+    std::vector<std::pair<double, uint32_t> > best;
+    for (uint32_t i = 0; i < frequencies.size(); ++i) {
+      uint32_t docLength = this->loadDocLength(frequencies[i].first, (uint32_t) avgDocLength, epoch);
+      keepBest(best, k, Bubu::calcScore(frequencies[i].second, idf, docLength, avgDocLength), frequencies[i].first);
+    }
+    sortBest(best, results);
+    return true;
+  }
+
+  uint32_t gramCount = grams.size();
+  std::vector<PostingLocation> locations(gramCount);
+
+  // the phrase can not be more frequent than its rarest gram
+  double idf = 0.0;
+  bool found = PostingList::locateAll(this->index, this->positions, this->getReader(), grams, locations, epoch);
+  for (uint32_t g = 0; g < gramCount && found; ++g) {
+    double docFrequency = (g < statistics.docFrequencies.size()) ?
+      statistics.docFrequencies[g] : PostingList::countDocs(locations[g].docLength);
+    double totalDocs = std::max((double) docCount, docFrequency);
+    idf = std::max(idf, log(1.0 + (totalDocs - docFrequency + 0.5) / (docFrequency + 0.5)));
+  }
+
+  // a document matches only if it holds every gram. The gram in the fewest
+  // documents leads and the others follow it with skipToDoc, rarest first,
+  // so blocks of the longer lists holding none of its documents are never
+  // read. Documents missing from the bitmaps of the dense grams are leapt
+  // over before any other doc stream is read for them. The phrase occurs
+  // in a document at most as many times as its least frequent gram does,
+  // so once k documents are scored, a document, or a whole block, whose
+  // term frequencies bound its score to no more than the k-th best is
+  // passed over; the block headers keep the largest frequency in each
+  std::vector<std::pair<double, uint32_t> > best;
+  std::vector<PostingIterator*> iterators;
+  if (found) {
+    std::vector<std::pair<uint32_t, uint32_t> > order;
+    for (uint32_t g = 0; g < gramCount; ++g) {
+      order.push_back(std::pair<uint32_t, uint32_t>(PostingList::countDocs(locations[g].docLength), g));
     }
-    
-    if (matchLength > 0) {
-      if (matchLength < valueLength) {
-	memmove(value + matchOffset, value + matchOffset + matchLength,
-		sizeof(uint32_t) * (valueLength - matchOffset - matchLength));
-	this->index->set(iter->c_str(), value, valueLength - matchLength);
+    std::sort(order.begin(), order.end());
+    for (uint32_t r = 0; r < gramCount; ++r) {
+      iterators.push_back(new PostingIterator(this->index, this->positions, locations[order[r].second]));
+    }
+
+    Bitmap filter;
+    std::vector<bool> filtered;
+    bool filtering = this->loadFilter(grams, epoch, filter, filtered);
+
+    uint32_t minFrequency = 0;
+    PostingIterator* driver = iterators.front();
+    bool more = driver->nextDoc(minFrequency);
+    while (more) {
+      uint32_t docId = driver->docId();
+      if (filtering) {
+	uint32_t nextDocId;
+	if (!filter.findNext(docId, &nextDocId)) break;
+	if (nextDocId != docId) {
+	  more = driver->skipToDoc(nextDocId, minFrequency);
+	  continue;
+	}
+      }
+
+      uint32_t maxFrequency = driver->termFrequency();
+      uint32_t r = 1;
+      for (; r < gramCount && maxFrequency > minFrequency; ++r) {
+	if (!iterators[r]->skipToDoc(docId, minFrequency)) break;
+	if (iterators[r]->docId() != docId) break;
+	maxFrequency = std::min(maxFrequency, iterators[r]->termFrequency());
+      }
+
+      if (maxFrequency <= minFrequency) {
+	more = driver->nextDoc(minFrequency);
+	continue;
+      }
+      if (r < gramCount) {
+	more = !iterators[r]->atEnd() && driver->skipToDoc(iterators[r]->docId(), minFrequency);
+	continue;
+      }
+
+      // only now are offsets read, and only those of this document; the
+      // postings of the first gram are narrowed down to the ones every later
+      // gram follows at its place in the phrase
+      std::vector<uint32_t> postings;
+      uint32_t termFrequency = 0;
+      for (uint32_t g = 0; g < gramCount; ++g) {
+	std::vector<uint32_t> gramPostings;
+	PostingIterator iterator(this->index, this->positions, locations[g]);
+	if (iterator.skipToDoc(docId) && iterator.docId() == docId) {
+	  do {
+	    gramPostings.push_back(docId);
+	    gramPostings.push_back(iterator.offset());
+	  } while (iterator.next() && iterator.docId() == docId);
+	}
+
+	if (g == 0) {
+	  postings.swap(gramPostings);
+	  termFrequency = postings.size() / 2;
+	}
+	else if (!gramPostings.empty()) {
+	  termFrequency = Intersection::intersectPositions(&postings[0], termFrequency,
+							   &gramPostings[0], gramPostings.size() / 2, offsets[g],
+							   &postings[0]);
+	}
+	else {
+	  termFrequency = 0;
+	}
+	if (termFrequency == 0) break;
       }
-      else {
-	this->index->remove(iter->c_str());
+
+      if (termFrequency > 0) {
+	uint32_t docLength = this->loadDocLength(docId, (uint32_t) avgDocLength, epoch);
+	keepBest(best, k, Bubu::calcScore(termFrequency, idf, docLength, avgDocLength), docId);
+	if (best.size() == k) minFrequency = Bubu::calcMaxFrequency(best.front().first, idf, avgDocLength);
       }
+      more = driver->nextDoc(minFrequency);
     }
+  }
 
-    delete[] value;
-    ++iter;
+  std::vector<PostingIterator*>::iterator iteratorIter = iterators.begin();
+  while (iteratorIter != iterators.end()) {
+    delete *iteratorIter;
+    ++iteratorIter;
   }
+
+  sortBest(best, results);
+  return true;
 }
 
-std::string Bubu::getDocContent(uint32_t docId)
+// Fills in what searchTopK scores a query with: the document count and
+// total length of this workspace at the epoch, and how many documents hold
+// each gram of the query, or the grams it prefixes all together. With no
+// query only the first two are.
+bool Bubu::getRankStatistics(const char* query, uint64_t epoch, RankStatistics& statistics)
 {
-  uint32_t docContentLength;
-  char* docContent = this->library->get(Bubu::uintToString(docId).c_str(), &docContentLength);
-  if (docContent == NULL) {
-    return std::string();
+  statistics.docCount = 0;
+  statistics.totalLength = 0;
+  statistics.docFrequencies.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  uint32_t storedStatistics[Bubu::STATISTICS_LENGTH];
+  this->loadStatistics(storedStatistics, epoch);
+  statistics.docCount = storedStatistics[0];
+  statistics.totalLength = ((uint64_t) storedStatistics[2] << 32) | storedStatistics[1];
+  if (query == NULL) return true;
+
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  Bubu::tokenizeQuery(query, this->gramSize, grams, offsets);
+  if (grams.empty()) return true;
+
+  std::vector<uint32_t> postings;
+  if (this->expandPrefix(query, postings, epoch)) {
+    uint32_t docFrequency = 0;
+    for (uint32_t i = 0; i < postings.size(); i += 2) {
+      if (i == 0 || postings[i] != postings[i - 2]) ++docFrequency;
+    }
+    statistics.docFrequencies.push_back(docFrequency);
+    return true;
   }
-  else {
-    std::string docContentString(docContent, docContentLength);
-    delete[] docContent;
-    return docContentString;
+
+  // the doc stream holds an entry per document, so its length is enough
+  std::vector<PostingLocation> locations;
+  PostingList::locateAll(this->index, this->positions, this->getReader(), grams, locations, epoch);
+  for (uint32_t g = 0; g < grams.size(); ++g) {
+    statistics.docFrequencies.push_back(PostingList::countDocs(locations[g].docLength));
   }
+  return true;
 }
 
-void Bubu::tokenizeUTF8(const char* text, bool overlap,
-			std::vector<std::string>& unigrams, std::vector<std::string>& bigrams)
+// Cursors and queries read their postings as they are stepped through,
+// so each cursor keeps the epoch it was opened at pinned until deleted;
+// on a read-only workspace, only their opening is held against the writer.
+SearchCursor* Bubu::openCursor(const char* query)
 {
-  unigrams.clear();
-  bigrams.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return NULL;
 
-  std::string prevToken;
-  std::string token;
-  uint32_t size = strlen(text);
+  uint64_t epoch = this->pinEpoch();
+  std::vector<uint32_t> postings;
+  if (this->expandPrefix(query, postings, epoch)) {
+    this->unpinEpoch(epoch);
+    std::vector<PostingIterator*> iterators(1, new PostingIterator(postings));
+    return new SearchCursor(iterators, std::vector<uint32_t>(1, 0));
+  }
 
-  for (uint32_t i = 0; i < size; ++i) {
-    char currentByte = *(text + i);
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  Bubu::tokenizeQuery(query, this->gramSize, grams, offsets);
 
-    if ((currentByte & 0xC0) != 0x80 && !token.empty()) {
-      unigrams.push_back(token);
+  std::vector<PostingLocation> locations;
+  PostingList::locateAll(this->index, this->positions, this->getReader(), grams, locations, epoch);
+  std::vector<PostingIterator*> iterators;
+  for (uint32_t g = 0; g < locations.size(); ++g) {
+    iterators.push_back(new PostingIterator(this->index, this->positions, locations[g]));
+  }
 
-      if (!prevToken.empty()) {
-	bigrams.push_back(prevToken + token);
-	if (!overlap) token.clear();
+  Bitmap filter;
+  std::vector<bool> filtered;
+  this->loadFilter(grams, epoch, filter, filtered);
+  SearchCursor* cursor = new SearchCursor(iterators, offsets, filter, filtered);
+  cursor->holdEpoch(this->epochs, epoch);
+  return cursor;
+}
+
+Query* Bubu::openQuery(const char* expression)
+{
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return NULL;
+
+  uint64_t epoch = this->pinEpoch();
+  QueryParser parser(this, epoch);
+  Query* query = parser.parse(expression);
+  this->unpinEpoch(epoch);
+  return query;
+}
+
+std::vector<uint32_t> Bubu::searchQuery(const char* expression)
+{
+  std::vector<uint32_t> docIds;
+  this->searchQuery(expression, docIds);
+  return docIds;
+}
+
+bool Bubu::searchQuery(const char* expression, std::vector<uint32_t>& docIds)
+{
+  docIds.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  Query* query = this->openQuery(expression);
+  if (query == NULL) return true;
+
+  while (query->next()) docIds.push_back(query->docId());
+
+  delete query;
+  return true;
+}
+
+std::vector<std::string> Bubu::searchPrefix(const char* prefix, uint32_t limit)
+{
+  std::vector<std::string> grams;
+  this->searchPrefix(prefix, limit, grams);
+  return grams;
+}
+
+bool Bubu::searchPrefix(const char* prefix, uint32_t limit, std::vector<std::string>& grams)
+{
+  // the dictionary keeps grams whose postings have all been removed, so
+  // those are passed over, asking it for more grams until enough are left
+  grams.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  uint64_t epoch = this->pinEpoch();
+  uint32_t requested = limit;
+  while (true) {
+    std::vector<std::string> found;
+    this->dictionary->findPrefix(prefix, requested, found);
+
+    // a gram closed by END_MARKER stands for the same characters without
+    // it, and sorts right after them
+    grams.clear();
+    size_t markerLength = strlen(Bubu::END_MARKER);
+    for (uint32_t i = 0; i < found.size(); ++i) {
+      if (!this->index->contains(found[i].c_str(), epoch)) continue;
+      std::string gram = found[i];
+      if (gram.size() >= markerLength && gram.compare(gram.size() - markerLength, markerLength, Bubu::END_MARKER) == 0) {
+	gram.erase(gram.size() - markerLength);
       }
+      grams.push_back(gram);
+    }
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
 
-      prevToken = token;
-      token.clear();	
-    } 
+    if (grams.size() >= limit || found.size() < requested) break;
+    requested = (requested > 0x7fffffff) ? 0xffffffff : requested * 2;
+  }
+  if (grams.size() > limit) grams.resize(limit);
+  this->unpinEpoch(epoch);
+  return true;
+}
 
-    token += currentByte;
+void Bubu::registerDoc(uint32_t docId, const char* docContent)
+{
+  if (this->readOnly || docContent == NULL || strcmp(docContent, "") == 0) return;
+  this->generation->beginWrite();
+
+  // a docId registered already has its old postings replaced rather than
+  // added to
+  std::string docIdString = Bubu::uintToString(docId);
+  if (this->catalog->contains(docIdString.c_str())) {
+    this->updateDoc(docId, docContent);
+    return;
   }
-  
-  unigrams.push_back(token);
-  if (!prevToken.empty()) bigrams.push_back(prevToken + token);
+  this->insertDoc(docId, docContent);
+}
+
+void Bubu::insertDoc(uint32_t docId, const char* docContent)
+{
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  uint32_t docLength = this->tokenizeDoc(docContent, grams, offsets);
+
+  // collect the postings of each gram so that every list is written once
+  std::map<std::string, std::vector<uint32_t> > postings;
+  for (uint32_t i = 0; i < grams.size(); ++i) {
+    std::vector<uint32_t>& gramPostings = postings[grams[i]];
+    gramPostings.push_back(docId);
+    gramPostings.push_back(offsets[i]);
+  }
+
+  uint32_t statistics[Bubu::STATISTICS_LENGTH];
+  this->loadStatistics(statistics);
+  this->addPostings(docId, postings, docId >= statistics[3], statistics[0] + 1);
+
+  this->docStore->put(docId, docContent, strlen(docContent));
+  this->updateStatistics(1, docLength, docId + 1);
+
+  // the length is followed by the byte offset of every
+  // CHECKPOINT_INTERVAL-th character, so that a character offset can be
+  // turned into a byte offset without reading the document up to it
+  std::vector<uint32_t> catalogValue(1, docLength);
+  Bubu::calcCheckpoints(docContent, catalogValue);
+  this->catalog->set(Bubu::uintToString(docId).c_str(), &catalogValue[0], catalogValue.size());
+  this->publishEpoch();
+}
+
+void Bubu::registerDoc(uint32_t docId, std::istream& input)
+{
+  if (this->readOnly) return;
+  this->generation->beginWrite();
+
+  std::vector<char> buffer(Bubu::STREAM_CHUNK_SIZE);
+  input.read(&buffer[0], buffer.size());
+  uint32_t length = input.gcount();
+  if (length == 0) return;
+
+  // the postings of a docId registered already are only known once the
+  // whole stream is read, so those of the old document go first, read back
+  // chunk by chunk as well
+  std::string docIdString = Bubu::uintToString(docId);
+  uint32_t oldDocLengthSize;
+  uint32_t* oldDocLength = this->catalog->get(docIdString.c_str(), &oldDocLengthSize);
+  if (oldDocLength != NULL) {
+    if (this->removeDocPostings(docId)) {
+      this->docStore->remove(docId);
+      this->updateStatistics(-1, -1 * (int64_t) *oldDocLength, 0);
+    }
+    delete[] oldDocLength;
+  }
+
+  uint32_t statistics[Bubu::STATISTICS_LENGTH];
+  this->loadStatistics(statistics);
+  bool appendable = docId >= statistics[3];
+
+  // the length leading the catalog entry is only known at the end, the
+  // checkpoints following it are appended chunk by chunk
+  uint32_t docLength = 0;
+  this->catalog->set(docIdString.c_str(), &docLength, 1);
+
+  // a chunk is tokenized together with the characters ending the previous
+  // one which do not begin a gram yet, and a character cut off at its end
+  // waits for the next one
+  std::vector<std::string> unigrams;
+  std::string token;
+  uint32_t byteOffset = 0;
+  while (length > 0) {
+    this->docStore->append(docId, &buffer[0], length);
+
+    std::vector<uint32_t> checkpoints;
+    uint32_t tokenized = unigrams.size();
+    uint32_t charOffset = docLength - tokenized - (token.empty() ? 0 : 1);
+    for (uint32_t i = 0; i < length; ++i, ++byteOffset) {
+      if ((buffer[i] & 0xC0) != 0x80 || byteOffset == 0) {
+	if (docLength > 0 && docLength % Bubu::CHECKPOINT_INTERVAL == 0) checkpoints.push_back(byteOffset);
+	++docLength;
+      }
+      if ((buffer[i] & 0xC0) != 0x80 && !token.empty()) {
+	unigrams.push_back(token);
+	token.clear();
+      }
+      token += buffer[i];
+    }
+
+    input.read(&buffer[0], buffer.size());
+    length = input.gcount();
+    if (length == 0) unigrams.push_back(token);
+
+    std::vector<std::string> grams;
+    std::vector<uint32_t> offsets;
+    this->tokenizePart(unigrams, tokenized, charOffset, length == 0, grams, offsets);
+    std::map<std::string, std::vector<uint32_t> > postings;
+    for (uint32_t i = 0; i < grams.size(); ++i) {
+      std::vector<uint32_t>& gramPostings = postings[grams[i]];
+      gramPostings.push_back(docId);
+      gramPostings.push_back(offsets[i]);
+    }
+    this->addPostings(docId, postings, appendable, statistics[0] + 1);
+    if (!checkpoints.empty()) this->catalog->append(docIdString.c_str(), &checkpoints[0], checkpoints.size());
+
+    uint32_t carried = std::min((uint32_t) unigrams.size(), this->gramSize - 1);
+    unigrams.erase(unigrams.begin(), unigrams.end() - carried);
+  }
+
+  uint64_t catalogOffset;
+  uint32_t catalogLength;
+  if (this->catalog->locate(docIdString.c_str(), &catalogOffset, &catalogLength)) {
+    this->catalog->write(catalogOffset, 0, &docLength, 1);
+  }
+  this->updateStatistics(1, docLength, docId + 1);
+  this->publishEpoch();
+}
+
+void Bubu::unregisterDoc(uint32_t docId)
+{
+  if (this->readOnly) return;
+  this->generation->beginWrite();
+
+  if (!this->removeDocPostings(docId)) return;
+  this->docStore->remove(docId);
+
+  std::string docIdString = Bubu::uintToString(docId);
+  uint32_t docLengthSize;
+  uint32_t* docLength = this->catalog->get(docIdString.c_str(), &docLengthSize);
+  if (docLength != NULL) {
+    this->updateStatistics(-1, -1 * (int64_t) *docLength, 0);
+    this->catalog->remove(docIdString.c_str());
+    delete[] docLength;
+  }
+  this->publishEpoch();
+}
+
+bool Bubu::removeDocPostings(uint32_t docId)
+{
+  // the stored document is tokenized chunk by chunk the way a stream is
+  // registered, so a long one is never held whole. A gram met in an
+  // earlier chunk has no postings of the document left, and is passed over
+  std::string chunk;
+  if (!this->docStore->read(docId, 0, Bubu::STREAM_CHUNK_SIZE, chunk)) return false;
+
+  std::vector<std::string> unigrams;
+  std::string token;
+  uint32_t byteOffset = 0;
+  std::vector<uint32_t> noPostings;
+  while (!chunk.empty()) {
+    uint32_t tokenized = unigrams.size();
+    for (uint32_t i = 0; i < chunk.size(); ++i) {
+      if ((chunk[i] & 0xC0) != 0x80 && !token.empty()) {
+	unigrams.push_back(token);
+	token.clear();
+      }
+      token += chunk[i];
+    }
+    byteOffset += chunk.size();
+
+    std::string nextChunk;
+    this->docStore->read(docId, byteOffset, Bubu::STREAM_CHUNK_SIZE, nextChunk);
+    if (nextChunk.empty()) unigrams.push_back(token);
+
+    // the offsets are of no use here
+    std::vector<std::string> grams;
+    std::vector<uint32_t> offsets;
+    this->tokenizePart(unigrams, tokenized, 0, nextChunk.empty(), grams, offsets);
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    for (uint32_t i = 0; i < grams.size(); ++i) {
+      uint32_t postingCount;
+      if (this->replacePostings(grams[i].c_str(), docId, noPostings, &postingCount)) {
+	this->removeFromBitmap(grams[i], docId, postingCount);
+      }
+    }
+
+    uint32_t carried = std::min((uint32_t) unigrams.size(), this->gramSize - 1);
+    unigrams.erase(unigrams.begin(), unigrams.end() - carried);
+    chunk.swap(nextChunk);
+  }
+  return true;
+}
+
+void Bubu::updateDoc(uint32_t docId, const char* docContent)
+{
+  if (this->readOnly) return;
+  this->generation->beginWrite();
+  if (docContent == NULL || strcmp(docContent, "") == 0) {
+    this->unregisterDoc(docId);
+    return;
+  }
+
+  // a docId without content is inserted afresh; registerDoc would send one
+  // its catalog still holds straight back here
+  std::string oldContent;
+  if (!this->docStore->get(docId, oldContent)) {
+    this->insertDoc(docId, docContent);
+    return;
+  }
+
+  // the offsets of each gram before and after; only grams whose offsets
+  // differ have their lists rewritten, so an edit leaves the grams ahead
+  // of it alone and an edit keeping its length those after it as well
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  std::map<std::string, std::vector<uint32_t> > oldOffsets;
+  this->tokenizeDoc(oldContent.c_str(), grams, offsets);
+  for (uint32_t i = 0; i < grams.size(); ++i) oldOffsets[grams[i]].push_back(offsets[i]);
+  std::map<std::string, std::vector<uint32_t> > newOffsets;
+  grams.clear();
+  offsets.clear();
+  uint32_t docLength = this->tokenizeDoc(docContent, grams, offsets);
+  for (uint32_t i = 0; i < grams.size(); ++i) newOffsets[grams[i]].push_back(offsets[i]);
+
+  uint32_t statistics[Bubu::STATISTICS_LENGTH];
+  this->loadStatistics(statistics);
+
+  std::map<std::string, std::vector<uint32_t> >::const_iterator oldIter = oldOffsets.begin();
+  std::map<std::string, std::vector<uint32_t> >::const_iterator newIter = newOffsets.begin();
+  while (oldIter != oldOffsets.end() || newIter != newOffsets.end()) {
+    bool inOld = oldIter != oldOffsets.end() && (newIter == newOffsets.end() || oldIter->first <= newIter->first);
+    bool inNew = newIter != newOffsets.end() && (oldIter == oldOffsets.end() || newIter->first <= oldIter->first);
+    const std::string& gram = inNew ? newIter->first : oldIter->first;
+
+    if (!inOld || !inNew || oldIter->second != newIter->second) {
+      std::vector<uint32_t> postings;
+      if (inNew) {
+	for (uint32_t i = 0; i < newIter->second.size(); ++i) {
+	  postings.push_back(docId);
+	  postings.push_back(newIter->second[i]);
+	}
+      }
+
+      uint32_t postingCount;
+      this->replacePostings(gram.c_str(), docId, postings, &postingCount);
+      if (!inNew) {
+	this->removeFromBitmap(gram, docId, postingCount);
+      }
+      else if (!inOld) {
+	this->addToBitmap(gram, docId, postingCount - newIter->second.size(), postingCount, statistics[0]);
+	this->dictionary->add(gram);
+      }
+      else if (postingCount < Bubu::BITMAP_MIN_POSTINGS) {
+	this->index->remove(Bubu::getBitmapKey(gram).c_str());
+      }
+    }
+
+    if (inOld) ++oldIter;
+    if (inNew) ++newIter;
+  }
+
+  this->docStore->put(docId, docContent, strlen(docContent));
+
+  std::string docIdString = Bubu::uintToString(docId);
+  uint32_t oldDocLengthSize;
+  uint32_t* oldDocLength = this->catalog->get(docIdString.c_str(), &oldDocLengthSize);
+  if (oldDocLength == NULL) {
+    this->updateStatistics(1, docLength, docId + 1);
+  }
+  else {
+    this->updateStatistics(0, (int64_t) docLength - *oldDocLength, docId + 1);
+    delete[] oldDocLength;
+  }
+
+  std::vector<uint32_t> catalogValue(1, docLength);
+  Bubu::calcCheckpoints(docContent, catalogValue);
+  this->catalog->set(docIdString.c_str(), &catalogValue[0], catalogValue.size());
+  this->publishEpoch();
+}
+
+std::string Bubu::getDocContent(uint32_t docId)
+{
+  std::string docContent;
+  this->getDocContent(docId, docContent);
+  return docContent;
+}
+
+bool Bubu::getDocContent(uint32_t docId, std::string& docContent)
+{
+  docContent.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+  this->docStore->get(docId, docContent);
+  return true;
+}
+
+std::string Bubu::getSnippet(uint32_t docId, uint32_t offset, uint32_t window)
+{
+  std::string snippet;
+  this->getSnippet(docId, offset, window, snippet);
+  return snippet;
+}
+
+bool Bubu::getSnippet(uint32_t docId, uint32_t offset, uint32_t window, std::string& snippet)
+{
+  snippet.clear();
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  // the window of characters is centered on the hit. Reading starts at the
+  // checkpoint before the window and covers as many bytes as the
+  // characters up to its end could take
+  uint32_t beginChar = offset - std::min(offset, window / 2);
+  uint32_t endChar = beginChar + window;
+  uint32_t bytePosition;
+  uint32_t charCount;
+  uint64_t epoch = this->pinEpoch();
+  this->findCheckpoint(docId, beginChar, epoch, &bytePosition, &charCount);
+  this->unpinEpoch(epoch);
+
+  std::string chunk;
+  uint32_t chunkLength = (uint32_t) std::min((uint64_t) (endChar - charCount) * Bubu::MAX_CHAR_LENGTH,
+					     (uint64_t) 0xffffffff);
+  if (!this->docStore->read(docId, bytePosition, chunkLength, chunk)) return true;
+
+  for (uint32_t i = 0; i < chunk.size(); ++i) {
+    if ((chunk[i] & 0xC0) != 0x80 || bytePosition + i == 0) {
+      if (charCount == endChar) break;
+      ++charCount;
+    }
+    if (charCount > beginChar) snippet += chunk[i];
+  }
+
+  return true;
+}
+
+bool Bubu::getByteOffset(uint32_t docId, uint32_t offset, uint32_t* byteOffset)
+{
+  ReadGuard guard(this->generation);
+  if (!guard.isCurrent()) return false;
+
+  uint32_t bytePosition;
+  uint32_t charCount;
+  uint64_t epoch = this->pinEpoch();
+  this->findCheckpoint(docId, offset, epoch, &bytePosition, &charCount);
+  this->unpinEpoch(epoch);
+
+  std::string chunk;
+  uint32_t chunkLength = (uint32_t) std::min((uint64_t) (offset - charCount + 1) * Bubu::MAX_CHAR_LENGTH,
+					     (uint64_t) 0xffffffff);
+  if (!this->docStore->read(docId, bytePosition, chunkLength, chunk)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < chunk.size(); ++i) {
+    if ((chunk[i] & 0xC0) != 0x80 || bytePosition + i == 0) {
+      if (charCount == offset) {
+	*byteOffset = bytePosition + i;
+	return true;
+      }
+      ++charCount;
+    }
+  }
+
+  return false;
+}
+
+void Bubu::trainDictionary(const std::vector<std::string>& samples)
+{
+  if (this->readOnly) return;
+  this->generation->beginWrite();
+  this->docStore->trainDictionary(samples);
+}
+
+void Bubu::tokenizeUTF8(const char* text, bool overlap,
+			std::vector<std::string>& unigrams, std::vector<std::string>& bigrams)
+{
+  unigrams.clear();
+  bigrams.clear();
+
+  std::string prevToken;
+  std::string token;
+  uint32_t size = strlen(text);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    char currentByte = *(text + i);
+
+    if ((currentByte & 0xC0) != 0x80 && !token.empty()) {
+      unigrams.push_back(token);
+
+      if (!prevToken.empty()) {
+	bigrams.push_back(prevToken + token);
+	if (!overlap) token.clear();
+      }
+
+      prevToken = token;
+      token.clear();	
+    } 
+
+    token += currentByte;
+  }
+  
+  unigrams.push_back(token);
+  if (!prevToken.empty()) bigrams.push_back(prevToken + token);
+}
+
+void Bubu::calcCheckpoints(const char* text, std::vector<uint32_t>& checkpoints)
+{
+  uint32_t charCount = 0;
+  for (uint32_t i = 0; *(text + i) != '\0'; ++i) {
+    if ((*(text + i) & 0xC0) != 0x80 || i == 0) {
+      if (charCount > 0 && charCount % Bubu::CHECKPOINT_INTERVAL == 0) checkpoints.push_back(i);
+      ++charCount;
+    }
+  }
+}
+
+void Bubu::findCheckpoint(uint32_t docId, uint32_t offset, uint64_t epoch, uint32_t* byteOffset, uint32_t* charOffset)
+{
+  *byteOffset = 0;
+  *charOffset = 0;
+
+  // documents registered before checkpoints existed are read from the start
+  uint64_t catalogOffset;
+  uint32_t catalogLength;
+  uint32_t checkpoint = offset / Bubu::CHECKPOINT_INTERVAL;
+  if (checkpoint == 0 ||
+      !this->catalog->locate(Bubu::uintToString(docId).c_str(), &catalogOffset, &catalogLength, epoch) ||
+      catalogLength <= 1) {
+    return;
+  }
+
+  checkpoint = std::min(checkpoint, catalogLength - 1);
+  if (this->catalog->read(catalogOffset, checkpoint, byteOffset, 1) == 1) {
+    *charOffset = checkpoint * Bubu::CHECKPOINT_INTERVAL;
+  }
+  else {
+    *byteOffset = 0;
+  }
+}
+
+uint32_t Bubu::tokenizeDoc(const char* docContent, std::vector<std::string>& grams, std::vector<uint32_t>& offsets)
+{
+  std::vector<std::string> unigrams;
+  std::vector<std::string> bigrams;
+  std::vector<std::string> longGrams;
+  Bubu::tokenizeUTF8(docContent, true, unigrams, bigrams);
+  Bubu::tokenizeGrams(unigrams, this->gramSize, longGrams);
+
+  if (this->indexUnigrams) {
+    for (uint32_t i = 0; i < unigrams.size(); ++i) {
+      grams.push_back(unigrams[i]);
+      offsets.push_back(i);
+    }
+  }
+  for (uint32_t i = 0; i < longGrams.size(); ++i) {
+    grams.push_back(longGrams[i]);
+    offsets.push_back(i);
+  }
+
+  // without unigrams every character still has to begin a gram, so the
+  // last ones, too close to the end for a full gram, begin a shorter one
+  // closed by END_MARKER
+  if (!this->indexUnigrams) {
+    for (uint32_t i = longGrams.size(); i < unigrams.size(); ++i) {
+      std::string gram;
+      for (uint32_t j = i; j < unigrams.size(); ++j) gram += unigrams[j];
+      grams.push_back(gram + Bubu::END_MARKER);
+      offsets.push_back(i);
+    }
+  }
+
+  return unigrams.size();
+}
+
+void Bubu::tokenizePart(const std::vector<std::string>& unigrams, uint32_t tokenized, uint32_t charOffset, bool last,
+			std::vector<std::string>& grams, std::vector<uint32_t>& offsets)
+{
+  // the first tokenized characters have been given their unigrams already
+  // but begin no gram yet; the last characters of a part which is not the
+  // last begin theirs in the next one
+  if (this->indexUnigrams) {
+    for (uint32_t i = tokenized; i < unigrams.size(); ++i) {
+      grams.push_back(unigrams[i]);
+      offsets.push_back(charOffset + i);
+    }
+  }
+
+  uint32_t i = 0;
+  for (; i + this->gramSize <= unigrams.size(); ++i) {
+    std::string gram;
+    for (uint32_t j = i; j < i + this->gramSize; ++j) gram += unigrams[j];
+    grams.push_back(gram);
+    offsets.push_back(charOffset + i);
+  }
+
+  if (last && !this->indexUnigrams) {
+    for (; i < unigrams.size(); ++i) {
+      std::string gram;
+      for (uint32_t j = i; j < unigrams.size(); ++j) gram += unigrams[j];
+      grams.push_back(gram + Bubu::END_MARKER);
+      offsets.push_back(charOffset + i);
+    }
+  }
+}
+
+bool Bubu::expandPrefix(const char* query, std::vector<uint32_t>& postings)
+{
+  return this->expandPrefix(query, postings, EpochManager::LATEST_EPOCH);
+}
+
+bool Bubu::expandPrefix(const char* query, std::vector<uint32_t>& postings, uint64_t epoch)
+{
+  postings.clear();
+  if (this->indexUnigrams || query == NULL) return false;
+
+  std::vector<std::string> unigrams;
+  std::vector<std::string> bigrams;
+  Bubu::tokenizeUTF8(query, true, unigrams, bigrams);
+  if (strcmp(query, "") == 0 || unigrams.size() >= this->gramSize) return false;
+
+  // a short query occurs wherever a gram it prefixes begins. Each position
+  // begins exactly one gram, so the lists are disjoint and only have to be
+  // brought into (docId, offset) order
+  std::vector<std::string> grams;
+  this->dictionary->findPrefix(query, 0xffffffff, grams);
+
+  std::vector<uint32_t*> docValues;
+  std::vector<uint32_t> docLengths;
+  std::vector<uint32_t*> positionValues;
+  std::vector<uint32_t> positionLengths;
+  this->index->getAll(this->getReader(), grams, docValues, docLengths, epoch);
+  this->positions->getAll(this->getReader(), grams, positionValues, positionLengths, epoch);
+
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  for (uint32_t g = 0; g < grams.size(); ++g) {
+    if (docValues[g] != NULL && positionValues[g] != NULL) {
+      std::vector<uint32_t> gramPostings;
+      PostingList::decode(docValues[g], docLengths[g], positionValues[g], gramPostings);
+      for (uint32_t i = 0; i < gramPostings.size(); i += 2) {
+	hits.push_back(std::pair<uint32_t, uint32_t>(gramPostings[i], gramPostings[i + 1]));
+      }
+    }
+    if (docValues[g] != NULL) delete[] docValues[g];
+    if (positionValues[g] != NULL) delete[] positionValues[g];
+  }
+  std::sort(hits.begin(), hits.end());
+
+  postings.reserve(hits.size() * 2);
+  for (uint32_t i = 0; i < hits.size(); ++i) {
+    postings.push_back(hits[i].first);
+    postings.push_back(hits[i].second);
+  }
+  return true;
+}
+
+uint32_t Bubu::loadDocLength(uint32_t docId, uint32_t defaultLength, uint64_t epoch)
+{
+  // only the length is needed out of the catalog entry, not the checkpoints
+  uint32_t docLength = defaultLength;
+  std::vector<std::string> keys(1, Bubu::uintToString(docId));
+  std::vector<uint64_t> catalogOffsets;
+  std::vector<uint32_t> catalogLengths;
+  this->catalog->locateAll(this->getReader(), keys, catalogOffsets, catalogLengths, epoch);
+  if (catalogOffsets[0] != 0 && catalogLengths[0] > 0) this->catalog->read(catalogOffsets[0], 0, &docLength, 1);
+  return docLength;
+}
+
+ThreadPool* Bubu::getThreadPool()
+{
+  pthread_mutex_lock(&(this->mutex));
+  if (this->threadPool == NULL) {
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    this->threadPool = new ThreadPool((processorCount > 0) ? processorCount : 1);
+  }
+  pthread_mutex_unlock(&(this->mutex));
+
+  return this->threadPool;
+}
+
+AsyncReader* Bubu::getReader()
+{
+  pthread_mutex_lock(&(this->mutex));
+  if (this->reader == NULL) this->reader = new AsyncReader();
+  pthread_mutex_unlock(&(this->mutex));
+  return this->reader;
+}
+
+// Reads the bitmaps of the dense grams among those of a phrase and ANDs
+// them into a filter for its cursors; false if there is nothing to filter.
+bool Bubu::loadFilter(const std::vector<std::string>& grams, uint64_t epoch,
+		      Bitmap& filter, std::vector<bool>& filtered)
+{
+  filtered.clear();
+  if (grams.size() < 2) return false;
+
+  std::vector<std::string> bitmapKeys;
+  for (uint32_t g = 0; g < grams.size(); ++g) bitmapKeys.push_back(Bubu::getBitmapKey(grams[g]));
+  std::vector<uint32_t*> bitmapValues;
+  std::vector<uint32_t> bitmapLengths;
+  this->index->getAll(this->getReader(), bitmapKeys, bitmapValues, bitmapLengths, epoch);
+
+  std::vector<Bitmap> bitmaps(grams.size());
+  std::vector<bool> dense(grams.size(), false);
+  for (uint32_t g = 0; g < grams.size(); ++g) {
+    if (bitmapValues[g] == NULL) continue;
+    bitmaps[g] = Bitmap(bitmapValues[g], bitmapLengths[g]);
+    dense[g] = true;
+    delete[] bitmapValues[g];
+  }
+  return Bubu::combineFilter(bitmaps, dense, filter, filtered);
+}
+
+std::vector<std::pair<uint32_t, uint32_t> > Bubu::searchPartitioned(const std::vector<PostingLocation>& locations,
+								      const std::vector<uint32_t>& offsets,
+								      const Bitmap& filter, const std::vector<bool>& filtered,
+								      uint32_t partitionCount)
+{
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  if (locations.empty()) return hits;
+
+  // the docId space is cut at the first docIds of evenly spaced blocks of
+  // the longest list, read from the block headers alone; phrases never
+  // cross documents, so the partitions are independent
+  uint32_t longest = 0;
+  for (uint32_t i = 1; i < locations.size(); ++i) {
+    if (locations[i].docLength > locations[longest].docLength) longest = i;
+  }
+
+  std::vector<uint32_t> boundaries;
+  uint64_t blockCount = PostingList::countBlocks(locations[longest].docLength);
+  for (uint32_t p = 1; p < partitionCount; ++p) {
+    uint32_t block = (uint32_t) (blockCount * p / partitionCount);
+    if (block == 0) continue;
+
+    uint32_t docId;
+    if (this->index->read(locations[longest].docOffset, block * PostingList::BLOCK_STRIDE, &docId, 1) != 1) break;
+    if (boundaries.empty() || docId > boundaries.back()) boundaries.push_back(docId);
+  }
+
+  std::vector<PartitionSearchTask*> tasks;
+  for (uint32_t p = 0; p <= boundaries.size(); ++p) {
+    uint32_t beginDocId = (p == 0) ? 0 : boundaries[p - 1];
+    bool bounded = (p < boundaries.size());
+    uint32_t endDocId = bounded ? boundaries[p] : 0;
+    tasks.push_back(new PartitionSearchTask(this->index, this->positions, locations, offsets, &filter, &filtered,
+					    beginDocId, endDocId, bounded));
+  }
+
+  if (tasks.size() == 1) {
+    tasks.front()->run();
+  }
+  else {
+    ThreadPool* pool = this->getThreadPool();
+    std::vector<PartitionSearchTask*>::iterator taskIter = tasks.begin();
+    while (taskIter != tasks.end()) {
+      pool->submit(*taskIter);
+      ++taskIter;
+    }
+    pool->wait();
+  }
+
+  std::vector<PartitionSearchTask*>::iterator taskIter = tasks.begin();
+  while (taskIter != tasks.end()) {
+    hits.insert(hits.end(), (*taskIter)->getHits().begin(), (*taskIter)->getHits().end());
+    delete *taskIter;
+    ++taskIter;
+  }
+
+  return hits;
+}
+
+void Bubu::loadStatistics(uint32_t* statistics, uint64_t epoch)
+{
+  std::fill(statistics, statistics + Bubu::STATISTICS_LENGTH, 0);
+
+  std::vector<std::string> keys(1, Bubu::STATISTICS_KEY);
+  std::vector<uint32_t*> values;
+  std::vector<uint32_t> valueLengths;
+  this->catalog->getAll(this->getReader(), keys, values, valueLengths, epoch);
+  if (values[0] != NULL) {
+    std::copy(values[0], values[0] + std::min(valueLengths[0], Bubu::STATISTICS_LENGTH), statistics);
+    delete[] values[0];
+  }
+}
+
+void Bubu::publishEpoch()
+{
+  // what this epoch replaced stays until the searches pinned before it end
+  this->epochs->publish();
+  this->index->reclaim();
+  this->positions->reclaim();
+  this->catalog->reclaim();
+}
+
+void Bubu::loadStatistics(uint32_t* statistics)
+{
+  std::fill(statistics, statistics + Bubu::STATISTICS_LENGTH, 0);
+
+  uint32_t statisticsLength;
+  uint32_t* storedStatistics = this->catalog->get(Bubu::STATISTICS_KEY, &statisticsLength);
+  if (storedStatistics != NULL) {
+    std::copy(storedStatistics,
+	      storedStatistics + std::min(statisticsLength, Bubu::STATISTICS_LENGTH), statistics);
+    delete[] storedStatistics;
+  }
+}
+
+void Bubu::updateStatistics(int32_t docCountDelta, int64_t docLengthDelta, uint32_t nextDocId)
+{
+  uint32_t statistics[Bubu::STATISTICS_LENGTH];
+  this->loadStatistics(statistics);
+
+  uint64_t totalLength = ((uint64_t) statistics[2] << 32) | statistics[1];
+  totalLength += docLengthDelta;
+  statistics[0] += docCountDelta;
+  statistics[1] = (uint32_t) totalLength;
+  statistics[2] = (uint32_t) (totalLength >> 32);
+  statistics[3] = std::max(statistics[3], nextDocId);
+
+  this->catalog->set(Bubu::STATISTICS_KEY, statistics, Bubu::STATISTICS_LENGTH);
+}
+
+void Bubu::addPostings(uint32_t docId, const std::map<std::string, std::vector<uint32_t> >& postings,
+		       bool appendable, uint32_t docCount)
+{
+  // lists are kept in docId order; a docId above every registered one can
+  // simply be appended, anything else has to be merged into place
+  std::map<std::string, std::vector<uint32_t> >::const_iterator iter = postings.begin();
+  while (iter != postings.end()) {
+    uint32_t postingCount;
+    if (appendable) {
+      postingCount = PostingList::append(this->index, this->positions, iter->first.c_str(), iter->second);
+    }
+    else {
+      postingCount = this->insertPostings(iter->first.c_str(), iter->second);
+    }
+    this->addToBitmap(iter->first, docId, postingCount - iter->second.size() / 2, postingCount, docCount);
+    this->dictionary->add(iter->first);
+    ++iter;
+  }
+}
+
+uint32_t Bubu::insertPostings(const char* gram, const std::vector<uint32_t>& postings)
+{
+  std::vector<uint32_t> oldPostings;
+  PostingList::get(this->index, this->positions, gram, oldPostings);
+
+  uint32_t docId = postings.front();
+  uint32_t position = 0;
+  while (position < oldPostings.size() && oldPostings[position] <= docId) position += 2;
+
+  oldPostings.insert(oldPostings.begin() + position, postings.begin(), postings.end());
+  PostingList::set(this->index, this->positions, gram, oldPostings);
+
+  return oldPostings.size() / 2;
+}
+
+bool Bubu::replacePostings(const char* gram, uint32_t docId, const std::vector<uint32_t>& postings,
+			   uint32_t* postingCount)
+{
+  // the postings of a document sit together in the list
+  std::vector<uint32_t> oldPostings;
+  PostingList::get(this->index, this->positions, gram, oldPostings);
+  uint32_t begin = 0;
+  while (begin < oldPostings.size() && oldPostings[begin] < docId) begin += 2;
+  uint32_t end = begin;
+  while (end < oldPostings.size() && oldPostings[end] == docId) end += 2;
+
+  *postingCount = oldPostings.size() / 2;
+  if (begin == end && postings.empty()) return false;
+
+  oldPostings.erase(oldPostings.begin() + begin, oldPostings.begin() + end);
+  oldPostings.insert(oldPostings.begin() + begin, postings.begin(), postings.end());
+  PostingList::set(this->index, this->positions, gram, oldPostings);
+  *postingCount = oldPostings.size() / 2;
+  return true;
+}
+
+void Bubu::addToBitmap(const std::string& gram, uint32_t docId, uint32_t oldPostingCount, uint32_t postingCount,
+		       uint32_t docCount)
+{
+  // lists this short never carry a bitmap
+  if (postingCount < Bubu::BITMAP_MIN_POSTINGS) return;
+
+  std::string bitmapKey = Bubu::getBitmapKey(gram);
+  if (Bitmap::append(this->index, bitmapKey.c_str(), docId)) return;
+
+  // a list is only checked for density when its length passes a power of
+  // two, so the decoding this takes stays cheap in total
+  if ((oldPostingCount ^ postingCount) <= oldPostingCount) return;
+
+  std::vector<uint32_t> docs;
+  PostingList::getDocs(this->index, gram.c_str(), docs);
+  Bitmap bitmap;
+  for (uint32_t i = 0; i < docs.size(); i += 2) bitmap.add(docs[i]);
+  if (bitmap.size() * Bubu::BITMAP_DENSITY >= docCount) Bitmap::set(this->index, bitmapKey.c_str(), bitmap);
+}
+
+void Bubu::removeFromBitmap(const std::string& gram, uint32_t docId, uint32_t postingCount)
+{
+  std::string bitmapKey = Bubu::getBitmapKey(gram);
+  if (postingCount < Bubu::BITMAP_MIN_POSTINGS) {
+    this->index->remove(bitmapKey.c_str());
+    return;
+  }
+
+  Bitmap bitmap;
+  if (Bitmap::get(this->index, bitmapKey.c_str(), bitmap)) {
+    bitmap.remove(docId);
+    Bitmap::set(this->index, bitmapKey.c_str(), bitmap);
+  }
+}
+
+double Bubu::calcScore(uint32_t termFrequency, double idf, uint32_t docLength, double avgDocLength)
+{
+  double lengthRatio = (avgDocLength > 0.0) ? docLength / avgDocLength : 1.0;
+  double norm = Bubu::BM25_K1 * (1.0 - Bubu::BM25_B + Bubu::BM25_B * lengthRatio);
+  return idf * termFrequency * (Bubu::BM25_K1 + 1.0) / (termFrequency + norm);
+}
+
+// The largest term frequency whose score, at the shortest document length,
+// does not exceed the score given.
+uint32_t Bubu::calcMaxFrequency(double score, double idf, double avgDocLength)
+{
+  uint32_t low = 0;
+  uint32_t high = 0xffffffff;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2 + 1;
+    if (Bubu::calcScore(middle, idf, 0, avgDocLength) <= score) low = middle;
+    else high = middle - 1;
+  }
+  return low;
+}
+
+void Bubu::tokenizeGrams(const std::vector<std::string>& unigrams, uint32_t gramSize,
+			 std::vector<std::string>& grams)
+{
+  grams.clear();
+
+  for (uint32_t i = 0; i + gramSize <= unigrams.size(); ++i) {
+    std::string gram;
+    for (uint32_t j = i; j < i + gramSize; ++j) gram += unigrams[j];
+    grams.push_back(gram);
+  }
+}
+
+void Bubu::tokenizeQuery(const char* query, uint32_t gramSize,
+			 std::vector<std::string>& grams, std::vector<uint32_t>& offsets)
+{
+  grams.clear();
+  offsets.clear();
+  if (query == NULL || strcmp(query, "") == 0) return;
+
+  std::vector<std::string> unigrams;
+  std::vector<std::string> bigrams;
+  Bubu::tokenizeUTF8(query, true, unigrams, bigrams);
+  uint32_t querySize = unigrams.size();
+
+  // a query shorter than the longest grams is matched character by character
+  if (querySize < gramSize) {
+    for (uint32_t i = 0; i < querySize; ++i) {
+      grams.push_back(unigrams[i]);
+      offsets.push_back(i);
+    }
+    return;
+  }
+
+  // otherwise it is tiled with the longest grams, the last of which is
+  // moved back to end with the query rather than falling back to unigrams
+  std::vector<std::string> longGrams;
+  Bubu::tokenizeGrams(unigrams, gramSize, longGrams);
+  for (uint32_t i = 0; i + gramSize <= querySize; i += gramSize) {
+    grams.push_back(longGrams[i]);
+    offsets.push_back(i);
+  }
+  if (querySize % gramSize) {
+    grams.push_back(longGrams[querySize - gramSize]);
+    offsets.push_back(querySize - gramSize);
+  }
+}
+
+// Bitmaps may hold documents newer than the epoch they were read at, or
+// removed since, so the filter is a superset of the documents holding
+// every dense gram; the cursor still confirms them in the doc streams.
+bool Bubu::combineFilter(const std::vector<Bitmap>& bitmaps, const std::vector<bool>& dense,
+			 Bitmap& filter, std::vector<bool>& filtered)
+{
+  filtered.clear();
+  if (bitmaps.size() < 2 || std::find(dense.begin(), dense.end(), true) == dense.end()) return false;
+
+  bool first = true;
+  for (uint32_t g = 0; g < bitmaps.size(); ++g) {
+    if (!dense[g]) continue;
+    if (first) filter = bitmaps[g];
+    else filter.intersect(bitmaps[g]);
+    first = false;
+  }
+  filtered = dense;
+  return true;
+}
+
+std::string Bubu::getBitmapKey(const std::string& gram)
+{
+  return Bubu::BITMAP_KEY_PREFIX + gram;
 }
 
 std::string Bubu::uintToString(uint32_t uintValue)
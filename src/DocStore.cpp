@@ -0,0 +1,750 @@
+/**
+ * DocStore.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include "bb/DocStore.hpp"
+#include "bb/LZCodec.hpp"
+
+using bb::DBM;
+using bb::DocStore;
+using bb::LZCodec;
+
+namespace {
+
+void putWord(std::string& bytes, uint32_t word)
+{
+  bytes.append((const char*) &word, sizeof(word));
+}
+
+uint32_t getWord(const char* bytes, uint32_t index)
+{
+  uint32_t word;
+  memcpy(&word, bytes + index * sizeof(word), sizeof(word));
+  return word;
+}
+
+uint64_t hashSegment(const char* bytes, uint32_t bits)
+{
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(word));
+  return (word * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+}
+
+}
+
+const char* DocStore::STATE_KEY = "$docstore";
+const char* DocStore::BLOCK_KEY_PREFIX = "$block:";
+const char* DocStore::OPEN_BLOCK_KEY = "$block:open";
+const char* DocStore::DIRECTORY_KEY_PREFIX = "$directory:";
+const char* DocStore::DICTIONARY_KEY_PREFIX = "$dictionary:";
+const char* DocStore::LARGE_KEY_PREFIX = "$large:";
+const uint32_t DocStore::LARGE_BLOCK_ID = 0xffffffff;
+const uint32_t DocStore::DIRECTORY_PAGE_LENGTH = 1024;
+const uint32_t DocStore::HEADER_LENGTH = 4;
+const uint32_t DocStore::FORMAT_RAW = 0;
+const uint32_t DocStore::FORMAT_LZ = 1;
+const uint32_t DocStore::BLOCK_SIZE = 65536;
+const uint32_t DocStore::CACHE_SIZE = 8;
+const uint32_t DocStore::DICTIONARY_SIZE = 32768;
+
+DocStore::DocStore(DBM<char>* library) : library(library)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+  this->clear();
+}
+
+DocStore::~DocStore()
+{
+  this->clear();
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+void DocStore::load()
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->clear();
+
+  uint32_t stateLength;
+  char* state = this->library->get(DocStore::STATE_KEY, &stateLength);
+  if (state != NULL && stateLength >= 3 * sizeof(uint32_t)) {
+    this->nextBlockId = getWord(state, 0);
+    this->openBlockId = getWord(state, 1);
+    this->dictionaryId = getWord(state, 2);
+  }
+  if (state != NULL) delete[] state;
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+void DocStore::reset()
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->clear();
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+bool DocStore::get(uint32_t docId, std::string& content)
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool found = this->getDoc(docId, content);
+  pthread_mutex_unlock(&(this->mutex));
+  return found;
+}
+
+bool DocStore::read(uint32_t docId, uint32_t begin, uint32_t length, std::string& content)
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool found = this->readDoc(docId, begin, length, content);
+  pthread_mutex_unlock(&(this->mutex));
+  return found;
+}
+
+void DocStore::put(uint32_t docId, const char* content, uint32_t length)
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->putDoc(docId, content, length);
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+void DocStore::append(uint32_t docId, const char* content, uint32_t length)
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->appendLarge(docId, content, length);
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+bool DocStore::remove(uint32_t docId)
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool removed = this->removeDoc(docId);
+  pthread_mutex_unlock(&(this->mutex));
+  return removed;
+}
+
+bool DocStore::sync()
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool synced = this->library->sync();
+  pthread_mutex_unlock(&(this->mutex));
+  return synced;
+}
+
+void DocStore::clear()
+{
+  std::vector<Block*>::iterator iter = this->cache.begin();
+  while (iter != this->cache.end()) {
+    delete *iter;
+    ++iter;
+  }
+  this->cache.clear();
+  this->dictionaries.clear();
+
+  this->nextBlockId = 1;
+  this->openBlockId = 0;
+  this->dictionaryId = 0;
+}
+
+bool DocStore::getDoc(uint32_t docId, std::string& content)
+{
+  content.clear();
+
+  uint32_t blockId = this->findBlock(docId);
+  if (blockId == DocStore::LARGE_BLOCK_ID) {
+    uint32_t partCount;
+    uint32_t docLength;
+    if (!this->loadLarge(docId, &partCount, &docLength)) return false;
+    for (uint32_t p = 0; p < partCount; ++p) {
+      std::string part;
+      if (!this->loadPart(docId, p, part)) {
+	content.clear();
+	return false;
+      }
+      content.append(part);
+    }
+    return true;
+  }
+  if (blockId == 0) {
+    uint32_t legacyLength;
+    char* legacy = this->library->get(DocStore::getKey("", docId).c_str(), &legacyLength);
+    if (legacy == NULL) return false;
+    content.assign(legacy, legacyLength);
+    delete[] legacy;
+    return true;
+  }
+
+  Block* block = this->loadBlock(blockId);
+  if (block == NULL) return false;
+
+  for (uint32_t i = 0; i < block->entries.size(); i += 3) {
+    if (block->entries[i] == docId) {
+      content.assign(block->content, block->entries[i + 1], block->entries[i + 2]);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DocStore::readDoc(uint32_t docId, uint32_t begin, uint32_t length, std::string& content)
+{
+  content.clear();
+
+  // only the parts of a large document holding the range are decompressed
+  uint32_t blockId = this->findBlock(docId);
+  if (blockId == DocStore::LARGE_BLOCK_ID) {
+    uint32_t partCount;
+    uint32_t docLength;
+    if (!this->loadLarge(docId, &partCount, &docLength)) return false;
+    if (begin >= docLength) return true;
+    uint32_t end = begin + std::min(length, docLength - begin);
+    for (uint32_t p = begin / DocStore::BLOCK_SIZE; p < partCount && p * DocStore::BLOCK_SIZE < end; ++p) {
+      std::string part;
+      if (!this->loadPart(docId, p, part)) return false;
+      uint32_t partBegin = p * DocStore::BLOCK_SIZE;
+      uint32_t from = std::max(begin, partBegin) - partBegin;
+      content.append(part, from, std::min(end - partBegin, (uint32_t) part.size()) - from);
+    }
+    return true;
+  }
+  if (blockId == 0) {
+    uint64_t legacyOffset;
+    uint32_t legacyLength;
+    if (!this->library->locate(DocStore::getKey("", docId).c_str(), &legacyOffset, &legacyLength)) return false;
+    if (begin >= legacyLength) return true;
+
+    content.resize(std::min(length, legacyLength - begin));
+    content.resize(this->library->read(legacyOffset, begin, &content[0], content.size()));
+    return true;
+  }
+
+  Block* block = this->loadBlock(blockId);
+  if (block == NULL) return false;
+
+  for (uint32_t i = 0; i < block->entries.size(); i += 3) {
+    if (block->entries[i] == docId) {
+      uint32_t docLength = block->entries[i + 2];
+      if (begin < docLength) content.assign(block->content, block->entries[i + 1] + begin, std::min(length, docLength - begin));
+      return true;
+    }
+  }
+  return false;
+}
+
+void DocStore::putDoc(uint32_t docId, const char* content, uint32_t length)
+{
+  this->removeDoc(docId);
+
+  // a document filling a block by itself gains nothing from sharing one,
+  // and split into parts compressed one by one it is read a range at a time
+  if (length >= DocStore::BLOCK_SIZE) {
+    this->appendLarge(docId, content, length);
+    return;
+  }
+
+  Block* block = (this->openBlockId == 0) ? NULL : this->loadBlock(this->openBlockId);
+  if (block == NULL) {
+    this->openBlockId = this->nextBlockId++;
+
+    // every open block is written to the same record, which is given its
+    // full size once; growing one by doubling for each block would leave a
+    // trail of freed records behind that sealed blocks are too small to fill
+    if (!this->library->contains(DocStore::OPEN_BLOCK_KEY)) {
+      std::string reserved(DocStore::BLOCK_SIZE * 2, '\0');
+      this->library->set(DocStore::OPEN_BLOCK_KEY, reserved.data(), reserved.size());
+    }
+    this->library->set(DocStore::OPEN_BLOCK_KEY, "", 0);
+    this->saveState();
+
+    block = new Block();
+    block->blockId = this->openBlockId;
+    block->sealed = false;
+    this->cache.insert(this->cache.begin(), block);
+  }
+
+  // a document only adds its own record to the end of the open block, and
+  // the state changes only when a block is opened or sealed
+  std::string record;
+  putWord(record, docId);
+  putWord(record, length);
+  record.append(content, length);
+  this->library->append(DocStore::OPEN_BLOCK_KEY, record.data(), record.size());
+
+  block->entries.push_back(docId);
+  block->entries.push_back(block->content.size());
+  block->entries.push_back(length);
+  block->content.append(content, length);
+  this->setBlock(docId, block->blockId);
+
+  if (block->content.size() >= DocStore::BLOCK_SIZE) {
+    block->sealed = true;
+    this->openBlockId = 0;
+    this->saveBlock(block);
+    this->saveState();
+  }
+}
+
+bool DocStore::removeDoc(uint32_t docId)
+{
+  uint32_t blockId = this->findBlock(docId);
+  if (blockId == DocStore::LARGE_BLOCK_ID) {
+    uint32_t partCount;
+    uint32_t docLength;
+    std::string largeKey = DocStore::getKey(DocStore::LARGE_KEY_PREFIX, docId);
+    if (this->loadLarge(docId, &partCount, &docLength)) {
+      for (uint32_t p = 0; p < partCount; ++p) this->library->remove(DocStore::getPartKey(docId, p).c_str());
+      this->library->remove(largeKey.c_str());
+    }
+    this->setBlock(docId, 0);
+    return true;
+  }
+  if (blockId == 0) {
+    std::string legacyKey = DocStore::getKey("", docId);
+    if (!this->library->contains(legacyKey.c_str())) return false;
+    this->library->remove(legacyKey.c_str());
+    return true;
+  }
+
+  this->setBlock(docId, 0);
+  Block* block = this->loadBlock(blockId);
+  if (block == NULL) return false;
+
+  // the remaining documents are packed together again so that a block
+  // never carries dead content
+  std::vector<uint32_t> entries;
+  std::string content;
+  bool found = false;
+  for (uint32_t i = 0; i < block->entries.size(); i += 3) {
+    if (block->entries[i] == docId) {
+      found = true;
+      continue;
+    }
+    entries.push_back(block->entries[i]);
+    entries.push_back(content.size());
+    entries.push_back(block->entries[i + 2]);
+    content.append(block->content, block->entries[i + 1], block->entries[i + 2]);
+  }
+  if (!found) return false;
+
+  if (entries.empty()) {
+    this->dropBlock(blockId);
+    if (this->openBlockId == blockId) {
+      this->openBlockId = 0;
+      this->saveState();
+    }
+  }
+  else {
+    block->entries.swap(entries);
+    block->content.swap(content);
+    this->saveBlock(block);
+  }
+  return true;
+}
+
+void DocStore::trainDictionary(const std::vector<std::string>& samples)
+{
+  std::string dictionary = DocStore::buildDictionary(samples, DocStore::DICTIONARY_SIZE);
+  if (dictionary.empty()) return;
+
+  // blocks sealed earlier keep referring to the dictionary they were
+  // compressed with, so every dictionary stays under its own key
+  pthread_mutex_lock(&(this->mutex));
+  ++(this->dictionaryId);
+  this->library->set(DocStore::getKey(DocStore::DICTIONARY_KEY_PREFIX, this->dictionaryId).c_str(),
+		     dictionary.data(), dictionary.size());
+  this->dictionaries[this->dictionaryId] = dictionary;
+  this->saveState();
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+std::string DocStore::buildDictionary(const std::vector<std::string>& samples, uint32_t dictionarySize)
+{
+  const uint32_t hashBits = 20;
+  const uint32_t gramLength = 8;
+  const uint32_t segmentLength = 64;
+
+  // count every 8-byte string over all samples, then score fixed-size
+  // segments by how often the strings in them recur elsewhere
+  std::vector<uint32_t> counts(1 << hashBits, 0);
+  std::vector<std::string>::const_iterator iter = samples.begin();
+  for (; iter != samples.end(); ++iter) {
+    for (uint32_t i = 0; i + gramLength <= iter->size(); ++i) {
+      ++counts[hashSegment(iter->data() + i, hashBits)];
+    }
+  }
+
+  std::vector<std::pair<uint64_t, std::pair<uint32_t, uint32_t> > > segments;
+  for (uint32_t s = 0; s < samples.size(); ++s) {
+    for (uint32_t begin = 0; begin + segmentLength <= samples[s].size(); begin += segmentLength) {
+      uint64_t score = 0;
+      for (uint32_t i = begin; i + gramLength <= begin + segmentLength; ++i) {
+	score += counts[hashSegment(samples[s].data() + i, hashBits)] - 1;
+      }
+      if (score > 0) segments.push_back(std::make_pair(score, std::make_pair(s, begin)));
+    }
+  }
+  std::sort(segments.begin(), segments.end(), std::greater<std::pair<uint64_t, std::pair<uint32_t, uint32_t> > >());
+
+  // take the best segments first, forgetting the strings each one covers
+  // so that the dictionary does not fill up with copies of one phrase
+  std::vector<std::string> chosen;
+  uint32_t size = 0;
+  for (uint32_t c = 0; c < segments.size() && size + segmentLength <= dictionarySize; ++c) {
+    const char* segment = samples[segments[c].second.first].data() + segments[c].second.second;
+    uint64_t score = 0;
+    for (uint32_t i = 0; i + gramLength <= segmentLength; ++i) {
+      uint32_t count = counts[hashSegment(segment + i, hashBits)];
+      if (count > 0) score += count - 1;
+    }
+    if (score * 2 < segments[c].first) continue;
+
+    for (uint32_t i = 0; i + gramLength <= segmentLength; ++i) counts[hashSegment(segment + i, hashBits)] = 0;
+    chosen.push_back(std::string(segment, segmentLength));
+    size += segmentLength;
+  }
+
+  // the most useful segments go last, where matches reach them cheapest
+  std::string dictionary;
+  dictionary.reserve(size);
+  std::vector<std::string>::reverse_iterator chosenIter = chosen.rbegin();
+  for (; chosenIter != chosen.rend(); ++chosenIter) dictionary.append(*chosenIter);
+  return dictionary;
+}
+
+std::string DocStore::getKey(const char* prefix, uint32_t id)
+{
+  std::ostringstream stream;
+  stream << prefix << id;
+  return stream.str();
+}
+
+std::string DocStore::getPartKey(uint32_t docId, uint32_t part)
+{
+  std::ostringstream stream;
+  stream << DocStore::LARGE_KEY_PREFIX << docId << ':' << part;
+  return stream.str();
+}
+
+std::string DocStore::getBlockKey(uint32_t blockId)
+{
+  if (blockId == this->openBlockId) return DocStore::OPEN_BLOCK_KEY;
+  return DocStore::getKey(DocStore::BLOCK_KEY_PREFIX, blockId);
+}
+
+void DocStore::saveState()
+{
+  std::string state;
+  putWord(state, this->nextBlockId);
+  putWord(state, this->openBlockId);
+  putWord(state, this->dictionaryId);
+  this->library->set(DocStore::STATE_KEY, state.data(), state.size());
+}
+
+uint32_t DocStore::findBlock(uint32_t docId)
+{
+  std::string pageKey = DocStore::getKey(DocStore::DIRECTORY_KEY_PREFIX, docId / DocStore::DIRECTORY_PAGE_LENGTH);
+  uint64_t pageOffset;
+  uint32_t pageLength;
+  if (!this->library->locate(pageKey.c_str(), &pageOffset, &pageLength)) return 0;
+
+  char slot[sizeof(uint32_t)];
+  uint32_t index = (docId % DocStore::DIRECTORY_PAGE_LENGTH) * sizeof(uint32_t);
+  if (this->library->read(pageOffset, index, slot, sizeof(slot)) != sizeof(slot)) return 0;
+  return getWord(slot, 0);
+}
+
+void DocStore::setBlock(uint32_t docId, uint32_t blockId)
+{
+  std::string pageKey = DocStore::getKey(DocStore::DIRECTORY_KEY_PREFIX, docId / DocStore::DIRECTORY_PAGE_LENGTH);
+  uint32_t index = (docId % DocStore::DIRECTORY_PAGE_LENGTH) * sizeof(uint32_t);
+  uint64_t pageOffset;
+  uint32_t pageLength;
+  if (this->library->locate(pageKey.c_str(), &pageOffset, &pageLength)) {
+    this->library->write(pageOffset, index, (const char*) &blockId, sizeof(blockId));
+  }
+  else if (blockId != 0) {
+    std::string page(DocStore::DIRECTORY_PAGE_LENGTH * sizeof(uint32_t), '\0');
+    memcpy(&page[index], &blockId, sizeof(blockId));
+    this->library->set(pageKey.c_str(), page.data(), page.size());
+  }
+}
+
+DocStore::Block* DocStore::loadBlock(uint32_t blockId)
+{
+  std::vector<Block*>::iterator iter = this->cache.begin();
+  while (iter != this->cache.end()) {
+    if ((*iter)->blockId == blockId) {
+      Block* block = *iter;
+      this->cache.erase(iter);
+      this->cache.insert(this->cache.begin(), block);
+      return block;
+    }
+    ++iter;
+  }
+
+  uint32_t valueLength;
+  char* value = this->library->get(this->getBlockKey(blockId).c_str(), &valueLength);
+  if (value == NULL) return NULL;
+
+  // the open block is a run of (docId, length, content) records
+  if (blockId == this->openBlockId) {
+    Block* block = new Block();
+    block->blockId = blockId;
+    block->sealed = false;
+    uint32_t position = 0;
+    while (position + 2 * sizeof(uint32_t) <= valueLength) {
+      uint32_t docId = getWord(value + position, 0);
+      uint32_t docLength = getWord(value + position, 1);
+      if (docLength > valueLength - position - 2 * sizeof(uint32_t)) break;
+
+      position += 2 * sizeof(uint32_t);
+      block->entries.push_back(docId);
+      block->entries.push_back(block->content.size());
+      block->entries.push_back(docLength);
+      block->content.append(value + position, docLength);
+      position += docLength;
+    }
+    delete[] value;
+    if (position != valueLength) {
+      delete block;
+      return NULL;
+    }
+
+    this->cacheBlock(block);
+    return block;
+  }
+
+  Block* block = NULL;
+  uint32_t entryCount = (valueLength >= DocStore::HEADER_LENGTH * sizeof(uint32_t)) ? getWord(value, 2) : 0;
+  uint32_t payloadBegin = (DocStore::HEADER_LENGTH + entryCount * 3) * sizeof(uint32_t);
+  if (entryCount > 0 && payloadBegin <= valueLength) {
+    block = new Block();
+    block->blockId = blockId;
+    block->sealed = true;
+    for (uint32_t i = 0; i < entryCount * 3; ++i) {
+      block->entries.push_back(getWord(value, DocStore::HEADER_LENGTH + i));
+    }
+
+    if (!this->decompress(getWord(value, 0), getWord(value, 1), value + payloadBegin, valueLength - payloadBegin,
+			  getWord(value, 3), block->content)) {
+      delete block;
+      block = NULL;
+    }
+  }
+  delete[] value;
+  if (block == NULL) return NULL;
+
+  this->cacheBlock(block);
+  return block;
+}
+
+void DocStore::cacheBlock(Block* block)
+{
+  this->cache.insert(this->cache.begin(), block);
+  if (this->cache.size() > DocStore::CACHE_SIZE) {
+    delete this->cache.back();
+    this->cache.pop_back();
+  }
+}
+
+void DocStore::saveBlock(const Block* block)
+{
+  // the open block is only written whole when a document leaves it
+  if (!block->sealed) {
+    std::string value;
+    for (uint32_t i = 0; i < block->entries.size(); i += 3) {
+      putWord(value, block->entries[i]);
+      putWord(value, block->entries[i + 2]);
+      value.append(block->content, block->entries[i + 1], block->entries[i + 2]);
+    }
+    this->library->set(DocStore::OPEN_BLOCK_KEY, value.data(), value.size());
+    return;
+  }
+
+  // only sealed blocks are compressed
+  uint32_t dictionaryId;
+  std::string payload;
+  uint32_t format = this->compress(block->content.data(), block->content.size(), &dictionaryId, payload);
+
+  std::string value;
+  value.reserve((DocStore::HEADER_LENGTH + block->entries.size()) * sizeof(uint32_t) + payload.size());
+  putWord(value, format);
+  putWord(value, dictionaryId);
+  putWord(value, block->entries.size() / 3);
+  putWord(value, block->content.size());
+  for (uint32_t i = 0; i < block->entries.size(); ++i) putWord(value, block->entries[i]);
+  value.append(payload);
+
+  this->library->set(this->getBlockKey(block->blockId).c_str(), value.data(), value.size());
+}
+
+// Content which does not shrink is kept as it is.
+uint32_t DocStore::compress(const char* content, uint32_t length, uint32_t* dictionaryId, std::string& payload)
+{
+  const std::string& dictionary = this->getDictionary(this->dictionaryId);
+  LZCodec::compress(content, length, dictionary.data(), dictionary.size(), payload);
+  if (payload.size() < length) {
+    *dictionaryId = this->dictionaryId;
+    return DocStore::FORMAT_LZ;
+  }
+
+  *dictionaryId = 0;
+  payload.assign(content, length);
+  return DocStore::FORMAT_RAW;
+}
+
+bool DocStore::decompress(uint32_t format, uint32_t dictionaryId, const char* payload, uint32_t payloadLength,
+			  uint32_t contentLength, std::string& content)
+{
+  if (format == DocStore::FORMAT_LZ) {
+    const std::string& dictionary = this->getDictionary(dictionaryId);
+    return LZCodec::decompress(payload, payloadLength, dictionary.data(), dictionary.size(), contentLength, content);
+  }
+  content.assign(payload, payloadLength);
+  return payloadLength == contentLength;
+}
+
+// A large document is kept as (part count, length) under a key of its own,
+// and as parts of BLOCK_SIZE bytes, the last one shorter, each under a key
+// of its own as (format, dictionary, content length) and the content. A
+// part is compressed by itself, so reading a range decompresses only the
+// parts holding it, and every record is given exactly the space it takes.
+// Content appended to a document fills up its last part before starting
+// a new one; a document which is not large yet is made one first.
+void DocStore::appendLarge(uint32_t docId, const char* content, uint32_t length)
+{
+  std::string largeKey = DocStore::getKey(DocStore::LARGE_KEY_PREFIX, docId);
+  uint32_t partCount = 0;
+  uint32_t docLength = 0;
+  std::string pending;
+  if (this->findBlock(docId) == DocStore::LARGE_BLOCK_ID) {
+    if (!this->loadLarge(docId, &partCount, &docLength)) return;
+    if (docLength % DocStore::BLOCK_SIZE != 0) {
+      if (!this->loadPart(docId, partCount - 1, pending)) return;
+      this->library->remove(DocStore::getPartKey(docId, --partCount).c_str());
+    }
+  }
+  else {
+    this->getDoc(docId, pending);
+    this->removeDoc(docId);
+  }
+  docLength = partCount * DocStore::BLOCK_SIZE;
+
+  // only a short last part is carried in memory
+  uint32_t position = 0;
+  while (pending.size() + (length - position) > 0) {
+    uint32_t taken = std::min(length - position, DocStore::BLOCK_SIZE - (uint32_t) pending.size());
+    pending.append(content + position, taken);
+    position += taken;
+
+    uint32_t dictionaryId;
+    std::string payload;
+    uint32_t format = this->compress(pending.data(), pending.size(), &dictionaryId, payload);
+    std::string value;
+    value.reserve(3 * sizeof(uint32_t) + payload.size());
+    putWord(value, format);
+    putWord(value, dictionaryId);
+    putWord(value, pending.size());
+    value.append(payload);
+    this->library->insert(DocStore::getPartKey(docId, partCount).c_str(), value.data(), value.size());
+
+    ++partCount;
+    docLength += pending.size();
+    pending.clear();
+  }
+
+  std::string header;
+  putWord(header, partCount);
+  putWord(header, docLength);
+  if (this->library->contains(largeKey.c_str())) {
+    this->library->set(largeKey.c_str(), header.data(), header.size());
+  }
+  else {
+    this->library->insert(largeKey.c_str(), header.data(), header.size());
+    this->setBlock(docId, DocStore::LARGE_BLOCK_ID);
+  }
+}
+
+bool DocStore::loadLarge(uint32_t docId, uint32_t* partCount, uint32_t* docLength)
+{
+  uint64_t offset;
+  uint32_t length;
+  char header[2 * sizeof(uint32_t)];
+  if (!this->library->locate(DocStore::getKey(DocStore::LARGE_KEY_PREFIX, docId).c_str(), &offset, &length) ||
+      this->library->read(offset, 0, header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  *partCount = getWord(header, 0);
+  *docLength = getWord(header, 1);
+  return true;
+}
+
+bool DocStore::loadPart(uint32_t docId, uint32_t part, std::string& content)
+{
+  uint32_t valueLength;
+  char* value = this->library->get(DocStore::getPartKey(docId, part).c_str(), &valueLength);
+  if (value == NULL) return false;
+
+  bool valid = valueLength >= 3 * sizeof(uint32_t) &&
+    this->decompress(getWord(value, 0), getWord(value, 1), value + 3 * sizeof(uint32_t),
+		     valueLength - 3 * sizeof(uint32_t), getWord(value, 2), content);
+  delete[] value;
+  return valid;
+}
+
+void DocStore::dropBlock(uint32_t blockId)
+{
+  if (blockId != this->openBlockId) this->library->remove(this->getBlockKey(blockId).c_str());
+
+  std::vector<Block*>::iterator iter = this->cache.begin();
+  while (iter != this->cache.end()) {
+    if ((*iter)->blockId == blockId) {
+      delete *iter;
+      this->cache.erase(iter);
+      return;
+    }
+    ++iter;
+  }
+}
+
+const std::string& DocStore::getDictionary(uint32_t dictionaryId)
+{
+  std::map<uint32_t, std::string>::iterator iter = this->dictionaries.find(dictionaryId);
+  if (iter != this->dictionaries.end()) return iter->second;
+
+  std::string& dictionary = this->dictionaries[dictionaryId];
+  if (dictionaryId == 0) return dictionary;
+
+  uint32_t dictionaryLength;
+  char* value = this->library->get(DocStore::getKey(DocStore::DICTIONARY_KEY_PREFIX, dictionaryId).c_str(),
+				   &dictionaryLength);
+  if (value != NULL) {
+    dictionary.assign(value, dictionaryLength);
+    delete[] value;
+  }
+  return dictionary;
+}
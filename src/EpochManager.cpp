@@ -0,0 +1,97 @@
+/**
+ * EpochManager.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/EpochManager.hpp"
+
+using bb::EpochManager;
+
+const uint64_t EpochManager::LATEST_EPOCH = ~0ULL;
+
+EpochManager::EpochManager() : epoch(0)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+}
+
+EpochManager::~EpochManager()
+{
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+uint64_t EpochManager::pin()
+{
+  pthread_mutex_lock(&(this->mutex));
+  uint64_t epoch = this->epoch;
+  this->pinned.insert(epoch);
+  pthread_mutex_unlock(&(this->mutex));
+  return epoch;
+}
+
+uint64_t EpochManager::pin(uint64_t epoch)
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->pinned.insert(epoch);
+  pthread_mutex_unlock(&(this->mutex));
+  return epoch;
+}
+
+void EpochManager::unpin(uint64_t epoch)
+{
+  pthread_mutex_lock(&(this->mutex));
+  std::multiset<uint64_t>::iterator iter = this->pinned.find(epoch);
+  if (iter != this->pinned.end()) this->pinned.erase(iter);
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+uint64_t EpochManager::publish()
+{
+  pthread_mutex_lock(&(this->mutex));
+  uint64_t epoch = ++(this->epoch);
+  pthread_mutex_unlock(&(this->mutex));
+  return epoch;
+}
+
+uint64_t EpochManager::getEpoch() const
+{
+  pthread_mutex_lock(&(this->mutex));
+  uint64_t epoch = this->epoch;
+  pthread_mutex_unlock(&(this->mutex));
+  return epoch;
+}
+
+uint64_t EpochManager::getWriteEpoch() const
+{
+  return this->getEpoch() + 1;
+}
+
+uint64_t EpochManager::getOldestEpoch() const
+{
+  // with no reader pinned, nothing older than the published epoch is needed
+  pthread_mutex_lock(&(this->mutex));
+  uint64_t epoch = this->pinned.empty() ? this->epoch : *(this->pinned.begin());
+  pthread_mutex_unlock(&(this->mutex));
+  return epoch;
+}
@@ -0,0 +1,169 @@
+/**
+ * Generation.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "bb/Generation.hpp"
+
+using bb::Generation;
+
+Generation::Generation() : fd(-1), readOnly(false), writing(false), generation(0), readers(0)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+}
+
+Generation::~Generation()
+{
+  this->close();
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+// A writer creates the file when it is missing; a reader fails on it, and
+// on a generation the writer has not finished.
+bool Generation::open(const char* path, bool readOnly)
+{
+  this->close();
+  if (path == NULL) return false;
+
+  this->fd = ::open(path, readOnly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+  if (this->fd < 0) return false;
+  this->readOnly = readOnly;
+  this->generation = this->load();
+
+  if (readOnly && this->generation % 2 != 0) {
+    this->close();
+    return false;
+  }
+  return true;
+}
+
+void Generation::close()
+{
+  if (this->fd < 0) return;
+
+  this->endWrite();
+  ::close(this->fd);
+  this->fd = -1;
+  this->readOnly = false;
+  this->writing = false;
+  this->generation = 0;
+  this->readers = 0;
+}
+
+uint64_t Generation::getGeneration() const
+{
+  pthread_mutex_lock(&(this->mutex));
+  uint64_t generation = this->generation;
+  pthread_mutex_unlock(&(this->mutex));
+  return generation;
+}
+
+bool Generation::isStale()
+{
+  return this->readOnly && this->fd >= 0 && this->load() != this->generation;
+}
+
+// Calls of a reader overlap, so the shared lock is taken by the first
+// of them and given up by the last. A writer reads its own changes.
+bool Generation::beginRead()
+{
+  if (this->fd < 0) return false;
+  if (!this->readOnly) return true;
+
+  pthread_mutex_lock(&(this->mutex));
+  bool current = this->readers > 0 || flock(this->fd, LOCK_SH | LOCK_NB) == 0;
+  if (current && this->load() != this->generation) {
+    if (this->readers == 0) flock(this->fd, LOCK_UN);
+    current = false;
+  }
+  if (current) ++(this->readers);
+  pthread_mutex_unlock(&(this->mutex));
+  return current;
+}
+
+void Generation::endRead()
+{
+  if (this->fd < 0 || !this->readOnly) return;
+
+  pthread_mutex_lock(&(this->mutex));
+  if (this->readers > 0 && --(this->readers) == 0) flock(this->fd, LOCK_UN);
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+bool Generation::beginWrite()
+{
+  if (this->fd < 0 || this->readOnly) return false;
+
+  pthread_mutex_lock(&(this->mutex));
+  bool writing = this->writing;
+  uint64_t generation = this->load();
+  pthread_mutex_unlock(&(this->mutex));
+  if (writing) return true;
+
+  // the odd generation is stored before waiting for the lock, so that
+  // calls of readers starting from now back off instead of holding the
+  // writer up; only those already reading are waited for
+  if (generation % 2 == 0) ++generation;
+  if (!this->store(generation) || flock(this->fd, LOCK_EX) != 0) return false;
+
+  pthread_mutex_lock(&(this->mutex));
+  this->generation = generation;
+  this->writing = true;
+  pthread_mutex_unlock(&(this->mutex));
+  return true;
+}
+
+bool Generation::endWrite()
+{
+  if (this->fd < 0 || this->readOnly) return false;
+
+  pthread_mutex_lock(&(this->mutex));
+  bool ended = !this->writing;
+  if (!ended) {
+    ended = this->store(this->generation + 1);
+    if (ended) {
+      ++(this->generation);
+      this->writing = false;
+      flock(this->fd, LOCK_UN);
+    }
+  }
+  pthread_mutex_unlock(&(this->mutex));
+  return ended;
+}
+
+uint64_t Generation::load()
+{
+  uint64_t generation = 0;
+  if (pread(this->fd, &generation, sizeof(generation), 0) != sizeof(generation)) return 0;
+  return generation;
+}
+
+bool Generation::store(uint64_t generation)
+{
+  return pwrite(this->fd, &generation, sizeof(generation), 0) == sizeof(generation) && fdatasync(this->fd) == 0;
+}
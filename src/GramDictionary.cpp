@@ -0,0 +1,425 @@
+/**
+ * GramDictionary.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bb/GramDictionary.hpp"
+
+using bb::GramDictionary;
+
+const uint32_t GramDictionary::HEADER_LENGTH = 2;
+const uint32_t GramDictionary::ENTRY_LENGTH = 3;
+const uint32_t GramDictionary::PENDING_LIMIT = 4096;
+
+GramDictionary::GramDictionary() : nextTermId(0)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+}
+
+GramDictionary::~GramDictionary()
+{
+  this->close();
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+bool GramDictionary::open(const char* path)
+{
+  if (path == NULL) return false;
+  this->close();
+
+  Table table;
+  if (!GramDictionary::mapTable(path, &table)) return false;
+  this->path = path;
+  this->tables.push_back(table);
+  while (GramDictionary::mapTable(GramDictionary::getTablePath(this->path, this->tables.size()), &table)) {
+    this->tables.push_back(table);
+  }
+
+  // term IDs are dense and every gram is in one table, so the next one
+  // follows the number of grams
+  this->nextTermId = 0;
+  for (uint32_t i = 0; i < this->tables.size(); ++i) this->nextTermId += this->tables[i].termCount;
+  return true;
+}
+
+bool GramDictionary::create(const char* path)
+{
+  if (path == NULL) return false;
+  this->close();
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) return false;
+  uint32_t header[2] = { 0, 0 };
+  bool written = fwrite(header, sizeof(uint32_t), GramDictionary::HEADER_LENGTH, fp) == GramDictionary::HEADER_LENGTH;
+  fclose(fp);
+  GramDictionary::removeTables(path, 1);
+
+  return written && this->open(path);
+}
+
+void GramDictionary::close()
+{
+  if (this->path.empty()) return;
+
+  this->flush();
+  for (uint32_t i = 0; i < this->tables.size(); ++i) GramDictionary::unmapTable(&(this->tables[i]));
+  this->tables.clear();
+  this->pending.clear();
+  this->nextTermId = 0;
+  this->path.clear();
+}
+
+bool GramDictionary::flush()
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool flushed = this->spill();
+  pthread_mutex_unlock(&(this->mutex));
+  return flushed;
+}
+
+bool GramDictionary::spill()
+{
+  if (this->path.empty()) return false;
+  if (this->pending.empty()) return true;
+
+  std::vector<uint32_t> entries;
+  std::string strings;
+  entries.reserve(this->pending.size() * GramDictionary::ENTRY_LENGTH);
+  std::map<std::string, uint32_t>::const_iterator iter = this->pending.begin();
+  for (; iter != this->pending.end(); ++iter) {
+    entries.push_back(strings.size());
+    entries.push_back(iter->first.size());
+    entries.push_back(iter->second);
+    strings += iter->first;
+  }
+
+  std::string tablePath = GramDictionary::getTablePath(this->path, this->tables.size());
+  std::string temporaryPath = tablePath + ".tmp";
+  FILE* fp = fopen(temporaryPath.c_str(), "wb");
+  if (fp == NULL) return false;
+  uint32_t header[2] = { (uint32_t) this->pending.size(), (uint32_t) strings.size() };
+  bool written = fwrite(header, sizeof(uint32_t), GramDictionary::HEADER_LENGTH, fp) == GramDictionary::HEADER_LENGTH &&
+    fwrite(&entries[0], sizeof(uint32_t), entries.size(), fp) == entries.size() &&
+    fwrite(strings.data(), sizeof(char), strings.size(), fp) == strings.size();
+  written = (fclose(fp) == 0) && written;
+  Table table;
+  if (!written || rename(temporaryPath.c_str(), tablePath.c_str()) != 0 ||
+      !GramDictionary::mapTable(tablePath, &table)) {
+    remove(temporaryPath.c_str());
+    return false;
+  }
+  this->tables.push_back(table);
+  this->pending.clear();
+
+  while (this->tables.size() >= 2 &&
+	 this->tables[this->tables.size() - 2].termCount <= this->tables.back().termCount) {
+    if (!this->mergeTables()) return false;
+  }
+  return true;
+}
+
+bool GramDictionary::mergeTables()
+{
+  // the newest table is merged into the one before it, whose file is
+  // replaced; the merge is walked three times, to count the grams and
+  // write the entries and then the strings, instead of being held
+  uint32_t level = this->tables.size() - 2;
+  const Table& first = this->tables[level];
+  const Table& second = this->tables[level + 1];
+  uint32_t header[2] = { 0, 0 };
+  uint32_t firstPosition = 0;
+  uint32_t secondPosition = 0;
+  std::string term;
+  uint32_t termId;
+  while (GramDictionary::nextMerged(first, &firstPosition, second, &secondPosition, &term, &termId)) {
+    ++header[0];
+    header[1] += term.size();
+  }
+
+  std::string tablePath = GramDictionary::getTablePath(this->path, level);
+  std::string temporaryPath = tablePath + ".tmp";
+  FILE* fp = fopen(temporaryPath.c_str(), "wb");
+  if (fp == NULL) return false;
+  bool written = fwrite(header, sizeof(uint32_t), GramDictionary::HEADER_LENGTH, fp) == GramDictionary::HEADER_LENGTH;
+
+  uint32_t offset = 0;
+  firstPosition = 0;
+  secondPosition = 0;
+  while (written && GramDictionary::nextMerged(first, &firstPosition, second, &secondPosition, &term, &termId)) {
+    uint32_t entry[3] = { offset, (uint32_t) term.size(), termId };
+    written = fwrite(entry, sizeof(uint32_t), GramDictionary::ENTRY_LENGTH, fp) == GramDictionary::ENTRY_LENGTH;
+    offset += term.size();
+  }
+  firstPosition = 0;
+  secondPosition = 0;
+  while (written && GramDictionary::nextMerged(first, &firstPosition, second, &secondPosition, &term, &termId)) {
+    written = fwrite(term.data(), sizeof(char), term.size(), fp) == term.size();
+  }
+  written = (fclose(fp) == 0) && written;
+
+  Table merged;
+  if (!written || rename(temporaryPath.c_str(), tablePath.c_str()) != 0 ||
+      !GramDictionary::mapTable(tablePath, &merged)) {
+    remove(temporaryPath.c_str());
+    return false;
+  }
+
+  // a crash before the newer file goes leaves its grams in both tables,
+  // which lookups take as they come
+  GramDictionary::unmapTable(&(this->tables[level]));
+  GramDictionary::unmapTable(&(this->tables[level + 1]));
+  remove(GramDictionary::getTablePath(this->path, level + 1).c_str());
+  this->tables.pop_back();
+  this->tables[level] = merged;
+  return true;
+}
+
+uint32_t GramDictionary::add(const std::string& gram)
+{
+  pthread_mutex_lock(&(this->mutex));
+  uint32_t termId;
+  if (!this->lookup(gram, &termId)) {
+    termId = this->nextTermId++;
+    this->pending.insert(std::make_pair(gram, termId));
+    if (this->pending.size() >= GramDictionary::PENDING_LIMIT) this->spill();
+  }
+  pthread_mutex_unlock(&(this->mutex));
+  return termId;
+}
+
+bool GramDictionary::find(const std::string& gram, uint32_t* termId) const
+{
+  pthread_mutex_lock(&(this->mutex));
+  bool found = this->lookup(gram, termId);
+  pthread_mutex_unlock(&(this->mutex));
+  return found;
+}
+
+bool GramDictionary::lookup(const std::string& gram, uint32_t* termId) const
+{
+  std::map<std::string, uint32_t>::const_iterator iter = this->pending.find(gram);
+  if (iter != this->pending.end()) {
+    *termId = iter->second;
+    return true;
+  }
+
+  for (uint32_t i = 0; i < this->tables.size(); ++i) {
+    uint32_t position = GramDictionary::lowerBound(this->tables[i], gram);
+    if (position < this->tables[i].termCount && GramDictionary::getTerm(this->tables[i], position) == gram) {
+      *termId = GramDictionary::getTermId(this->tables[i], position);
+      return true;
+    }
+  }
+  return false;
+}
+
+void GramDictionary::findPrefix(const std::string& prefix, uint32_t limit, std::vector<std::string>& grams) const
+{
+  grams.clear();
+
+  // every table and the pending grams are walked together, taking the
+  // smallest gram next and skipping it wherever else it is
+  pthread_mutex_lock(&(this->mutex));
+  std::vector<uint32_t> positions;
+  for (uint32_t i = 0; i < this->tables.size(); ++i) {
+    positions.push_back(GramDictionary::lowerBound(this->tables[i], prefix));
+  }
+  std::map<std::string, uint32_t>::const_iterator iter = this->pending.lower_bound(prefix);
+  while (grams.size() < limit) {
+    bool found = iter != this->pending.end();
+    std::string term;
+    if (found) term = iter->first;
+    for (uint32_t i = 0; i < this->tables.size(); ++i) {
+      if (positions[i] >= this->tables[i].termCount) continue;
+      std::string tableTerm = GramDictionary::getTerm(this->tables[i], positions[i]);
+      if (!found || tableTerm < term) term = tableTerm;
+      found = true;
+    }
+    if (!found || term.compare(0, prefix.size(), prefix) != 0) break;
+
+    if (iter != this->pending.end() && iter->first == term) ++iter;
+    for (uint32_t i = 0; i < this->tables.size(); ++i) {
+      if (positions[i] < this->tables[i].termCount && GramDictionary::getTerm(this->tables[i], positions[i]) == term) {
+	++positions[i];
+      }
+    }
+    grams.push_back(term);
+  }
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+uint32_t GramDictionary::size() const
+{
+  return this->nextTermId;
+}
+
+bool GramDictionary::build(const char* path, FILE* grams)
+{
+  // grams holds (length, bytes) records in byte order, numbered in that
+  // order; it is read twice, once for the entries and once for the strings
+  std::string temporaryPath = std::string(path) + ".tmp";
+  FILE* fp = fopen(temporaryPath.c_str(), "wb");
+  if (fp == NULL) return false;
+
+  uint32_t header[2] = { 0, 0 };
+  bool written = fwrite(header, sizeof(uint32_t), GramDictionary::HEADER_LENGTH, fp) == GramDictionary::HEADER_LENGTH;
+  std::string gram;
+  uint32_t gramLength;
+  rewind(grams);
+  while (written && fread(&gramLength, sizeof(uint32_t), 1, grams) == 1) {
+    fseeko(grams, gramLength, SEEK_CUR);
+    uint32_t entry[3] = { header[1], gramLength, header[0] };
+    written = fwrite(entry, sizeof(uint32_t), GramDictionary::ENTRY_LENGTH, fp) == GramDictionary::ENTRY_LENGTH;
+    ++header[0];
+    header[1] += gramLength;
+  }
+
+  rewind(grams);
+  while (written && fread(&gramLength, sizeof(uint32_t), 1, grams) == 1) {
+    gram.resize(gramLength);
+    written = gramLength == 0 || (fread(&gram[0], sizeof(char), gramLength, grams) == gramLength &&
+				  fwrite(gram.data(), sizeof(char), gramLength, fp) == gramLength);
+  }
+
+  written = written && fseeko(fp, 0, SEEK_SET) == 0 &&
+    fwrite(header, sizeof(uint32_t), GramDictionary::HEADER_LENGTH, fp) == GramDictionary::HEADER_LENGTH;
+  written = (fclose(fp) == 0) && written;
+  if (!written || rename(temporaryPath.c_str(), path) != 0) {
+    remove(temporaryPath.c_str());
+    return false;
+  }
+  GramDictionary::removeTables(path, 1);
+  return true;
+}
+
+std::string GramDictionary::getTablePath(const std::string& path, uint32_t level)
+{
+  if (level == 0) return path;
+  std::ostringstream tablePath;
+  tablePath << path << "." << level;
+  return tablePath.str();
+}
+
+void GramDictionary::removeTables(const std::string& path, uint32_t firstLevel)
+{
+  for (uint32_t level = firstLevel; remove(GramDictionary::getTablePath(path, level).c_str()) == 0; ++level);
+}
+
+bool GramDictionary::mapTable(const std::string& path, Table* table)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) (GramDictionary::HEADER_LENGTH * sizeof(uint32_t))) {
+    ::close(fd);
+    return false;
+  }
+
+  void* map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const uint32_t* header = (const uint32_t*) map;
+  uint64_t expectedLength = (GramDictionary::HEADER_LENGTH + (uint64_t) *header * GramDictionary::ENTRY_LENGTH) *
+    sizeof(uint32_t) + *(header + 1);
+  if (expectedLength != (uint64_t) fileStat.st_size) {
+    munmap(map, fileStat.st_size);
+    return false;
+  }
+
+  table->map = map;
+  table->mapLength = fileStat.st_size;
+  table->termCount = *header;
+  table->entries = header + GramDictionary::HEADER_LENGTH;
+  table->strings = (const char*) (table->entries + table->termCount * GramDictionary::ENTRY_LENGTH);
+  return true;
+}
+
+void GramDictionary::unmapTable(Table* table)
+{
+  if (table->map != NULL) munmap(table->map, table->mapLength);
+  table->map = NULL;
+  table->mapLength = 0;
+  table->termCount = 0;
+  table->entries = NULL;
+  table->strings = NULL;
+}
+
+std::string GramDictionary::getTerm(const Table& table, uint32_t position)
+{
+  const uint32_t* entry = table.entries + position * GramDictionary::ENTRY_LENGTH;
+  return std::string(table.strings + *entry, *(entry + 1));
+}
+
+uint32_t GramDictionary::getTermId(const Table& table, uint32_t position)
+{
+  return *(table.entries + position * GramDictionary::ENTRY_LENGTH + 2);
+}
+
+uint32_t GramDictionary::lowerBound(const Table& table, const std::string& gram)
+{
+  uint32_t low = 0;
+  uint32_t high = table.termCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (GramDictionary::getTerm(table, middle) < gram) low = middle + 1;
+    else high = middle;
+  }
+  return low;
+}
+
+bool GramDictionary::nextMerged(const Table& first, uint32_t* firstPosition, const Table& second,
+				uint32_t* secondPosition, std::string* term, uint32_t* termId)
+{
+  bool firstLeft = *firstPosition < first.termCount;
+  bool secondLeft = *secondPosition < second.termCount;
+  if (!firstLeft && !secondLeft) return false;
+
+  std::string firstTerm;
+  std::string secondTerm;
+  if (firstLeft) firstTerm = GramDictionary::getTerm(first, *firstPosition);
+  if (secondLeft) secondTerm = GramDictionary::getTerm(second, *secondPosition);
+  if (firstLeft && (!secondLeft || firstTerm <= secondTerm)) {
+    *term = firstTerm;
+    *termId = GramDictionary::getTermId(first, *firstPosition);
+    ++(*firstPosition);
+    if (secondLeft && secondTerm == firstTerm) ++(*secondPosition);
+  }
+  else {
+    *term = secondTerm;
+    *termId = GramDictionary::getTermId(second, *secondPosition);
+    ++(*secondPosition);
+  }
+  return true;
+}
@@ -0,0 +1,447 @@
+/**
+ * IndexBuilder.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include "bb/IndexBuilder.hpp"
+#include "bb/GramDictionary.hpp"
+#include "bb/PostingList.hpp"
+
+using bb::Bitmap;
+using bb::Bubu;
+using bb::GramDictionary;
+using bb::IndexBuilder;
+using bb::PostingList;
+using bb::Task;
+using bb::ThreadPool;
+
+namespace {
+
+// Reads a run back one gram at a time, the postings of a gram in parts
+// of any size.
+class RunReader
+{
+protected:
+  FILE* fp;
+
+public:
+  std::string gram;
+  uint32_t remaining;
+  bool ended;
+
+  RunReader(const char* path) : remaining(0), ended(false) {
+    this->fp = fopen(path, "rb");
+    this->nextGram();
+  }
+
+  ~RunReader() {
+    if (this->fp != NULL) fclose(this->fp);
+  }
+
+  bool isOpen() const { return this->fp != NULL; }
+
+  void nextGram() {
+    if (this->fp != NULL && this->remaining > 0) fseeko(this->fp, sizeof(uint32_t) * 2 * (off_t) this->remaining, SEEK_CUR);
+    this->remaining = 0;
+
+    uint32_t gramLength;
+    this->ended = this->fp == NULL || fread(&gramLength, sizeof(uint32_t), 1, this->fp) != 1;
+    if (this->ended) return;
+    this->gram.resize(gramLength);
+    if (gramLength > 0) fread(&(this->gram[0]), sizeof(char), gramLength, this->fp);
+    this->ended = fread(&(this->remaining), sizeof(uint32_t), 1, this->fp) != 1;
+  }
+
+  uint32_t read(std::vector<uint32_t>& postings, uint32_t limit) {
+    uint32_t count = std::min(this->remaining, limit);
+    uint32_t begin = postings.size();
+    postings.resize(begin + count * 2);
+    if (count > 0 && fread(&postings[begin], sizeof(uint32_t), count * 2, this->fp) != count * 2) {
+      this->ended = true;
+    }
+    this->remaining -= count;
+    return count;
+  }
+};
+
+}
+
+// Tokenizes a run of documents and writes their postings sorted by gram,
+// each gram as (length, bytes, posting count) and its (docId, offset)
+// pairs; the catalog entries of the documents are made on the way.
+class IndexBuilder::RunTask : public Task
+{
+protected:
+  Bubu* bubu;
+
+public:
+  std::string path;
+  std::vector<const std::pair<uint32_t, std::string>*> docs;
+  std::vector<std::vector<uint32_t> > catalogValues;
+  uint32_t gramCount;
+  bool written;
+
+  RunTask(Bubu* bubu, const std::string& path) : bubu(bubu), path(path), gramCount(0), written(false) {}
+
+  virtual void run() {
+    std::map<std::string, std::vector<uint32_t> > postings;
+    this->catalogValues.resize(this->docs.size());
+    for (uint32_t d = 0; d < this->docs.size(); ++d) {
+      std::vector<std::string> grams;
+      std::vector<uint32_t> offsets;
+      IndexBuilder::tokenizeDoc(this->bubu, this->docs[d]->second.c_str(), grams, offsets, this->catalogValues[d]);
+      for (uint32_t i = 0; i < grams.size(); ++i) {
+	std::vector<uint32_t>& gramPostings = postings[grams[i]];
+	gramPostings.push_back(this->docs[d]->first);
+	gramPostings.push_back(offsets[i]);
+      }
+    }
+    this->gramCount = postings.size();
+
+    FILE* fp = fopen(this->path.c_str(), "wb");
+    if (fp == NULL) return;
+    this->written = true;
+    std::map<std::string, std::vector<uint32_t> >::const_iterator iter = postings.begin();
+    while (iter != postings.end() && this->written) {
+      uint32_t gramLength = iter->first.size();
+      uint32_t postingCount = iter->second.size() / 2;
+      this->written = fwrite(&gramLength, sizeof(uint32_t), 1, fp) == 1 &&
+	fwrite(iter->first.data(), sizeof(char), gramLength, fp) == gramLength &&
+	fwrite(&postingCount, sizeof(uint32_t), 1, fp) == 1 &&
+	fwrite(&(iter->second[0]), sizeof(uint32_t), iter->second.size(), fp) == iter->second.size();
+      ++iter;
+    }
+    this->written = (fclose(fp) == 0) && this->written;
+  }
+};
+
+const uint32_t IndexBuilder::RUN_SIZE = 4 * 1024 * 1024;
+const uint32_t IndexBuilder::MERGE_FAN_IN = 64;
+const uint32_t IndexBuilder::MERGE_LIMIT = 1 << 20;
+const uint32_t IndexBuilder::MAX_BUCKET_LENGTH = 1 << 24;
+
+IndexBuilder::IndexBuilder()
+{
+  long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+  this->init((processorCount > 0) ? processorCount : 1);
+}
+
+IndexBuilder::IndexBuilder(uint32_t threadCount)
+{
+  this->init(std::max(threadCount, 1U));
+}
+
+IndexBuilder::~IndexBuilder()
+{
+  if (this->bubu != NULL) {
+    this->removeRuns();
+    delete this->bubu;
+  }
+  delete this->threadPool;
+}
+
+void IndexBuilder::init(uint32_t threadCount)
+{
+  this->bubu = NULL;
+  this->threadPool = new ThreadPool(threadCount);
+  this->runSize = IndexBuilder::RUN_SIZE;
+  this->mergeFanIn = IndexBuilder::MERGE_FAN_IN;
+  this->mergeLimit = IndexBuilder::MERGE_LIMIT;
+  this->pendingSize = 0;
+  this->nextRunId = 0;
+  this->gramEstimate = 0;
+  this->docCount = 0;
+  this->totalLength = 0;
+  this->nextDocId = 0;
+}
+
+bool IndexBuilder::create(const char* workspaceDir, uint32_t gramSize, bool indexUnigrams)
+{
+  if (this->bubu != NULL) return false;
+
+  Bubu* bubu = new Bubu();
+  if (!bubu->create(workspaceDir, gramSize, indexUnigrams)) {
+    delete bubu;
+    return false;
+  }
+
+  // nobody searches a workspace being built, so no old version is kept
+  bubu->index->setEpochs(NULL);
+  bubu->positions->setEpochs(NULL);
+  bubu->catalog->setEpochs(NULL);
+  this->bubu = bubu;
+  this->workspace = workspaceDir;
+  return true;
+}
+
+bool IndexBuilder::addDoc(uint32_t docId, const char* docContent)
+{
+  // the runs are merged in the order they were made, which has to be the
+  // docId order of the postings
+  if (this->bubu == NULL || docId < this->nextDocId || docContent == NULL || strcmp(docContent, "") == 0) {
+    return false;
+  }
+
+  uint32_t length = strlen(docContent);
+  this->bubu->docStore->put(docId, docContent, length);
+  this->pending.push_back(std::pair<uint32_t, std::string>(docId, std::string(docContent, length)));
+  this->pendingSize += length;
+  this->nextDocId = docId + 1;
+
+  if (this->pendingSize < (uint64_t) this->runSize * this->threadPool->size()) return true;
+  return this->tokenizeRuns();
+}
+
+bool IndexBuilder::addDump(std::istream& input)
+{
+  std::string line;
+  std::string docContent;
+  while (std::getline(input, line)) {
+    if (line.empty()) continue;
+
+    uint32_t docId;
+    uint32_t length;
+    if (sscanf(line.c_str(), "%u %u", &docId, &length) != 2) return false;
+    docContent.resize(length);
+    if (length > 0 && !input.read(&docContent[0], length)) return false;
+    if (input.peek() == '\n') input.get();
+
+    if (length > 0 && !this->addDoc(docId, docContent.c_str())) return false;
+  }
+  return !input.bad();
+}
+
+bool IndexBuilder::finish()
+{
+  if (this->bubu == NULL) return false;
+  bool built = this->tokenizeRuns();
+
+  // each pass merges runs next to one another, which keeps docId order
+  while (built && this->runs.size() > this->mergeFanIn) {
+    std::vector<std::string> merged;
+    uint32_t begin = 0;
+    for (; begin < this->runs.size() && built; begin += this->mergeFanIn) {
+      std::vector<std::string> group(this->runs.begin() + begin,
+				     this->runs.begin() + std::min(begin + this->mergeFanIn, (uint32_t) this->runs.size()));
+      merged.push_back(this->getRunPath());
+      FILE* out = fopen(merged.back().c_str(), "wb");
+      built = out != NULL && this->mergeRuns(group, out, NULL);
+      if (out != NULL) built = (fclose(out) == 0) && built;
+      for (uint32_t r = 0; r < group.size(); ++r) remove(group[r].c_str());
+    }
+    if (begin < this->runs.size()) merged.insert(merged.end(), this->runs.begin() + begin, this->runs.end());
+    this->runs.swap(merged);
+  }
+
+  // the last pass writes the lists, into files given about a bucket for
+  // each of them now that their number is roughly known
+  std::string indexPath = this->workspace + "/bubu.idx";
+  std::string positionsPath = this->workspace + "/bubu.pos";
+  std::string dictionaryPath = this->workspace + "/bubu.dic";
+  std::string gramsPath = this->workspace + "/bubu.grams";
+  uint32_t bucketLength = std::min(std::max(this->gramEstimate, (uint64_t) 100000),
+				   (uint64_t) IndexBuilder::MAX_BUCKET_LENGTH);
+  this->bubu->index->close();
+  this->bubu->positions->close();
+  built = built &&
+    this->bubu->index->create(indexPath.c_str(), bucketLength, 10000) &&
+    this->bubu->positions->create(positionsPath.c_str(), bucketLength, 10000);
+
+  FILE* grams = fopen(gramsPath.c_str(), "wb+");
+  built = built && grams != NULL && this->mergeRuns(this->runs, NULL, grams) && fflush(grams) == 0;
+  this->bubu->dictionary->close();
+  built = built && GramDictionary::build(dictionaryPath.c_str(), grams);
+  built = this->bubu->dictionary->open(dictionaryPath.c_str()) && built;
+  if (grams != NULL) fclose(grams);
+  remove(gramsPath.c_str());
+  this->removeRuns();
+
+  uint32_t statistics[Bubu::STATISTICS_LENGTH] = {
+    this->docCount, (uint32_t) this->totalLength, (uint32_t) (this->totalLength >> 32), this->nextDocId
+  };
+  this->bubu->catalog->set(Bubu::STATISTICS_KEY, statistics, Bubu::STATISTICS_LENGTH);
+
+  built = this->bubu->flush() && built;
+  delete this->bubu;
+  this->bubu = NULL;
+  return built;
+}
+
+uint32_t IndexBuilder::tokenizeDoc(Bubu* bubu, const char* docContent, std::vector<std::string>& grams,
+				   std::vector<uint32_t>& offsets, std::vector<uint32_t>& catalogValue)
+{
+  uint32_t docLength = bubu->tokenizeDoc(docContent, grams, offsets);
+  catalogValue.assign(1, docLength);
+  Bubu::calcCheckpoints(docContent, catalogValue);
+  return docLength;
+}
+
+std::string IndexBuilder::getRunPath()
+{
+  return this->workspace + "/bubu.run." + Bubu::uintToString(this->nextRunId++);
+}
+
+bool IndexBuilder::tokenizeRuns()
+{
+  if (this->pending.empty()) return true;
+
+  std::vector<RunTask*> tasks;
+  uint64_t taskSize = 0;
+  for (uint32_t d = 0; d < this->pending.size(); ++d) {
+    if (tasks.empty() || taskSize >= this->runSize) {
+      tasks.push_back(new RunTask(this->bubu, this->getRunPath()));
+      taskSize = 0;
+    }
+    tasks.back()->docs.push_back(&(this->pending[d]));
+    taskSize += this->pending[d].second.size();
+  }
+  for (uint32_t t = 0; t < tasks.size(); ++t) this->threadPool->submit(tasks[t]);
+  this->threadPool->wait();
+
+  // every document is new, so its catalog entry needs no lookup first
+  bool written = true;
+  for (uint32_t t = 0; t < tasks.size(); ++t) {
+    written = written && tasks[t]->written;
+    this->runs.push_back(tasks[t]->path);
+    this->gramEstimate += tasks[t]->gramCount;
+    for (uint32_t d = 0; d < tasks[t]->docs.size(); ++d) {
+      const std::vector<uint32_t>& catalogValue = tasks[t]->catalogValues[d];
+      this->bubu->catalog->insert(Bubu::uintToString(tasks[t]->docs[d]->first).c_str(),
+				  &catalogValue[0], catalogValue.size());
+      ++(this->docCount);
+      this->totalLength += catalogValue[0];
+    }
+    delete tasks[t];
+  }
+
+  this->pending.clear();
+  this->pendingSize = 0;
+  return written;
+}
+
+bool IndexBuilder::mergeRuns(const std::vector<std::string>& runs, FILE* out, FILE* grams)
+{
+  bool merged = true;
+  std::vector<RunReader*> readers;
+  for (uint32_t r = 0; r < runs.size(); ++r) {
+    readers.push_back(new RunReader(runs[r].c_str()));
+    merged = merged && readers.back()->isOpen();
+  }
+
+  // the postings of a gram are taken from the runs in their order; into
+  // another run they go as they come, into the index a list at a time
+  std::vector<uint32_t> postings;
+  while (merged) {
+    const std::string* smallest = NULL;
+    for (uint32_t r = 0; r < readers.size(); ++r) {
+      if (!readers[r]->ended && (smallest == NULL || readers[r]->gram < *smallest)) smallest = &(readers[r]->gram);
+    }
+    if (smallest == NULL) break;
+    std::string gram = *smallest;
+    uint32_t gramLength = gram.size();
+
+    if (out != NULL) {
+      uint32_t postingCount = 0;
+      fwrite(&gramLength, sizeof(uint32_t), 1, out);
+      fwrite(gram.data(), sizeof(char), gramLength, out);
+      off_t countOffset = ftello(out);
+      fwrite(&postingCount, sizeof(uint32_t), 1, out);
+      for (uint32_t r = 0; r < readers.size(); ++r) {
+	if (readers[r]->ended || readers[r]->gram != gram) continue;
+	while (readers[r]->remaining > 0 && !readers[r]->ended) {
+	  postings.clear();
+	  postingCount += readers[r]->read(postings, this->mergeLimit);
+	  fwrite(&postings[0], sizeof(uint32_t), postings.size(), out);
+	}
+	readers[r]->nextGram();
+      }
+      fseeko(out, countOffset, SEEK_SET);
+      fwrite(&postingCount, sizeof(uint32_t), 1, out);
+      fseeko(out, 0, SEEK_END);
+      merged = ferror(out) == 0;
+      continue;
+    }
+
+    postings.clear();
+    bool whole = true;
+    uint32_t postingCount = 0;
+    Bitmap docs;
+    for (uint32_t r = 0; r < readers.size(); ++r) {
+      if (readers[r]->ended || readers[r]->gram != gram) continue;
+      while (readers[r]->remaining > 0 && !readers[r]->ended) {
+	postingCount += readers[r]->read(postings, this->mergeLimit - postings.size() / 2);
+	if (postings.size() / 2 >= this->mergeLimit) {
+	  this->writePostings(gram, postings, false, docs);
+	  postings.clear();
+	  whole = false;
+	}
+      }
+      readers[r]->nextGram();
+    }
+    this->writePostings(gram, postings, whole, docs);
+
+    if (postingCount >= Bubu::BITMAP_MIN_POSTINGS && docs.size() * Bubu::BITMAP_DENSITY >= this->docCount) {
+      Bitmap::set(this->bubu->index, Bubu::getBitmapKey(gram).c_str(), docs);
+    }
+    merged = fwrite(&gramLength, sizeof(uint32_t), 1, grams) == 1 &&
+      fwrite(gram.data(), sizeof(char), gramLength, grams) == gramLength;
+  }
+
+  for (uint32_t r = 0; r < readers.size(); ++r) {
+    merged = merged && readers[r]->ended && readers[r]->remaining == 0;
+    delete readers[r];
+  }
+  return merged;
+}
+
+void IndexBuilder::writePostings(const std::string& gram, const std::vector<uint32_t>& postings, bool whole,
+				 Bitmap& docs)
+{
+  // a whole list goes into records of just its size; one too long to be
+  // held at once is appended a part at a time instead
+  if (whole && !postings.empty()) {
+    std::vector<uint32_t> docValue;
+    std::vector<uint32_t> positionValue;
+    PostingList::encode(&postings[0], postings.size() / 2, 0, docValue, positionValue);
+    this->bubu->index->insert(gram.c_str(), &docValue[0], docValue.size());
+    this->bubu->positions->insert(gram.c_str(), &positionValue[0], positionValue.size());
+  }
+  else if (!postings.empty()) {
+    PostingList::append(this->bubu->index, this->bubu->positions, gram.c_str(), postings);
+  }
+
+  if (!whole || postings.size() / 2 >= Bubu::BITMAP_MIN_POSTINGS) {
+    for (uint32_t i = 0; i < postings.size(); i += 2) docs.add(postings[i]);
+  }
+}
+
+void IndexBuilder::removeRuns()
+{
+  for (uint32_t r = 0; r < this->runs.size(); ++r) remove(this->runs[r].c_str());
+  this->runs.clear();
+}
@@ -0,0 +1,420 @@
+/**
+ * Intersection.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "bb/Intersection.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BB_INTERSECTION_X86
+#include <immintrin.h>
+#endif
+
+using bb::Intersection;
+
+namespace {
+
+bool isBefore(uint32_t docId, uint32_t offset, uint32_t otherDocId, uint32_t otherOffset)
+{
+  return docId < otherDocId || (docId == otherDocId && offset < otherOffset);
+}
+
+// Returns the first index in [begin, length) whose value is not less than
+// docId, probing 1, 2, 4, ... ahead before binary searching.
+uint32_t gallop(const uint32_t* values, uint32_t begin, uint32_t length, uint32_t docId)
+{
+  uint32_t step = 1;
+  uint32_t low = begin;
+  uint32_t high = begin;
+  while (high < length && *(values + high) < docId) {
+    low = high + 1;
+    high += step;
+    step *= 2;
+  }
+  return std::lower_bound(values + low, values + std::min(high, length), docId) - values;
+}
+
+uint32_t gallopPostings(const uint32_t* postings, uint32_t begin, uint32_t count,
+			uint32_t docId, uint32_t offset)
+{
+  uint32_t step = 1;
+  uint32_t low = begin;
+  uint32_t high = begin;
+  while (high < count && isBefore(*(postings + high * 2), *(postings + high * 2 + 1), docId, offset)) {
+    low = high + 1;
+    high += step;
+    step *= 2;
+  }
+  high = std::min(high, count);
+  while (low < high) {
+    uint32_t middle = (low + high) / 2;
+    if (isBefore(*(postings + middle * 2), *(postings + middle * 2 + 1), docId, offset)) low = middle + 1;
+    else high = middle;
+  }
+  return low;
+}
+
+uint32_t mergeScalar(const uint32_t* a, uint32_t i, uint32_t aLength,
+		     const uint32_t* b, uint32_t j, uint32_t bLength, uint32_t* out, uint32_t o)
+{
+  while (i < aLength && j < bLength) {
+    if (*(a + i) < *(b + j)) {
+      ++i;
+    }
+    else if (*(b + j) < *(a + i)) {
+      ++j;
+    }
+    else {
+      *(out + o++) = *(a + i);
+      ++i;
+      ++j;
+    }
+  }
+  return o;
+}
+
+uint32_t mergePositionsScalar(const uint32_t* a, uint32_t i, uint32_t aCount,
+			      const uint32_t* b, uint32_t j, uint32_t bCount, uint32_t delta,
+			      uint32_t* out, uint32_t o)
+{
+  while (i < aCount && j < bCount) {
+    uint32_t docId = *(a + i * 2);
+    uint32_t offset = *(a + i * 2 + 1);
+    uint32_t otherDocId = *(b + j * 2);
+    uint32_t otherOffset = *(b + j * 2 + 1);
+    if (isBefore(docId, offset + delta, otherDocId, otherOffset)) {
+      ++i;
+    }
+    else if (isBefore(otherDocId, otherOffset, docId, offset + delta)) {
+      ++j;
+    }
+    else {
+      *(out + o * 2) = docId;
+      *(out + o * 2 + 1) = offset;
+      ++o;
+      ++i;
+      ++j;
+    }
+  }
+  return o;
+}
+
+// The shorter list drives, and each of its elements gallops forward in
+// the longer one; matches are always written as elements of a.
+uint32_t intersectGallop(const uint32_t* a, uint32_t aLength,
+			 const uint32_t* b, uint32_t bLength, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  if (aLength <= bLength) {
+    for (; i < aLength && j < bLength; ++i) {
+      j = gallop(b, j, bLength, *(a + i));
+      if (j < bLength && *(b + j) == *(a + i)) *(out + o++) = *(a + i);
+    }
+  }
+  else {
+    for (; j < bLength && i < aLength; ++j) {
+      i = gallop(a, i, aLength, *(b + j));
+      if (i < aLength && *(a + i) == *(b + j)) *(out + o++) = *(b + j);
+    }
+  }
+  return o;
+}
+
+uint32_t intersectPositionsGallop(const uint32_t* a, uint32_t aCount,
+				  const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  if (aCount <= bCount) {
+    for (; i < aCount && j < bCount; ++i) {
+      uint32_t docId = *(a + i * 2);
+      uint32_t offset = *(a + i * 2 + 1);
+      j = gallopPostings(b, j, bCount, docId, offset + delta);
+      if (j < bCount && *(b + j * 2) == docId && *(b + j * 2 + 1) == offset + delta) {
+	*(out + o * 2) = docId;
+	*(out + o * 2 + 1) = offset;
+	++o;
+      }
+    }
+  }
+  else {
+    for (; j < bCount && i < aCount; ++j) {
+      if (*(b + j * 2 + 1) < delta) continue;
+      uint32_t docId = *(b + j * 2);
+      uint32_t offset = *(b + j * 2 + 1) - delta;
+      i = gallopPostings(a, i, aCount, docId, offset);
+      if (i < aCount && *(a + i * 2) == docId && *(a + i * 2 + 1) == offset) {
+	*(out + o * 2) = docId;
+	*(out + o * 2 + 1) = offset;
+	++o;
+      }
+    }
+  }
+  return o;
+}
+
+#ifdef BB_INTERSECTION_X86
+
+// Each step compares a block of a against every rotation of a block of b,
+// emits the lanes of a that matched and advances whichever block ends
+// first. Lanes are copied out before anything is written, so out may
+// alias a.
+__attribute__((target("sse4.2")))
+uint32_t intersectSSE42(const uint32_t* a, uint32_t aLength,
+			const uint32_t* b, uint32_t bLength, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  uint32_t lanes[4];
+  while (i + 4 <= aLength && j + 4 <= bLength) {
+    __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*) (b + j));
+    __m128i equal = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(va, vb),
+					      _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+				 _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+					      _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+    uint32_t aLast = *(a + i + 3);
+    uint32_t bLast = *(b + j + 3);
+
+    if (mask != 0) {
+      _mm_storeu_si128((__m128i*) lanes, va);
+      for (uint32_t k = 0; k < 4; ++k) {
+	if (mask & (1 << k)) *(out + o++) = lanes[k];
+      }
+    }
+    if (aLast <= bLast) i += 4;
+    if (bLast <= aLast) j += 4;
+  }
+  return mergeScalar(a, i, aLength, b, j, bLength, out, o);
+}
+
+__attribute__((target("avx2")))
+uint32_t intersectAVX2(const uint32_t* a, uint32_t aLength,
+		       const uint32_t* b, uint32_t bLength, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  uint32_t lanes[8];
+  const __m256i rotation = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+  while (i + 8 <= aLength && j + 8 <= bLength) {
+    __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i*) (b + j));
+    __m256i equal = _mm256_cmpeq_epi32(va, vb);
+    for (uint32_t r = 1; r < 8; ++r) {
+      vb = _mm256_permutevar8x32_epi32(vb, rotation);
+      equal = _mm256_or_si256(equal, _mm256_cmpeq_epi32(va, vb));
+    }
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+    uint32_t aLast = *(a + i + 7);
+    uint32_t bLast = *(b + j + 7);
+
+    if (mask != 0) {
+      _mm256_storeu_si256((__m256i*) lanes, va);
+      for (uint32_t k = 0; k < 8; ++k) {
+	if (mask & (1 << k)) *(out + o++) = lanes[k];
+      }
+    }
+    if (aLast <= bLast) i += 8;
+    if (bLast <= aLast) j += 8;
+  }
+  return mergeScalar(a, i, aLength, b, j, bLength, out, o);
+}
+
+// Postings are compared as 64-bit (docId, offset) lanes, with delta added
+// to the offsets of a; block order is still decided on the last posting.
+__attribute__((target("sse4.2")))
+uint32_t intersectPositionsSSE42(const uint32_t* a, uint32_t aCount,
+				 const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  uint32_t lanes[4];
+  const __m128i shift = _mm_set_epi32(delta, 0, delta, 0);
+  while (i + 2 <= aCount && j + 2 <= bCount) {
+    __m128i va = _mm_loadu_si128((const __m128i*) (a + i * 2));
+    __m128i vb = _mm_loadu_si128((const __m128i*) (b + j * 2));
+    __m128i shifted = _mm_add_epi32(va, shift);
+    __m128i equal = _mm_or_si128(_mm_cmpeq_epi64(shifted, vb),
+				 _mm_cmpeq_epi64(shifted, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+    uint32_t aLastDocId = *(a + i * 2 + 2);
+    uint32_t aLastOffset = *(a + i * 2 + 3) + delta;
+    uint32_t bLastDocId = *(b + j * 2 + 2);
+    uint32_t bLastOffset = *(b + j * 2 + 3);
+
+    if (mask != 0) {
+      _mm_storeu_si128((__m128i*) lanes, va);
+      for (uint32_t k = 0; k < 2; ++k) {
+	if (mask & (1 << k)) {
+	  *(out + o * 2) = lanes[k * 2];
+	  *(out + o * 2 + 1) = lanes[k * 2 + 1];
+	  ++o;
+	}
+      }
+    }
+    if (!isBefore(bLastDocId, bLastOffset, aLastDocId, aLastOffset)) i += 2;
+    if (!isBefore(aLastDocId, aLastOffset, bLastDocId, bLastOffset)) j += 2;
+  }
+  return mergePositionsScalar(a, i, aCount, b, j, bCount, delta, out, o);
+}
+
+__attribute__((target("avx2")))
+uint32_t intersectPositionsAVX2(const uint32_t* a, uint32_t aCount,
+				const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out)
+{
+  uint32_t o = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+  uint32_t lanes[8];
+  const __m256i shift = _mm256_set_epi32(delta, 0, delta, 0, delta, 0, delta, 0);
+  while (i + 4 <= aCount && j + 4 <= bCount) {
+    __m256i va = _mm256_loadu_si256((const __m256i*) (a + i * 2));
+    __m256i vb = _mm256_loadu_si256((const __m256i*) (b + j * 2));
+    __m256i shifted = _mm256_add_epi32(va, shift);
+    __m256i equal = _mm256_cmpeq_epi64(shifted, vb);
+    for (uint32_t r = 1; r < 4; ++r) {
+      vb = _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1));
+      equal = _mm256_or_si256(equal, _mm256_cmpeq_epi64(shifted, vb));
+    }
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+    uint32_t aLastDocId = *(a + i * 2 + 6);
+    uint32_t aLastOffset = *(a + i * 2 + 7) + delta;
+    uint32_t bLastDocId = *(b + j * 2 + 6);
+    uint32_t bLastOffset = *(b + j * 2 + 7);
+
+    if (mask != 0) {
+      _mm256_storeu_si256((__m256i*) lanes, va);
+      for (uint32_t k = 0; k < 4; ++k) {
+	if (mask & (1 << k)) {
+	  *(out + o * 2) = lanes[k * 2];
+	  *(out + o * 2 + 1) = lanes[k * 2 + 1];
+	  ++o;
+	}
+      }
+    }
+    if (!isBefore(bLastDocId, bLastOffset, aLastDocId, aLastOffset)) i += 4;
+    if (!isBefore(aLastDocId, aLastOffset, bLastDocId, bLastOffset)) j += 4;
+  }
+  return mergePositionsScalar(a, i, aCount, b, j, bCount, delta, out, o);
+}
+
+#endif // BB_INTERSECTION_X86
+
+bool isSkewed(uint32_t aLength, uint32_t bLength)
+{
+  uint32_t shorter = std::min(aLength, bLength);
+  uint32_t longer = std::max(aLength, bLength);
+  return (uint64_t) shorter * Intersection::GALLOP_RATIO <= longer;
+}
+
+}
+
+const uint32_t Intersection::GALLOP_RATIO = 32;
+
+bool Intersection::isSupported(Kernel kernel)
+{
+  switch (kernel) {
+  case SCALAR:
+  case GALLOP:
+    return true;
+#ifdef BB_INTERSECTION_X86
+  case SSE42:
+    return __builtin_cpu_supports("sse4.2");
+  case AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+Intersection::Kernel Intersection::getBestKernel()
+{
+  static const Kernel bestKernel = Intersection::isSupported(AVX2) ? AVX2 :
+    Intersection::isSupported(SSE42) ? SSE42 : SCALAR;
+  return bestKernel;
+}
+
+uint32_t Intersection::intersect(const uint32_t* a, uint32_t aLength,
+				 const uint32_t* b, uint32_t bLength, uint32_t* out)
+{
+  Kernel kernel = isSkewed(aLength, bLength) ? GALLOP : Intersection::getBestKernel();
+  return Intersection::intersect(kernel, a, aLength, b, bLength, out);
+}
+
+uint32_t Intersection::intersect(Kernel kernel, const uint32_t* a, uint32_t aLength,
+				 const uint32_t* b, uint32_t bLength, uint32_t* out)
+{
+  switch (kernel) {
+  case GALLOP:
+    return intersectGallop(a, aLength, b, bLength, out);
+#ifdef BB_INTERSECTION_X86
+  case SSE42:
+    if (Intersection::isSupported(SSE42)) return intersectSSE42(a, aLength, b, bLength, out);
+    break;
+  case AVX2:
+    if (Intersection::isSupported(AVX2)) return intersectAVX2(a, aLength, b, bLength, out);
+    break;
+#endif
+  default:
+    break;
+  }
+  return mergeScalar(a, 0, aLength, b, 0, bLength, out, 0);
+}
+
+uint32_t Intersection::intersectPositions(const uint32_t* a, uint32_t aCount,
+					  const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out)
+{
+  Kernel kernel = isSkewed(aCount, bCount) ? GALLOP : Intersection::getBestKernel();
+  return Intersection::intersectPositions(kernel, a, aCount, b, bCount, delta, out);
+}
+
+uint32_t Intersection::intersectPositions(Kernel kernel, const uint32_t* a, uint32_t aCount,
+					  const uint32_t* b, uint32_t bCount, uint32_t delta, uint32_t* out)
+{
+  switch (kernel) {
+  case GALLOP:
+    return intersectPositionsGallop(a, aCount, b, bCount, delta, out);
+#ifdef BB_INTERSECTION_X86
+  case SSE42:
+    if (Intersection::isSupported(SSE42)) return intersectPositionsSSE42(a, aCount, b, bCount, delta, out);
+    break;
+  case AVX2:
+    if (Intersection::isSupported(AVX2)) return intersectPositionsAVX2(a, aCount, b, bCount, delta, out);
+    break;
+#endif
+  default:
+    break;
+  }
+  return mergePositionsScalar(a, 0, aCount, b, 0, bCount, delta, out, 0);
+}
@@ -0,0 +1,173 @@
+/**
+ * LZCodec.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "bb/LZCodec.hpp"
+
+using bb::LZCodec;
+
+const uint32_t LZCodec::HASH_BITS = 14;
+const uint32_t LZCodec::MIN_MATCH = 4;
+const uint32_t LZCodec::MAX_DISTANCE = 65535;
+
+uint32_t LZCodec::hash(const char* bytes)
+{
+  uint32_t word;
+  memcpy(&word, bytes, sizeof(word));
+  return (word * 2654435761U) >> (32 - LZCodec::HASH_BITS);
+}
+
+void LZCodec::writeLength(uint32_t length, std::string& out)
+{
+  while (length >= 255) {
+    out.push_back((char) 255);
+    length -= 255;
+  }
+  out.push_back((char) length);
+}
+
+bool LZCodec::readLength(const unsigned char** in, const unsigned char* end, uint32_t* length)
+{
+  unsigned char byte;
+  do {
+    if (*in >= end) return false;
+    byte = **in;
+    ++(*in);
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+void LZCodec::compress(const char* src, uint32_t srcLength, const char* dictionary, uint32_t dictionaryLength,
+		       std::string& out)
+{
+  out.clear();
+  out.reserve(srcLength / 2 + 16);
+
+  // the dictionary is laid out right before the input so that a match may
+  // start in either of them
+  if (dictionaryLength > LZCodec::MAX_DISTANCE) {
+    dictionary += dictionaryLength - LZCodec::MAX_DISTANCE;
+    dictionaryLength = LZCodec::MAX_DISTANCE;
+  }
+  std::string buffer;
+  buffer.reserve(dictionaryLength + srcLength);
+  buffer.append(dictionary, dictionaryLength);
+  buffer.append(src, srcLength);
+  const char* data = buffer.data();
+  uint32_t end = buffer.size();
+
+  // positions are kept off by one so that zero marks an empty slot
+  std::vector<uint32_t> table(1 << LZCodec::HASH_BITS, 0);
+  for (uint32_t position = 0; position + LZCodec::MIN_MATCH <= dictionaryLength; ++position) {
+    table[LZCodec::hash(data + position)] = position + 1;
+  }
+
+  uint32_t anchor = dictionaryLength;
+  uint32_t position = dictionaryLength;
+  while (position + LZCodec::MIN_MATCH <= end) {
+    uint32_t slot = LZCodec::hash(data + position);
+    uint32_t candidate = table[slot];
+    table[slot] = position + 1;
+    if (candidate == 0 || position - (candidate - 1) > LZCodec::MAX_DISTANCE ||
+	memcmp(data + candidate - 1, data + position, LZCodec::MIN_MATCH) != 0) {
+      ++position;
+      continue;
+    }
+
+    uint32_t matchBegin = candidate - 1;
+    uint32_t matchLength = LZCodec::MIN_MATCH;
+    while (position + matchLength < end && data[matchBegin + matchLength] == data[position + matchLength]) {
+      ++matchLength;
+    }
+
+    uint32_t literalLength = position - anchor;
+    uint32_t extraLength = matchLength - LZCodec::MIN_MATCH;
+    out.push_back((char) ((std::min(literalLength, 15U) << 4) | std::min(extraLength, 15U)));
+    if (literalLength >= 15) LZCodec::writeLength(literalLength - 15, out);
+    out.append(data + anchor, literalLength);
+    uint32_t distance = position - matchBegin;
+    out.push_back((char) (distance & 0xff));
+    out.push_back((char) (distance >> 8));
+    if (extraLength >= 15) LZCodec::writeLength(extraLength - 15, out);
+
+    uint32_t matchEnd = position + matchLength;
+    for (++position; position < matchEnd && position + LZCodec::MIN_MATCH <= end; ++position) {
+      table[LZCodec::hash(data + position)] = position + 1;
+    }
+    position = matchEnd;
+    anchor = matchEnd;
+  }
+
+  uint32_t literalLength = end - anchor;
+  out.push_back((char) (std::min(literalLength, 15U) << 4));
+  if (literalLength >= 15) LZCodec::writeLength(literalLength - 15, out);
+  out.append(data + anchor, literalLength);
+}
+
+bool LZCodec::decompress(const char* src, uint32_t srcLength, const char* dictionary, uint32_t dictionaryLength,
+			 uint32_t rawLength, std::string& out)
+{
+  if (dictionaryLength > LZCodec::MAX_DISTANCE) {
+    dictionary += dictionaryLength - LZCodec::MAX_DISTANCE;
+    dictionaryLength = LZCodec::MAX_DISTANCE;
+  }
+  out.clear();
+  out.reserve(dictionaryLength + rawLength);
+  out.append(dictionary, dictionaryLength);
+  uint32_t end = dictionaryLength + rawLength;
+
+  const unsigned char* in = (const unsigned char*) src;
+  const unsigned char* inEnd = in + srcLength;
+  while (in < inEnd) {
+    uint32_t token = *(in++);
+    uint32_t literalLength = token >> 4;
+    if (literalLength == 15 && !LZCodec::readLength(&in, inEnd, &literalLength)) return false;
+    if (literalLength > (uint32_t) (inEnd - in) || out.size() + literalLength > end) return false;
+    out.append((const char*) in, literalLength);
+    in += literalLength;
+    if (in == inEnd) break;
+
+    if (inEnd - in < 2) return false;
+    uint32_t distance = *in | (*(in + 1) << 8);
+    in += 2;
+    uint32_t matchLength = token & 0x0f;
+    if (matchLength == 15 && !LZCodec::readLength(&in, inEnd, &matchLength)) return false;
+    matchLength += LZCodec::MIN_MATCH;
+    if (distance == 0 || distance > out.size() || out.size() + matchLength > end) return false;
+
+    // the match may overlap what it is copying, so it goes a byte at a time
+    uint32_t from = out.size() - distance;
+    for (uint32_t i = 0; i < matchLength; ++i) out.push_back(out[from + i]);
+  }
+  if (out.size() != end) return false;
+
+  out.erase(0, dictionaryLength);
+  return true;
+}
@@ -0,0 +1,306 @@
+/**
+ * PostingIterator.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/PostingIterator.hpp"
+
+using bb::DBM;
+using bb::PostingIterator;
+using bb::PostingList;
+using bb::PostingLocation;
+
+PostingIterator::PostingIterator(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram)
+  : index(index), positions(positions), positionValue(NULL)
+{
+  PostingList::locate(index, positions, gram, &(this->location));
+  this->buffer = new uint32_t[PostingList::BLOCK_STRIDE];
+  this->init();
+}
+
+PostingIterator::PostingIterator(DBM<uint32_t>* index, DBM<uint32_t>* positions, const PostingLocation& location)
+  : index(index), positions(positions), location(location), positionValue(NULL)
+{
+  this->buffer = new uint32_t[PostingList::BLOCK_STRIDE];
+  this->init();
+}
+
+PostingIterator::PostingIterator(const uint32_t* docValue, uint32_t docLength,
+				 const uint32_t* positionValue, uint32_t positionLength)
+  : index(NULL), positions(NULL), positionValue(positionValue)
+{
+  this->location.docOffset = 0;
+  this->location.docLength = docLength;
+  this->location.positionOffset = 0;
+  this->location.positionLength = positionLength;
+  this->buffer = const_cast<uint32_t*>(docValue);
+  this->init();
+}
+
+PostingIterator::PostingIterator(const std::vector<uint32_t>& postings)
+  : index(NULL), positions(NULL)
+{
+  if (!postings.empty()) {
+    PostingList::encode(&postings[0], postings.size() / 2, 0, this->docStorage, this->positionStorage);
+  }
+  this->location.docOffset = 0;
+  this->location.docLength = this->docStorage.size();
+  this->location.positionOffset = 0;
+  this->location.positionLength = this->positionStorage.size();
+  this->buffer = this->docStorage.empty() ? NULL : &(this->docStorage[0]);
+  this->positionValue = this->positionStorage.empty() ? NULL : &(this->positionStorage[0]);
+  this->init();
+}
+
+PostingIterator::~PostingIterator()
+{
+  if (this->index != NULL) delete[] this->buffer;
+}
+
+void PostingIterator::init()
+{
+  this->blockCount = PostingList::countBlocks(this->location.docLength);
+  this->block = NULL;
+  this->blockIndex = 0;
+  this->blockDocCount = 0;
+  this->docPosition = 0;
+  this->positionBegin = 0;
+  this->offsets = NULL;
+  this->offsetPosition = 0;
+  this->started = false;
+  this->loadedBlocks = 0;
+}
+
+bool PostingIterator::loadBlock(uint32_t blockIndex)
+{
+  this->blockIndex = blockIndex;
+  this->blockDocCount = 0;
+  this->docPosition = 0;
+  this->offsets = NULL;
+  this->offsetPosition = 0;
+  if (blockIndex >= this->blockCount) return false;
+
+  uint32_t begin = blockIndex * PostingList::BLOCK_STRIDE;
+  if (this->index == NULL) {
+    this->block = this->buffer + begin;
+  }
+  else {
+    uint32_t count = std::min(PostingList::BLOCK_STRIDE, this->location.docLength - begin);
+    if (this->index->read(this->location.docOffset, begin, this->buffer, count) < PostingList::HEADER_LENGTH) {
+      this->blockIndex = this->blockCount;
+      return false;
+    }
+    this->block = this->buffer;
+  }
+
+  this->blockDocCount = PostingList::countBlockDocs(this->block, this->location.docLength - begin);
+  this->positionBegin = *(this->block + 3);
+  ++(this->loadedBlocks);
+  return this->blockDocCount > 0;
+}
+
+bool PostingIterator::loadBlockAbove(uint32_t blockIndex, uint32_t minFrequency)
+{
+  if (minFrequency > 0) {
+    while (blockIndex < this->blockCount && this->readMaxFrequency(blockIndex) <= minFrequency) ++blockIndex;
+  }
+  return this->loadBlock(blockIndex);
+}
+
+void PostingIterator::moveToDoc(uint32_t docPosition)
+{
+  while (this->docPosition < docPosition) {
+    this->positionBegin += this->termFrequency();
+    ++(this->docPosition);
+  }
+  this->offsets = NULL;
+  this->offsetPosition = 0;
+}
+
+bool PostingIterator::loadOffsets()
+{
+  if (this->offsets != NULL) return true;
+
+  uint32_t count = this->termFrequency();
+  if (this->index == NULL) {
+    this->offsets = this->positionValue + this->positionBegin;
+    return true;
+  }
+
+  this->offsetBuffer.resize(count);
+  if (this->positions->read(this->location.positionOffset, this->positionBegin, &(this->offsetBuffer[0]), count) < count) {
+    return false;
+  }
+  this->offsets = &(this->offsetBuffer[0]);
+  return true;
+}
+
+uint32_t PostingIterator::readLastDocId(uint32_t blockIndex)
+{
+  uint32_t begin = blockIndex * PostingList::BLOCK_STRIDE + 1;
+  if (this->index == NULL) return *(this->buffer + begin);
+
+  uint32_t lastDocId = 0;
+  this->index->read(this->location.docOffset, begin, &lastDocId, 1);
+  return lastDocId;
+}
+
+uint32_t PostingIterator::readMaxFrequency(uint32_t blockIndex)
+{
+  uint32_t begin = blockIndex * PostingList::BLOCK_STRIDE + 4;
+  if (this->index == NULL) return *(this->buffer + begin);
+
+  uint32_t maxFrequency = 0xffffffff;
+  this->index->read(this->location.docOffset, begin, &maxFrequency, 1);
+  return maxFrequency;
+}
+
+bool PostingIterator::next()
+{
+  if (this->started && !this->atEnd() && this->offsetPosition + 1 < this->termFrequency()) {
+    ++(this->offsetPosition);
+    return true;
+  }
+
+  return this->nextDoc();
+}
+
+bool PostingIterator::nextDoc()
+{
+  return this->nextDoc(0);
+}
+
+bool PostingIterator::nextDoc(uint32_t minFrequency)
+{
+  if (this->atEnd()) return false;
+
+  if (!this->started) {
+    this->started = true;
+    return this->loadBlockAbove(0, minFrequency);
+  }
+
+  if (this->docPosition + 1 < this->blockDocCount) {
+    this->moveToDoc(this->docPosition + 1);
+    return true;
+  }
+
+  return this->loadBlockAbove(this->blockIndex + 1, minFrequency);
+}
+
+bool PostingIterator::skipTo(uint32_t docId, uint32_t offset)
+{
+  if (!this->skipToDoc(docId)) return false;
+  if (this->docId() > docId) return true;
+  if (!this->loadOffsets()) return false;
+
+  uint32_t low = this->offsetPosition;
+  uint32_t high = this->termFrequency();
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (*(this->offsets + middle) < offset) low = middle + 1;
+    else high = middle;
+  }
+
+  if (low < this->termFrequency()) {
+    this->offsetPosition = low;
+    return true;
+  }
+  return this->nextDoc();
+}
+
+bool PostingIterator::skipToDoc(uint32_t docId)
+{
+  return this->skipToDoc(docId, 0);
+}
+
+// Only whole blocks are passed over for their frequencies; the document
+// moved to may still occur no more than minFrequency times.
+bool PostingIterator::skipToDoc(uint32_t docId, uint32_t minFrequency)
+{
+  if (this->atEnd()) return false;
+
+  if (!this->started) {
+    this->started = true;
+    if (!this->loadBlockAbove(0, minFrequency)) return false;
+  }
+  if (this->docId() >= docId) return true;
+
+  // jump straight to the first later block which may hold the target
+  if (*(this->block + 1) < docId) {
+    uint32_t low = this->blockIndex + 1;
+    uint32_t high = this->blockCount;
+    while (low < high) {
+      uint32_t middle = low + (high - low) / 2;
+      if (this->readLastDocId(middle) < docId) low = middle + 1;
+      else high = middle;
+    }
+    if (!this->loadBlockAbove(low, minFrequency)) return false;
+  }
+
+  uint32_t low = this->docPosition;
+  uint32_t high = this->blockDocCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (*(this->block + PostingList::HEADER_LENGTH + middle * 2) < docId) low = middle + 1;
+    else high = middle;
+  }
+
+  if (low < this->blockDocCount) {
+    if (low != this->docPosition) this->moveToDoc(low);
+    return true;
+  }
+  return this->loadBlockAbove(this->blockIndex + 1, minFrequency);
+}
+
+bool PostingIterator::atEnd() const
+{
+  return this->blockIndex >= this->blockCount;
+}
+
+uint32_t PostingIterator::size() const
+{
+  return this->location.positionLength;
+}
+
+uint32_t PostingIterator::docId() const
+{
+  return *(this->block + PostingList::HEADER_LENGTH + this->docPosition * 2);
+}
+
+uint32_t PostingIterator::termFrequency() const
+{
+  return *(this->block + PostingList::HEADER_LENGTH + this->docPosition * 2 + 1);
+}
+
+uint32_t PostingIterator::countLoadedBlocks() const
+{
+  return this->loadedBlocks;
+}
+
+uint32_t PostingIterator::offset()
+{
+  if (!this->loadOffsets()) return 0;
+  return *(this->offsets + this->offsetPosition);
+}
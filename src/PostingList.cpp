@@ -0,0 +1,304 @@
+/**
+ * PostingList.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/PostingList.hpp"
+
+using bb::AsyncReader;
+using bb::DBM;
+using bb::EpochManager;
+using bb::PostingList;
+using bb::PostingLocation;
+
+namespace {
+
+// Turns (docId, offset) postings into one (docId, term frequency) entry per
+// document and the bare offsets.
+void splitPostings(const uint32_t* postings, uint32_t postingCount,
+		   std::vector<uint32_t>& docs, std::vector<uint32_t>& offsets)
+{
+  for (uint32_t i = 0; i < postingCount; ++i) {
+    uint32_t docId = *(postings + i * 2);
+    if (docs.empty() || docs[docs.size() - 2] != docId) {
+      docs.push_back(docId);
+      docs.push_back(0);
+    }
+    ++docs.back();
+    offsets.push_back(*(postings + i * 2 + 1));
+  }
+}
+
+void encodeDocs(const uint32_t* docs, uint32_t docCount, uint32_t positionBegin, std::vector<uint32_t>& docValue)
+{
+  for (uint32_t begin = 0; begin < docCount; begin += PostingList::BLOCK_LENGTH) {
+    uint32_t count = std::min(PostingList::BLOCK_LENGTH, docCount - begin);
+    uint32_t maxFrequency = 0;
+    for (uint32_t d = begin; d < begin + count; ++d) maxFrequency = std::max(maxFrequency, *(docs + d * 2 + 1));
+    docValue.push_back(*(docs + begin * 2));
+    docValue.push_back(*(docs + (begin + count - 1) * 2));
+    docValue.push_back(count);
+    docValue.push_back(positionBegin);
+    docValue.push_back(maxFrequency);
+    docValue.insert(docValue.end(), docs + begin * 2, docs + (begin + count) * 2);
+    for (uint32_t d = begin; d < begin + count; ++d) positionBegin += *(docs + d * 2 + 1);
+  }
+}
+
+}
+
+const uint32_t PostingList::BLOCK_LENGTH = 128;
+const uint32_t PostingList::HEADER_LENGTH = 5;
+const uint32_t PostingList::BLOCK_STRIDE = PostingList::HEADER_LENGTH + PostingList::BLOCK_LENGTH * 2;
+
+uint32_t PostingList::countBlocks(uint32_t docLength)
+{
+  return (docLength + PostingList::BLOCK_STRIDE - 1) / PostingList::BLOCK_STRIDE;
+}
+
+uint32_t PostingList::countBlockDocs(const uint32_t* block, uint32_t length)
+{
+  // the last block may have been topped up past a length read earlier
+  uint32_t available = (length > PostingList::HEADER_LENGTH) ? (length - PostingList::HEADER_LENGTH) / 2 : 0;
+  return std::min(*(block + 2), available);
+}
+
+uint32_t PostingList::countDocs(uint32_t docLength)
+{
+  uint32_t blockCount = PostingList::countBlocks(docLength);
+  if (blockCount == 0) return 0;
+
+  uint32_t lastBlockLength = docLength - (blockCount - 1) * PostingList::BLOCK_STRIDE;
+  return (blockCount - 1) * PostingList::BLOCK_LENGTH + (lastBlockLength - PostingList::HEADER_LENGTH) / 2;
+}
+
+void PostingList::encode(const uint32_t* postings, uint32_t postingCount, uint32_t positionBegin,
+			 std::vector<uint32_t>& docValue, std::vector<uint32_t>& positionValue)
+{
+  std::vector<uint32_t> docs;
+  splitPostings(postings, postingCount, docs, positionValue);
+  if (!docs.empty()) encodeDocs(&docs[0], docs.size() / 2, positionBegin, docValue);
+}
+
+void PostingList::decode(const uint32_t* docValue, uint32_t docLength, const uint32_t* positionValue,
+			 std::vector<uint32_t>& postings)
+{
+  postings.clear();
+
+  uint32_t begin = 0;
+  while (begin + PostingList::HEADER_LENGTH <= docLength) {
+    uint32_t count = PostingList::countBlockDocs(docValue + begin, docLength - begin);
+    uint32_t position = *(docValue + begin + 3);
+    const uint32_t* docs = docValue + begin + PostingList::HEADER_LENGTH;
+    for (uint32_t d = 0; d < count; ++d) {
+      for (uint32_t i = 0; i < *(docs + d * 2 + 1); ++i) {
+	postings.push_back(*(docs + d * 2));
+	postings.push_back(*(positionValue + position++));
+      }
+    }
+    begin += PostingList::BLOCK_STRIDE;
+  }
+}
+
+void PostingList::decodeDocs(const uint32_t* docValue, uint32_t docLength, std::vector<uint32_t>& docs)
+{
+  docs.clear();
+  docs.reserve(PostingList::countDocs(docLength) * 2);
+
+  uint32_t begin = 0;
+  while (begin + PostingList::HEADER_LENGTH <= docLength) {
+    uint32_t count = PostingList::countBlockDocs(docValue + begin, docLength - begin);
+    const uint32_t* blockDocs = docValue + begin + PostingList::HEADER_LENGTH;
+    docs.insert(docs.end(), blockDocs, blockDocs + count * 2);
+    begin += PostingList::BLOCK_STRIDE;
+  }
+}
+
+bool PostingList::locate(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram, PostingLocation* location)
+{
+  location->docOffset = 0;
+  location->docLength = 0;
+  location->positionOffset = 0;
+  location->positionLength = 0;
+
+  return index->locate(gram, &(location->docOffset), &(location->docLength)) &&
+    positions->locate(gram, &(location->positionOffset), &(location->positionLength));
+}
+
+bool PostingList::locate(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram, PostingLocation* location,
+			 uint64_t epoch)
+{
+  location->docOffset = 0;
+  location->docLength = 0;
+  location->positionOffset = 0;
+  location->positionLength = 0;
+
+  return index->locate(gram, &(location->docOffset), &(location->docLength), epoch) &&
+    positions->locate(gram, &(location->positionOffset), &(location->positionLength), epoch);
+}
+
+bool PostingList::locateAll(DBM<uint32_t>* index, DBM<uint32_t>* positions, AsyncReader* reader,
+			    const std::vector<std::string>& grams, std::vector<PostingLocation>& locations)
+{
+  return PostingList::locateAll(index, positions, reader, grams, locations, EpochManager::LATEST_EPOCH);
+}
+
+bool PostingList::locateAll(DBM<uint32_t>* index, DBM<uint32_t>* positions, AsyncReader* reader,
+			    const std::vector<std::string>& grams, std::vector<PostingLocation>& locations,
+			    uint64_t epoch)
+{
+  std::vector<uint64_t> docOffsets;
+  std::vector<uint32_t> docLengths;
+  std::vector<uint64_t> positionOffsets;
+  std::vector<uint32_t> positionLengths;
+  index->locateAll(reader, grams, docOffsets, docLengths, epoch);
+  positions->locateAll(reader, grams, positionOffsets, positionLengths, epoch);
+
+  bool found = true;
+  locations.resize(grams.size());
+  for (uint32_t g = 0; g < grams.size(); ++g) {
+    PostingLocation location = { 0, 0, 0, 0 };
+    if (docOffsets[g] != 0 && positionOffsets[g] != 0) {
+      location.docOffset = docOffsets[g];
+      location.docLength = docLengths[g];
+      location.positionOffset = positionOffsets[g];
+      location.positionLength = positionLengths[g];
+    }
+    else {
+      found = false;
+    }
+    locations[g] = location;
+  }
+
+  return found;
+}
+
+uint32_t PostingList::append(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram,
+			     const std::vector<uint32_t>& postings)
+{
+  PostingLocation location;
+  if (!PostingList::locate(index, positions, gram, &location) || location.docLength == 0) {
+    PostingList::set(index, positions, gram, postings);
+    return postings.size() / 2;
+  }
+  if (postings.empty()) return location.positionLength;
+
+  std::vector<uint32_t> docs;
+  std::vector<uint32_t> offsets;
+  splitPostings(&postings[0], postings.size() / 2, docs, offsets);
+  uint32_t docCount = docs.size() / 2;
+
+  // top up the last block first, rewriting only its header in place
+  uint32_t lastBlockBegin = (PostingList::countBlocks(location.docLength) - 1) * PostingList::BLOCK_STRIDE;
+  uint32_t header[5];
+  index->read(location.docOffset, lastBlockBegin, header, PostingList::HEADER_LENGTH);
+
+  uint32_t positionBegin = location.positionLength;
+  uint32_t continued = 0;
+
+  // the postings of a document coming in parts continue its entry, whose
+  // term frequency is raised in place
+  if (header[2] > 0 && header[1] == docs[0]) {
+    uint32_t frequencyIndex = lastBlockBegin + PostingList::HEADER_LENGTH + (header[2] - 1) * 2 + 1;
+    uint32_t termFrequency = 0;
+    index->read(location.docOffset, frequencyIndex, &termFrequency, 1);
+    termFrequency += docs[1];
+    index->write(location.docOffset, frequencyIndex, &termFrequency, 1);
+    positionBegin += docs[1];
+    continued = 1;
+    header[4] = std::max(header[4], termFrequency);
+  }
+
+  uint32_t fillCount = std::min(PostingList::BLOCK_LENGTH - header[2], docCount - continued);
+  std::vector<uint32_t> tail;
+  if (fillCount > 0) {
+    header[1] = docs[(continued + fillCount - 1) * 2];
+    header[2] += fillCount;
+    tail.insert(tail.end(), docs.begin() + continued * 2, docs.begin() + (continued + fillCount) * 2);
+    for (uint32_t d = continued; d < continued + fillCount; ++d) {
+      positionBegin += docs[d * 2 + 1];
+      header[4] = std::max(header[4], docs[d * 2 + 1]);
+    }
+  }
+  if (fillCount > 0 || continued > 0) index->write(location.docOffset, lastBlockBegin, header, PostingList::HEADER_LENGTH);
+
+  fillCount += continued;
+  if (fillCount < docCount) encodeDocs(&docs[0] + fillCount * 2, docCount - fillCount, positionBegin, tail);
+  if (!tail.empty()) index->append(gram, &tail[0], tail.size());
+  positions->append(gram, &offsets[0], offsets.size());
+
+  return location.positionLength + offsets.size();
+}
+
+bool PostingList::get(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram,
+		      std::vector<uint32_t>& postings)
+{
+  postings.clear();
+
+  uint32_t docLength;
+  uint32_t* docValue = index->get(gram, &docLength);
+  if (docValue == NULL) return false;
+
+  uint32_t positionLength;
+  uint32_t* positionValue = positions->get(gram, &positionLength);
+  if (positionValue != NULL) {
+    PostingList::decode(docValue, docLength, positionValue, postings);
+    delete[] positionValue;
+  }
+  delete[] docValue;
+
+  return positionValue != NULL;
+}
+
+bool PostingList::getDocs(DBM<uint32_t>* index, const char* gram, std::vector<uint32_t>& docs)
+{
+  uint32_t docLength;
+  uint32_t* docValue = index->get(gram, &docLength);
+  if (docValue == NULL) {
+    docs.clear();
+    return false;
+  }
+
+  PostingList::decodeDocs(docValue, docLength, docs);
+  delete[] docValue;
+
+  return true;
+}
+
+void PostingList::set(DBM<uint32_t>* index, DBM<uint32_t>* positions, const char* gram,
+		      const std::vector<uint32_t>& postings)
+{
+  if (postings.empty()) {
+    index->remove(gram);
+    positions->remove(gram);
+    return;
+  }
+
+  std::vector<uint32_t> docValue;
+  std::vector<uint32_t> positionValue;
+  PostingList::encode(&postings[0], postings.size() / 2, 0, docValue, positionValue);
+  index->set(gram, &docValue[0], docValue.size());
+  positions->set(gram, &positionValue[0], positionValue.size());
+}
@@ -0,0 +1,221 @@
+/**
+ * Query.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/Query.hpp"
+
+using bb::Query;
+using bb::PhraseQuery;
+using bb::AndQuery;
+using bb::OrQuery;
+using bb::NotQuery;
+using bb::SearchCursor;
+
+PhraseQuery::PhraseQuery(SearchCursor* cursor) : cursor(cursor), started(false)
+{
+}
+
+PhraseQuery::~PhraseQuery()
+{
+  delete this->cursor;
+}
+
+bool PhraseQuery::next()
+{
+  if (!this->started) {
+    this->started = true;
+    return this->cursor->next();
+  }
+
+  uint32_t docId = this->cursor->docId();
+  if (docId == UINT32_MAX) return false;
+
+  return this->cursor->skipTo(docId + 1);
+}
+
+bool PhraseQuery::skipTo(uint32_t docId)
+{
+  this->started = true;
+  return this->cursor->skipTo(docId);
+}
+
+uint32_t PhraseQuery::docId() const
+{
+  return this->cursor->docId();
+}
+
+AndQuery::AndQuery(const std::vector<Query*>& children) : children(children)
+{
+}
+
+AndQuery::~AndQuery()
+{
+  std::vector<Query*>::iterator iter = this->children.begin();
+  while (iter != this->children.end()) {
+    delete *iter;
+    ++iter;
+  }
+}
+
+bool AndQuery::next()
+{
+  if (!this->children.front()->next()) return false;
+  return this->align();
+}
+
+bool AndQuery::skipTo(uint32_t docId)
+{
+  if (!this->children.front()->skipTo(docId)) return false;
+  return this->align();
+}
+
+uint32_t AndQuery::docId() const
+{
+  return this->children.front()->docId();
+}
+
+bool AndQuery::align()
+{
+  uint32_t i = 1;
+  while (i < this->children.size()) {
+    uint32_t docId = this->children.front()->docId();
+    if (!this->children[i]->skipTo(docId)) return false;
+
+    if (this->children[i]->docId() == docId) {
+      ++i;
+      continue;
+    }
+
+    if (!this->children.front()->skipTo(this->children[i]->docId())) return false;
+    i = 1;
+  }
+
+  return true;
+}
+
+OrQuery::OrQuery(const std::vector<Query*>& children)
+  : children(children), alive(children.size(), true), currentDocId(0), started(false)
+{
+}
+
+OrQuery::~OrQuery()
+{
+  std::vector<Query*>::iterator iter = this->children.begin();
+  while (iter != this->children.end()) {
+    delete *iter;
+    ++iter;
+  }
+}
+
+bool OrQuery::next()
+{
+  for (uint32_t i = 0; i < this->children.size(); ++i) {
+    if (!this->alive[i]) continue;
+    if (!this->started || this->children[i]->docId() == this->currentDocId) {
+      this->alive[i] = this->children[i]->next();
+    }
+  }
+  this->started = true;
+
+  return this->update();
+}
+
+bool OrQuery::skipTo(uint32_t docId)
+{
+  for (uint32_t i = 0; i < this->children.size(); ++i) {
+    if (!this->alive[i]) continue;
+    if (!this->started || this->children[i]->docId() < docId) {
+      this->alive[i] = this->children[i]->skipTo(docId);
+    }
+  }
+  this->started = true;
+
+  return this->update();
+}
+
+uint32_t OrQuery::docId() const
+{
+  return this->currentDocId;
+}
+
+bool OrQuery::update()
+{
+  bool found = false;
+  for (uint32_t i = 0; i < this->children.size(); ++i) {
+    if (!this->alive[i]) continue;
+    if (!found || this->children[i]->docId() < this->currentDocId) {
+      this->currentDocId = this->children[i]->docId();
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+NotQuery::NotQuery(Query* include, Query* exclude)
+  : include(include), exclude(exclude), excludeAlive(true), excludeStarted(false)
+{
+}
+
+NotQuery::~NotQuery()
+{
+  delete this->include;
+  delete this->exclude;
+}
+
+bool NotQuery::next()
+{
+  if (!this->include->next()) return false;
+  return this->align();
+}
+
+bool NotQuery::skipTo(uint32_t docId)
+{
+  if (!this->include->skipTo(docId)) return false;
+  return this->align();
+}
+
+uint32_t NotQuery::docId() const
+{
+  return this->include->docId();
+}
+
+bool NotQuery::align()
+{
+  while (this->excludeAlive) {
+    uint32_t docId = this->include->docId();
+    if (!this->excludeStarted || this->exclude->docId() < docId) {
+      this->excludeStarted = true;
+      this->excludeAlive = this->exclude->skipTo(docId);
+      if (!this->excludeAlive) break;
+    }
+
+    if (this->exclude->docId() != docId) break;
+    if (!this->include->next()) return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,249 @@
+/**
+ * QueryParser.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cctype>
+#include "bb/Bubu.hpp"
+#include "bb/QueryParser.hpp"
+
+using bb::Bitmap;
+using bb::DBM;
+using bb::EpochManager;
+using bb::Bubu;
+using bb::PostingIterator;
+using bb::PostingList;
+using bb::PostingLocation;
+using bb::SearchCursor;
+using bb::Query;
+using bb::PhraseQuery;
+using bb::AndQuery;
+using bb::OrQuery;
+using bb::NotQuery;
+using bb::QueryParser;
+
+QueryParser::QueryParser(Bubu* bubu)
+  : bubu(bubu), index(bubu->index), positions(bubu->positions), gramSize(bubu->gramSize),
+    epoch(EpochManager::LATEST_EPOCH), cursor(NULL)
+{
+}
+
+QueryParser::QueryParser(Bubu* bubu, uint64_t epoch)
+  : bubu(bubu), index(bubu->index), positions(bubu->positions), gramSize(bubu->gramSize), epoch(epoch), cursor(NULL)
+{
+}
+
+QueryParser::~QueryParser()
+{
+}
+
+Query* QueryParser::parse(const char* expression)
+{
+  if (expression == NULL) return NULL;
+  this->cursor = expression;
+
+  Query* query = this->parseOr();
+  this->skipSpaces();
+  if (query != NULL && *(this->cursor) != '\0') {
+    delete query;
+    return NULL;
+  }
+
+  return query;
+}
+
+Query* QueryParser::parseOr()
+{
+  std::vector<Query*> children;
+
+  do {
+    Query* child = this->parseAnd();
+    if (child == NULL) {
+      std::vector<Query*>::iterator iter = children.begin();
+      while (iter != children.end()) {
+	delete *iter;
+	++iter;
+      }
+      return NULL;
+    }
+    children.push_back(child);
+  } while (this->acceptKeyword("OR"));
+
+  if (children.size() == 1) return children.front();
+  return new OrQuery(children);
+}
+
+Query* QueryParser::parseAnd()
+{
+  std::vector<Query*> children;
+  Query* query = this->parsePrimary();
+
+  while (query != NULL) {
+    this->skipSpaces();
+    char next = *(this->cursor);
+    if (next == '\0' || next == ')') break;
+    if (this->matchKeyword("OR")) break;
+
+    if (this->acceptKeyword("NOT")) {
+      Query* exclude = this->parsePrimary();
+      if (exclude == NULL) {
+	delete query;
+	query = NULL;
+	break;
+      }
+
+      if (!children.empty()) {
+	children.push_back(query);
+	query = new AndQuery(children);
+	children.clear();
+      }
+      query = new NotQuery(query, exclude);
+      continue;
+    }
+
+    this->acceptKeyword("AND");
+    Query* child = this->parsePrimary();
+    if (child == NULL) {
+      delete query;
+      query = NULL;
+      break;
+    }
+    children.push_back(query);
+    query = child;
+  }
+
+  if (query == NULL) {
+    std::vector<Query*>::iterator iter = children.begin();
+    while (iter != children.end()) {
+      delete *iter;
+      ++iter;
+    }
+    return NULL;
+  }
+
+  if (children.empty()) return query;
+  children.push_back(query);
+  return new AndQuery(children);
+}
+
+Query* QueryParser::parsePrimary()
+{
+  this->skipSpaces();
+
+  if (*(this->cursor) == '(') {
+    ++(this->cursor);
+    Query* query = this->parseOr();
+    this->skipSpaces();
+    if (query == NULL || *(this->cursor) != ')') {
+      if (query != NULL) delete query;
+      return NULL;
+    }
+    ++(this->cursor);
+    return query;
+  }
+
+  if (*(this->cursor) == '"') {
+    const char* begin = ++(this->cursor);
+    while (*(this->cursor) != '"' && *(this->cursor) != '\0') ++(this->cursor);
+    if (*(this->cursor) != '"' || this->cursor == begin) return NULL;
+    std::string phrase(begin, this->cursor - begin);
+    ++(this->cursor);
+    return this->createPhrase(phrase);
+  }
+
+  std::string word = this->readWord();
+  if (word.empty() || word == "AND" || word == "OR" || word == "NOT") return NULL;
+  return this->createPhrase(word);
+}
+
+Query* QueryParser::createPhrase(const std::string& phrase)
+{
+  std::vector<uint32_t> postings;
+  if (this->bubu->expandPrefix(phrase.c_str(), postings, this->epoch)) {
+    std::vector<PostingIterator*> iterators(1, new PostingIterator(postings));
+    return new PhraseQuery(new SearchCursor(iterators, std::vector<uint32_t>(1, 0)));
+  }
+
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  Bubu::tokenizeQuery(phrase.c_str(), this->gramSize, grams, offsets);
+
+  std::vector<PostingIterator*> iterators;
+  std::vector<std::string>::iterator iter = grams.begin();
+  while (iter != grams.end()) {
+    std::map<std::string, PostingLocation>::iterator location = this->locations.find(*iter);
+    if (location == this->locations.end()) {
+      PostingLocation newLocation;
+      PostingList::locate(this->index, this->positions, iter->c_str(), &newLocation, this->epoch);
+      location = this->locations.insert(std::make_pair(*iter, newLocation)).first;
+    }
+    iterators.push_back(new PostingIterator(this->index, this->positions, location->second));
+    ++iter;
+  }
+
+  Bitmap filter;
+  std::vector<bool> filtered;
+  this->bubu->loadFilter(grams, this->epoch, filter, filtered);
+  SearchCursor* cursor = new SearchCursor(iterators, offsets, filter, filtered);
+  if (this->epoch != EpochManager::LATEST_EPOCH) {
+    cursor->holdEpoch(this->bubu->epochs, this->bubu->epochs->pin(this->epoch));
+  }
+  return new PhraseQuery(cursor);
+}
+
+std::string QueryParser::readWord()
+{
+  const char* begin = this->cursor;
+  while (*(this->cursor) != '\0' && !isspace((unsigned char) *(this->cursor)) &&
+	 *(this->cursor) != '"' && *(this->cursor) != '(' && *(this->cursor) != ')') {
+    ++(this->cursor);
+  }
+
+  return std::string(begin, this->cursor - begin);
+}
+
+bool QueryParser::acceptKeyword(const char* keyword)
+{
+  this->skipSpaces();
+  if (!this->matchKeyword(keyword)) return false;
+
+  this->cursor += strlen(keyword);
+  return true;
+}
+
+bool QueryParser::matchKeyword(const char* keyword) const
+{
+  size_t length = strlen(keyword);
+  if (strncmp(this->cursor, keyword, length) != 0) return false;
+
+  char following = *(this->cursor + length);
+  return (following == '\0' || isspace((unsigned char) following) ||
+	  following == '"' || following == '(');
+}
+
+void QueryParser::skipSpaces()
+{
+  while (isspace((unsigned char) *(this->cursor))) ++(this->cursor);
+}
@@ -0,0 +1,197 @@
+/**
+ * SearchCursor.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/SearchCursor.hpp"
+
+using bb::Bitmap;
+using bb::DBM;
+using bb::EpochManager;
+using bb::PostingIterator;
+using bb::SearchCursor;
+
+SearchCursor::SearchCursor(DBM<uint32_t>* index, DBM<uint32_t>* positions, const std::vector<std::string>& grams,
+			   const std::vector<uint32_t>& offsets)
+  : offsets(offsets), epochs(NULL), epoch(0), exhausted(grams.empty())
+{
+  std::vector<std::string>::const_iterator iter = grams.begin();
+  while (iter != grams.end()) {
+    PostingIterator* iterator = new PostingIterator(index, positions, iter->c_str());
+    if (iterator->atEnd()) this->exhausted = true;
+    this->iterators.push_back(iterator);
+    ++iter;
+  }
+}
+
+SearchCursor::SearchCursor(const std::vector<PostingIterator*>& iterators, const std::vector<uint32_t>& offsets)
+  : iterators(iterators), offsets(offsets), epochs(NULL), epoch(0), exhausted(iterators.empty())
+{
+  std::vector<PostingIterator*>::const_iterator iter = iterators.begin();
+  while (iter != iterators.end()) {
+    if ((*iter)->atEnd()) this->exhausted = true;
+    ++iter;
+  }
+}
+
+SearchCursor::SearchCursor(const std::vector<PostingIterator*>& iterators, const std::vector<uint32_t>& offsets,
+			   const Bitmap& filter, const std::vector<bool>& filtered)
+  : iterators(iterators), offsets(offsets), filter(filter), filtered(filtered), epochs(NULL), epoch(0),
+    exhausted(iterators.empty())
+{
+  std::vector<PostingIterator*>::const_iterator iter = iterators.begin();
+  while (iter != iterators.end()) {
+    if ((*iter)->atEnd()) this->exhausted = true;
+    ++iter;
+  }
+}
+
+SearchCursor::~SearchCursor()
+{
+  std::vector<PostingIterator*>::iterator iter = this->iterators.begin();
+  while (iter != this->iterators.end()) {
+    delete *iter;
+    ++iter;
+  }
+  if (this->epochs != NULL) this->epochs->unpin(this->epoch);
+}
+
+void SearchCursor::holdEpoch(EpochManager* epochs, uint64_t epoch)
+{
+  this->epochs = epochs;
+  this->epoch = epoch;
+}
+
+bool SearchCursor::next()
+{
+  if (this->exhausted) return false;
+  if (!this->iterators.front()->next()) return this->finish();
+
+  return this->align();
+}
+
+bool SearchCursor::skipTo(uint32_t docId)
+{
+  if (this->exhausted) return false;
+  if (!this->iterators.front()->skipToDoc(docId)) return this->finish();
+
+  return this->align();
+}
+
+uint32_t SearchCursor::docId() const
+{
+  return this->iterators.front()->docId();
+}
+
+uint32_t SearchCursor::offset() const
+{
+  return this->iterators.front()->offset();
+}
+
+bool SearchCursor::align()
+{
+  while (this->alignDocs()) {
+    if (this->alignOffsets()) return true;
+  }
+
+  return this->finish();
+}
+
+bool SearchCursor::alignDocs()
+{
+  PostingIterator* anchor = this->iterators.front();
+  uint32_t gramCount = this->iterators.size();
+  bool filtering = !this->filtered.empty();
+
+  uint32_t g = 1;
+  while (!anchor->atEnd()) {
+    uint32_t docId = anchor->docId();
+    if (filtering && g == 1) {
+      uint32_t nextDocId;
+      if (!this->filter.findNext(docId, &nextDocId)) return false;
+      if (nextDocId != docId) {
+	if (!anchor->skipToDoc(nextDocId)) return false;
+	continue;
+      }
+    }
+
+    if (g == gramCount) break;
+    if (filtering && this->filtered[g]) {
+      ++g;
+      continue;
+    }
+    PostingIterator* iterator = this->iterators[g];
+
+    if (!iterator->skipToDoc(docId)) return false;
+
+    if (iterator->docId() == docId) {
+      ++g;
+      continue;
+    }
+
+    if (!anchor->skipToDoc(iterator->docId())) return false;
+    g = 1;
+  }
+
+  return !anchor->atEnd();
+}
+
+// Looks for a hit within the document every gram is on, leaving the
+// anchor past that document when there is none.
+bool SearchCursor::alignOffsets()
+{
+  PostingIterator* anchor = this->iterators.front();
+  uint32_t gramCount = this->iterators.size();
+  uint32_t docId = anchor->docId();
+
+  uint32_t g = 1;
+  while (g < gramCount) {
+    uint32_t offset = anchor->offset() + this->offsets[g];
+    PostingIterator* iterator = this->iterators[g];
+
+    if (!iterator->skipTo(docId, offset) || iterator->docId() != docId) {
+      anchor->nextDoc();
+      return false;
+    }
+
+    if (iterator->offset() == offset) {
+      ++g;
+      continue;
+    }
+
+    // leap the anchor to the first position the mismatching gram allows
+    uint32_t nextOffset = (iterator->offset() >= this->offsets[g]) ? iterator->offset() - this->offsets[g] : 0;
+    if (!anchor->skipTo(docId, nextOffset) || anchor->docId() != docId) return false;
+    g = 1;
+  }
+
+  return true;
+}
+
+bool SearchCursor::finish()
+{
+  this->exhausted = true;
+  return false;
+}
@@ -0,0 +1,544 @@
+/**
+ * ShardedBubu.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bb/ShardedBubu.hpp"
+
+using bb::Bubu;
+using bb::DBM;
+using bb::RankStatistics;
+using bb::ShardedBubu;
+using bb::Task;
+using bb::ThreadPool;
+
+namespace {
+
+// Runs one search call on one shard; the kind of call decides which of
+// the results is filled, and served tells whether the shard answered it
+// or refused it as stale. Ranking takes two calls at the epoch pinned on
+// the shard: one for its statistics and one to score with the global ones.
+class ShardSearchTask : public Task
+{
+public:
+  enum Kind { SEARCH, BATCH, STATISTICS, TOP_K, QUERY };
+
+protected:
+  Bubu* shard;
+  Kind kind;
+  std::string query;
+  const std::vector<std::string>* queries;
+  uint32_t k;
+  uint64_t epoch;
+  const RankStatistics* globalStatistics;
+
+public:
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > batchHits;
+  RankStatistics statistics;
+  std::vector<std::pair<uint32_t, double> > results;
+  std::vector<uint32_t> docIds;
+  bool served;
+
+  ShardSearchTask(Bubu* shard, Kind kind, const char* query, const std::vector<std::string>* queries, uint32_t k)
+    : shard(shard), kind(kind), query(query ? query : ""), queries(queries), k(k), epoch(0),
+      globalStatistics(NULL), served(false) {}
+
+  ShardSearchTask(Bubu* shard, Kind kind, const char* query, uint32_t k, uint64_t epoch,
+		  const RankStatistics* globalStatistics)
+    : shard(shard), kind(kind), query(query ? query : ""), queries(NULL), k(k), epoch(epoch),
+      globalStatistics(globalStatistics), served(false) {}
+
+  virtual void run() {
+    uint64_t epoch;
+    switch (this->kind) {
+    case SEARCH:
+      epoch = this->shard->pinEpoch();
+      this->served = this->shard->search(this->query.c_str(), epoch, this->hits);
+      this->shard->unpinEpoch(epoch);
+      break;
+    case BATCH:
+      epoch = this->shard->pinEpoch();
+      this->served = this->shard->searchBatch(*(this->queries), epoch, this->batchHits);
+      this->shard->unpinEpoch(epoch);
+      break;
+    case STATISTICS:
+      this->served = this->shard->getRankStatistics(this->query.c_str(), this->epoch, this->statistics);
+      break;
+    case TOP_K:
+      this->served = this->shard->searchTopK(this->query.c_str(), this->k, this->epoch, *(this->globalStatistics),
+					     this->results);
+      break;
+    case QUERY:
+      this->served = this->shard->searchQuery(this->query.c_str(), this->docIds);
+      break;
+    }
+  }
+};
+
+// Registers the documents dealt to one shard, in the order given.
+class ShardRegisterTask : public Task
+{
+protected:
+  Bubu* shard;
+  std::vector<const std::pair<uint32_t, std::string>*> docs;
+
+public:
+  ShardRegisterTask(Bubu* shard) : shard(shard) {}
+
+  void add(const std::pair<uint32_t, std::string>* doc) { this->docs.push_back(doc); }
+
+  virtual void run() {
+    std::vector<const std::pair<uint32_t, std::string>*>::iterator iter = this->docs.begin();
+    while (iter != this->docs.end()) {
+      this->shard->registerDoc((*iter)->first, (*iter)->second.c_str());
+      ++iter;
+    }
+  }
+};
+
+// Merges lists sorted in ascending order, taking the smallest head of
+// any list at every step.
+template <typename T>
+void mergeSorted(const std::vector<const std::vector<T>*>& lists, std::vector<T>& merged)
+{
+  std::vector<std::pair<T, uint32_t> > heads;
+  std::vector<size_t> positions(lists.size(), 0);
+  for (uint32_t l = 0; l < lists.size(); ++l) {
+    if (!lists[l]->empty()) heads.push_back(std::pair<T, uint32_t>(lists[l]->front(), l));
+  }
+  std::make_heap(heads.begin(), heads.end(), std::greater<std::pair<T, uint32_t> >());
+
+  while (!heads.empty()) {
+    std::pop_heap(heads.begin(), heads.end(), std::greater<std::pair<T, uint32_t> >());
+    uint32_t l = heads.back().second;
+    merged.push_back(heads.back().first);
+    heads.pop_back();
+
+    if (++positions[l] < lists[l]->size()) {
+      heads.push_back(std::pair<T, uint32_t>((*lists[l])[positions[l]], l));
+      std::push_heap(heads.begin(), heads.end(), std::greater<std::pair<T, uint32_t> >());
+    }
+  }
+}
+
+// Orders results as a single workspace does: best score first, and the
+// larger docId first among equal scores.
+bool compareScores(const std::pair<uint32_t, double>& a, const std::pair<uint32_t, double>& b)
+{
+  if (a.second != b.second) return a.second > b.second;
+  return a.first > b.first;
+}
+
+}
+
+const char* ShardedBubu::SETTINGS_FILE = "/bubu.shd";
+const char* ShardedBubu::SHARDS_KEY = "$shards";
+
+ShardedBubu::ShardedBubu() : threadPool(NULL)
+{
+}
+
+ShardedBubu::~ShardedBubu()
+{
+  this->close();
+  if (this->threadPool) delete this->threadPool;
+}
+
+bool ShardedBubu::open(const char* workspaceDir)
+{
+  return this->open(workspaceDir, false);
+}
+
+bool ShardedBubu::open(const char* workspaceDir, bool readOnly)
+{
+  this->close();
+
+  std::string workspace(workspaceDir);
+  DBM<uint32_t> settings;
+  std::string settingsPath = workspace + ShardedBubu::SETTINGS_FILE;
+  if ((!readOnly && !DBM<uint32_t>::upgrade(settingsPath.c_str())) ||
+      !settings.open(settingsPath.c_str(), readOnly)) {
+    return false;
+  }
+
+  uint32_t valueLength;
+  uint32_t* shardCount = settings.get(ShardedBubu::SHARDS_KEY, &valueLength);
+  settings.close();
+  if (shardCount == NULL) return false;
+
+  bool opened = valueLength == 1 && *shardCount > 0 &&
+    this->openShards(workspace, *shardCount, false, readOnly, 0, false);
+  delete[] shardCount;
+  return opened;
+}
+
+bool ShardedBubu::create(const char* workspaceDir, uint32_t shardCount)
+{
+  return this->create(workspaceDir, shardCount, 0);
+}
+
+bool ShardedBubu::create(const char* workspaceDir, uint32_t shardCount, uint32_t gramSize)
+{
+  return this->create(workspaceDir, shardCount, gramSize, true);
+}
+
+bool ShardedBubu::create(const char* workspaceDir, uint32_t shardCount, uint32_t gramSize, bool indexUnigrams)
+{
+  this->close();
+  if (shardCount == 0) return false;
+
+  std::string workspace(workspaceDir);
+  DBM<uint32_t> settings;
+  std::string settingsPath = workspace + ShardedBubu::SETTINGS_FILE;
+  if (!settings.create(settingsPath.c_str(), 16, 16)) return false;
+  settings.set(ShardedBubu::SHARDS_KEY, &shardCount, 1);
+  settings.close();
+
+  return this->openShards(workspace, shardCount, true, false, gramSize, indexUnigrams);
+}
+
+void ShardedBubu::close()
+{
+  std::vector<Bubu*>::iterator iter = this->shards.begin();
+  while (iter != this->shards.end()) {
+    delete *iter;
+    ++iter;
+  }
+  this->shards.clear();
+
+  // the pool is sized by the shard count, which the next workspace may not share
+  if (this->threadPool) {
+    delete this->threadPool;
+    this->threadPool = NULL;
+  }
+}
+
+bool ShardedBubu::flush()
+{
+  bool flushed = !this->shards.empty();
+  std::vector<Bubu*>::iterator iter = this->shards.begin();
+  while (iter != this->shards.end()) {
+    flushed = (*iter)->flush() && flushed;
+    ++iter;
+  }
+  return flushed;
+}
+
+uint32_t ShardedBubu::getShardCount() const
+{
+  return this->shards.size();
+}
+
+bool ShardedBubu::isStale()
+{
+  std::vector<Bubu*>::iterator iter = this->shards.begin();
+  while (iter != this->shards.end()) {
+    if ((*iter)->isStale()) return true;
+    ++iter;
+  }
+  return false;
+}
+
+std::vector<std::pair<uint32_t, uint32_t> > ShardedBubu::search(const char* query)
+{
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  this->search(query, hits);
+  return hits;
+}
+
+// A read is served only if every shard serves it.
+bool ShardedBubu::search(const char* query, std::vector<std::pair<uint32_t, uint32_t> >& hits)
+{
+  hits.clear();
+  std::vector<ShardSearchTask*> tasks;
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t s = 0; s < this->shards.size(); ++s) {
+    tasks.push_back(new ShardSearchTask(this->shards[s], ShardSearchTask::SEARCH, query, NULL, 0));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  bool served = true;
+  std::vector<const std::vector<std::pair<uint32_t, uint32_t> >*> lists;
+  for (uint32_t s = 0; s < tasks.size(); ++s) {
+    served = served && tasks[s]->served;
+    lists.push_back(&(tasks[s]->hits));
+  }
+  if (served) mergeSorted(lists, hits);
+
+  for (uint32_t s = 0; s < tasks.size(); ++s) delete tasks[s];
+  return served;
+}
+
+std::vector<std::vector<std::pair<uint32_t, uint32_t> > > ShardedBubu::searchBatch(const std::vector<std::string>& queries)
+{
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > hits;
+  this->searchBatch(queries, hits);
+  return hits;
+}
+
+bool ShardedBubu::searchBatch(const std::vector<std::string>& queries,
+			      std::vector<std::vector<std::pair<uint32_t, uint32_t> > >& hits)
+{
+  hits.assign(queries.size(), std::vector<std::pair<uint32_t, uint32_t> >());
+  std::vector<ShardSearchTask*> tasks;
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t s = 0; s < this->shards.size(); ++s) {
+    tasks.push_back(new ShardSearchTask(this->shards[s], ShardSearchTask::BATCH, NULL, &queries, 0));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  bool served = true;
+  for (uint32_t s = 0; s < tasks.size(); ++s) served = served && tasks[s]->served;
+  for (uint32_t q = 0; q < queries.size() && served; ++q) {
+    std::vector<const std::vector<std::pair<uint32_t, uint32_t> >*> lists;
+    for (uint32_t s = 0; s < tasks.size(); ++s) lists.push_back(&(tasks[s]->batchHits[q]));
+    mergeSorted(lists, hits[q]);
+  }
+
+  for (uint32_t s = 0; s < tasks.size(); ++s) delete tasks[s];
+  return served;
+}
+
+std::vector<std::pair<uint32_t, double> > ShardedBubu::searchTopK(const char* query, uint32_t k)
+{
+  std::vector<std::pair<uint32_t, double> > results;
+  this->searchTopK(query, k, results);
+  return results;
+}
+
+bool ShardedBubu::searchTopK(const char* query, uint32_t k, std::vector<std::pair<uint32_t, double> >& results)
+{
+  results.clear();
+
+  // shards hold disjoint documents, so the statistics of the whole
+  // workspace are the sums of theirs; they are gathered first, at an epoch
+  // pinned on every shard, and every shard then scores with them
+  std::vector<uint64_t> epochs;
+  std::vector<ShardSearchTask*> tasks;
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t s = 0; s < this->shards.size(); ++s) {
+    epochs.push_back(this->shards[s]->pinEpoch());
+    tasks.push_back(new ShardSearchTask(this->shards[s], ShardSearchTask::STATISTICS, query, 0, epochs[s], NULL));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  bool served = true;
+  RankStatistics statistics = { 0, 0, std::vector<uint32_t>() };
+  for (uint32_t s = 0; s < tasks.size(); ++s) {
+    served = served && tasks[s]->served;
+    const RankStatistics& shardStatistics = tasks[s]->statistics;
+    statistics.docCount += shardStatistics.docCount;
+    statistics.totalLength += shardStatistics.totalLength;
+    if (statistics.docFrequencies.size() < shardStatistics.docFrequencies.size()) {
+      statistics.docFrequencies.resize(shardStatistics.docFrequencies.size(), 0);
+    }
+    for (uint32_t g = 0; g < shardStatistics.docFrequencies.size(); ++g) {
+      statistics.docFrequencies[g] += shardStatistics.docFrequencies[g];
+    }
+    delete tasks[s];
+  }
+
+  // with the same statistics everywhere, scores compare across shards and
+  // the best k overall are among the best k of every shard
+  tasks.clear();
+  for (uint32_t s = 0; s < this->shards.size() && served; ++s) {
+    tasks.push_back(new ShardSearchTask(this->shards[s], ShardSearchTask::TOP_K, query, k, epochs[s], &statistics));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  for (uint32_t s = 0; s < tasks.size(); ++s) {
+    served = served && tasks[s]->served;
+    results.insert(results.end(), tasks[s]->results.begin(), tasks[s]->results.end());
+    delete tasks[s];
+  }
+  for (uint32_t s = 0; s < this->shards.size(); ++s) this->shards[s]->unpinEpoch(epochs[s]);
+  if (!served) {
+    results.clear();
+    return false;
+  }
+
+  std::sort(results.begin(), results.end(), compareScores);
+  if (results.size() > k) results.resize(k);
+  return true;
+}
+
+std::vector<uint32_t> ShardedBubu::searchQuery(const char* expression)
+{
+  std::vector<uint32_t> docIds;
+  this->searchQuery(expression, docIds);
+  return docIds;
+}
+
+bool ShardedBubu::searchQuery(const char* expression, std::vector<uint32_t>& docIds)
+{
+  docIds.clear();
+  std::vector<ShardSearchTask*> tasks;
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t s = 0; s < this->shards.size(); ++s) {
+    tasks.push_back(new ShardSearchTask(this->shards[s], ShardSearchTask::QUERY, expression, NULL, 0));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  bool served = true;
+  std::vector<const std::vector<uint32_t>*> lists;
+  for (uint32_t s = 0; s < tasks.size(); ++s) {
+    served = served && tasks[s]->served;
+    lists.push_back(&(tasks[s]->docIds));
+  }
+  if (served) mergeSorted(lists, docIds);
+
+  for (uint32_t s = 0; s < tasks.size(); ++s) delete tasks[s];
+  return served;
+}
+
+void ShardedBubu::registerDoc(uint32_t docId, const char* docContent)
+{
+  if (this->shards.empty()) return;
+  this->getShard(docId)->registerDoc(docId, docContent);
+}
+
+void ShardedBubu::registerDoc(uint32_t docId, std::istream& input)
+{
+  if (this->shards.empty()) return;
+  this->getShard(docId)->registerDoc(docId, input);
+}
+
+void ShardedBubu::registerDocs(const std::vector<std::pair<uint32_t, std::string> >& docs)
+{
+  if (this->shards.empty()) return;
+
+  std::vector<ShardRegisterTask*> tasks;
+  for (uint32_t s = 0; s < this->shards.size(); ++s) tasks.push_back(new ShardRegisterTask(this->shards[s]));
+  std::vector<std::pair<uint32_t, std::string> >::const_iterator iter = docs.begin();
+  while (iter != docs.end()) {
+    tasks[iter->first % this->shards.size()]->add(&(*iter));
+    ++iter;
+  }
+
+  ThreadPool* pool = this->getThreadPool();
+  for (uint32_t s = 0; s < tasks.size(); ++s) pool->submit(tasks[s]);
+  pool->wait();
+
+  for (uint32_t s = 0; s < tasks.size(); ++s) delete tasks[s];
+}
+
+void ShardedBubu::updateDoc(uint32_t docId, const char* docContent)
+{
+  if (this->shards.empty()) return;
+  this->getShard(docId)->updateDoc(docId, docContent);
+}
+
+void ShardedBubu::unregisterDoc(uint32_t docId)
+{
+  if (this->shards.empty()) return;
+  this->getShard(docId)->unregisterDoc(docId);
+}
+
+std::string ShardedBubu::getDocContent(uint32_t docId)
+{
+  if (this->shards.empty()) return std::string();
+  return this->getShard(docId)->getDocContent(docId);
+}
+
+bool ShardedBubu::getDocContent(uint32_t docId, std::string& docContent)
+{
+  docContent.clear();
+  if (this->shards.empty()) return false;
+  return this->getShard(docId)->getDocContent(docId, docContent);
+}
+
+std::string ShardedBubu::getSnippet(uint32_t docId, uint32_t offset, uint32_t window)
+{
+  if (this->shards.empty()) return std::string();
+  return this->getShard(docId)->getSnippet(docId, offset, window);
+}
+
+bool ShardedBubu::getSnippet(uint32_t docId, uint32_t offset, uint32_t window, std::string& snippet)
+{
+  snippet.clear();
+  if (this->shards.empty()) return false;
+  return this->getShard(docId)->getSnippet(docId, offset, window, snippet);
+}
+
+std::string ShardedBubu::getShardPath(const std::string& workspace, uint32_t shard)
+{
+  std::stringstream path;
+  path << workspace << "/shard" << shard;
+  return path.str();
+}
+
+ThreadPool* ShardedBubu::getThreadPool()
+{
+  // shards are worked on one task each, so a thread per shard keeps all
+  // of them busy; a shard splits long lists up on a pool of its own
+  if (this->threadPool == NULL) {
+    this->threadPool = new ThreadPool(std::max((size_t) 1, this->shards.size()));
+  }
+
+  return this->threadPool;
+}
+
+Bubu* ShardedBubu::getShard(uint32_t docId)
+{
+  return this->shards[docId % this->shards.size()];
+}
+
+// A gram size of 0 creates the shards with the default one.
+bool ShardedBubu::openShards(const std::string& workspace, uint32_t shardCount, bool creating, bool readOnly,
+			     uint32_t gramSize, bool indexUnigrams)
+{
+  for (uint32_t s = 0; s < shardCount; ++s) {
+    std::string shardPath = ShardedBubu::getShardPath(workspace, s);
+    Bubu* shard = new Bubu();
+    this->shards.push_back(shard);
+
+    bool opened;
+    if (creating) {
+      opened = (mkdir(shardPath.c_str(), 0755) == 0 || access(shardPath.c_str(), F_OK) == 0) &&
+	shard->create(shardPath.c_str(), (gramSize == 0) ? Bubu::DEFAULT_GRAM_SIZE : gramSize, indexUnigrams);
+    }
+    else {
+      opened = shard->open(shardPath.c_str(), readOnly);
+    }
+
+    if (!opened) {
+      this->close();
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,171 @@
+/**
+ * ThreadPool.cpp
+ *
+ * @author      Yu Nejigane
+ * @link        http://wiki.github.com/nejigane/Bubu
+ *
+ * Copyright (c) 2009 Yu Nejigane
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bb/ThreadPool.hpp"
+
+using bb::Task;
+using bb::ThreadPool;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+  : queuedCount(0), pendingCount(0), runningCount(0), nextWorker(0), stopping(false)
+{
+  pthread_mutex_init(&(this->mutex), NULL);
+  pthread_cond_init(&(this->taskAvailable), NULL);
+  pthread_cond_init(&(this->tasksDone), NULL);
+
+  if (threadCount == 0) threadCount = 1;
+  for (uint32_t i = 0; i < threadCount; ++i) {
+    Worker* worker = new Worker();
+    worker->pool = this;
+    worker->index = this->workers.size();
+    pthread_mutex_init(&(worker->mutex), NULL);
+    this->workers.push_back(worker);
+  }
+
+  // the deques must all exist before any worker starts stealing; a deque
+  // whose thread failed to start is still drained by the others
+  std::vector<Worker*>::iterator iter = this->workers.begin();
+  while (iter != this->workers.end()) {
+    (*iter)->running = (pthread_create(&((*iter)->thread), NULL, ThreadPool::work, *iter) == 0);
+    if ((*iter)->running) ++(this->runningCount);
+    ++iter;
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  pthread_mutex_lock(&(this->mutex));
+  this->stopping = true;
+  pthread_cond_broadcast(&(this->taskAvailable));
+  pthread_mutex_unlock(&(this->mutex));
+
+  std::vector<Worker*>::iterator iter = this->workers.begin();
+  while (iter != this->workers.end()) {
+    if ((*iter)->running) pthread_join((*iter)->thread, NULL);
+    pthread_mutex_destroy(&((*iter)->mutex));
+    delete *iter;
+    ++iter;
+  }
+
+  pthread_cond_destroy(&(this->tasksDone));
+  pthread_cond_destroy(&(this->taskAvailable));
+  pthread_mutex_destroy(&(this->mutex));
+}
+
+void ThreadPool::submit(Task* task)
+{
+  // without any worker the task is simply run in the caller
+  if (this->runningCount == 0) {
+    task->run();
+    return;
+  }
+
+  pthread_mutex_lock(&(this->mutex));
+  Worker* worker = this->workers[this->nextWorker];
+  this->nextWorker = (this->nextWorker + 1) % this->workers.size();
+
+  pthread_mutex_lock(&(worker->mutex));
+  worker->tasks.push_back(task);
+  pthread_mutex_unlock(&(worker->mutex));
+
+  ++(this->queuedCount);
+  ++(this->pendingCount);
+  pthread_cond_signal(&(this->taskAvailable));
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+void ThreadPool::wait()
+{
+  pthread_mutex_lock(&(this->mutex));
+  while (this->pendingCount > 0) {
+    pthread_cond_wait(&(this->tasksDone), &(this->mutex));
+  }
+  pthread_mutex_unlock(&(this->mutex));
+}
+
+uint32_t ThreadPool::size() const
+{
+  return this->runningCount;
+}
+
+void* ThreadPool::work(void* worker)
+{
+  Worker* self = static_cast<Worker*>(worker);
+  ThreadPool* pool = self->pool;
+
+  while (true) {
+    // reserve one queued task first; it is then certain to be found in
+    // some deque, even if another worker steals it from ours meanwhile
+    pthread_mutex_lock(&(pool->mutex));
+    while (pool->queuedCount == 0 && !pool->stopping) {
+      pthread_cond_wait(&(pool->taskAvailable), &(pool->mutex));
+    }
+    if (pool->queuedCount == 0) {
+      pthread_mutex_unlock(&(pool->mutex));
+      break;
+    }
+    --(pool->queuedCount);
+    pthread_mutex_unlock(&(pool->mutex));
+
+    Task* task = NULL;
+    while (task == NULL) task = pool->takeTask(self->index);
+    task->run();
+
+    pthread_mutex_lock(&(pool->mutex));
+    if (--(pool->pendingCount) == 0) {
+      pthread_cond_broadcast(&(pool->tasksDone));
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+  }
+
+  return NULL;
+}
+
+Task* ThreadPool::takeTask(uint32_t index)
+{
+  Task* task = NULL;
+  Worker* own = this->workers[index];
+
+  pthread_mutex_lock(&(own->mutex));
+  if (!own->tasks.empty()) {
+    task = own->tasks.back();
+    own->tasks.pop_back();
+  }
+  pthread_mutex_unlock(&(own->mutex));
+
+  for (uint32_t i = 1; task == NULL && i < this->workers.size(); ++i) {
+    Worker* victim = this->workers[(index + i) % this->workers.size()];
+    pthread_mutex_lock(&(victim->mutex));
+    if (!victim->tasks.empty()) {
+      task = victim->tasks.front();
+      victim->tasks.pop_front();
+    }
+    pthread_mutex_unlock(&(victim->mutex));
+  }
+
+  return task;
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+#include "bb/AsyncReader.hpp"
+
+namespace bb {
+
+class TestableAsyncReader : public AsyncReader
+{
+public:
+  using AsyncReader::teardown;
+};
+
+}
+
+class AsyncReaderTest : public ::testing::Test
+{
+protected:
+  FILE* fp;
+
+  virtual void SetUp() {
+    this->fp = fopen("reader.dat", "wb+");
+    for (uint32_t i = 0; i < 10000; ++i) fwrite(&i, sizeof(uint32_t), 1, this->fp);
+    fflush(this->fp);
+  }
+
+  virtual void TearDown() {
+    fclose(this->fp);
+    remove("reader.dat");
+  }
+
+  void checkReads(bb::AsyncReader& reader) {
+    // more requests than the ring holds at once, one of them past the end
+    // of the file and one cut short by it
+    std::vector<uint32_t> buffers(100 * 4, 0);
+    std::vector<bb::AsyncReader::Request> requests;
+    for (uint32_t i = 0; i < 100; ++i) {
+      bb::AsyncReader::Request request = { fileno(this->fp), (uint64_t) i * 97 * sizeof(uint32_t),
+					   &buffers[i * 4], 4 * sizeof(uint32_t), 0 };
+      requests.push_back(request);
+    }
+    requests[98].offset = 20000 * sizeof(uint32_t);
+    requests[99].offset = 9998 * sizeof(uint32_t);
+    reader.readAll(requests);
+
+    for (uint32_t i = 0; i < 98; ++i) {
+      ASSERT_EQ(4 * sizeof(uint32_t), requests[i].result);
+      EXPECT_EQ(i * 97, buffers[i * 4]);
+      EXPECT_EQ(i * 97 + 3, buffers[i * 4 + 3]);
+    }
+    EXPECT_EQ(0, requests[98].result);
+    EXPECT_EQ(2 * sizeof(uint32_t), requests[99].result);
+    EXPECT_EQ(9999, buffers[99 * 4 + 1]);
+
+    std::vector<bb::AsyncReader::Request> badRequests(1, requests[0]);
+    badRequests[0].fd = -1;
+    reader.readAll(badRequests);
+    EXPECT_EQ(-EBADF, badRequests[0].result);
+  }
+};
+
+TEST_F(AsyncReaderTest, ReadAllTest) {
+  bb::AsyncReader reader;
+  this->checkReads(reader);
+
+  std::vector<bb::AsyncReader::Request> requests;
+  reader.readAll(requests);
+  EXPECT_TRUE(requests.empty());
+}
+
+TEST_F(AsyncReaderTest, ShallowRingTest) {
+  bb::AsyncReader reader(2);
+  this->checkReads(reader);
+}
+
+TEST_F(AsyncReaderTest, FallbackTest) {
+  // without a ring every read is done synchronously
+  bb::TestableAsyncReader reader;
+  reader.teardown();
+  EXPECT_FALSE(reader.isAsync());
+  this->checkReads(reader);
+}
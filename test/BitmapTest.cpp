@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "bb/Bitmap.hpp"
+
+class BitmapTest : public ::testing::Test
+{
+protected:
+  bb::DBM<uint32_t>* index;
+
+  virtual void SetUp() {
+    remove("bitmap.dat");
+    this->index = new bb::DBM<uint32_t>();
+    this->index->create("bitmap.dat", 100, 100);
+  }
+
+  virtual void TearDown() {
+    delete this->index;
+    remove("bitmap.dat");
+  }
+};
+
+TEST_F(BitmapTest, AddRemoveTest) {
+  bb::Bitmap bitmap;
+  EXPECT_EQ(0, bitmap.size());
+  EXPECT_FALSE(bitmap.contains(0));
+
+  bitmap.add(5);
+  bitmap.add(3);
+  bitmap.add(70000);
+  bitmap.add(5);
+  EXPECT_EQ(3, bitmap.size());
+  EXPECT_TRUE(bitmap.contains(3));
+  EXPECT_TRUE(bitmap.contains(5));
+  EXPECT_TRUE(bitmap.contains(70000));
+  EXPECT_FALSE(bitmap.contains(4));
+  EXPECT_FALSE(bitmap.contains(65541));
+
+  bitmap.remove(5);
+  bitmap.remove(6);
+  EXPECT_EQ(2, bitmap.size());
+  EXPECT_FALSE(bitmap.contains(5));
+
+  std::vector<uint32_t> docIds;
+  bitmap.toVector(docIds);
+  ASSERT_EQ(2, docIds.size());
+  EXPECT_EQ(3, docIds[0]);
+  EXPECT_EQ(70000, docIds[1]);
+}
+
+TEST_F(BitmapTest, ContainerTest) {
+  // a container turns into a bitmap past ARRAY_LIMIT values and back
+  bb::Bitmap bitmap;
+  for (uint32_t i = 0; i <= bb::Bitmap::ARRAY_LIMIT; ++i) bitmap.add(i * 3);
+  EXPECT_EQ(bb::Bitmap::ARRAY_LIMIT + 1, bitmap.size());
+
+  std::vector<uint32_t> value;
+  bitmap.encode(value);
+  EXPECT_EQ(bb::Bitmap::HEADER_LENGTH + 2 + bb::Bitmap::BITMAP_LENGTH, value.size());
+  EXPECT_TRUE(bitmap.contains(3 * bb::Bitmap::ARRAY_LIMIT));
+  EXPECT_FALSE(bitmap.contains(3 * bb::Bitmap::ARRAY_LIMIT + 1));
+
+  bitmap.remove(0);
+  bitmap.encode(value);
+  EXPECT_EQ(bb::Bitmap::HEADER_LENGTH + 2 + bb::Bitmap::ARRAY_LIMIT / 2, value.size());
+
+  bb::Bitmap decoded(&value[0], value.size());
+  EXPECT_EQ(bb::Bitmap::ARRAY_LIMIT, decoded.size());
+  std::vector<uint32_t> docIds;
+  decoded.toVector(docIds);
+  ASSERT_EQ(bb::Bitmap::ARRAY_LIMIT, docIds.size());
+  for (uint32_t i = 0; i < docIds.size(); ++i) EXPECT_EQ((i + 1) * 3, docIds[i]);
+}
+
+TEST_F(BitmapTest, FindNextTest) {
+  bb::Bitmap bitmap;
+  uint32_t next;
+  EXPECT_FALSE(bitmap.findNext(0, &next));
+
+  // an array container, a bitmap container and one past a gap in keys
+  bitmap.add(5);
+  bitmap.add(70);
+  for (uint32_t i = 0; i <= bb::Bitmap::ARRAY_LIMIT; ++i) bitmap.add(65536 + 64 + i * 7);
+  bitmap.add(5 * 65536 + 1);
+
+  ASSERT_TRUE(bitmap.findNext(0, &next));
+  EXPECT_EQ(5, next);
+  ASSERT_TRUE(bitmap.findNext(6, &next));
+  EXPECT_EQ(70, next);
+  ASSERT_TRUE(bitmap.findNext(71, &next));
+  EXPECT_EQ(65536 + 64, next);
+  ASSERT_TRUE(bitmap.findNext(65536 + 65, &next));
+  EXPECT_EQ(65536 + 71, next);
+  ASSERT_TRUE(bitmap.findNext(65536 + 64 + bb::Bitmap::ARRAY_LIMIT * 7 + 1, &next));
+  EXPECT_EQ(5 * 65536 + 1, next);
+  ASSERT_TRUE(bitmap.findNext(5 * 65536 + 1, &next));
+  EXPECT_EQ(5 * 65536 + 1, next);
+  EXPECT_FALSE(bitmap.findNext(5 * 65536 + 2, &next));
+}
+
+TEST_F(BitmapTest, IntersectTest) {
+  bb::Bitmap multiplesOf2;
+  bb::Bitmap multiplesOf3;
+  bb::Bitmap sparse;
+  for (uint32_t i = 0; i < 200000; i += 2) multiplesOf2.add(i);
+  for (uint32_t i = 0; i < 200000; i += 3) multiplesOf3.add(i);
+  sparse.add(6);
+  sparse.add(9);
+  sparse.add(131070);
+  sparse.add(300000);
+
+  bb::Bitmap common = multiplesOf2;
+  common.intersect(multiplesOf3);
+  EXPECT_EQ(33334, common.size());
+  std::vector<uint32_t> docIds;
+  common.toVector(docIds);
+  ASSERT_EQ(33334, docIds.size());
+  for (uint32_t i = 0; i < docIds.size(); ++i) EXPECT_EQ(i * 6, docIds[i]);
+
+  common.intersect(sparse);
+  common.toVector(docIds);
+  ASSERT_EQ(2, docIds.size());
+  EXPECT_EQ(6, docIds[0]);
+  EXPECT_EQ(131070, docIds[1]);
+}
+
+TEST_F(BitmapTest, StoreTest) {
+  bb::Bitmap bitmap;
+  EXPECT_FALSE(bb::Bitmap::get(this->index, "gram", bitmap));
+  EXPECT_FALSE(bb::Bitmap::append(this->index, "gram", 1));
+
+  bitmap.add(1);
+  bb::Bitmap::set(this->index, "gram", bitmap);
+
+  // ascending docIds fill the last array in place, cross into new
+  // containers and switch to a bitmap container on the way
+  std::vector<uint32_t> expected(1, 1);
+  for (uint32_t docId = 2; docId < 140000; docId += 7) {
+    EXPECT_TRUE(bb::Bitmap::append(this->index, "gram", docId));
+    expected.push_back(docId);
+  }
+  // out of order docIds rewrite the whole value
+  EXPECT_TRUE(bb::Bitmap::append(this->index, "gram", 4));
+  expected.insert(expected.begin() + 2, 4);
+  EXPECT_TRUE(bb::Bitmap::append(this->index, "gram", 9));
+
+  bb::Bitmap stored;
+  ASSERT_TRUE(bb::Bitmap::get(this->index, "gram", stored));
+  std::vector<uint32_t> docIds;
+  stored.toVector(docIds);
+  EXPECT_TRUE(expected == docIds);
+
+  bb::Bitmap::set(this->index, "gram", bb::Bitmap());
+  EXPECT_FALSE(this->index->contains("gram"));
+}
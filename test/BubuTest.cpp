@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
+#include <map>
+#include <sstream>
+#include <unistd.h>
 #include "bb/Bubu.hpp"
+#include "bb/PostingList.hpp"
 
 namespace bb {
 
@@ -7,10 +11,28 @@ class TestableBubu : public Bubu
 {
 public:
   using Bubu::index;
+  using Bubu::positions;
   using Bubu::library;
+  using Bubu::catalog;
+  using Bubu::docStore;
 
   using Bubu::uintToString;
   using Bubu::tokenizeUTF8;
+  using Bubu::tokenizeQuery;
+  using Bubu::searchPartitioned;
+
+  uint32_t* getPostings(const char* gram, uint32_t* postingsLength) {
+    std::vector<uint32_t> postings;
+    if (!PostingList::get(this->index, this->positions, gram, postings)) {
+      *postingsLength = 0;
+      return NULL;
+    }
+
+    *postingsLength = postings.size();
+    uint32_t* copy = new uint32_t[postings.size()];
+    std::copy(postings.begin(), postings.end(), copy);
+    return copy;
+  }
 };
 
 }
@@ -20,12 +42,20 @@ class BubuTest : public ::testing::Test
 protected:
   virtual void SetUp() {
     remove("bubu.idx");
+    remove("bubu.pos");
     remove("bubu.lib");
+    remove("bubu.cat");
+    remove("bubu.dic");
+    remove("bubu.gen");
   }
   
   virtual void TearDown() {
     remove("bubu.idx");
+    remove("bubu.pos");
     remove("bubu.lib");
+    remove("bubu.cat");
+    remove("bubu.dic");
+    remove("bubu.gen");
   }
 };
 
@@ -87,6 +117,40 @@ TEST_F(BubuTest, TokenizeUTF8Test) {
   EXPECT_EQ(0, bigrams.at(1).compare("ふが"));
 }
 
+TEST_F(BubuTest, TokenizeQueryTest) {
+  std::vector<std::string> grams;
+  std::vector<uint32_t> offsets;
+  bb::TestableBubu::tokenizeQuery("ほげふが", 2, grams, offsets);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("ほげ", grams[0].c_str());
+  EXPECT_STREQ("ふが", grams[1].c_str());
+  EXPECT_EQ(2, offsets[1]);
+
+  bb::TestableBubu::tokenizeQuery("ほげふ", 2, grams, offsets);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("げふ", grams[1].c_str());
+  EXPECT_EQ(1, offsets[1]);
+
+  bb::TestableBubu::tokenizeQuery("search", 3, grams, offsets);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("sea", grams[0].c_str());
+  EXPECT_STREQ("rch", grams[1].c_str());
+  EXPECT_EQ(3, offsets[1]);
+
+  bb::TestableBubu::tokenizeQuery("index", 3, grams, offsets);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("dex", grams[1].c_str());
+  EXPECT_EQ(2, offsets[1]);
+
+  bb::TestableBubu::tokenizeQuery("ab", 3, grams, offsets);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("b", grams[1].c_str());
+  EXPECT_EQ(1, offsets[1]);
+
+  bb::TestableBubu::tokenizeQuery("", 3, grams, offsets);
+  EXPECT_TRUE(grams.empty());
+}
+
 TEST_F(BubuTest, OpenTest) {
   bb::TestableBubu* bubu = new bb::TestableBubu();
 
@@ -102,12 +166,135 @@ TEST_F(BubuTest, OpenTest) {
   library->close();
   delete library;
 
+  EXPECT_FALSE(bubu->open("."));
+
+  bb::DBM<uint32_t>* positions = new bb::DBM<uint32_t>();
+  positions->create("bubu.pos", 100, 100);
+  positions->close();
+  delete positions;
+
   EXPECT_TRUE(bubu->open("."));
   bubu->close();
 
   delete bubu;
 }
 
+namespace {
+
+// writes a file of the original 32-bit DBM layout, with every record
+// chained from the first bucket entry
+void writeLegacyDBM(const char* path, const std::map<std::string, std::string>& records, uint32_t valueSize)
+{
+  FILE* fp = fopen(path, "wb");
+  uint32_t bucketLength = 7;
+  uint32_t freePoolLength = 3;
+  std::vector<uint32_t> bucket(bucketLength, 0);
+  std::vector<uint32_t> freePool(freePoolLength * 2, 0);
+  uint32_t offset = sizeof(uint32_t) * (2 + bucketLength + freePoolLength * 2);
+  if (!records.empty()) bucket[0] = offset;
+  fwrite(&bucketLength, sizeof(uint32_t), 1, fp);
+  fwrite(&bucket[0], sizeof(uint32_t), bucketLength, fp);
+  fwrite(&freePoolLength, sizeof(uint32_t), 1, fp);
+  fwrite(&freePool[0], sizeof(uint32_t), freePoolLength * 2, fp);
+
+  std::map<std::string, std::string>::const_iterator iter = records.begin();
+  while (iter != records.end()) {
+    std::map<std::string, std::string>::const_iterator next = iter;
+    ++next;
+    offset += sizeof(uint32_t) * 4 + iter->first.size() + iter->second.size();
+    uint32_t fields[2] = { (next == records.end()) ? 0 : offset, (uint32_t) iter->first.size() };
+    uint32_t valueFields[2] = { (uint32_t) iter->second.size() / valueSize, (uint32_t) iter->second.size() / valueSize };
+    fwrite(fields, sizeof(uint32_t), 2, fp);
+    fwrite(iter->first.data(), sizeof(char), iter->first.size(), fp);
+    fwrite(valueFields, sizeof(uint32_t), 2, fp);
+    fwrite(iter->second.data(), sizeof(char), iter->second.size(), fp);
+    iter = next;
+  }
+  fclose(fp);
+}
+
+}
+
+TEST_F(BubuTest, UpgradeTest) {
+  // documents registered out of order by the original code, which appended
+  // (docId, offset) pairs of unigrams and bigrams to plain lists
+  const char* docs[] = { "", "今日は晴れ", "今日は雨", "明日は晴れ" };
+  uint32_t order[] = { 3, 1, 2 };
+  std::map<std::string, std::vector<uint32_t> > lists;
+  std::map<std::string, std::string> contents;
+  for (uint32_t i = 0; i < 3; ++i) {
+    std::vector<std::string> unigrams;
+    std::vector<std::string> bigrams;
+    bb::TestableBubu::tokenizeUTF8(docs[order[i]], true, unigrams, bigrams);
+    for (uint32_t j = 0; j < unigrams.size(); ++j) {
+      lists[unigrams[j]].push_back(order[i]);
+      lists[unigrams[j]].push_back(j);
+    }
+    for (uint32_t j = 0; j < bigrams.size(); ++j) {
+      lists[bigrams[j]].push_back(order[i]);
+      lists[bigrams[j]].push_back(j);
+    }
+    contents[bb::TestableBubu::uintToString(order[i])] = docs[order[i]];
+  }
+  std::map<std::string, std::string> postings;
+  std::map<std::string, std::vector<uint32_t> >::iterator iter = lists.begin();
+  for (; iter != lists.end(); ++iter) {
+    postings[iter->first].assign((const char*) &(iter->second[0]), iter->second.size() * sizeof(uint32_t));
+  }
+  writeLegacyDBM("bubu.idx", postings, sizeof(uint32_t));
+
+  // nothing is touched unless the whole workspace can be converted
+  bb::TestableBubu* bubu = new bb::TestableBubu();
+  EXPECT_FALSE(bubu->open("."));
+  EXPECT_TRUE(bb::DBM<uint32_t>::isLegacy("bubu.idx"));
+
+  writeLegacyDBM("bubu.lib", contents, sizeof(char));
+  std::map<std::string, std::string> oddPostings(postings);
+  oddPostings["晴"].resize(3 * sizeof(uint32_t));
+  writeLegacyDBM("bubu.idx", oddPostings, sizeof(uint32_t));
+  EXPECT_FALSE(bubu->open("."));
+  EXPECT_TRUE(bb::DBM<uint32_t>::isLegacy("bubu.idx"));
+  EXPECT_TRUE(bb::DBM<char>::isLegacy("bubu.lib"));
+  EXPECT_NE(0, access("bubu.pos", F_OK));
+  EXPECT_NE(0, access("bubu.cat", F_OK));
+  EXPECT_NE(0, access("bubu.idx.upgrade", F_OK));
+  EXPECT_NE(0, access("bubu.idx.flat", F_OK));
+
+  writeLegacyDBM("bubu.idx", postings, sizeof(uint32_t));
+  ASSERT_TRUE(bubu->open("."));
+  EXPECT_FALSE(bb::DBM<uint32_t>::isLegacy("bubu.idx"));
+  EXPECT_NE(0, access("bubu.idx.upgrade", F_OK));
+
+  std::vector<std::pair<uint32_t, uint32_t> > results = bubu->search("は晴れ");
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(1, results.at(0).first);
+  EXPECT_EQ(2, results.at(0).second);
+  EXPECT_EQ(3, results.at(1).first);
+  results = bubu->search("今日");
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(1, results.at(0).first);
+  EXPECT_EQ(2, results.at(1).first);
+  EXPECT_EQ(2, bubu->searchTopK("晴れ", 10).size());
+  EXPECT_EQ("今日は雨", bubu->getDocContent(2));
+  EXPECT_EQ("日は", bubu->getSnippet(3, 2, 2));
+
+  std::vector<std::string> grams = bubu->searchPrefix("今", 10);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_EQ("今", grams.at(0));
+  EXPECT_EQ("今日", grams.at(1));
+
+  bubu->unregisterDoc(1);
+  bubu->registerDoc(4, "明日も晴れ");
+  bubu->close();
+
+  ASSERT_TRUE(bubu->open("."));
+  results = bubu->search("晴れ");
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(3, results.at(0).first);
+  EXPECT_EQ(4, results.at(1).first);
+  delete bubu;
+}
+
 TEST_F(BubuTest, CreateTest) {
   bb::TestableBubu* bubu = new bb::TestableBubu();
 
@@ -126,44 +313,272 @@ TEST_F(BubuTest, CreateTest) {
   fclose(fp);
 }
 
+TEST_F(BubuTest, SearchPrefixTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  bubu->registerDoc(1, "今日は晴れ");
+  bubu->registerDoc(2, "今年は雨");
+
+  std::vector<std::string> grams = bubu->searchPrefix("今", 10);
+  ASSERT_EQ(3, grams.size());
+  EXPECT_STREQ("今", grams[0].c_str());
+  EXPECT_STREQ("今年", grams[1].c_str());
+  EXPECT_STREQ("今日", grams[2].c_str());
+
+  bubu->close();
+  ASSERT_TRUE(bubu->open("."));
+  EXPECT_EQ(3, bubu->searchPrefix("は", 10).size());
+  EXPECT_EQ(1, bubu->searchPrefix("は", 1).size());
+
+  // grams left without postings are passed over
+  bubu->unregisterDoc(2);
+  grams = bubu->searchPrefix("今", 2);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_STREQ("今", grams[0].c_str());
+  EXPECT_STREQ("今日", grams[1].c_str());
+  EXPECT_EQ(2, bubu->searchPrefix("は", 10).size());
+  EXPECT_TRUE(bubu->searchPrefix("今年", 10).empty());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, GramSizeTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  EXPECT_FALSE(bubu->create(".", 1));
+  ASSERT_TRUE(bubu->create(".", 3));
+  EXPECT_EQ(3, bubu->getGramSize());
+
+  bubu->registerDoc(1, "the quick brown fox");
+  bubu->registerDoc(2, "the lazy dog");
+  EXPECT_TRUE(bubu->index->contains("qui"));
+  EXPECT_TRUE(bubu->index->contains("q"));
+  EXPECT_FALSE(bubu->index->contains("qu"));
+
+  // the gram size is kept with the workspace
+  bubu->close();
+  delete bubu;
+  bubu = new bb::TestableBubu();
+  ASSERT_TRUE(bubu->open("."));
+  EXPECT_EQ(3, bubu->getGramSize());
+
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("quick");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(1, hits[0].first);
+  EXPECT_EQ(4, hits[0].second);
+
+  hits = bubu->search("he");
+  ASSERT_EQ(2, hits.size());
+  EXPECT_EQ(1, hits[0].second);
+  EXPECT_EQ(2, hits[1].first);
+
+  EXPECT_EQ(2, bubu->search("the ").size());
+  EXPECT_EQ(1, bubu->searchTopK("lazy", 10).size());
+  EXPECT_EQ(1, bubu->searchQuery("\"the\" NOT dog").size());
+
+  bubu->unregisterDoc(1);
+  EXPECT_FALSE(bubu->index->contains("qui"));
+  EXPECT_EQ(0, bubu->search("quick").size());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, SkipUnigramsTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  ASSERT_TRUE(bubu->create(".", 3, false));
+
+  bubu->registerDoc(1, "abcab");
+  bubu->registerDoc(2, "cab");
+  EXPECT_FALSE(bubu->index->contains("a"));
+  EXPECT_TRUE(bubu->index->contains("abc"));
+  EXPECT_TRUE(bubu->index->contains("ab\x01"));
+  EXPECT_TRUE(bubu->index->contains("b\x01"));
+
+  // the mode is kept with the workspace
+  bubu->close();
+  delete bubu;
+  bubu = new bb::TestableBubu();
+  ASSERT_TRUE(bubu->open("."));
+  EXPECT_FALSE(bubu->index->contains("a"));
+
+  // short queries are found at the ends of documents, too
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("b");
+  ASSERT_EQ(3, hits.size());
+  EXPECT_EQ(std::make_pair(1u, 1u), hits[0]);
+  EXPECT_EQ(std::make_pair(1u, 4u), hits[1]);
+  EXPECT_EQ(std::make_pair(2u, 2u), hits[2]);
+
+  hits = bubu->search("ab");
+  ASSERT_EQ(3, hits.size());
+  EXPECT_EQ(std::make_pair(1u, 0u), hits[0]);
+  EXPECT_EQ(std::make_pair(1u, 3u), hits[1]);
+  EXPECT_EQ(std::make_pair(2u, 1u), hits[2]);
+  EXPECT_EQ(1, bubu->search("bca").size());
+  EXPECT_EQ(0, bubu->search("ba").size());
+
+  std::vector<std::string> queries;
+  queries.push_back("c");
+  queries.push_back("abcab");
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > batchHits = bubu->searchBatch(queries);
+  EXPECT_EQ(2, batchHits[0].size());
+  EXPECT_EQ(1, batchHits[1].size());
+
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("b", 10);
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(1, results[0].first);
+
+  bb::SearchCursor* cursor = bubu->openCursor("ca");
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(1, cursor->docId());
+  EXPECT_EQ(2, cursor->offset());
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(2, cursor->docId());
+  EXPECT_FALSE(cursor->next());
+  delete cursor;
+
+  std::vector<uint32_t> docIds = bubu->searchQuery("b NOT bca");
+  ASSERT_EQ(1, docIds.size());
+  EXPECT_EQ(2, docIds[0]);
+
+  // grams closed by the marker are reported without it
+  std::vector<std::string> grams = bubu->searchPrefix("ab", 10);
+  ASSERT_EQ(2, grams.size());
+  EXPECT_EQ("ab", grams[0]);
+  EXPECT_EQ("abc", grams[1]);
+
+  bubu->unregisterDoc(2);
+  EXPECT_EQ(2, bubu->search("b").size());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, FlushTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();
+  EXPECT_FALSE(bubu->flush());
+  ASSERT_TRUE(bubu->create("."));
+
+  bubu->registerDoc(1, "abcab");
+  bubu->registerDoc(2, "cab");
+  EXPECT_TRUE(bubu->flush());
+
+  // a flushed workspace opens as it stands, without closing the writer
+  bb::TestableBubu* reader = new bb::TestableBubu();
+  ASSERT_TRUE(reader->open("."));
+  EXPECT_EQ(3, reader->search("ab").size());
+  EXPECT_EQ("cab", reader->getDocContent(2));
+  EXPECT_EQ(1, reader->searchPrefix("ca", 10).size());
+  delete reader;
+
+  bubu->registerDoc(3, "bc");
+  EXPECT_TRUE(bubu->flush());
+  EXPECT_EQ(2, bubu->search("bc").size());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, ReadOnlyTest) {
+  bb::TestableBubu* reader = new bb::TestableBubu();
+  EXPECT_FALSE(reader->open(".", true));
+
+  bb::TestableBubu* writer = new bb::TestableBubu();
+  ASSERT_TRUE(writer->create("."));
+  writer->registerDoc(1, "abcab");
+  ASSERT_TRUE(writer->flush());
+
+  ASSERT_TRUE(reader->open(".", true));
+  EXPECT_TRUE(reader->isReadOnly());
+  EXPECT_TRUE(reader->index->isReadOnly());
+  EXPECT_EQ(2, reader->search("ab").size());
+
+  reader->registerDoc(2, "xyz");
+  reader->unregisterDoc(1);
+  EXPECT_FALSE(reader->flush());
+  EXPECT_EQ(2, reader->search("ab").size());
+  EXPECT_EQ(0, writer->search("xy").size());
+
+  // a reader is stale once the writer changes anything, and opens again
+  // only once the writer has flushed
+  EXPECT_FALSE(reader->isStale());
+  writer->registerDoc(2, "xyz");
+  EXPECT_TRUE(reader->isStale());
+  EXPECT_EQ(0, reader->search("ab").size());
+  EXPECT_EQ("", reader->getDocContent(1));
+  EXPECT_EQ(0, reader->searchTopK("ab", 1).size());
+  EXPECT_EQ(0, reader->searchQuery("ab").size());
+
+  // every read says it was refused rather than found nothing
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  EXPECT_FALSE(reader->search("ab", bb::EpochManager::LATEST_EPOCH, hits));
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > batchHits;
+  EXPECT_FALSE(reader->searchBatch(std::vector<std::string>(1, "ab"), bb::EpochManager::LATEST_EPOCH, batchHits));
+  EXPECT_EQ(1, batchHits.size());
+  bb::RankStatistics statistics;
+  EXPECT_FALSE(reader->getRankStatistics("ab", bb::EpochManager::LATEST_EPOCH, statistics));
+  std::vector<std::pair<uint32_t, double> > results;
+  EXPECT_FALSE(reader->searchTopK("ab", 1, bb::EpochManager::LATEST_EPOCH, statistics, results));
+  std::vector<uint32_t> docIds;
+  EXPECT_FALSE(reader->searchQuery("ab", docIds));
+  std::vector<std::string> grams;
+  EXPECT_FALSE(reader->searchPrefix("a", 10, grams));
+  std::string content;
+  EXPECT_FALSE(reader->getDocContent(1, content));
+  EXPECT_FALSE(reader->getSnippet(1, 0, 2, content));
+  uint32_t byteOffset;
+  EXPECT_FALSE(reader->getByteOffset(1, 0, &byteOffset));
+  EXPECT_TRUE(reader->openCursor("ab") == NULL);
+  EXPECT_TRUE(reader->openQuery("ab") == NULL);
+  EXPECT_TRUE(writer->search("zz", bb::EpochManager::LATEST_EPOCH, hits));
+  EXPECT_TRUE(hits.empty());
+  EXPECT_TRUE(writer->getDocContent(5, content));
+  bb::TestableBubu* other = new bb::TestableBubu();
+  EXPECT_FALSE(other->open(".", true));
+  delete other;
+
+  ASSERT_TRUE(writer->flush());
+  delete reader;
+  reader = new bb::TestableBubu();
+  ASSERT_TRUE(reader->open(".", true));
+  EXPECT_EQ(1, reader->search("xy").size());
+  EXPECT_EQ("xyz", reader->getDocContent(2));
+
+  delete reader;
+  delete writer;
+}
+
 TEST_F(BubuTest, RegisterDocTest) {
   bb::TestableBubu* bubu = new bb::TestableBubu();  
   bubu->create(".");
 
   bubu->registerDoc(1, "テスト");
 
-  uint32_t docLength;
-  char* doc = bubu->library->get("1", &docLength);
-  ASSERT_TRUE(docLength > 0);
-  EXPECT_EQ(0, strncmp("テスト", doc, docLength));
-  delete[] doc;
+  EXPECT_STREQ("テスト", bubu->getDocContent(1).c_str());
 
   uint32_t valueLength;
-  uint32_t* value = bubu->index->get("テ", &valueLength);
+  uint32_t* value = bubu->getPostings("テ", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(0, *(value + 1));
   delete[] value;
   
-  value = bubu->index->get("ス", &valueLength);
+  value = bubu->getPostings("ス", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(1, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("ト", &valueLength);
+  value = bubu->getPostings("ト", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(2, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("テス", &valueLength);
+  value = bubu->getPostings("テス", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(0, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("スト", &valueLength);
+  value = bubu->getPostings("スト", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(1, *(value + 1));
@@ -171,7 +586,7 @@ TEST_F(BubuTest, RegisterDocTest) {
 
   bubu->registerDoc(2, "ストア");
 
-  value = bubu->index->get("ス", &valueLength);
+  value = bubu->getPostings("ス", &valueLength);
   ASSERT_EQ(4, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(1, *(value + 1));
@@ -179,7 +594,7 @@ TEST_F(BubuTest, RegisterDocTest) {
   EXPECT_EQ(0, *(value + 3));
   delete[] value;
 
-  value = bubu->index->get("ト", &valueLength);
+  value = bubu->getPostings("ト", &valueLength);
   ASSERT_EQ(4, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(2, *(value + 1));
@@ -187,13 +602,13 @@ TEST_F(BubuTest, RegisterDocTest) {
   EXPECT_EQ(1, *(value + 3));
   delete[] value;
 
-  value = bubu->index->get("ア", &valueLength);
+  value = bubu->getPostings("ア", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(2, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("スト", &valueLength);
+  value = bubu->getPostings("スト", &valueLength);
   ASSERT_EQ(4, valueLength);
   EXPECT_EQ(1, *value);
   EXPECT_EQ(1, *(value + 1));
@@ -201,7 +616,7 @@ TEST_F(BubuTest, RegisterDocTest) {
   EXPECT_EQ(0, *(value + 3));
   delete[] value;
 
-  value = bubu->index->get("トア", &valueLength);
+  value = bubu->getPostings("トア", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(1, *(value + 1));
@@ -218,51 +633,44 @@ TEST_F(BubuTest, UnregisterDocTest) {
   bubu->registerDoc(2, "ストア");
   bubu->unregisterDoc(1);
 
-  uint32_t docLength;
-  char* doc = bubu->library->get("1", &docLength);
-  EXPECT_TRUE(docLength == 0);
-  EXPECT_TRUE(doc == NULL);
-
-  doc = bubu->library->get("2", &docLength);
-  ASSERT_TRUE(docLength > 0);
-  EXPECT_EQ(0, strncmp("ストア", doc, docLength));
-  delete[] doc;
+  EXPECT_TRUE(bubu->getDocContent(1).empty());
+  EXPECT_STREQ("ストア", bubu->getDocContent(2).c_str());
   
   uint32_t valueLength;
-  uint32_t* value = bubu->index->get("テ", &valueLength);
+  uint32_t* value = bubu->getPostings("テ", &valueLength);
   ASSERT_EQ(0, valueLength);
   EXPECT_TRUE(value == NULL);
   
-  value = bubu->index->get("ス", &valueLength);
+  value = bubu->getPostings("ス", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(0, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("ト", &valueLength);
+  value = bubu->getPostings("ト", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(1, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("ア", &valueLength);
+  value = bubu->getPostings("ア", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(2, *(value + 1));
   delete[] value;
   
   value = NULL;
-  value = bubu->index->get("テス", &valueLength);
+  value = bubu->getPostings("テス", &valueLength);
   ASSERT_EQ(0, valueLength);
   EXPECT_TRUE(value == NULL);
 
-  value = bubu->index->get("スト", &valueLength);
+  value = bubu->getPostings("スト", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(0, *(value + 1));
   delete[] value;
 
-  value = bubu->index->get("トア", &valueLength);
+  value = bubu->getPostings("トア", &valueLength);
   ASSERT_EQ(2, valueLength);
   EXPECT_EQ(2, *value);
   EXPECT_EQ(1, *(value + 1));
@@ -271,6 +679,52 @@ TEST_F(BubuTest, UnregisterDocTest) {
   delete bubu;
 }
 
+TEST_F(BubuTest, ReregisterDocTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  bubu->registerDoc(1, "テスト");
+  bubu->registerDoc(2, "ストア");
+  bubu->registerDoc(1, "テニス");
+
+  // the old postings of the docId are gone, not left behind the new ones
+  EXPECT_STREQ("テニス", bubu->getDocContent(1).c_str());
+  EXPECT_TRUE(bubu->search("スト").size() == 1);
+  EXPECT_EQ(2, bubu->search("スト").front().first);
+  uint32_t valueLength;
+  uint32_t* value = bubu->getPostings("テ", &valueLength);
+  ASSERT_EQ(2, valueLength);
+  EXPECT_EQ(1, *value);
+  EXPECT_EQ(0, *(value + 1));
+  delete[] value;
+
+  std::istringstream input("ストーブ");
+  bubu->registerDoc(1, input);
+  EXPECT_STREQ("ストーブ", bubu->getDocContent(1).c_str());
+  EXPECT_TRUE(bubu->search("テ").empty());
+  value = bubu->getPostings("ス", &valueLength);
+  ASSERT_EQ(4, valueLength);
+  EXPECT_EQ(1, *value);
+  EXPECT_EQ(0, *(value + 1));
+  EXPECT_EQ(2, *(value + 2));
+  EXPECT_EQ(0, *(value + 3));
+  delete[] value;
+
+  bb::RankStatistics statistics;
+  bubu->getRankStatistics(NULL, bb::EpochManager::LATEST_EPOCH, statistics);
+  EXPECT_EQ(2, statistics.docCount);
+  EXPECT_EQ(7, statistics.totalLength);
+
+  // a catalog entry left without its content does not send registerDoc
+  // and updateDoc round in circles
+  bubu->docStore->remove(2);
+  bubu->registerDoc(2, "ノート");
+  EXPECT_STREQ("ノート", bubu->getDocContent(2).c_str());
+  EXPECT_EQ(2, bubu->search("ノー").front().first);
+
+  delete bubu;
+}
+
 TEST_F(BubuTest, GetDocContentTest) {
   bb::TestableBubu* bubu = new bb::TestableBubu();  
   bubu->create(".");
@@ -284,6 +738,66 @@ TEST_F(BubuTest, GetDocContentTest) {
   delete bubu;
 }
 
+TEST_F(BubuTest, GetSnippetTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  // long enough, and mixed enough, for characters to straddle chunks
+  std::string doc;
+  for (uint32_t i = 0; i < 500; ++i) doc += (i % 2) ? "あいう" : "abc";
+  doc += "明日は雨";
+  for (uint32_t i = 0; i < 100; ++i) doc += "えお";
+  bubu->registerDoc(1, doc.c_str());
+
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("明日は雨");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(1500, hits[0].second);
+  EXPECT_STREQ("bcあいう明日は雨え", bubu->getSnippet(1, hits[0].second, 10).c_str());
+
+  EXPECT_STREQ("abcあいうab", bubu->getSnippet(1, 1, 8).c_str());
+  EXPECT_STREQ("えおえおえお", bubu->getSnippet(1, 1702, 8).c_str());
+  EXPECT_STREQ("", bubu->getSnippet(1, 2000, 8).c_str());
+  EXPECT_STREQ("", bubu->getSnippet(2, 0, 8).c_str());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, GetByteOffsetTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  // two bytes per character in the first half, three in the second
+  std::string doc;
+  for (uint32_t i = 0; i < 100; ++i) doc += "é";
+  for (uint32_t i = 0; i < 100; ++i) doc += "あ";
+  bubu->registerDoc(1, doc.c_str());
+
+  uint32_t catalogLength;
+  uint32_t* catalogValue = bubu->catalog->get("1", &catalogLength);
+  ASSERT_EQ(4, catalogLength);
+  EXPECT_EQ(200, *catalogValue);
+  EXPECT_EQ(128, *(catalogValue + 1));
+  EXPECT_EQ(200 + 28 * 3, *(catalogValue + 2));
+  EXPECT_EQ(200 + 92 * 3, *(catalogValue + 3));
+  delete[] catalogValue;
+
+  uint32_t byteOffset;
+  EXPECT_TRUE(bubu->getByteOffset(1, 0, &byteOffset));
+  EXPECT_EQ(0, byteOffset);
+  EXPECT_TRUE(bubu->getByteOffset(1, 70, &byteOffset));
+  EXPECT_EQ(140, byteOffset);
+  EXPECT_TRUE(bubu->getByteOffset(1, 150, &byteOffset));
+  EXPECT_EQ(350, byteOffset);
+  EXPECT_TRUE(bubu->getByteOffset(1, 199, &byteOffset));
+  EXPECT_EQ(497, byteOffset);
+  EXPECT_FALSE(bubu->getByteOffset(1, 200, &byteOffset));
+  EXPECT_FALSE(bubu->getByteOffset(2, 0, &byteOffset));
+
+  EXPECT_STREQ("éééあああ", bubu->getSnippet(1, 100, 6).c_str());
+
+  delete bubu;
+}
+
 TEST_F(BubuTest, SearchTest) {
   bb::TestableBubu* bubu = new bb::TestableBubu();  
   bubu->create(".");
@@ -307,3 +821,549 @@ TEST_F(BubuTest, SearchTest) {
 
   delete bubu;
 }
+
+TEST_F(BubuTest, SearchTopKTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  bubu->registerDoc(1, "東京の天気は晴れ");
+  bubu->registerDoc(2, "東京タワーと東京駅と東京ドーム");
+  bubu->registerDoc(3, "大阪の天気は雨だ");
+  bubu->registerDoc(4, "東京と東京");
+  bubu->registerDoc(5, "京都の天気");
+
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("東京", 10);
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ(4, results.at(0).first);
+  EXPECT_EQ(2, results.at(1).first);
+  EXPECT_EQ(1, results.at(2).first);
+  EXPECT_GT(results.at(0).second, results.at(1).second);
+  EXPECT_GT(results.at(1).second, results.at(2).second);
+
+  results = bubu->searchTopK("東京", 2);
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(4, results.at(0).first);
+  EXPECT_EQ(2, results.at(1).first);
+
+  results = bubu->searchTopK("の天気は", 10);
+  ASSERT_EQ(2, results.size());
+  EXPECT_DOUBLE_EQ(results.at(0).second, results.at(1).second);
+
+  EXPECT_EQ(0, bubu->searchTopK("京都タワー", 10).size());
+  EXPECT_EQ(0, bubu->searchTopK("東京", 0).size());
+
+  bubu->unregisterDoc(2);
+  results = bubu->searchTopK("東京", 10);
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(4, results.at(0).first);
+  EXPECT_EQ(1, results.at(1).first);
+
+  uint32_t statisticsLength;
+  uint32_t* statistics = bubu->catalog->get("$statistics", &statisticsLength);
+  ASSERT_EQ(4, statisticsLength);
+  EXPECT_EQ(4, *statistics);
+  EXPECT_EQ(26, *(statistics + 1));
+  delete[] statistics;
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, SearchTopKSkipTest) {
+  bb::Bubu* bubu = new bb::Bubu();
+  bubu->create(".");
+
+  // the rare gram leads and the common ones skip across whole blocks to it
+  for (uint32_t docId = 1; docId <= 1000; ++docId) {
+    if (docId % 97 == 0) bubu->registerDoc(docId, docId % 2 ? "今日は晴れ、明日は雨" : "今日は晴れ、明日は雨、明日は雨");
+    else bubu->registerDoc(docId, "今日は晴れ");
+  }
+
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("晴れ、明日", 100);
+  ASSERT_EQ(10, results.size());
+  for (uint32_t i = 0; i < results.size(); ++i) EXPECT_EQ(0, results.at(i).first % 97);
+
+  // the documents holding the phrase twice rank above those holding it once
+  results = bubu->searchTopK("明日は雨", 5);
+  ASSERT_EQ(5, results.size());
+  for (uint32_t i = 0; i < results.size(); ++i) EXPECT_EQ(0, results.at(i).first % 194);
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, SearchTopKBlockMaxTest) {
+  bb::Bubu* bubu = new bb::Bubu();
+  bubu->create(".");
+
+  // a few documents hold the gram far more often than the rest, so once
+  // they are found the blocks without them are passed over
+  for (uint32_t docId = 1; docId <= 2000; ++docId) {
+    if (docId == 100 || docId == 1500 || docId == 1900) bubu->registerDoc(docId, "晴れ晴れ晴れ晴れ晴れ");
+    else if (docId % 3 == 0) bubu->registerDoc(docId, "晴れ晴れ");
+    else bubu->registerDoc(docId, "晴れ");
+  }
+
+  std::vector<std::pair<uint32_t, double> > all = bubu->searchTopK("晴れ", 2000);
+  ASSERT_EQ(2000, all.size());
+  for (uint32_t k = 1; k <= 4; ++k) {
+    std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("晴れ", k);
+    ASSERT_EQ(k, results.size());
+    for (uint32_t i = 0; i < k; ++i) EXPECT_DOUBLE_EQ(all.at(i).second, results.at(i).second);
+  }
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("晴れ", 3);
+  std::vector<uint32_t> docIds;
+  for (uint32_t i = 0; i < results.size(); ++i) docIds.push_back(results.at(i).first);
+  std::sort(docIds.begin(), docIds.end());
+  EXPECT_EQ(100, docIds.at(0));
+  EXPECT_EQ(1500, docIds.at(1));
+  EXPECT_EQ(1900, docIds.at(2));
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, SearchBatchTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  bubu->registerDoc(1, "本日は、快晴なり。");
+  bubu->registerDoc(2, "明後日は、仕事。今度の休日は、お出かけ");
+  bubu->registerDoc(3, "東京タワーは、結構高い");
+
+  std::vector<std::string> queries;
+  queries.push_back("日は、");
+  queries.push_back("は、");
+  queries.push_back("検索エンジン");
+  queries.push_back("");
+  queries.push_back("日は、");
+
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > hits = bubu->searchBatch(queries);
+  ASSERT_EQ(5, hits.size());
+  for (uint32_t i = 0; i < queries.size(); ++i) {
+    std::vector<std::pair<uint32_t, uint32_t> > expected = bubu->search(queries[i].c_str());
+    EXPECT_TRUE(expected == hits[i]);
+  }
+  EXPECT_EQ(3, hits[0].size());
+  EXPECT_EQ(4, hits[1].size());
+  EXPECT_EQ(0, hits[2].size());
+  EXPECT_EQ(0, hits[3].size());
+
+  EXPECT_EQ(0, bubu->searchBatch(std::vector<std::string>()).size());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, SearchPartitionedTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  for (uint32_t docId = 1; docId <= 60; ++docId) {
+    bubu->registerDoc(docId, (docId % 3) ? "今日は晴れ、明日は雨" : "今日は雨");
+  }
+
+  const char* grams[] = { "今日", "は雨" };
+  std::vector<bb::PostingLocation> locations;
+  for (uint32_t i = 0; i < 2; ++i) {
+    bb::PostingLocation location;
+    ASSERT_TRUE(bb::PostingList::locate(bubu->index, bubu->positions, grams[i], &location));
+    locations.push_back(location);
+  }
+
+  std::vector<uint32_t> offsets;
+  offsets.push_back(0);
+  offsets.push_back(2);
+  bb::Bitmap filter;
+  std::vector<bool> filtered;
+  std::vector<std::pair<uint32_t, uint32_t> > expected = bubu->searchPartitioned(locations, offsets, filter, filtered, 1);
+  ASSERT_EQ(20, expected.size());
+  EXPECT_EQ(3, expected.front().first);
+  EXPECT_EQ(60, expected.back().first);
+
+  for (uint32_t partitionCount = 2; partitionCount <= 9; ++partitionCount) {
+    std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->searchPartitioned(locations, offsets, filter, filtered,
+									      partitionCount);
+    EXPECT_TRUE(expected == hits);
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t> > phraseHits = bubu->search("明日は雨");
+  ASSERT_EQ(40, phraseHits.size());
+  EXPECT_EQ(1, phraseHits.front().first);
+  EXPECT_EQ(6, phraseHits.front().second);
+  EXPECT_EQ(59, phraseHits.back().first);
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, PostingBlockTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  for (uint32_t docId = 1; docId <= 200; ++docId) {
+    bubu->registerDoc(docId, "あいあいあ");
+  }
+
+  // the doc stream holds one (docId, tf) entry per document and each block
+  // header points at the offsets of its first document
+  uint32_t valueLength;
+  uint32_t* value = bubu->index->get("あ", &valueLength);
+  ASSERT_EQ(200, bb::PostingList::countDocs(valueLength));
+  ASSERT_EQ(2, bb::PostingList::countBlocks(valueLength));
+  EXPECT_EQ(1, *value);
+  EXPECT_EQ(128, *(value + 1));
+  EXPECT_EQ(128, *(value + 2));
+  EXPECT_EQ(0, *(value + 3));
+  EXPECT_EQ(1, *(value + bb::PostingList::HEADER_LENGTH));
+  EXPECT_EQ(3, *(value + bb::PostingList::HEADER_LENGTH + 1));
+  EXPECT_EQ(129, *(value + bb::PostingList::BLOCK_STRIDE));
+  EXPECT_EQ(200, *(value + bb::PostingList::BLOCK_STRIDE + 1));
+  EXPECT_EQ(72, *(value + bb::PostingList::BLOCK_STRIDE + 2));
+  EXPECT_EQ(384, *(value + bb::PostingList::BLOCK_STRIDE + 3));
+  delete[] value;
+
+  value = bubu->positions->get("あ", &valueLength);
+  ASSERT_EQ(600, valueLength);
+  EXPECT_EQ(0, *value);
+  EXPECT_EQ(2, *(value + 1));
+  EXPECT_EQ(4, *(value + 2));
+  delete[] value;
+
+  bubu->unregisterDoc(50);
+  value = bubu->getPostings("あ", &valueLength);
+  ASSERT_EQ(1194, valueLength);
+  EXPECT_EQ(51, *(value + 49 * 6));
+  delete[] value;
+
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("あいあ");
+  ASSERT_EQ(398, hits.size());
+  EXPECT_EQ(49, hits.at(97).first);
+  EXPECT_EQ(2, hits.at(97).second);
+  EXPECT_EQ(51, hits.at(98).first);
+  EXPECT_EQ(200, hits.back().first);
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, DenseGramTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();  
+  bubu->create(".");
+
+  for (uint32_t docId = 1; docId <= 1200; ++docId) {
+    if (docId % 100 == 0) bubu->registerDoc(docId, "明日は晴れ");
+    else if (docId % 2 == 0) bubu->registerDoc(docId, "今日は晴れ");
+    else bubu->registerDoc(docId, "今日は雨");
+  }
+
+  EXPECT_TRUE(bubu->index->contains("$bitmap:今日"));
+  EXPECT_TRUE(bubu->index->contains("$bitmap:日は"));
+  EXPECT_FALSE(bubu->index->contains("$bitmap:晴れ"));
+  EXPECT_FALSE(bubu->index->contains("$bitmap:明日"));
+
+  // every gram dense
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("今日は", 2000);
+  EXPECT_EQ(1188, results.size());
+
+  // a sparse gram filtered through a dense one
+  results = bubu->searchTopK("日は晴れ", 2000);
+  EXPECT_EQ(600, results.size());
+  results = bubu->searchTopK("明日は晴れ", 2000);
+  ASSERT_EQ(12, results.size());
+  for (uint32_t i = 0; i < results.size(); ++i) EXPECT_EQ(0, results.at(i).first % 100);
+
+  bubu->unregisterDoc(2);
+  bubu->unregisterDoc(100);
+  EXPECT_EQ(1187, bubu->searchTopK("今日は", 2000).size());
+  EXPECT_EQ(598, bubu->searchTopK("日は晴れ", 2000).size());
+
+  bubu->registerDoc(1201, "今日は晴れ");
+  EXPECT_EQ(1188, bubu->searchTopK("今日は", 2000).size());
+  EXPECT_EQ(599, bubu->searchTopK("日は晴れ", 2000).size());
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, DenseSearchTest) {
+  bb::Bubu* bubu = new bb::Bubu();
+  bubu->create(".");
+
+  for (uint32_t docId = 1; docId <= 1200; ++docId) {
+    if (docId % 100 == 0) bubu->registerDoc(docId, "明日は晴れ");
+    else if (docId % 2 == 0) bubu->registerDoc(docId, "今日は晴れ");
+    else bubu->registerDoc(docId, "今日は雨");
+  }
+  bubu->unregisterDoc(2);
+
+  // the dense grams only filter the documents and are confirmed in their
+  // doc streams, so a document dropped from them is never a hit
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("今日は晴れ");
+  ASSERT_EQ(587, hits.size());
+  EXPECT_EQ(4, hits.front().first);
+  EXPECT_EQ(0, hits.front().second);
+  EXPECT_EQ(1198, hits.back().first);
+
+  hits = bubu->search("明日は晴れ");
+  ASSERT_EQ(12, hits.size());
+  for (uint32_t i = 0; i < hits.size(); ++i) EXPECT_EQ(0, hits.at(i).first % 100);
+
+  std::vector<std::string> queries;
+  queries.push_back("日は雨");
+  queries.push_back("明日は");
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > batchHits = bubu->searchBatch(queries);
+  EXPECT_EQ(600, batchHits.at(0).size());
+  EXPECT_EQ(12, batchHits.at(1).size());
+
+  bb::SearchCursor* cursor = bubu->openCursor("日は晴れ");
+  ASSERT_TRUE(cursor->skipTo(1));
+  EXPECT_EQ(4, cursor->docId());
+  EXPECT_EQ(1, cursor->offset());
+  ASSERT_TRUE(cursor->skipTo(1101));
+  EXPECT_EQ(1102, cursor->docId());
+  delete cursor;
+
+  std::vector<uint32_t> docIds = bubu->searchQuery("今日 NOT 晴れ");
+  ASSERT_EQ(600, docIds.size());
+  EXPECT_EQ(1, docIds.front());
+  EXPECT_EQ(1199, docIds.back());
+
+  delete bubu;
+}
+
+namespace {
+
+void* registerDocs(void* argument)
+{
+  bb::Bubu* bubu = static_cast<bb::Bubu*>(argument);
+  for (uint32_t docId = 1; docId <= 1200; ++docId) {
+    bubu->registerDoc(docId, (docId % 2 == 0) ? "今日は晴れ" : "今日は雨");
+  }
+  return NULL;
+}
+
+void* ingestDocs(void* argument)
+{
+  bb::Bubu* bubu = static_cast<bb::Bubu*>(argument);
+  for (uint32_t docId = 2; docId <= 600; ++docId) {
+    bubu->registerDoc(docId, (docId % 2 == 0) ? "今日は晴れ" : "今日は雨");
+    if (docId % 10 == 0) bubu->updateDoc(docId - 5, "明日は雪");
+    if (docId % 50 == 0) bubu->unregisterDoc(docId - 20);
+  }
+  return NULL;
+}
+
+}
+
+TEST_F(BubuTest, SnapshotTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();
+  ASSERT_TRUE(bubu->create("."));
+  bubu->registerDoc(1, "abcab");
+  bubu->registerDoc(2, "xyz");
+
+  uint64_t epoch = bubu->pinEpoch();
+  bubu->registerDoc(3, "abc");
+  bubu->unregisterDoc(1);
+
+  // the pinned epoch still sees the workspace as it was
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("ab", epoch);
+  ASSERT_EQ(2, hits.size());
+  EXPECT_EQ(1, hits.at(0).first);
+  EXPECT_EQ(1, hits.at(1).first);
+  EXPECT_EQ(1, bubu->search("xy", epoch).size());
+  EXPECT_EQ(2, bubu->searchTopK("ab", 10, epoch).size() + bubu->searchTopK("xyz", 10, epoch).size());
+  std::vector<std::string> queries;
+  queries.push_back("ab");
+  queries.push_back("xy");
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > batch = bubu->searchBatch(queries, epoch);
+  EXPECT_EQ(2, batch.at(0).size());
+  EXPECT_EQ(1, batch.at(1).size());
+
+  hits = bubu->search("ab");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(3, hits.at(0).first);
+  hits = bubu->search("xy");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(2, hits.at(0).first);
+  bubu->unpinEpoch(epoch);
+  EXPECT_EQ(1, bubu->search("ab").size());
+
+  delete bubu;
+
+  // searches running next to the writer see whole documents, in order
+  bubu = new bb::TestableBubu();
+  ASSERT_TRUE(bubu->create("."));
+  pthread_t writer;
+  ASSERT_EQ(0, pthread_create(&writer, NULL, registerDocs, bubu));
+  uint32_t lastCount = 0;
+  while (lastCount < 1200) {
+    uint64_t epoch = bubu->pinEpoch();
+    std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("今日は", epoch);
+    std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("今日", 2000, epoch);
+    bubu->unpinEpoch(epoch);
+
+    ASSERT_GE(hits.size(), lastCount);
+    for (uint32_t i = 0; i < hits.size(); ++i) ASSERT_EQ(i + 1, hits.at(i).first);
+    ASSERT_EQ(hits.size(), results.size());
+    lastCount = hits.size();
+  }
+  pthread_join(writer, NULL);
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, ConcurrentReadTest) {
+  std::ostringstream content;
+  for (uint32_t i = 0; i < 40; ++i) content << "晴れ時々曇り" << i << "。";
+  std::string text = content.str();
+
+  // every other read runs next to the writer as well, and always sees the
+  // document registered before it started as it is
+  bb::Bubu* bubu = new bb::Bubu();
+  ASSERT_TRUE(bubu->create("."));
+  bubu->registerDoc(1, text.c_str());
+  std::string snippet = bubu->getSnippet(1, 200, 10);
+  uint32_t byteOffset;
+  ASSERT_TRUE(bubu->getByteOffset(1, 200, &byteOffset));
+
+  pthread_t writer;
+  ASSERT_EQ(0, pthread_create(&writer, NULL, ingestDocs, bubu));
+  for (uint32_t round = 0; round < 300; ++round) {
+    ASSERT_EQ(text, bubu->getDocContent(1));
+    ASSERT_EQ(snippet, bubu->getSnippet(1, 200, 10));
+    uint32_t currentOffset;
+    ASSERT_TRUE(bubu->getByteOffset(1, 200, &currentOffset));
+    ASSERT_EQ(byteOffset, currentOffset);
+
+    std::vector<std::string> grams = bubu->searchPrefix("晴", 10);
+    ASSERT_FALSE(grams.empty());
+    std::vector<uint32_t> docIds = bubu->searchQuery("晴れ NOT 曇り");
+    for (uint32_t i = 0; i < docIds.size(); ++i) {
+      ASSERT_EQ(0, docIds.at(i) % 2);
+      if (i > 0) ASSERT_LT(docIds.at(i - 1), docIds.at(i));
+    }
+
+    bb::SearchCursor* cursor = bubu->openCursor("時々曇り");
+    ASSERT_TRUE(cursor->next());
+    EXPECT_EQ(1, cursor->docId());
+    delete cursor;
+  }
+  pthread_join(writer, NULL);
+
+  EXPECT_EQ("明日は雪", bubu->getDocContent(595));
+  EXPECT_TRUE(bubu->getDocContent(580).empty());
+  delete bubu;
+}
+
+TEST_F(BubuTest, UpdateDocTest) {
+  bb::TestableBubu* bubu = new bb::TestableBubu();
+  ASSERT_TRUE(bubu->create("."));
+  bubu->registerDoc(1, "abcdefg");
+  bubu->registerDoc(2, "xyzab");
+
+  // grams which keep their offsets are not rewritten
+  uint64_t abOffset;
+  uint32_t abLength;
+  ASSERT_TRUE(bubu->index->locate("ab", &abOffset, &abLength));
+  uint64_t fgOffset;
+  uint32_t fgLength;
+  ASSERT_TRUE(bubu->index->locate("fg", &fgOffset, &fgLength));
+  bubu->updateDoc(1, "abcxefg");
+  uint64_t offset;
+  uint32_t length;
+  ASSERT_TRUE(bubu->index->locate("ab", &offset, &length));
+  EXPECT_EQ(abOffset, offset);
+  ASSERT_TRUE(bubu->index->locate("fg", &offset, &length));
+  EXPECT_EQ(fgOffset, offset);
+
+  EXPECT_EQ("abcxefg", bubu->getDocContent(1));
+  EXPECT_EQ(0, bubu->search("cd").size());
+  EXPECT_EQ(0, bubu->search("de").size());
+  EXPECT_FALSE(bubu->index->contains("cd"));
+  std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search("cxe");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(1, hits.at(0).first);
+  EXPECT_EQ(2, hits.at(0).second);
+  EXPECT_EQ(2, bubu->search("ab").size());
+  EXPECT_EQ(2, bubu->searchTopK("ab", 10).size());
+
+  // a shift moves every later gram but leaves the other documents alone
+  bubu->updateDoc(1, "zabcxefg");
+  hits = bubu->search("ab");
+  ASSERT_EQ(2, hits.size());
+  EXPECT_EQ(1, hits.at(0).first);
+  EXPECT_EQ(1, hits.at(0).second);
+  EXPECT_EQ(2, hits.at(1).first);
+  EXPECT_EQ(3, hits.at(1).second);
+  EXPECT_EQ(1, bubu->search("zabc").size());
+
+  // a missing document is registered and an empty one unregistered
+  bubu->updateDoc(3, "xyz");
+  EXPECT_EQ(2, bubu->search("xyz").size());
+  bubu->updateDoc(2, "");
+  EXPECT_EQ("", bubu->getDocContent(2));
+  hits = bubu->search("xyz");
+  ASSERT_EQ(1, hits.size());
+  EXPECT_EQ(3, hits.at(0).first);
+
+  delete bubu;
+}
+
+TEST_F(BubuTest, StreamTest) {
+  // long enough to be read in several chunks, which cut characters apart
+  std::ostringstream content;
+  content << "123456789";
+  for (uint32_t i = 0; content.tellp() < 600000; ++i) content << "今日は晴れ。line " << i << "\n";
+  std::string text = content.str();
+
+  for (uint32_t gramSize = 2; gramSize <= 3; ++gramSize) {
+    bb::TestableBubu* bubu = new bb::TestableBubu();
+    ASSERT_TRUE(bubu->create(".", gramSize, gramSize == 2));
+    bubu->registerDoc(1, text.c_str());
+    std::istringstream input(text);
+    bubu->registerDoc(2, input);
+
+    // both documents are indexed the same way
+    EXPECT_EQ(text, bubu->getDocContent(2));
+    const char* queries[] = { "今日は", "晴れ。l", "\n今", "9\n", "ne 1234", "9" };
+    for (uint32_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+      std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search(queries[q]);
+      std::vector<uint32_t> first;
+      std::vector<uint32_t> second;
+      for (uint32_t i = 0; i < hits.size(); ++i) (hits[i].first == 1 ? first : second).push_back(hits[i].second);
+      EXPECT_FALSE(first.empty()) << queries[q];
+      EXPECT_EQ(first, second) << queries[q];
+    }
+
+    uint32_t firstLength;
+    uint32_t* firstCatalog = bubu->catalog->get("1", &firstLength);
+    uint32_t secondLength;
+    uint32_t* secondCatalog = bubu->catalog->get("2", &secondLength);
+    ASSERT_EQ(firstLength, secondLength);
+    EXPECT_TRUE(std::equal(firstCatalog, firstCatalog + firstLength, secondCatalog));
+    delete[] firstCatalog;
+    delete[] secondCatalog;
+    EXPECT_EQ(bubu->getSnippet(1, 100000, 20), bubu->getSnippet(2, 100000, 20));
+
+    std::istringstream empty("");
+    bubu->registerDoc(3, empty);
+    EXPECT_EQ("", bubu->getDocContent(3));
+
+    // registered again, the long document has its old postings removed as
+    // it was read, chunk by chunk
+    std::ostringstream otherContent;
+    for (uint32_t i = 0; otherContent.tellp() < 600000; ++i) otherContent << "明日は雪。line " << i << "\n";
+    std::istringstream other(otherContent.str());
+    bubu->registerDoc(2, other);
+    EXPECT_EQ(otherContent.str(), bubu->getDocContent(2));
+    const char* oldQueries[] = { "今日は", "晴れ。l", "123456789" };
+    for (uint32_t q = 0; q < sizeof(oldQueries) / sizeof(oldQueries[0]); ++q) {
+      std::vector<std::pair<uint32_t, uint32_t> > hits = bubu->search(oldQueries[q]);
+      ASSERT_FALSE(hits.empty()) << oldQueries[q];
+      EXPECT_EQ(1, hits.back().first) << oldQueries[q];
+    }
+    EXPECT_EQ(2, bubu->search("雪。l").front().first);
+    delete bubu;
+
+    remove("bubu.idx");
+    remove("bubu.pos");
+    remove("bubu.lib");
+    remove("bubu.cat");
+    remove("bubu.dic");
+    remove("bubu.gen");
+  }
+}
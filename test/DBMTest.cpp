@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
 #include "bb/DBM.hpp"
 
 namespace bb {
@@ -11,9 +13,15 @@ public:
   using DBM<uint32_t>::bucketLength;
   using DBM<uint32_t>::freePool;
   using DBM<uint32_t>::freePoolLength;
+  using DBM<uint32_t>::freePoolLoaded;
+  using DBM<uint32_t>::freePoolDirty;
+  using DBM<uint32_t>::mapping;
+  using DBM<uint32_t>::versions;
+  using DBM<uint32_t>::retired;
 
   using DBM<uint32_t>::loadMetaData;
   using DBM<uint32_t>::saveMetaData;
+  using DBM<uint32_t>::loadFreePool;
   using DBM<uint32_t>::calcBucketIndex;
   using DBM<uint32_t>::calcValueCapacity;
   using DBM<uint32_t>::calcRecordSize;
@@ -29,6 +37,8 @@ class DBMTest : public ::testing::Test
 {
 public:
   static const char* emptyDBMPath;
+  static const uint32_t magic;
+  static const uint32_t version;
   static const uint32_t bucketLength;
   static const uint32_t freePoolLength;
 
@@ -36,18 +46,17 @@ protected:
   virtual void SetUp() {
     FILE* fp = fopen(DBMTest::emptyDBMPath, "wb+");
 
-    fwrite(&(DBMTest::bucketLength), sizeof(uint32_t), 1, fp);
+    uint32_t header[] = { DBMTest::magic, DBMTest::version, DBMTest::bucketLength, DBMTest::freePoolLength };
+    fwrite(header, sizeof(uint32_t), 4, fp);
 
-    uint32_t* tempBucket = new uint32_t[DBMTest::bucketLength];
+    uint64_t* tempBucket = new uint64_t[DBMTest::bucketLength];
     std::fill(tempBucket, tempBucket + DBMTest::bucketLength, 0);
-    fwrite(tempBucket, sizeof(uint32_t), DBMTest::bucketLength, fp);
+    fwrite(tempBucket, sizeof(uint64_t), DBMTest::bucketLength, fp);
     delete[] tempBucket;
 
-    fwrite(&(DBMTest::freePoolLength), sizeof(uint32_t), 1, fp);
-
-    uint32_t* tempFreePool = new uint32_t[DBMTest::freePoolLength * 2];
+    uint64_t* tempFreePool = new uint64_t[DBMTest::freePoolLength * 2];
     std::fill(tempFreePool, tempFreePool + DBMTest::freePoolLength * 2, 0);
-    fwrite(tempFreePool, sizeof(uint32_t), DBMTest::freePoolLength * 2, fp);
+    fwrite(tempFreePool, sizeof(uint64_t), DBMTest::freePoolLength * 2, fp);
     delete[] tempFreePool;
     
     fclose(fp);
@@ -59,6 +68,8 @@ protected:
 };
 
 const char* DBMTest::emptyDBMPath = "test.dat";
+const uint32_t DBMTest::magic = 0x4d444242;
+const uint32_t DBMTest::version = 2;
 const uint32_t DBMTest::bucketLength = 1000;
 const uint32_t DBMTest::freePoolLength = 1000;
 
@@ -82,9 +93,10 @@ TEST_F(DBMTest, SaveMetaDataTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM();
 
   dbm->bucketLength = DBMTest::bucketLength * 2;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
-  std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
+  dbm->bucket = new uint64_t[dbm->bucketLength];
+  std::fill(dbm->bucket, dbm->bucket + dbm->bucketLength, 0);
   dbm->freePoolLength = 2000;
+  dbm->freePool->push_back(std::pair<uint64_t, uint64_t>(5000000000ULL, 4096));
 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->saveMetaData();
@@ -95,17 +107,20 @@ TEST_F(DBMTest, SaveMetaDataTest) {
 
   FILE* fp = fopen(DBMTest::emptyDBMPath, "rb+");
 
-  uint32_t bucketLength;
-  EXPECT_EQ(fread(&bucketLength, sizeof(uint32_t), 1, fp), 1);
-  ASSERT_EQ(bucketLength, DBMTest::bucketLength * 2);
-  uint32_t bucket[bucketLength];
-  EXPECT_EQ(fread(bucket, sizeof(uint32_t), bucketLength, fp), bucketLength);
-
-  uint32_t freePoolLength;
-  EXPECT_EQ(fread(&freePoolLength, sizeof(uint32_t), 1, fp), 1);
-  ASSERT_EQ(freePoolLength, DBMTest::freePoolLength * 2);
-  uint32_t freePool[freePoolLength * 2];
-  EXPECT_EQ(fread(freePool, sizeof(uint32_t), freePoolLength * 2, fp), freePoolLength * 2);
+  uint32_t header[4];
+  EXPECT_EQ(fread(header, sizeof(uint32_t), 4, fp), 4);
+  EXPECT_EQ(DBMTest::magic, header[0]);
+  EXPECT_EQ(DBMTest::version, header[1]);
+  ASSERT_EQ(header[2], DBMTest::bucketLength * 2);
+  ASSERT_EQ(header[3], DBMTest::freePoolLength * 2);
+  std::vector<uint64_t> bucket(header[2]);
+  EXPECT_EQ(fread(&bucket[0], sizeof(uint64_t), header[2], fp), header[2]);
+
+  std::vector<uint64_t> freePool(header[3] * 2);
+  EXPECT_EQ(fread(&freePool[0], sizeof(uint64_t), header[3] * 2, fp), header[3] * 2);
+  EXPECT_EQ(5000000000ULL, freePool[0]);
+  EXPECT_EQ(4096, freePool[1]);
+  EXPECT_EQ(0, freePool[2]);
   
   fclose(fp);
 }
@@ -128,14 +143,14 @@ TEST_F(DBMTest, CalcValueCapacityTest) {
 }
 
 TEST_F(DBMTest, CalcRecordSizeTest) {
-  EXPECT_EQ(4020, bb::TestableDBM::calcRecordSize("hoge", 1000));
-  EXPECT_EQ(4024, bb::TestableDBM::calcRecordSize("fugafuga", 1000));
+  EXPECT_EQ(4032, bb::TestableDBM::calcRecordSize("hoge", 1000));
+  EXPECT_EQ(4036, bb::TestableDBM::calcRecordSize("fugafuga", 1000));
 }
 
 TEST_F(DBMTest, GetFreeAreaTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM();
-  dbm->freePool->push_back(std::pair<uint32_t, uint32_t>(100, 1000));
-  dbm->freePool->push_back(std::pair<uint32_t, uint32_t>(50, 2000));
+  dbm->freePool->push_back(std::pair<uint64_t, uint64_t>(100, 1000));
+  dbm->freePool->push_back(std::pair<uint64_t, uint64_t>(50, 2000));
 
   EXPECT_EQ(0, dbm->getFreeArea(2001));
   EXPECT_EQ(50, dbm->getFreeArea(2000));
@@ -176,14 +191,14 @@ TEST_F(DBMTest, AllocNewRecordTest) {
 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
   uint32_t testData[] = {1, 2, 3, 4};
   dbm->allocNewRecord(0, 0, "hoge", testData, 4);
 
-  uint32_t offset;
+  uint64_t offset = 0;
   for (uint32_t i = 0; i < dbm->bucketLength; ++i) {
     if (*(dbm->bucket + i) != 0) {
       offset = *(dbm->bucket + i);
@@ -192,8 +207,8 @@ TEST_F(DBMTest, AllocNewRecordTest) {
   }
   fseek(dbm->fp, offset, SEEK_SET);
 
-  uint32_t nextOffset;
-  EXPECT_EQ(fread(&nextOffset, sizeof(uint32_t), 1, dbm->fp), 1);
+  uint64_t nextOffset;
+  EXPECT_EQ(fread(&nextOffset, sizeof(uint64_t), 1, dbm->fp), 1);
   EXPECT_EQ(0, nextOffset);
 
   uint32_t keyLength;
@@ -204,11 +219,11 @@ TEST_F(DBMTest, AllocNewRecordTest) {
   ASSERT_EQ(fread(key, sizeof(char), keyLength, dbm->fp), keyLength);
   EXPECT_STREQ("hoge", key);
 
-  uint32_t valueCapacity;
-  uint32_t valueLength;
-  EXPECT_EQ(fread(&valueCapacity, sizeof(uint32_t), 1, dbm->fp), 1);
+  uint64_t valueCapacity;
+  uint64_t valueLength;
+  EXPECT_EQ(fread(&valueCapacity, sizeof(uint64_t), 1, dbm->fp), 1);
   ASSERT_EQ(valueCapacity, 1024);
-  EXPECT_EQ(fread(&valueLength, sizeof(uint32_t), 1, dbm->fp), 1);
+  EXPECT_EQ(fread(&valueLength, sizeof(uint64_t), 1, dbm->fp), 1);
   EXPECT_EQ(valueLength, 4);
   uint32_t value[valueCapacity];
   ASSERT_EQ(fread(value, sizeof(uint32_t), valueCapacity, dbm->fp), valueCapacity);
@@ -223,14 +238,14 @@ TEST_F(DBMTest, AllocNewRecordTest) {
   dbm->allocNewRecord(offset, 100, "fugafuga", testData2, 3);
   fseek(dbm->fp, offset, SEEK_SET);
 
-  uint32_t offset2;
-  ASSERT_EQ(fread(&offset2, sizeof(uint32_t), 1, dbm->fp), 1);
+  uint64_t offset2;
+  ASSERT_EQ(fread(&offset2, sizeof(uint64_t), 1, dbm->fp), 1);
   ASSERT_NE(0, offset2);
 
   fseek(dbm->fp, offset2, SEEK_SET);
 
-  uint32_t nextOffset2;
-  EXPECT_EQ(fread(&nextOffset2, sizeof(uint32_t), 1, dbm->fp), 1);
+  uint64_t nextOffset2;
+  EXPECT_EQ(fread(&nextOffset2, sizeof(uint64_t), 1, dbm->fp), 1);
   EXPECT_EQ(100, nextOffset2);
 
   uint32_t keyLength2;
@@ -241,11 +256,11 @@ TEST_F(DBMTest, AllocNewRecordTest) {
   ASSERT_EQ(fread(key2, sizeof(char), keyLength2, dbm->fp), keyLength2);
   EXPECT_STREQ("fugafuga", key2);
 
-  uint32_t valueCapacity2;
-  uint32_t valueLength2;
-  EXPECT_EQ(fread(&valueCapacity2, sizeof(uint32_t), 1, dbm->fp), 1);
+  uint64_t valueCapacity2;
+  uint64_t valueLength2;
+  EXPECT_EQ(fread(&valueCapacity2, sizeof(uint64_t), 1, dbm->fp), 1);
   ASSERT_EQ(valueCapacity2, 1024);
-  EXPECT_EQ(fread(&valueLength2, sizeof(uint32_t), 1, dbm->fp), 1);
+  EXPECT_EQ(fread(&valueLength2, sizeof(uint64_t), 1, dbm->fp), 1);
   EXPECT_EQ(valueLength2, 3);
   uint32_t value2[valueCapacity2];
   ASSERT_EQ(fread(value2, sizeof(uint32_t), valueCapacity2, dbm->fp), valueCapacity2);
@@ -262,13 +277,13 @@ TEST_F(DBMTest, FindRecordOffsetTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   dbm->findRecordOffset("hoge", &prevOffset, &offset, &nextOffset);
   EXPECT_EQ(offset, 0);
   ASSERT_EQ(prevOffset, 0);  
@@ -276,7 +291,7 @@ TEST_F(DBMTest, FindRecordOffsetTest) {
 
   uint32_t testData[] = {1, 2, 3, 4};
   dbm->allocNewRecord(0, 0, "fuga", testData, 4);
-  uint32_t actualOffset;
+  uint64_t actualOffset;
   for (uint32_t i = 0; i < dbm->bucketLength; ++i) {
     if (*(dbm->bucket + i) != 0) {
       actualOffset = *(dbm->bucket + i);
@@ -332,18 +347,18 @@ TEST_F(DBMTest, CreateTest) {
 
   FILE* fp = fopen("not_exist.dat", "rb+");
 
-  uint32_t bucketLength;
-  EXPECT_EQ(1, fread(&bucketLength, sizeof(uint32_t), 1, fp));
-  ASSERT_EQ(2000, bucketLength);
-  uint32_t bucket[bucketLength];
-  EXPECT_EQ(bucketLength, fread(bucket, sizeof(uint32_t), bucketLength, fp));
-
-  uint32_t freePoolLength;
-  EXPECT_EQ(1, fread(&freePoolLength, sizeof(uint32_t), 1, fp));
-  ASSERT_EQ(1000, freePoolLength);
-  uint32_t freePool[freePoolLength * 2];
-  EXPECT_EQ(2000, fread(freePool, sizeof(uint32_t), freePoolLength * 2, fp));
-  EXPECT_EQ(0, *(freePool + freePoolLength * 2 - 1));
+  uint32_t header[4];
+  EXPECT_EQ(4, fread(header, sizeof(uint32_t), 4, fp));
+  EXPECT_EQ(DBMTest::magic, header[0]);
+  EXPECT_EQ(DBMTest::version, header[1]);
+  ASSERT_EQ(2000, header[2]);
+  ASSERT_EQ(1000, header[3]);
+  std::vector<uint64_t> bucket(header[2]);
+  EXPECT_EQ(header[2], fread(&bucket[0], sizeof(uint64_t), header[2], fp));
+
+  std::vector<uint64_t> freePool(header[3] * 2);
+  EXPECT_EQ(2000, fread(&freePool[0], sizeof(uint64_t), header[3] * 2, fp));
+  EXPECT_EQ(0, freePool.back());
   
   fclose(fp);
 
@@ -354,7 +369,7 @@ TEST_F(DBMTest, GetTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
@@ -381,7 +396,7 @@ TEST_F(DBMTest, SetTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
@@ -425,13 +440,13 @@ TEST_F(DBMTest, RemoveTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
   uint32_t testData[] = {1, 2, 3, 4};
   dbm->allocNewRecord(0, 0, "fuga", testData, 4);
-  uint32_t actualOffset;
+  uint64_t actualOffset;
   uint32_t index;
   for (index = 0; index < dbm->bucketLength; ++index) {
     if (*(dbm->bucket + index) != 0) {
@@ -442,9 +457,9 @@ TEST_F(DBMTest, RemoveTest) {
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, actualOffset);
   dbm->allocNewRecord(actualOffset, 0, "hoge", testData, 4);
 
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   dbm->findRecordOffset("hoge", &prevOffset, &offset ,&nextOffset);
   EXPECT_NE(0, offset);
   EXPECT_EQ(actualOffset, prevOffset);
@@ -481,7 +496,7 @@ TEST_F(DBMTest, AppendTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
   
@@ -510,9 +525,9 @@ TEST_F(DBMTest, AppendTest) {
   EXPECT_EQ(0, dbm->freePool->size());
   delete[] value;
 
-  uint32_t prevOffset;
-  uint32_t offset;
-  uint32_t nextOffset;
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
   dbm->findRecordOffset("fuga", &prevOffset, &offset, &nextOffset);
 
   std::fill(originalValue, originalValue + 400, 200);
@@ -540,7 +555,7 @@ TEST_F(DBMTest, ContainsTest) {
   bb::TestableDBM* dbm = new bb::TestableDBM(); 
   dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
   dbm->bucketLength = DBMTest::bucketLength;
-  dbm->bucket = new uint32_t[dbm->bucketLength];
+  dbm->bucket = new uint64_t[dbm->bucketLength];
   std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
   dbm->freePoolLength = DBMTest::freePoolLength;
 
@@ -555,3 +570,380 @@ TEST_F(DBMTest, ContainsTest) {
   dbm->fp = NULL;  
   delete dbm;    
 }
+
+TEST_F(DBMTest, LocateTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM(); 
+  dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
+  dbm->bucketLength = DBMTest::bucketLength;
+  dbm->bucket = new uint64_t[dbm->bucketLength];
+  std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
+  dbm->freePoolLength = DBMTest::freePoolLength;
+
+  uint64_t valueOffset;
+  uint32_t valueLength;
+  EXPECT_FALSE(dbm->locate("hoge", &valueOffset, &valueLength));
+  EXPECT_EQ(0, valueLength);
+
+  uint32_t testData[] = {1, 2, 3, 4};
+  dbm->set("hoge", testData, 4);
+
+  ASSERT_TRUE(dbm->locate("hoge", &valueOffset, &valueLength));
+  EXPECT_EQ(4, valueLength);
+
+  uint32_t value;
+  fseek(dbm->fp, valueOffset, SEEK_SET);
+  ASSERT_EQ(1, fread(&value, sizeof(uint32_t), 1, dbm->fp));
+  EXPECT_EQ(1, value);
+
+  fclose(dbm->fp);  
+  dbm->fp = NULL;  
+  delete dbm;    
+}
+
+TEST_F(DBMTest, ReadTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM(); 
+  dbm->fp = fopen(DBMTest::emptyDBMPath, "rb+");
+  dbm->bucketLength = DBMTest::bucketLength;
+  dbm->bucket = new uint64_t[dbm->bucketLength];
+  std::fill(dbm->bucket, dbm->bucket + this->bucketLength, 0);
+  dbm->freePoolLength = DBMTest::freePoolLength;
+
+  uint32_t testData[] = {1, 2, 3, 4, 5};
+  dbm->set("hoge", testData, 5);
+
+  uint64_t valueOffset;
+  uint32_t valueLength;
+  ASSERT_TRUE(dbm->locate("hoge", &valueOffset, &valueLength));
+
+  uint32_t buffer[3];
+  ASSERT_EQ(3, dbm->read(valueOffset, 1, buffer, 3));
+  EXPECT_EQ(2, buffer[0]);
+  EXPECT_EQ(3, buffer[1]);
+  EXPECT_EQ(4, buffer[2]);
+
+  ASSERT_EQ(1, dbm->read(valueOffset, 4, buffer, 1));
+  EXPECT_EQ(5, buffer[0]);
+
+  fclose(dbm->fp);  
+  dbm->fp = NULL;  
+  delete dbm;    
+}
+
+TEST_F(DBMTest, UpgradeTest) {
+  // a file of the 32-bit layout holding a chain of two records, the first
+  // of which has more capacity than it needs
+  FILE* fp = fopen(DBMTest::emptyDBMPath, "wb+");
+  uint32_t legacyBucketLength = 10;
+  uint32_t legacyFreePoolLength = 5;
+  std::vector<uint32_t> legacyBucket(legacyBucketLength, 0);
+  std::vector<uint32_t> legacyFreePool(legacyFreePoolLength * 2, 0);
+  uint32_t firstOffset = sizeof(uint32_t) * (2 + legacyBucketLength + legacyFreePoolLength * 2);
+  uint32_t secondOffset = firstOffset + sizeof(uint32_t) * 4 + 4 + sizeof(uint32_t) * 3;
+  legacyBucket[3] = firstOffset;
+  fwrite(&legacyBucketLength, sizeof(uint32_t), 1, fp);
+  fwrite(&legacyBucket[0], sizeof(uint32_t), legacyBucketLength, fp);
+  fwrite(&legacyFreePoolLength, sizeof(uint32_t), 1, fp);
+  fwrite(&legacyFreePool[0], sizeof(uint32_t), legacyFreePoolLength * 2, fp);
+
+  uint32_t firstFields[] = {secondOffset, 4};
+  uint32_t firstValue[] = {2048, 3, 1, 2, 3};
+  fwrite(firstFields, sizeof(uint32_t), 2, fp);
+  fwrite("hoge", sizeof(char), 4, fp);
+  fwrite(firstValue, sizeof(uint32_t), 5, fp);
+  uint32_t secondFields[] = {0, 8};
+  uint32_t secondValue[] = {1024, 1, 9};
+  fwrite(secondFields, sizeof(uint32_t), 2, fp);
+  fwrite("fugafuga", sizeof(char), 8, fp);
+  fwrite(secondValue, sizeof(uint32_t), 3, fp);
+  fclose(fp);
+
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  EXPECT_FALSE(dbm->open(DBMTest::emptyDBMPath));
+  EXPECT_FALSE(bb::TestableDBM::upgrade("not_exist.dat"));
+  EXPECT_FALSE(bb::TestableDBM::isLegacy("not_exist.dat"));
+  EXPECT_TRUE(bb::TestableDBM::isLegacy(DBMTest::emptyDBMPath));
+  ASSERT_TRUE(bb::TestableDBM::upgrade(DBMTest::emptyDBMPath));
+  EXPECT_FALSE(bb::TestableDBM::isLegacy(DBMTest::emptyDBMPath));
+  EXPECT_FALSE(bb::TestableDBM::upgrade(DBMTest::emptyDBMPath, "upgraded.dat"));
+  EXPECT_TRUE(bb::TestableDBM::upgrade(DBMTest::emptyDBMPath));
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  EXPECT_EQ(legacyBucketLength, dbm->bucketLength);
+  EXPECT_EQ(legacyFreePoolLength, dbm->freePoolLength);
+
+  uint32_t valueLength;
+  uint32_t* value = dbm->get("hoge", &valueLength);
+  ASSERT_EQ(3, valueLength);
+  EXPECT_EQ(1, *value);
+  EXPECT_EQ(3, *(value + 2));
+  delete[] value;
+
+  value = dbm->get("fugafuga", &valueLength);
+  ASSERT_EQ(1, valueLength);
+  EXPECT_EQ(9, *value);
+  delete[] value;
+
+  std::vector<std::string> keys;
+  dbm->getKeys(keys);
+  std::sort(keys.begin(), keys.end());
+  ASSERT_EQ(2, keys.size());
+  EXPECT_EQ("fugafuga", keys.at(0));
+  EXPECT_EQ("hoge", keys.at(1));
+
+  uint64_t prevOffset;
+  uint64_t offset;
+  uint64_t nextOffset;
+  dbm->findRecordOffset("hoge", &prevOffset, &offset, &nextOffset);
+  uint64_t valueCapacity;
+  ASSERT_EQ(1, fread(&valueCapacity, sizeof(uint64_t), 1, dbm->fp));
+  EXPECT_EQ(2048, valueCapacity);
+
+  delete dbm;
+}
+
+TEST_F(DBMTest, LargeOffsetTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+
+  // records beyond 4GB; the gap before them stays a hole in the file
+  uint64_t largeOffset = 5ULL << 30;
+  ASSERT_EQ(0, ftruncate(fileno(dbm->fp), largeOffset));
+
+  uint32_t testData[] = {1, 2, 3};
+  dbm->set("hoge", testData, 3);
+  dbm->set("fuga", testData, 2);
+
+  uint64_t valueOffset;
+  uint32_t valueLength;
+  ASSERT_TRUE(dbm->locate("fuga", &valueOffset, &valueLength));
+  EXPECT_LT(largeOffset, valueOffset);
+  EXPECT_EQ(2, valueLength);
+  dbm->close();
+
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  uint32_t* value = dbm->get("hoge", &valueLength);
+  ASSERT_EQ(3, valueLength);
+  EXPECT_EQ(3, *(value + 2));
+  delete[] value;
+
+  uint32_t buffer[2];
+  ASSERT_TRUE(dbm->locate("fuga", &valueOffset, &valueLength));
+  ASSERT_EQ(2, dbm->read(valueOffset, 0, buffer, 2));
+  EXPECT_EQ(2, buffer[1]);
+
+  delete dbm;
+}
+
+TEST_F(DBMTest, LocateAllTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  ASSERT_TRUE(dbm->create(DBMTest::emptyDBMPath, 3, 10));
+
+  // few buckets, so that the keys share chains of several records
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < 20; ++i) {
+    std::stringstream key;
+    key << "key" << i;
+    keys.push_back(key.str());
+    std::vector<uint32_t> value(i + 1, i);
+    dbm->set(keys.back().c_str(), &value[0], value.size());
+  }
+  keys.push_back("missing");
+  keys.push_back("key");
+  keys.push_back("key10");
+
+  bb::AsyncReader reader;
+  std::vector<uint64_t> valueOffsets;
+  std::vector<uint32_t> valueLengths;
+  dbm->locateAll(&reader, keys, valueOffsets, valueLengths);
+  ASSERT_EQ(keys.size(), valueOffsets.size());
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    uint64_t valueOffset = 0;
+    uint32_t valueLength;
+    bool found = dbm->locate(keys[i].c_str(), &valueOffset, &valueLength);
+    EXPECT_EQ(found ? valueOffset : 0, valueOffsets[i]) << keys[i];
+    EXPECT_EQ(valueLength, valueLengths[i]) << keys[i];
+  }
+  EXPECT_EQ(0, valueOffsets[20]);
+  EXPECT_EQ(0, valueOffsets[21]);
+
+  std::vector<uint32_t*> values;
+  dbm->getAll(&reader, keys, values, valueLengths);
+  for (uint32_t i = 0; i < 20; ++i) {
+    ASSERT_TRUE(values[i] != NULL);
+    ASSERT_EQ(i + 1, valueLengths[i]);
+    EXPECT_EQ(i, *(values[i] + i));
+    delete[] values[i];
+  }
+  EXPECT_EQ(NULL, values[20]);
+  EXPECT_EQ(0, valueLengths[20]);
+  ASSERT_TRUE(values[22] != NULL);
+  EXPECT_EQ(11, valueLengths[22]);
+  delete[] values[22];
+
+  delete dbm;
+}
+
+TEST_F(DBMTest, LazyMetaDataTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  ASSERT_TRUE(dbm->mapping != NULL);
+  EXPECT_EQ((void*) (dbm->mapping + sizeof(uint32_t) * 4), (void*) dbm->bucket);
+  EXPECT_FALSE(dbm->freePoolLoaded);
+
+  // only allocating or freeing a record needs the free pool
+  uint32_t value[] = {1, 2, 3};
+  dbm->set("hoge", value, 3);
+  dbm->set("fuga", value, 1);
+  EXPECT_TRUE(dbm->freePoolLoaded);
+  dbm->remove("fuga");
+  EXPECT_EQ(1, dbm->freePool->size());
+  dbm->close();
+
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  EXPECT_FALSE(dbm->freePoolLoaded);
+  uint32_t valueLength;
+  uint32_t* result = dbm->get("hoge", &valueLength);
+  ASSERT_EQ(3, valueLength);
+  EXPECT_EQ(3, *(result + 2));
+  delete[] result;
+  dbm->set("hoge", value, 2);
+  EXPECT_FALSE(dbm->freePoolLoaded);
+  dbm->close();
+
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  dbm->remove("hoge");
+  EXPECT_TRUE(dbm->freePoolLoaded);
+  EXPECT_EQ(2, dbm->freePool->size());
+  dbm->close();
+
+  // a file too short for the bucket its header declares is refused
+  ASSERT_EQ(0, truncate(DBMTest::emptyDBMPath, sizeof(uint32_t) * 4 + sizeof(uint64_t) * 10));
+  EXPECT_FALSE(dbm->open(DBMTest::emptyDBMPath));
+
+  delete dbm;
+}
+
+TEST_F(DBMTest, SyncTest) {
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  EXPECT_FALSE(dbm->sync());
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+
+  uint32_t value[] = {1, 2, 3};
+  dbm->set("hoge", value, 3);
+  dbm->set("fuga", value, 2);
+  dbm->remove("fuga");
+  EXPECT_TRUE(dbm->freePoolDirty);
+  EXPECT_TRUE(dbm->sync());
+  EXPECT_FALSE(dbm->freePoolDirty);
+
+  // everything synced is seen by another handle while the first stays open
+  bb::TestableDBM* other = new bb::TestableDBM();
+  ASSERT_TRUE(other->open(DBMTest::emptyDBMPath));
+  uint32_t valueLength;
+  uint32_t* result = other->get("hoge", &valueLength);
+  ASSERT_EQ(3, valueLength);
+  EXPECT_EQ(3, *(result + 2));
+  delete[] result;
+  EXPECT_FALSE(other->contains("fuga"));
+  other->loadFreePool();
+  ASSERT_EQ(1, other->freePool->size());
+  EXPECT_EQ(dbm->freePool->front(), other->freePool->front());
+  delete other;
+
+  // reading leaves nothing to write back
+  dbm->get("hoge", &valueLength);
+  EXPECT_FALSE(dbm->freePoolDirty);
+
+  delete dbm;
+}
+
+TEST_F(DBMTest, ReadOnlyTest) {
+  bb::TestableDBM* writer = new bb::TestableDBM();
+  ASSERT_TRUE(writer->open(DBMTest::emptyDBMPath));
+  uint32_t value[] = {1, 2, 3};
+  writer->set("hoge", value, 3);
+
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath, true));
+  EXPECT_TRUE(dbm->isReadOnly());
+  EXPECT_FALSE(writer->isReadOnly());
+  EXPECT_TRUE(dbm->contains("hoge"));
+
+  // changes are ignored and nothing is written back
+  dbm->set("fuga", value, 3);
+  dbm->remove("hoge");
+  dbm->append("hoge", value, 3);
+  EXPECT_FALSE(dbm->contains("fuga"));
+  EXPECT_FALSE(dbm->freePoolLoaded);
+  EXPECT_FALSE(dbm->sync());
+  uint32_t valueLength;
+  uint32_t* result = dbm->get("hoge", &valueLength);
+  ASSERT_EQ(3, valueLength);
+  delete[] result;
+
+  // records the writer adds are seen without reopening
+  writer->set("fuga", value, 2);
+  result = dbm->get("fuga", &valueLength);
+  ASSERT_EQ(2, valueLength);
+  EXPECT_EQ(2, *(result + 1));
+  delete[] result;
+
+  dbm->close();
+  delete dbm;
+  delete writer;
+}
+
+TEST_F(DBMTest, VersionTest) {
+  bb::EpochManager epochs;
+  bb::TestableDBM* dbm = new bb::TestableDBM();
+  ASSERT_TRUE(dbm->open(DBMTest::emptyDBMPath));
+  dbm->setEpochs(&epochs);
+  bb::AsyncReader reader;
+
+  uint32_t value[] = {1, 2, 3, 4, 5, 6};
+  dbm->set("hoge", value, 3);
+  dbm->set("piyo", value, 1);
+  epochs.publish();
+  dbm->reclaim();
+  EXPECT_TRUE(dbm->versions->empty());
+  uint64_t epoch = epochs.pin();
+
+  // the pinned reader keeps the old values while the writer moves on
+  dbm->set("hoge", value + 3, 3);
+  dbm->append("piyo", value + 1, 2);
+  dbm->set("fuga", value, 2);
+  epochs.publish();
+  dbm->reclaim();
+  EXPECT_EQ(1, dbm->retired->size());
+
+  std::vector<std::string> keys;
+  keys.push_back("hoge");
+  keys.push_back("piyo");
+  keys.push_back("fuga");
+  std::vector<uint32_t*> values;
+  std::vector<uint32_t> valueLengths;
+  dbm->getAll(&reader, keys, values, valueLengths, epoch);
+  ASSERT_EQ(3, valueLengths[0]);
+  EXPECT_EQ(1, *(values[0]));
+  EXPECT_EQ(3, *(values[0] + 2));
+  ASSERT_EQ(1, valueLengths[1]);
+  EXPECT_EQ(1, *(values[1]));
+  EXPECT_TRUE(values[2] == NULL);
+  for (uint32_t i = 0; i < values.size(); ++i) delete[] values[i];
+
+  dbm->getAll(&reader, keys, values, valueLengths);
+  ASSERT_EQ(3, valueLengths[0]);
+  EXPECT_EQ(4, *(values[0]));
+  ASSERT_EQ(3, valueLengths[1]);
+  EXPECT_EQ(3, *(values[1] + 2));
+  ASSERT_EQ(2, valueLengths[2]);
+  for (uint32_t i = 0; i < values.size(); ++i) delete[] values[i];
+
+  // the old record is reused only after the reader is gone
+  epochs.unpin(epoch);
+  dbm->reclaim();
+  EXPECT_TRUE(dbm->retired->empty());
+  EXPECT_TRUE(dbm->versions->empty());
+  EXPECT_FALSE(dbm->freePool->empty());
+
+  delete dbm;
+}
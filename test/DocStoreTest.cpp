@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include "bb/DocStore.hpp"
+
+namespace {
+
+std::string makeDoc(uint32_t docId)
+{
+  std::ostringstream stream;
+  stream << "文書" << docId << "：今日は晴れ、明日は雨。";
+  for (uint32_t i = 0; i < docId % 5; ++i) stream << "ところにより曇り。";
+  return stream.str();
+}
+
+}
+
+class DocStoreTest : public ::testing::Test
+{
+protected:
+  bb::DBM<char>* library;
+
+  virtual void SetUp() {
+    remove("library.dat");
+    this->library = new bb::DBM<char>();
+    this->library->create("library.dat", 100, 100);
+  }
+
+  virtual void TearDown() {
+    delete this->library;
+    remove("library.dat");
+  }
+};
+
+TEST_F(DocStoreTest, PutGetTest) {
+  bb::DocStore* store = new bb::DocStore(this->library);
+  store->load();
+
+  // enough documents to seal several blocks
+  for (uint32_t docId = 1; docId <= 2000; ++docId) {
+    std::string doc = makeDoc(docId);
+    store->put(docId, doc.data(), doc.size());
+  }
+
+  std::string content;
+  EXPECT_TRUE(store->get(1, content));
+  EXPECT_TRUE(makeDoc(1) == content);
+  EXPECT_TRUE(store->get(2000, content));
+  EXPECT_TRUE(makeDoc(2000) == content);
+  EXPECT_FALSE(store->get(2001, content));
+  EXPECT_TRUE(content.empty());
+
+  // a reopened store reads sealed and open blocks alike
+  delete store;
+  store = new bb::DocStore(this->library);
+  store->load();
+  for (uint32_t docId = 1; docId <= 2000; docId += 97) {
+    EXPECT_TRUE(store->get(docId, content));
+    EXPECT_TRUE(makeDoc(docId) == content);
+  }
+
+  store->put(1, "ほげ", strlen("ほげ"));
+  EXPECT_TRUE(store->get(1, content));
+  EXPECT_STREQ("ほげ", content.c_str());
+  delete store;
+}
+
+TEST_F(DocStoreTest, ReadTest) {
+  bb::DocStore store(this->library);
+  store.load();
+
+  store.put(1, "0123456789", 10);
+  this->library->set("2", "abcdefghij", 10);
+
+  std::string content;
+  EXPECT_TRUE(store.read(1, 3, 4, content));
+  EXPECT_STREQ("3456", content.c_str());
+  EXPECT_TRUE(store.read(1, 8, 4, content));
+  EXPECT_STREQ("89", content.c_str());
+  EXPECT_TRUE(store.read(1, 10, 4, content));
+  EXPECT_TRUE(content.empty());
+  EXPECT_TRUE(store.read(2, 7, 4, content));
+  EXPECT_STREQ("hij", content.c_str());
+  EXPECT_FALSE(store.read(3, 0, 4, content));
+
+  // a document as large as a block is kept out of the blocks
+  std::string large(bb::DocStore::BLOCK_SIZE, 'x');
+  large.replace(bb::DocStore::BLOCK_SIZE - 4, 4, "tail");
+  store.put(4, large.data(), large.size());
+  EXPECT_TRUE(this->library->contains("$large:4"));
+  EXPECT_TRUE(store.read(4, bb::DocStore::BLOCK_SIZE - 4, 8, content));
+  EXPECT_STREQ("tail", content.c_str());
+  EXPECT_TRUE(store.get(4, content));
+  EXPECT_TRUE(large == content);
+
+  store.put(4, "small", 5);
+  EXPECT_FALSE(this->library->contains("$large:4"));
+  EXPECT_FALSE(this->library->contains("$large:4:0"));
+  EXPECT_TRUE(store.get(4, content));
+  EXPECT_STREQ("small", content.c_str());
+}
+
+TEST_F(DocStoreTest, LargeTest) {
+  std::string large;
+  for (uint32_t docId = 1; large.size() < 3 * bb::DocStore::BLOCK_SIZE + 100; ++docId) large += makeDoc(docId);
+
+  bb::DocStore* store = new bb::DocStore(this->library);
+  store->load();
+  store->put(5, large.data(), large.size());
+
+  // every part is compressed by itself and given no spare capacity
+  for (uint32_t p = 0; p < 4; ++p) {
+    std::ostringstream key;
+    key << "$large:5:" << p;
+    uint32_t valueLength;
+    char* value = this->library->get(key.str().c_str(), &valueLength);
+    ASSERT_TRUE(value != NULL);
+    EXPECT_LT(valueLength, bb::DocStore::BLOCK_SIZE / 2);
+    delete[] value;
+  }
+  EXPECT_FALSE(this->library->contains("$large:5:4"));
+
+  std::string content;
+  EXPECT_TRUE(store->read(5, bb::DocStore::BLOCK_SIZE - 3, 10, content));
+  EXPECT_TRUE(large.substr(bb::DocStore::BLOCK_SIZE - 3, 10) == content);
+  EXPECT_TRUE(store->read(5, large.size() - 4, 10, content));
+  EXPECT_TRUE(large.substr(large.size() - 4) == content);
+  EXPECT_TRUE(store->read(5, large.size(), 10, content));
+  EXPECT_TRUE(content.empty());
+
+  // a streamed document fills up its last part before starting another
+  uint32_t lengths[] = { 1000, 100000, 3, (uint32_t) large.size() - 101003 };
+  uint32_t position = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    store->append(6, large.data() + position, lengths[i]);
+    position += lengths[i];
+  }
+  EXPECT_FALSE(this->library->contains("$large:6:4"));
+
+  delete store;
+  store = new bb::DocStore(this->library);
+  store->load();
+  EXPECT_TRUE(store->get(5, content));
+  EXPECT_TRUE(large == content);
+  EXPECT_TRUE(store->get(6, content));
+  EXPECT_TRUE(large == content);
+  EXPECT_TRUE(store->read(6, 2 * bb::DocStore::BLOCK_SIZE - 100, bb::DocStore::BLOCK_SIZE + 200, content));
+  EXPECT_TRUE(large.substr(2 * bb::DocStore::BLOCK_SIZE - 100, bb::DocStore::BLOCK_SIZE + 200) == content);
+
+  EXPECT_TRUE(store->remove(6));
+  EXPECT_FALSE(store->get(6, content));
+  EXPECT_FALSE(this->library->contains("$large:6"));
+  EXPECT_FALSE(this->library->contains("$large:6:0"));
+  delete store;
+}
+
+TEST_F(DocStoreTest, RemoveTest) {
+  bb::DocStore store(this->library);
+  store.load();
+
+  for (uint32_t docId = 1; docId <= 10; ++docId) {
+    std::string doc = makeDoc(docId);
+    store.put(docId, doc.data(), doc.size());
+  }
+
+  std::string content;
+  EXPECT_TRUE(store.remove(5));
+  EXPECT_FALSE(store.remove(5));
+  EXPECT_FALSE(store.get(5, content));
+  EXPECT_TRUE(store.get(6, content));
+  EXPECT_TRUE(makeDoc(6) == content);
+
+  for (uint32_t docId = 1; docId <= 10; ++docId) store.remove(docId);
+  EXPECT_FALSE(store.get(1, content));
+
+  store.put(3, "ふが", strlen("ふが"));
+  EXPECT_TRUE(store.get(3, content));
+  EXPECT_STREQ("ふが", content.c_str());
+}
+
+TEST_F(DocStoreTest, OpenBlockTest) {
+  bb::DocStore* store = new bb::DocStore(this->library);
+  store->load();
+  store->put(1, "0123456789", 10);
+
+  // later documents are appended to the open block in place, and leave
+  // the state alone
+  uint64_t openOffset;
+  uint32_t openLength;
+  ASSERT_TRUE(this->library->locate("$block:open", &openOffset, &openLength));
+  EXPECT_EQ(2 * sizeof(uint32_t) + 10, openLength);
+  uint32_t stateValueLength;
+  char* state = this->library->get("$docstore", &stateValueLength);
+
+  store->put(2, "abcde", 5);
+  uint64_t offset;
+  uint32_t length;
+  ASSERT_TRUE(this->library->locate("$block:open", &offset, &length));
+  EXPECT_EQ(openOffset, offset);
+  EXPECT_EQ(openLength + 2 * sizeof(uint32_t) + 5, length);
+  uint32_t valueLength;
+  char* value = this->library->get("$docstore", &valueLength);
+  ASSERT_EQ(stateValueLength, valueLength);
+  EXPECT_EQ(0, memcmp(state, value, valueLength));
+  delete[] state;
+  delete[] value;
+
+  // a document leaving the open block rewrites it without the document
+  EXPECT_TRUE(store->remove(1));
+  delete store;
+  store = new bb::DocStore(this->library);
+  store->load();
+  std::string content;
+  EXPECT_FALSE(store->get(1, content));
+  EXPECT_TRUE(store->get(2, content));
+  EXPECT_STREQ("abcde", content.c_str());
+  store->put(3, "xyz", 3);
+  EXPECT_TRUE(store->get(3, content));
+  EXPECT_STREQ("xyz", content.c_str());
+  delete store;
+}
+
+TEST_F(DocStoreTest, CompressionTest) {
+  std::vector<std::string> samples;
+  for (uint32_t docId = 1; docId <= 100; ++docId) samples.push_back(makeDoc(docId));
+
+  std::string dictionary = bb::DocStore::buildDictionary(samples, 4096);
+  EXPECT_FALSE(dictionary.empty());
+  EXPECT_GE(4096, dictionary.size());
+
+  bb::DocStore store(this->library);
+  store.load();
+  store.trainDictionary(samples);
+
+  uint32_t rawLength = 0;
+  for (uint32_t docId = 1; docId <= 3000; ++docId) {
+    std::string doc = makeDoc(docId);
+    store.put(docId, doc.data(), doc.size());
+    rawLength += doc.size();
+  }
+
+  // sealed blocks hold a fraction of the raw text
+  uint32_t valueLength;
+  char* value = this->library->get("$block:1", &valueLength);
+  ASSERT_TRUE(value != NULL);
+  EXPECT_LT(valueLength, bb::DocStore::BLOCK_SIZE / 4);
+  delete[] value;
+
+  std::string content;
+  for (uint32_t docId = 1; docId <= 3000; docId += 31) {
+    EXPECT_TRUE(store.get(docId, content));
+    EXPECT_TRUE(makeDoc(docId) == content);
+  }
+}
+
+TEST_F(DocStoreTest, LegacyTest) {
+  // documents stored one per key before blocks existed
+  this->library->set("7", "てすと", strlen("てすと"));
+
+  bb::DocStore store(this->library);
+  store.load();
+
+  std::string content;
+  EXPECT_TRUE(store.get(7, content));
+  EXPECT_STREQ("てすと", content.c_str());
+  EXPECT_TRUE(store.remove(7));
+  EXPECT_FALSE(this->library->contains("7"));
+  EXPECT_FALSE(store.get(7, content));
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include "bb/EpochManager.hpp"
+
+TEST(EpochManagerTest, PublishTest) {
+  bb::EpochManager epochs;
+  EXPECT_EQ(0, epochs.getEpoch());
+  EXPECT_EQ(1, epochs.getWriteEpoch());
+
+  EXPECT_EQ(1, epochs.publish());
+  EXPECT_EQ(1, epochs.getEpoch());
+  EXPECT_EQ(2, epochs.getWriteEpoch());
+  EXPECT_EQ(1, epochs.getOldestEpoch());
+}
+
+TEST(EpochManagerTest, PinTest) {
+  bb::EpochManager epochs;
+  epochs.publish();
+  uint64_t first = epochs.pin();
+  EXPECT_EQ(1, first);
+
+  epochs.publish();
+  epochs.publish();
+  uint64_t second = epochs.pin();
+  uint64_t third = epochs.pin();
+  EXPECT_EQ(3, second);
+  EXPECT_EQ(3, third);
+  EXPECT_EQ(1, epochs.getOldestEpoch());
+
+  epochs.unpin(first);
+  EXPECT_EQ(3, epochs.getOldestEpoch());
+  epochs.publish();
+  epochs.unpin(second);
+  EXPECT_EQ(3, epochs.getOldestEpoch());
+  epochs.unpin(third);
+  EXPECT_EQ(4, epochs.getOldestEpoch());
+
+  // an epoch which is not pinned is left alone
+  epochs.unpin(2);
+  EXPECT_EQ(4, epochs.getOldestEpoch());
+}
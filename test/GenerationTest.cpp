@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bb/Generation.hpp"
+
+namespace {
+
+void* beginWrite(void* generation)
+{
+  ((bb::Generation*) generation)->beginWrite();
+  return NULL;
+}
+
+}
+
+class GenerationTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp() {
+    remove("bubu.gen");
+  }
+
+  virtual void TearDown() {
+    remove("bubu.gen");
+  }
+};
+
+TEST_F(GenerationTest, OpenTest) {
+  bb::Generation reader;
+  EXPECT_FALSE(reader.open("bubu.gen", true));
+  EXPECT_FALSE(reader.beginRead());
+
+  bb::Generation writer;
+  ASSERT_TRUE(writer.open("bubu.gen", false));
+  EXPECT_EQ(0, writer.getGeneration());
+  ASSERT_TRUE(reader.open("bubu.gen", true));
+  EXPECT_EQ(0, reader.getGeneration());
+  EXPECT_FALSE(reader.isStale());
+
+  // a reader can neither begin nor end writing
+  EXPECT_FALSE(reader.beginWrite());
+  EXPECT_FALSE(reader.endWrite());
+}
+
+TEST_F(GenerationTest, WriteTest) {
+  bb::Generation writer;
+  ASSERT_TRUE(writer.open("bubu.gen", false));
+  EXPECT_TRUE(writer.beginWrite());
+  EXPECT_TRUE(writer.beginWrite());
+  EXPECT_EQ(1, writer.getGeneration());
+  EXPECT_TRUE(writer.beginRead());
+
+  // nothing opens halfway through a write
+  bb::Generation reader;
+  EXPECT_FALSE(reader.open("bubu.gen", true));
+  EXPECT_TRUE(writer.endWrite());
+  EXPECT_EQ(2, writer.getGeneration());
+  ASSERT_TRUE(reader.open("bubu.gen", true));
+  EXPECT_EQ(2, reader.getGeneration());
+  EXPECT_TRUE(reader.beginRead());
+  EXPECT_TRUE(reader.beginRead());
+  reader.endRead();
+  reader.endRead();
+
+  // once the writer begins again, the reader is stale until reopened
+  EXPECT_TRUE(writer.beginWrite());
+  EXPECT_TRUE(reader.isStale());
+  EXPECT_FALSE(reader.beginRead());
+  EXPECT_TRUE(writer.endWrite());
+  EXPECT_TRUE(reader.isStale());
+  ASSERT_TRUE(reader.open("bubu.gen", true));
+  EXPECT_EQ(4, reader.getGeneration());
+  EXPECT_TRUE(reader.beginRead());
+  reader.endRead();
+
+  // closing the writer ends its write as well
+  EXPECT_TRUE(writer.beginWrite());
+  writer.close();
+  EXPECT_TRUE(reader.isStale());
+  ASSERT_TRUE(reader.open("bubu.gen", true));
+  EXPECT_EQ(6, reader.getGeneration());
+}
+
+TEST_F(GenerationTest, WaitTest) {
+  bb::Generation writer;
+  ASSERT_TRUE(writer.open("bubu.gen", false));
+  bb::Generation reader;
+  ASSERT_TRUE(reader.open("bubu.gen", true));
+  ASSERT_TRUE(reader.beginRead());
+
+  // the writer waits for the read in progress before changing anything,
+  // while later reads back off at once
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, beginWrite, &writer));
+  while (!reader.isStale()) usleep(1000);
+  usleep(50000);
+  EXPECT_EQ(0, writer.getGeneration());
+
+  bb::Generation other;
+  EXPECT_FALSE(other.open("bubu.gen", true));
+  reader.endRead();
+  pthread_join(thread, NULL);
+  EXPECT_EQ(1, writer.getGeneration());
+  EXPECT_FALSE(reader.beginRead());
+  EXPECT_TRUE(writer.endWrite());
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "bb/GramDictionary.hpp"
+
+namespace bb {
+
+class TestableGramDictionary : public GramDictionary
+{
+public:
+  using GramDictionary::tables;
+};
+
+}
+
+class GramDictionaryTest : public ::testing::Test
+{
+protected:
+  static void removeTables() {
+    const char* paths[] = { "gram.dic", "gram.dic.1", "gram.dic.2", "gram.dic.3" };
+    for (uint32_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) remove(paths[i]);
+  }
+
+  virtual void SetUp() {
+    removeTables();
+  }
+
+  virtual void TearDown() {
+    removeTables();
+  }
+};
+
+TEST_F(GramDictionaryTest, AddFindTest) {
+  bb::GramDictionary dictionary;
+  EXPECT_FALSE(dictionary.open("gram.dic"));
+  ASSERT_TRUE(dictionary.create("gram.dic"));
+
+  EXPECT_EQ(0, dictionary.add("ほげ"));
+  EXPECT_EQ(1, dictionary.add("ふが"));
+  EXPECT_EQ(0, dictionary.add("ほげ"));
+  EXPECT_EQ(2, dictionary.size());
+
+  uint32_t termId;
+  EXPECT_TRUE(dictionary.find("ふが", &termId));
+  EXPECT_EQ(1, termId);
+  EXPECT_FALSE(dictionary.find("ぴよ", &termId));
+
+  // term IDs survive being merged into the file and reopened
+  ASSERT_TRUE(dictionary.flush());
+  EXPECT_EQ(2, dictionary.add("ぴよ"));
+  dictionary.close();
+
+  ASSERT_TRUE(dictionary.open("gram.dic"));
+  EXPECT_EQ(3, dictionary.size());
+  EXPECT_TRUE(dictionary.find("ほげ", &termId));
+  EXPECT_EQ(0, termId);
+  EXPECT_TRUE(dictionary.find("ぴよ", &termId));
+  EXPECT_EQ(2, termId);
+  EXPECT_EQ(3, dictionary.add("a"));
+}
+
+TEST_F(GramDictionaryTest, FindPrefixTest) {
+  bb::GramDictionary dictionary;
+  ASSERT_TRUE(dictionary.create("gram.dic"));
+
+  const char* grams[] = { "今", "今日", "今年", "明日", "日", "日曜", "今朝" };
+  for (uint32_t i = 0; i < 4; ++i) dictionary.add(grams[i]);
+  dictionary.flush();
+  for (uint32_t i = 4; i < 7; ++i) dictionary.add(grams[i]);
+
+  // mapped and pending grams come out merged in byte order
+  std::vector<std::string> found;
+  dictionary.findPrefix("今", 10, found);
+  ASSERT_EQ(4, found.size());
+  EXPECT_STREQ("今", found[0].c_str());
+  EXPECT_STREQ("今年", found[1].c_str());
+  EXPECT_STREQ("今日", found[2].c_str());
+  EXPECT_STREQ("今朝", found[3].c_str());
+
+  dictionary.findPrefix("今", 2, found);
+  EXPECT_EQ(2, found.size());
+  dictionary.findPrefix("日", 10, found);
+  EXPECT_EQ(2, found.size());
+  dictionary.findPrefix("雨", 10, found);
+  EXPECT_TRUE(found.empty());
+  dictionary.findPrefix("", 10, found);
+  EXPECT_EQ(7, found.size());
+}
+
+TEST_F(GramDictionaryTest, PendingLimitTest) {
+  bb::GramDictionary dictionary;
+  ASSERT_TRUE(dictionary.create("gram.dic"));
+
+  for (uint32_t i = 0; i < bb::GramDictionary::PENDING_LIMIT + 10; ++i) {
+    std::ostringstream stream;
+    stream << "gram" << i;
+    EXPECT_EQ(i, dictionary.add(stream.str()));
+  }
+
+  std::vector<std::string> found;
+  dictionary.findPrefix("gram409", 100, found);
+  ASSERT_EQ(11, found.size());
+  EXPECT_STREQ("gram409", found[0].c_str());
+  EXPECT_STREQ("gram4099", found[10].c_str());
+}
+
+TEST_F(GramDictionaryTest, TableTest) {
+  bb::TestableGramDictionary dictionary;
+  ASSERT_TRUE(dictionary.create("gram.dic"));
+
+  // each table is merged into the one before it once it holds as many
+  // grams, like a binary counter
+  uint32_t gramCount = bb::GramDictionary::PENDING_LIMIT * 5 + 10;
+  for (uint32_t i = 0; i < gramCount; ++i) {
+    std::ostringstream stream;
+    stream << "gram" << i;
+    EXPECT_EQ(i, dictionary.add(stream.str()));
+  }
+  ASSERT_EQ(2, dictionary.tables.size());
+  EXPECT_EQ(bb::GramDictionary::PENDING_LIMIT * 4, dictionary.tables[0].termCount);
+  EXPECT_EQ(bb::GramDictionary::PENDING_LIMIT, dictionary.tables[1].termCount);
+  dictionary.close();
+  EXPECT_EQ(0, access("gram.dic.2", F_OK));
+
+  ASSERT_TRUE(dictionary.open("gram.dic"));
+  ASSERT_EQ(3, dictionary.tables.size());
+  EXPECT_EQ(gramCount, dictionary.size());
+  uint32_t termId;
+  EXPECT_TRUE(dictionary.find("gram7", &termId));
+  EXPECT_EQ(7, termId);
+  EXPECT_TRUE(dictionary.find("gram20485", &termId));
+  EXPECT_EQ(20485, termId);
+  EXPECT_EQ(gramCount, dictionary.add("a"));
+
+  std::vector<std::string> found;
+  dictionary.findPrefix("gram2048", 100, found);
+  ASSERT_EQ(11, found.size());
+  EXPECT_STREQ("gram2048", found[0].c_str());
+  EXPECT_STREQ("gram20489", found[10].c_str());
+  dictionary.findPrefix("", 0xffffffff, found);
+  EXPECT_EQ(gramCount + 1, found.size());
+  for (uint32_t i = 1; i < found.size(); ++i) EXPECT_LT(found[i - 1], found[i]);
+
+  // a new dictionary leaves nothing of the old tables
+  ASSERT_TRUE(dictionary.create("gram.dic"));
+  EXPECT_EQ(1, dictionary.tables.size());
+  EXPECT_NE(0, access("gram.dic.1", F_OK));
+  EXPECT_FALSE(dictionary.find("gram7", &termId));
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bb/Bubu.hpp"
+#include "bb/IndexBuilder.hpp"
+
+namespace bb {
+
+class TestableIndexBuilder : public IndexBuilder
+{
+public:
+  using IndexBuilder::runSize;
+  using IndexBuilder::mergeFanIn;
+  using IndexBuilder::mergeLimit;
+
+  TestableIndexBuilder(uint32_t threadCount) : IndexBuilder(threadCount) {}
+};
+
+class TestableBuiltBubu : public Bubu
+{
+public:
+  using Bubu::index;
+};
+
+}
+
+class IndexBuilderTest : public ::testing::Test
+{
+protected:
+  static void removeWorkspace(const std::string& workspace) {
+    const char* files[] = { "bubu.idx", "bubu.pos", "bubu.lib", "bubu.cat", "bubu.dic", "bubu.dic.1", "bubu.dic.2",
+			    "bubu.gen" };
+    for (uint32_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+      remove((workspace + "/" + files[i]).c_str());
+    }
+  }
+
+  static std::string makeDoc(uint32_t docId) {
+    std::stringstream doc;
+    doc << ((docId % 2 == 0) ? "今日は晴れ" : "今日は雨") << " 番号" << docId;
+    if (docId == 1000) {
+      for (uint32_t i = 0; i < 300; ++i) doc << "晴れ";
+    }
+    if (docId % 7 == 0) doc << "\n明日は\n曇り";
+    return doc.str();
+  }
+
+  virtual void SetUp() {
+    mkdir("builder", 0755);
+  }
+
+  virtual void TearDown() {
+    removeWorkspace("builder");
+    rmdir("builder");
+    removeWorkspace(".");
+  }
+};
+
+TEST_F(IndexBuilderTest, AddDocTest) {
+  bb::IndexBuilder* builder = new bb::IndexBuilder(2);
+  EXPECT_FALSE(builder->addDoc(1, "今日は晴れ"));
+  ASSERT_TRUE(builder->create("builder", 2, true));
+  EXPECT_FALSE(builder->create("builder", 2, true));
+
+  EXPECT_TRUE(builder->addDoc(3, "今日は晴れ"));
+  EXPECT_FALSE(builder->addDoc(3, "今日は雨"));
+  EXPECT_FALSE(builder->addDoc(2, "今日は雨"));
+  EXPECT_FALSE(builder->addDoc(4, ""));
+  EXPECT_TRUE(builder->addDoc(5, "今日は雨"));
+
+  std::stringstream malformed("7 100\n今日は");
+  EXPECT_FALSE(builder->addDump(malformed));
+  ASSERT_TRUE(builder->finish());
+  EXPECT_FALSE(builder->finish());
+  delete builder;
+
+  bb::Bubu* bubu = new bb::Bubu();
+  ASSERT_TRUE(bubu->open("builder"));
+  std::vector<std::pair<uint32_t, uint32_t> > results = bubu->search("今日は");
+  ASSERT_EQ(2, results.size());
+  EXPECT_EQ(3, results.at(0).first);
+  EXPECT_EQ(5, results.at(1).first);
+  EXPECT_EQ("今日は雨", bubu->getDocContent(5));
+  EXPECT_EQ("", bubu->getDocContent(7));
+  delete bubu;
+}
+
+TEST_F(IndexBuilderTest, BuildTest) {
+  // small runs and merge limits, so that the runs are merged in more than
+  // one pass and the longest lists are written in parts
+  bb::TestableIndexBuilder* builder = new bb::TestableIndexBuilder(2);
+  builder->runSize = 2000;
+  builder->mergeFanIn = 4;
+  builder->mergeLimit = 500;
+  ASSERT_TRUE(builder->create("builder", 2, true));
+
+  bb::Bubu* expected = new bb::Bubu();
+  ASSERT_TRUE(expected->create(".", 2, true));
+
+  std::stringstream dump;
+  for (uint32_t docId = 1; docId <= 1300; ++docId) {
+    std::string doc = makeDoc(docId);
+    dump << docId << " " << doc.size() << "\n" << doc << "\n";
+    expected->registerDoc(docId, doc.c_str());
+  }
+  ASSERT_TRUE(builder->addDump(dump));
+  ASSERT_TRUE(builder->finish());
+  delete builder;
+  EXPECT_NE(0, access("builder/bubu.run.0", F_OK));
+  EXPECT_NE(0, access("builder/bubu.grams", F_OK));
+
+  bb::TestableBuiltBubu* bubu = new bb::TestableBuiltBubu();
+  ASSERT_TRUE(bubu->open("builder"));
+  EXPECT_TRUE(bubu->index->contains("$bitmap:今日"));
+  EXPECT_FALSE(bubu->index->contains("$bitmap:明日"));
+
+  const char* queries[] = { "今日は", "晴れ", "晴れ晴れ", "雨 番号1", "番号12", "明日は\n曇り", "曇", "快晴" };
+  for (uint32_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+    EXPECT_EQ(expected->search(queries[i]), bubu->search(queries[i])) << queries[i];
+
+    std::vector<std::pair<uint32_t, double> > expectedTopK = expected->searchTopK(queries[i], 20);
+    std::vector<std::pair<uint32_t, double> > topK = bubu->searchTopK(queries[i], 20);
+    ASSERT_EQ(expectedTopK.size(), topK.size()) << queries[i];
+    for (uint32_t j = 0; j < topK.size(); ++j) {
+      EXPECT_EQ(expectedTopK.at(j).first, topK.at(j).first);
+      EXPECT_DOUBLE_EQ(expectedTopK.at(j).second, topK.at(j).second);
+    }
+  }
+  EXPECT_EQ(expected->searchPrefix("晴", 10), bubu->searchPrefix("晴", 10));
+  EXPECT_EQ(expected->searchPrefix("番", 10), bubu->searchPrefix("番", 10));
+  EXPECT_EQ(makeDoc(1000), bubu->getDocContent(1000));
+  EXPECT_EQ(makeDoc(1001), bubu->getDocContent(1001));
+  EXPECT_EQ(expected->getSnippet(994, 10, 4), bubu->getSnippet(994, 10, 4));
+
+  // the built workspace takes documents like any other
+  bubu->registerDoc(1301, "快晴");
+  std::vector<std::pair<uint32_t, uint32_t> > results = bubu->search("快晴");
+  ASSERT_EQ(1, results.size());
+  EXPECT_EQ(1301, results.at(0).first);
+  results = bubu->search("晴");
+  ASSERT_FALSE(results.empty());
+  EXPECT_EQ(1301, results.back().first);
+
+  delete bubu;
+  delete expected;
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <set>
+#include "bb/Intersection.hpp"
+
+namespace {
+
+const bb::Intersection::Kernel KERNELS[] = {
+  bb::Intersection::SCALAR, bb::Intersection::GALLOP, bb::Intersection::SSE42, bb::Intersection::AVX2
+};
+
+std::vector<uint32_t> makeDocIds(uint32_t length, uint32_t maxGap)
+{
+  std::vector<uint32_t> docIds;
+  uint32_t docId = 0;
+  for (uint32_t i = 0; i < length; ++i) {
+    docId += 1 + rand() % maxGap;
+    docIds.push_back(docId);
+  }
+  return docIds;
+}
+
+std::vector<uint32_t> makePostings(uint32_t docCount, uint32_t maxOffset)
+{
+  std::vector<uint32_t> postings;
+  for (uint32_t docId = 0; docId < docCount; ++docId) {
+    for (uint32_t offset = 0; offset < maxOffset; ++offset) {
+      if (rand() % 3 == 0) {
+	postings.push_back(docId);
+	postings.push_back(offset);
+      }
+    }
+  }
+  return postings;
+}
+
+std::vector<uint32_t> intersectReference(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+  std::set<uint32_t> values(b.begin(), b.end());
+  std::vector<uint32_t> result;
+  for (uint32_t i = 0; i < a.size(); ++i) {
+    if (values.count(a[i])) result.push_back(a[i]);
+  }
+  return result;
+}
+
+std::vector<uint32_t> intersectPositionsReference(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+						  uint32_t delta)
+{
+  std::set<std::pair<uint32_t, uint32_t> > postings;
+  for (uint32_t i = 0; i < b.size(); i += 2) postings.insert(std::make_pair(b[i], b[i + 1]));
+  std::vector<uint32_t> result;
+  for (uint32_t i = 0; i < a.size(); i += 2) {
+    if (postings.count(std::make_pair(a[i], a[i + 1] + delta))) {
+      result.push_back(a[i]);
+      result.push_back(a[i + 1]);
+    }
+  }
+  return result;
+}
+
+}
+
+TEST(IntersectionTest, SupportTest) {
+  EXPECT_TRUE(bb::Intersection::isSupported(bb::Intersection::SCALAR));
+  EXPECT_TRUE(bb::Intersection::isSupported(bb::Intersection::GALLOP));
+  EXPECT_TRUE(bb::Intersection::isSupported(bb::Intersection::getBestKernel()));
+}
+
+TEST(IntersectionTest, IntersectTest) {
+  uint32_t a[] = { 1, 3, 4, 7, 9, 10, 11, 20, 21, 30 };
+  uint32_t b[] = { 2, 3, 7, 8, 9, 11, 12, 13, 14, 15, 21, 29, 30 };
+  uint32_t expected[] = { 3, 7, 9, 11, 21, 30 };
+
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t out[10];
+    ASSERT_EQ(6, bb::Intersection::intersect(KERNELS[k], a, 10, b, 13, out));
+    for (uint32_t i = 0; i < 6; ++i) EXPECT_EQ(expected[i], out[i]);
+    ASSERT_EQ(6, bb::Intersection::intersect(KERNELS[k], b, 13, a, 10, out));
+    for (uint32_t i = 0; i < 6; ++i) EXPECT_EQ(expected[i], out[i]);
+    EXPECT_EQ(0, bb::Intersection::intersect(KERNELS[k], a, 0, b, 13, out));
+  }
+}
+
+TEST(IntersectionTest, RandomTest) {
+  srand(1);
+  uint32_t lengths[][2] = { { 1000, 1000 }, { 5000, 300 }, { 17, 20000 }, { 3, 3 } };
+  for (uint32_t l = 0; l < 4; ++l) {
+    std::vector<uint32_t> a = makeDocIds(lengths[l][0], 8);
+    std::vector<uint32_t> b = makeDocIds(lengths[l][1], 8);
+    std::vector<uint32_t> expected = intersectReference(a, b);
+
+    for (uint32_t k = 0; k < 4; ++k) {
+      std::vector<uint32_t> out(a.size());
+      out.resize(bb::Intersection::intersect(KERNELS[k], &a[0], a.size(), &b[0], b.size(), &out[0]));
+      EXPECT_TRUE(expected == out) << "kernel " << KERNELS[k];
+    }
+
+    // the result may overwrite a
+    std::vector<uint32_t> inPlace(a);
+    inPlace.resize(bb::Intersection::intersect(&inPlace[0], inPlace.size(), &b[0], b.size(), &inPlace[0]));
+    EXPECT_TRUE(expected == inPlace);
+  }
+}
+
+TEST(IntersectionTest, IntersectPositionsTest) {
+  uint32_t a[] = { 1, 0, 1, 4, 1, 9, 2, 3, 5, 0, 5, 2 };
+  uint32_t b[] = { 1, 2, 1, 11, 2, 1, 2, 5, 5, 2, 5, 4, 6, 2 };
+  uint32_t expected[] = { 1, 0, 1, 9, 2, 3, 5, 0, 5, 2 };
+
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t out[12];
+    ASSERT_EQ(5, bb::Intersection::intersectPositions(KERNELS[k], a, 6, b, 7, 2, out));
+    for (uint32_t i = 0; i < 10; ++i) EXPECT_EQ(expected[i], out[i]);
+    EXPECT_EQ(0, bb::Intersection::intersectPositions(KERNELS[k], a, 6, b, 7, 1, out));
+  }
+}
+
+TEST(IntersectionTest, RandomPositionsTest) {
+  srand(2);
+  uint32_t sizes[][2] = { { 300, 300 }, { 2000, 40 }, { 10, 3000 } };
+  for (uint32_t s = 0; s < 3; ++s) {
+    std::vector<uint32_t> a = makePostings(sizes[s][0], 12);
+    std::vector<uint32_t> b = makePostings(sizes[s][1], 12);
+    for (uint32_t delta = 0; delta < 4; ++delta) {
+      std::vector<uint32_t> expected = intersectPositionsReference(a, b, delta);
+
+      for (uint32_t k = 0; k < 4; ++k) {
+	std::vector<uint32_t> out(a.size());
+	out.resize(bb::Intersection::intersectPositions(KERNELS[k], &a[0], a.size() / 2,
+							&b[0], b.size() / 2, delta, &out[0]) * 2);
+	EXPECT_TRUE(expected == out) << "kernel " << KERNELS[k] << " delta " << delta;
+      }
+    }
+  }
+}
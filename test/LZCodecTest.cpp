@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "bb/LZCodec.hpp"
+
+TEST(LZCodecTest, RoundTripTest) {
+  std::string raw;
+  for (uint32_t i = 0; i < 1000; ++i) raw += (i % 7) ? "今日は晴れ、" : "明日は雨かもしれない。";
+  std::string compressed;
+  bb::LZCodec::compress(raw.data(), raw.size(), NULL, 0, compressed);
+  EXPECT_LT(compressed.size(), raw.size() / 10);
+
+  std::string decompressed;
+  ASSERT_TRUE(bb::LZCodec::decompress(compressed.data(), compressed.size(), NULL, 0, raw.size(), decompressed));
+  EXPECT_TRUE(raw == decompressed);
+
+  // incompressible input only grows by its tokens
+  std::string noise;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    noise.push_back((char) (seed >> 16));
+  }
+  bb::LZCodec::compress(noise.data(), noise.size(), NULL, 0, compressed);
+  EXPECT_LT(compressed.size(), noise.size() + noise.size() / 100);
+  ASSERT_TRUE(bb::LZCodec::decompress(compressed.data(), compressed.size(), NULL, 0, noise.size(), decompressed));
+  EXPECT_TRUE(noise == decompressed);
+
+  bb::LZCodec::compress("", 0, NULL, 0, compressed);
+  ASSERT_TRUE(bb::LZCodec::decompress(compressed.data(), compressed.size(), NULL, 0, 0, decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
+TEST(LZCodecTest, DictionaryTest) {
+  std::string dictionary = "The quick brown fox jumps over the lazy dog. ";
+  std::string raw = "the lazy dog. The quick brown fox";
+
+  std::string plain;
+  bb::LZCodec::compress(raw.data(), raw.size(), NULL, 0, plain);
+  std::string compressed;
+  bb::LZCodec::compress(raw.data(), raw.size(), dictionary.data(), dictionary.size(), compressed);
+  EXPECT_LT(compressed.size(), plain.size() / 2);
+
+  std::string decompressed;
+  ASSERT_TRUE(bb::LZCodec::decompress(compressed.data(), compressed.size(),
+				      dictionary.data(), dictionary.size(), raw.size(), decompressed));
+  EXPECT_TRUE(raw == decompressed);
+}
+
+TEST(LZCodecTest, CorruptInputTest) {
+  std::string raw = "0123456789abcdefghijklmnopqrstuvwxyz";
+  std::string compressed;
+  bb::LZCodec::compress(raw.data(), raw.size(), NULL, 0, compressed);
+
+  std::string decompressed;
+  EXPECT_FALSE(bb::LZCodec::decompress(compressed.data(), compressed.size(), NULL, 0, raw.size() + 1, decompressed));
+  EXPECT_FALSE(bb::LZCodec::decompress(compressed.data(), compressed.size() - 1, NULL, 0, raw.size(), decompressed));
+
+  // a match reaching back before the start of the output
+  const char bogus[] = { 0x14, 'a', 0x10, 0x00, 0x00 };
+  EXPECT_FALSE(bb::LZCodec::decompress(bogus, sizeof(bogus), NULL, 0, 9, decompressed));
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include "bb/PostingIterator.hpp"
+#include "bb/PostingList.hpp"
+
+class PostingIteratorTest : public ::testing::Test
+{
+protected:
+  bb::DBM<uint32_t>* index;
+  bb::DBM<uint32_t>* positions;
+
+  virtual void SetUp() {
+    remove("posting.dat");
+    remove("position.dat");
+    this->index = new bb::DBM<uint32_t>();
+    this->index->create("posting.dat", 100, 100);
+    this->positions = new bb::DBM<uint32_t>();
+    this->positions->create("position.dat", 100, 100);
+
+    // 1000 postings spread over docs 0..499, two per document
+    std::vector<uint32_t> postings;
+    for (uint32_t i = 0; i < 1000; ++i) {
+      postings.push_back(i / 2);
+      postings.push_back((i % 2) * 10);
+    }
+    bb::PostingList::set(this->index, this->positions, "hoge", postings);
+  }
+
+  virtual void TearDown() {
+    delete this->index;
+    delete this->positions;
+    remove("posting.dat");
+    remove("position.dat");
+  }
+};
+
+TEST_F(PostingIteratorTest, NextTest) {
+  bb::PostingIterator iterator(this->index, this->positions, "hoge");
+  EXPECT_EQ(1000, iterator.size());
+  EXPECT_FALSE(iterator.atEnd());
+
+  uint32_t count = 0;
+  while (iterator.next()) {
+    EXPECT_EQ(count / 2, iterator.docId());
+    EXPECT_EQ((count % 2) * 10, iterator.offset());
+    ++count;
+  }
+  EXPECT_EQ(1000, count);
+  EXPECT_TRUE(iterator.atEnd());
+  EXPECT_FALSE(iterator.next());
+}
+
+TEST_F(PostingIteratorTest, NextDocTest) {
+  bb::PostingIterator iterator(this->index, this->positions, "hoge");
+
+  uint32_t count = 0;
+  while (iterator.nextDoc()) {
+    EXPECT_EQ(count, iterator.docId());
+    EXPECT_EQ(2, iterator.termFrequency());
+    ++count;
+  }
+  EXPECT_EQ(500, count);
+
+  // offsets are still right after skipping documents without reading them
+  bb::PostingIterator skipping(this->index, this->positions, "hoge");
+  for (uint32_t i = 0; i < 300; ++i) ASSERT_TRUE(skipping.nextDoc());
+  ASSERT_TRUE(skipping.next());
+  EXPECT_EQ(299, skipping.docId());
+  EXPECT_EQ(10, skipping.offset());
+  ASSERT_TRUE(skipping.next());
+  EXPECT_EQ(300, skipping.docId());
+  EXPECT_EQ(0, skipping.offset());
+}
+
+TEST_F(PostingIteratorTest, SkipToTest) {
+  bb::PostingIterator iterator(this->index, this->positions, "hoge");
+
+  ASSERT_TRUE(iterator.skipTo(3, 5));
+  EXPECT_EQ(3, iterator.docId());
+  EXPECT_EQ(10, iterator.offset());
+
+  ASSERT_TRUE(iterator.skipTo(2, 0));
+  EXPECT_EQ(3, iterator.docId());
+
+  ASSERT_TRUE(iterator.skipTo(400, 0));
+  EXPECT_EQ(400, iterator.docId());
+  EXPECT_EQ(0, iterator.offset());
+
+  ASSERT_TRUE(iterator.next());
+  EXPECT_EQ(400, iterator.docId());
+  EXPECT_EQ(10, iterator.offset());
+
+  ASSERT_TRUE(iterator.skipTo(499, 10));
+  EXPECT_EQ(499, iterator.docId());
+  EXPECT_EQ(10, iterator.offset());
+
+  EXPECT_FALSE(iterator.skipTo(500, 0));
+  EXPECT_TRUE(iterator.atEnd());
+}
+
+TEST_F(PostingIteratorTest, SkipToDocTest) {
+  bb::PostingIterator iterator(this->index, this->positions, "hoge");
+
+  ASSERT_TRUE(iterator.skipToDoc(200));
+  EXPECT_EQ(200, iterator.docId());
+  ASSERT_TRUE(iterator.skipToDoc(100));
+  EXPECT_EQ(200, iterator.docId());
+  EXPECT_EQ(0, iterator.offset());
+  ASSERT_TRUE(iterator.skipToDoc(450));
+  EXPECT_EQ(450, iterator.docId());
+  EXPECT_EQ(2, iterator.termFrequency());
+  EXPECT_FALSE(iterator.skipToDoc(500));
+}
+
+TEST_F(PostingIteratorTest, BlockMaxTest) {
+  // five blocks of documents occurring once, but for doc 300 in the third
+  std::vector<uint32_t> postings;
+  for (uint32_t docId = 0; docId < 640; ++docId) {
+    for (uint32_t offset = 0; offset < (docId == 300 ? 5 : 1); ++offset) {
+      postings.push_back(docId);
+      postings.push_back(offset);
+    }
+  }
+  bb::PostingList::set(this->index, this->positions, "fuga", postings);
+
+  bb::PostingIterator all(this->index, this->positions, "fuga");
+  while (all.nextDoc()) {}
+  EXPECT_EQ(5, all.countLoadedBlocks());
+
+  // blocks whose documents all occur too rarely are never loaded
+  bb::PostingIterator iterator(this->index, this->positions, "fuga");
+  EXPECT_TRUE(iterator.nextDoc(1));
+  EXPECT_EQ(256, iterator.docId());
+  EXPECT_EQ(1, iterator.countLoadedBlocks());
+  EXPECT_TRUE(iterator.skipToDoc(300, 1));
+  EXPECT_EQ(5, iterator.termFrequency());
+  EXPECT_TRUE(iterator.nextDoc(1));
+  EXPECT_EQ(301, iterator.docId());
+  EXPECT_FALSE(iterator.skipToDoc(400, 1));
+  EXPECT_TRUE(iterator.atEnd());
+  EXPECT_EQ(1, iterator.countLoadedBlocks());
+
+  bb::PostingIterator skipping(this->index, this->positions, "fuga");
+  EXPECT_TRUE(skipping.skipToDoc(10, 4));
+  EXPECT_EQ(256, skipping.docId());
+  EXPECT_FALSE(skipping.skipToDoc(384, 5));
+  EXPECT_EQ(1, skipping.countLoadedBlocks());
+}
+
+TEST_F(PostingIteratorTest, MissingGramTest) {
+  bb::PostingIterator iterator(this->index, this->positions, "fuga");
+  EXPECT_EQ(0, iterator.size());
+  EXPECT_TRUE(iterator.atEnd());
+  EXPECT_FALSE(iterator.next());
+  EXPECT_FALSE(iterator.skipTo(0, 0));
+}
+
+TEST_F(PostingIteratorTest, InMemoryTest) {
+  uint32_t docLength;
+  uint32_t* docValue = this->index->get("hoge", &docLength);
+  uint32_t positionLength;
+  uint32_t* positionValue = this->positions->get("hoge", &positionLength);
+
+  bb::PostingIterator iterator(docValue, docLength, positionValue, positionLength);
+  EXPECT_EQ(1000, iterator.size());
+  ASSERT_TRUE(iterator.next());
+  EXPECT_EQ(0, iterator.docId());
+  ASSERT_TRUE(iterator.skipTo(300, 10));
+  EXPECT_EQ(300, iterator.docId());
+  EXPECT_EQ(10, iterator.offset());
+  ASSERT_TRUE(iterator.skipTo(301, 1));
+  EXPECT_EQ(301, iterator.docId());
+  EXPECT_EQ(10, iterator.offset());
+  EXPECT_FALSE(iterator.skipTo(1000, 0));
+
+  delete[] docValue;
+  delete[] positionValue;
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "bb/PostingList.hpp"
+
+class PostingListTest : public ::testing::Test
+{
+protected:
+  bb::DBM<uint32_t>* index;
+  bb::DBM<uint32_t>* positions;
+
+  virtual void SetUp() {
+    remove("posting.dat");
+    remove("position.dat");
+    this->index = new bb::DBM<uint32_t>();
+    this->index->create("posting.dat", 100, 100);
+    this->positions = new bb::DBM<uint32_t>();
+    this->positions->create("position.dat", 100, 100);
+  }
+
+  virtual void TearDown() {
+    delete this->index;
+    delete this->positions;
+    remove("posting.dat");
+    remove("position.dat");
+  }
+};
+
+TEST_F(PostingListTest, CountTest) {
+  EXPECT_EQ(0, bb::PostingList::countBlocks(0));
+  EXPECT_EQ(0, bb::PostingList::countDocs(0));
+  EXPECT_EQ(1, bb::PostingList::countBlocks(7));
+  EXPECT_EQ(1, bb::PostingList::countDocs(7));
+  EXPECT_EQ(1, bb::PostingList::countBlocks(bb::PostingList::BLOCK_STRIDE));
+  EXPECT_EQ(128, bb::PostingList::countDocs(bb::PostingList::BLOCK_STRIDE));
+  EXPECT_EQ(2, bb::PostingList::countBlocks(bb::PostingList::BLOCK_STRIDE + 7));
+  EXPECT_EQ(129, bb::PostingList::countDocs(bb::PostingList::BLOCK_STRIDE + 7));
+}
+
+TEST_F(PostingListTest, EncodeDecodeTest) {
+  // 300 postings spread over docs 0..99, three per document
+  std::vector<uint32_t> postings;
+  for (uint32_t i = 0; i < 300; ++i) {
+    postings.push_back(i / 3);
+    postings.push_back(i % 3);
+  }
+
+  std::vector<uint32_t> docValue;
+  std::vector<uint32_t> positionValue;
+  bb::PostingList::encode(&postings[0], 300, 0, docValue, positionValue);
+  ASSERT_EQ(100 * 2 + bb::PostingList::HEADER_LENGTH, docValue.size());
+  EXPECT_EQ(0, docValue[0]);
+  EXPECT_EQ(99, docValue[1]);
+  EXPECT_EQ(100, docValue[2]);
+  EXPECT_EQ(0, docValue[3]);
+  EXPECT_EQ(3, docValue[4]);
+  EXPECT_EQ(0, docValue[5]);
+  EXPECT_EQ(3, docValue[6]);
+  ASSERT_EQ(300, positionValue.size());
+  EXPECT_EQ(2, positionValue[5]);
+
+  std::vector<uint32_t> decoded;
+  bb::PostingList::decode(&docValue[0], docValue.size(), &positionValue[0], decoded);
+  EXPECT_TRUE(postings == decoded);
+
+  std::vector<uint32_t> docs;
+  bb::PostingList::decodeDocs(&docValue[0], docValue.size(), docs);
+  ASSERT_EQ(200, docs.size());
+  EXPECT_EQ(42, docs[84]);
+  EXPECT_EQ(3, docs[85]);
+}
+
+TEST_F(PostingListTest, AppendTest) {
+  std::vector<uint32_t> expected;
+  uint32_t expectedDocs = 0;
+  for (uint32_t docId = 0; docId < 300; ++docId) {
+    std::vector<uint32_t> postings;
+    for (uint32_t offset = 0; offset < docId % 7 + 1; ++offset) {
+      postings.push_back(docId);
+      postings.push_back(offset);
+    }
+    // some documents come in two parts, the second continuing the first
+    if (docId % 5 == 0 && postings.size() > 2) {
+      std::vector<uint32_t> part(postings.begin(), postings.begin() + 2);
+      EXPECT_EQ((expected.size() + part.size()) / 2,
+		bb::PostingList::append(this->index, this->positions, "hoge", part));
+      expected.insert(expected.end(), part.begin(), part.end());
+      postings.erase(postings.begin(), postings.begin() + 2);
+    }
+    EXPECT_EQ((expected.size() + postings.size()) / 2,
+	      bb::PostingList::append(this->index, this->positions, "hoge", postings));
+    expected.insert(expected.end(), postings.begin(), postings.end());
+    ++expectedDocs;
+  }
+
+  bb::PostingLocation location;
+  ASSERT_TRUE(bb::PostingList::locate(this->index, this->positions, "hoge", &location));
+  EXPECT_EQ(expectedDocs, bb::PostingList::countDocs(location.docLength));
+  EXPECT_EQ(expected.size() / 2, location.positionLength);
+
+  // appending block by block has to give the same layout as encoding at once
+  uint32_t docLength;
+  uint32_t* docValue = this->index->get("hoge", &docLength);
+  std::vector<uint32_t> reencoded;
+  std::vector<uint32_t> positionValue;
+  bb::PostingList::encode(&expected[0], expected.size() / 2, 0, reencoded, positionValue);
+  ASSERT_EQ(reencoded.size(), docLength);
+  EXPECT_TRUE(std::equal(reencoded.begin(), reencoded.end(), docValue));
+  delete[] docValue;
+
+  std::vector<uint32_t> postings;
+  EXPECT_TRUE(bb::PostingList::get(this->index, this->positions, "hoge", postings));
+  EXPECT_TRUE(expected == postings);
+  EXPECT_FALSE(bb::PostingList::get(this->index, this->positions, "fuga", postings));
+  EXPECT_TRUE(postings.empty());
+
+  std::vector<uint32_t> docs;
+  EXPECT_TRUE(bb::PostingList::getDocs(this->index, "hoge", docs));
+  ASSERT_EQ(expectedDocs * 2, docs.size());
+  EXPECT_EQ(200, docs[400]);
+  EXPECT_EQ(200 % 7 + 1, docs[401]);
+}
+
+TEST_F(PostingListTest, SetTest) {
+  std::vector<uint32_t> postings;
+  postings.push_back(1);
+  postings.push_back(2);
+  bb::PostingList::set(this->index, this->positions, "hoge", postings);
+  EXPECT_TRUE(this->index->contains("hoge"));
+  EXPECT_TRUE(this->positions->contains("hoge"));
+
+  postings.clear();
+  bb::PostingList::set(this->index, this->positions, "hoge", postings);
+  EXPECT_FALSE(this->index->contains("hoge"));
+  EXPECT_FALSE(this->positions->contains("hoge"));
+}
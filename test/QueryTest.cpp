@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "bb/Bubu.hpp"
+
+class QueryTest : public ::testing::Test
+{
+protected:
+  bb::Bubu* bubu;
+
+  virtual void SetUp() {
+    this->bubu = new bb::Bubu();
+    this->bubu->create(".");
+    this->bubu->registerDoc(1, "東京の天気は晴れ");
+    this->bubu->registerDoc(2, "大阪の天気は雨");
+    this->bubu->registerDoc(3, "東京の天気は雨");
+    this->bubu->registerDoc(4, "京都は晴れ");
+  }
+
+  virtual void TearDown() {
+    delete this->bubu;
+    remove("bubu.idx");
+    remove("bubu.pos");
+    remove("bubu.lib");
+    remove("bubu.cat");
+    remove("bubu.dic");
+    remove("bubu.gen");
+  }
+};
+
+TEST_F(QueryTest, PhraseTest) {
+  std::vector<uint32_t> docIds = this->bubu->searchQuery("\"の天気は\"");
+  ASSERT_EQ(3, docIds.size());
+  EXPECT_EQ(1, docIds.at(0));
+  EXPECT_EQ(2, docIds.at(1));
+  EXPECT_EQ(3, docIds.at(2));
+}
+
+TEST_F(QueryTest, AndTest) {
+  std::vector<uint32_t> docIds = this->bubu->searchQuery("\"東京\" AND \"雨\"");
+  ASSERT_EQ(1, docIds.size());
+  EXPECT_EQ(3, docIds.at(0));
+
+  docIds = this->bubu->searchQuery("天気 晴れ");
+  ASSERT_EQ(1, docIds.size());
+  EXPECT_EQ(1, docIds.at(0));
+}
+
+TEST_F(QueryTest, OrTest) {
+  std::vector<uint32_t> docIds = this->bubu->searchQuery("\"大阪\" OR \"京都\"");
+  ASSERT_EQ(2, docIds.size());
+  EXPECT_EQ(2, docIds.at(0));
+  EXPECT_EQ(4, docIds.at(1));
+
+  docIds = this->bubu->searchQuery("雨 OR 晴れ OR 検索");
+  ASSERT_EQ(4, docIds.size());
+}
+
+TEST_F(QueryTest, NotTest) {
+  std::vector<uint32_t> docIds = this->bubu->searchQuery("\"天気\" NOT \"東京\"");
+  ASSERT_EQ(1, docIds.size());
+  EXPECT_EQ(2, docIds.at(0));
+
+  docIds = this->bubu->searchQuery("\"京\" AND \"晴れ\" NOT \"天気\"");
+  ASSERT_EQ(1, docIds.size());
+  EXPECT_EQ(4, docIds.at(0));
+}
+
+TEST_F(QueryTest, NestedTest) {
+  std::vector<uint32_t> docIds = this->bubu->searchQuery("(\"大阪\" OR \"東京\") AND 雨");
+  ASSERT_EQ(2, docIds.size());
+  EXPECT_EQ(2, docIds.at(0));
+  EXPECT_EQ(3, docIds.at(1));
+}
+
+TEST_F(QueryTest, SkipToTest) {
+  bb::Query* query = this->bubu->openQuery("晴れ OR 雨");
+  ASSERT_TRUE(query != NULL);
+  ASSERT_TRUE(query->skipTo(3));
+  EXPECT_EQ(3, query->docId());
+  ASSERT_TRUE(query->next());
+  EXPECT_EQ(4, query->docId());
+  EXPECT_FALSE(query->next());
+  delete query;
+}
+
+TEST_F(QueryTest, SyntaxErrorTest) {
+  EXPECT_TRUE(this->bubu->openQuery("\"東京") == NULL);
+  EXPECT_TRUE(this->bubu->openQuery("(東京 OR 大阪") == NULL);
+  EXPECT_TRUE(this->bubu->openQuery("東京 AND") == NULL);
+  EXPECT_TRUE(this->bubu->openQuery("NOT 東京") == NULL);
+  EXPECT_TRUE(this->bubu->openQuery(NULL) == NULL);
+  EXPECT_EQ(0, this->bubu->searchQuery("OR").size());
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "bb/Bubu.hpp"
+
+class SearchCursorTest : public ::testing::Test
+{
+protected:
+  bb::Bubu* bubu;
+
+  virtual void SetUp() {
+    this->bubu = new bb::Bubu();
+    this->bubu->create(".");
+    this->bubu->registerDoc(1, "本日は、快晴なり。");
+    this->bubu->registerDoc(2, "明後日は、仕事。今度の休日は、お出かけ");
+    this->bubu->registerDoc(3, "東京タワーは、結構高い");
+    this->bubu->registerDoc(5, "日曜日は、雨");
+  }
+
+  virtual void TearDown() {
+    delete this->bubu;
+    remove("bubu.idx");
+    remove("bubu.pos");
+    remove("bubu.lib");
+    remove("bubu.cat");
+    remove("bubu.dic");
+    remove("bubu.gen");
+  }
+};
+
+TEST_F(SearchCursorTest, NextTest) {
+  bb::SearchCursor* cursor = this->bubu->openCursor("日は、");
+
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(1, cursor->docId());
+  EXPECT_EQ(1, cursor->offset());
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(2, cursor->docId());
+  EXPECT_EQ(2, cursor->offset());
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(2, cursor->docId());
+  EXPECT_EQ(12, cursor->offset());
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(5, cursor->docId());
+  EXPECT_EQ(2, cursor->offset());
+  EXPECT_FALSE(cursor->next());
+  EXPECT_FALSE(cursor->next());
+
+  delete cursor;
+}
+
+TEST_F(SearchCursorTest, SkipToTest) {
+  bb::SearchCursor* cursor = this->bubu->openCursor("日は、");
+
+  ASSERT_TRUE(cursor->skipTo(2));
+  EXPECT_EQ(2, cursor->docId());
+  EXPECT_EQ(2, cursor->offset());
+
+  ASSERT_TRUE(cursor->skipTo(3));
+  EXPECT_EQ(5, cursor->docId());
+
+  EXPECT_FALSE(cursor->skipTo(6));
+
+  delete cursor;
+}
+
+TEST_F(SearchCursorTest, NoHitTest) {
+  bb::SearchCursor* cursor = this->bubu->openCursor("検索エンジン");
+  EXPECT_FALSE(cursor->next());
+  delete cursor;
+
+  cursor = this->bubu->openCursor("");
+  EXPECT_FALSE(cursor->next());
+  delete cursor;
+}
+
+TEST_F(SearchCursorTest, UnorderedRegistrationTest) {
+  this->bubu->registerDoc(4, "土曜日は、晴れ");
+
+  bb::SearchCursor* cursor = this->bubu->openCursor("日は、");
+  ASSERT_TRUE(cursor->skipTo(3));
+  EXPECT_EQ(4, cursor->docId());
+  EXPECT_EQ(2, cursor->offset());
+  ASSERT_TRUE(cursor->next());
+  EXPECT_EQ(5, cursor->docId());
+
+  delete cursor;
+}
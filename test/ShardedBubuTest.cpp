@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bb/Bubu.hpp"
+#include "bb/ShardedBubu.hpp"
+
+namespace bb {
+
+class TestableShardedBubu : public ShardedBubu
+{
+public:
+  using ShardedBubu::shards;
+};
+
+class TestableShard : public Bubu
+{
+public:
+  using Bubu::gramSize;
+  using Bubu::indexUnigrams;
+};
+
+}
+
+class ShardedBubuTest : public ::testing::Test
+{
+protected:
+  static void removeWorkspace(const std::string& workspace) {
+    const char* files[] = { "bubu.idx", "bubu.pos", "bubu.lib", "bubu.cat", "bubu.dic", "bubu.dic.1", "bubu.dic.2",
+			    "bubu.gen" };
+    for (uint32_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+      remove((workspace + "/" + files[i]).c_str());
+    }
+  }
+
+  virtual void SetUp() {
+    mkdir("sharded", 0755);
+  }
+
+  virtual void TearDown() {
+    for (uint32_t s = 0; s < 4; ++s) {
+      std::stringstream shardPath;
+      shardPath << "sharded/shard" << s;
+      removeWorkspace(shardPath.str());
+      rmdir(shardPath.str().c_str());
+    }
+    remove("sharded/bubu.shd");
+    rmdir("sharded");
+    removeWorkspace(".");
+  }
+};
+
+TEST_F(ShardedBubuTest, OpenTest) {
+  bb::ShardedBubu* bubu = new bb::ShardedBubu();
+  EXPECT_FALSE(bubu->open("sharded"));
+  EXPECT_FALSE(bubu->create("sharded", 0));
+  ASSERT_TRUE(bubu->create("sharded", 3));
+  EXPECT_EQ(3, bubu->getShardCount());
+  bubu->registerDoc(4, "東京タワー");
+  delete bubu;
+
+  // the shard count is kept with the workspace
+  bubu = new bb::ShardedBubu();
+  ASSERT_TRUE(bubu->open("sharded"));
+  EXPECT_EQ(3, bubu->getShardCount());
+  EXPECT_EQ("東京タワー", bubu->getDocContent(4));
+  EXPECT_EQ(1, bubu->search("タワー").size());
+
+  bubu->close();
+  EXPECT_EQ(0, bubu->getShardCount());
+  EXPECT_EQ(0, bubu->search("タワー").size());
+
+  ASSERT_TRUE(bubu->open("sharded", true));
+  EXPECT_EQ(3, bubu->getShardCount());
+  bubu->registerDoc(5, "東京タワー");
+  EXPECT_EQ(1, bubu->search("タワー").size());
+  EXPECT_FALSE(bubu->isStale());
+
+  // a change to one shard makes the whole workspace stale
+  bb::ShardedBubu* writer = new bb::ShardedBubu();
+  ASSERT_TRUE(writer->open("sharded"));
+  writer->registerDoc(5, "東京タワー");
+  EXPECT_TRUE(bubu->isStale());
+  std::vector<std::pair<uint32_t, uint32_t> > hits;
+  EXPECT_FALSE(bubu->search("タワー", hits));
+  std::vector<std::pair<uint32_t, double> > results;
+  EXPECT_FALSE(bubu->searchTopK("タワー", 1, results));
+  std::vector<uint32_t> docIds;
+  EXPECT_FALSE(bubu->searchQuery("タワー", docIds));
+  std::string content;
+  EXPECT_FALSE(bubu->getDocContent(5, content));
+  EXPECT_TRUE(writer->flush());
+  delete writer;
+  delete bubu;
+}
+
+TEST_F(ShardedBubuTest, SettingsTest) {
+  // shards index unigrams by default, as a plain workspace does
+  bb::TestableShardedBubu* bubu = new bb::TestableShardedBubu();
+  ASSERT_TRUE(bubu->create("sharded", 2));
+  for (uint32_t s = 0; s < bubu->shards.size(); ++s) {
+    bb::TestableShard* shard = static_cast<bb::TestableShard*>(bubu->shards[s]);
+    EXPECT_EQ(2, shard->gramSize);
+    EXPECT_TRUE(shard->indexUnigrams);
+  }
+
+  ASSERT_TRUE(bubu->create("sharded", 2, 3));
+  for (uint32_t s = 0; s < bubu->shards.size(); ++s) {
+    bb::TestableShard* shard = static_cast<bb::TestableShard*>(bubu->shards[s]);
+    EXPECT_EQ(3, shard->gramSize);
+    EXPECT_TRUE(shard->indexUnigrams);
+  }
+
+  // the settings are kept with each shard
+  ASSERT_TRUE(bubu->create("sharded", 2, 3, false));
+  bubu->close();
+  ASSERT_TRUE(bubu->open("sharded"));
+  for (uint32_t s = 0; s < bubu->shards.size(); ++s) {
+    bb::TestableShard* shard = static_cast<bb::TestableShard*>(bubu->shards[s]);
+    EXPECT_EQ(3, shard->gramSize);
+    EXPECT_FALSE(shard->indexUnigrams);
+  }
+
+  delete bubu;
+}
+
+TEST_F(ShardedBubuTest, SearchTest) {
+  const char* contents[] = {
+    "本日は、快晴なり。",
+    "明後日は、仕事。今度の休日は、お出かけ",
+    "東京タワーは、結構高い",
+    "日曜日は、雨",
+    "今日は、晴れ",
+    "明日は、晴れのち雨"
+  };
+
+  // the same documents go into one plain workspace for comparison
+  bb::Bubu* plain = new bb::Bubu();
+  ASSERT_TRUE(plain->create("."));
+  bb::ShardedBubu* bubu = new bb::ShardedBubu();
+  ASSERT_TRUE(bubu->create("sharded", 4));
+
+  std::vector<std::pair<uint32_t, std::string> > docs;
+  for (uint32_t i = 0; i < sizeof(contents) / sizeof(contents[0]); ++i) {
+    docs.push_back(std::pair<uint32_t, std::string>(i + 1, contents[i]));
+    plain->registerDoc(i + 1, contents[i]);
+  }
+  bubu->registerDocs(docs);
+
+  const char* queries[] = { "日は、", "晴れ", "雨", "は", "タワー", "存在しない" };
+  std::vector<std::string> batch;
+  for (uint32_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+    EXPECT_EQ(plain->search(queries[q]), bubu->search(queries[q])) << queries[q];
+    EXPECT_EQ(plain->searchQuery(queries[q]), bubu->searchQuery(queries[q])) << queries[q];
+    batch.push_back(queries[q]);
+  }
+  EXPECT_EQ(plain->searchBatch(batch), bubu->searchBatch(batch));
+  EXPECT_EQ(plain->searchQuery("晴れ OR 雨 NOT 明日"), bubu->searchQuery("晴れ OR 雨 NOT 明日"));
+
+  std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK("は、", 3);
+  ASSERT_EQ(3, results.size());
+  EXPECT_GE(results[0].second, results[1].second);
+  EXPECT_GE(results[1].second, results[2].second);
+
+  EXPECT_EQ("東京タワー", bubu->getSnippet(3, 2, 5));
+  bubu->unregisterDoc(3);
+  EXPECT_EQ(0, bubu->search("タワー").size());
+  EXPECT_EQ("", bubu->getDocContent(3));
+
+  bubu->updateDoc(5, "今日は、雨");
+  plain->updateDoc(5, "今日は、雨");
+  EXPECT_EQ(plain->search("雨"), bubu->search("雨"));
+  EXPECT_EQ(1, bubu->search("晴れ").size());
+
+  delete bubu;
+  delete plain;
+}
+
+TEST_F(ShardedBubuTest, RankTest) {
+  const char* contents[] = {
+    "本日は、快晴なり。",
+    "明後日は、仕事。今度の休日は、お出かけ",
+    "東京タワーは、結構高い",
+    "日曜日は、雨",
+    "今日は、晴れ。",
+    "明日は、晴れのち雨、明後日は、雨のち晴れ",
+    "雨",
+    "晴れの日は、散歩。雨の日は、読書"
+  };
+
+  // shards score with the statistics of the whole workspace, so ranks and
+  // scores are those of one plain workspace, prefix queries included; no
+  // two documents are of the same length, so that no scores tie
+  for (uint32_t mode = 0; mode < 2; ++mode) {
+    bb::Bubu* plain = new bb::Bubu();
+    ASSERT_TRUE(plain->create(".", 2, mode == 1));
+    bb::ShardedBubu* bubu = new bb::ShardedBubu();
+    ASSERT_TRUE(bubu->create("sharded", 3, 2, mode == 1));
+
+    for (uint32_t i = 0; i < sizeof(contents) / sizeof(contents[0]); ++i) {
+      plain->registerDoc(i + 1, contents[i]);
+      bubu->registerDoc(i + 1, contents[i]);
+    }
+    if (mode == 1) {
+      delete bubu;
+      bubu = new bb::ShardedBubu();
+      ASSERT_TRUE(bubu->open("sharded"));
+    }
+
+    const char* queries[] = { "日は、", "晴れ", "雨", "は", "タワー", "雨の日", "存在しない" };
+    for (uint32_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+      for (uint32_t k = 1; k <= 8; k += 3) {
+	std::vector<std::pair<uint32_t, double> > expected = plain->searchTopK(queries[q], k);
+	std::vector<std::pair<uint32_t, double> > results = bubu->searchTopK(queries[q], k);
+	ASSERT_EQ(expected.size(), results.size()) << queries[q];
+	for (uint32_t r = 0; r < expected.size(); ++r) {
+	  EXPECT_EQ(expected[r].first, results[r].first) << queries[q];
+	  EXPECT_DOUBLE_EQ(expected[r].second, results[r].second) << queries[q];
+	}
+      }
+    }
+    EXPECT_EQ(plain->search("雨"), bubu->search("雨"));
+
+    delete bubu;
+    delete plain;
+    TearDown();
+    SetUp();
+  }
+}
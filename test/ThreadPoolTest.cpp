@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "bb/ThreadPool.hpp"
+
+namespace {
+
+class SumTask : public bb::Task
+{
+public:
+  uint32_t limit;
+  uint64_t sum;
+
+  SumTask(uint32_t limit) : limit(limit), sum(0) {}
+
+  virtual void run() {
+    for (uint32_t i = 1; i <= this->limit; ++i) this->sum += i;
+  }
+};
+
+}
+
+TEST(ThreadPoolTest, RunTest) {
+  bb::ThreadPool* pool = new bb::ThreadPool(4);
+  EXPECT_EQ(4, pool->size());
+
+  std::vector<SumTask*> tasks;
+  for (uint32_t i = 0; i < 100; ++i) {
+    tasks.push_back(new SumTask(i * 100));
+    pool->submit(tasks.back());
+  }
+  pool->wait();
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    uint64_t limit = i * 100;
+    EXPECT_EQ(limit * (limit + 1) / 2, tasks[i]->sum);
+    delete tasks[i];
+  }
+
+  delete pool;
+}
+
+TEST(ThreadPoolTest, ReuseTest) {
+  bb::ThreadPool pool(2);
+
+  SumTask first(10);
+  pool.submit(&first);
+  pool.wait();
+  EXPECT_EQ(55, first.sum);
+
+  SumTask second(100);
+  pool.submit(&second);
+  pool.wait();
+  EXPECT_EQ(5050, second.sum);
+
+  pool.wait();
+}
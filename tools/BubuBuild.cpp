@@ -0,0 +1,63 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bb/IndexBuilder.hpp"
+
+namespace {
+
+void usage()
+{
+  fprintf(stderr, "usage: bububuild [-g gramSize] [-n] [-j threads] workspaceDir [dumpFile]\n");
+  fprintf(stderr, "  the dump holds each document as a \"docId length\" line, its content and a newline\n");
+  fprintf(stderr, "  -n leaves unigrams out of the index; the dump is read from stdin by default\n");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t gramSize = 2;
+  bool indexUnigrams = true;
+  uint32_t threadCount = 0;
+  int option;
+  while ((option = getopt(argc, argv, "g:nj:")) != -1) {
+    switch (option) {
+    case 'g': gramSize = atoi(optarg); break;
+    case 'n': indexUnigrams = false; break;
+    case 'j': threadCount = atoi(optarg); break;
+    default: usage(); return 2;
+    }
+  }
+  if (optind >= argc || argc - optind > 2) {
+    usage();
+    return 2;
+  }
+
+  const char* workspaceDir = argv[optind];
+  if (mkdir(workspaceDir, 0755) != 0 && errno != EEXIST) {
+    perror(workspaceDir);
+    return 1;
+  }
+
+  std::ifstream file;
+  if (argc - optind == 2) {
+    file.open(argv[optind + 1], std::ios::in | std::ios::binary);
+    if (!file) {
+      perror(argv[optind + 1]);
+      return 1;
+    }
+  }
+  std::istream& input = file.is_open() ? file : std::cin;
+
+  bb::IndexBuilder* builder = (threadCount > 0) ? new bb::IndexBuilder(threadCount) : new bb::IndexBuilder();
+  bool built = builder->create(workspaceDir, gramSize, indexUnigrams);
+  if (!built) fprintf(stderr, "%s: cannot create workspace\n", workspaceDir);
+  else if (!(built = builder->addDump(input))) fprintf(stderr, "malformed dump or document out of order\n");
+  else if (!(built = builder->finish())) fprintf(stderr, "%s: cannot write workspace\n", workspaceDir);
+  delete builder;
+  return built ? 0 : 1;
+}